@@ -6,6 +6,9 @@
 #include <thread>
 #include <vector>
 
+#include <pthread.h>
+#include <sched.h>
+
 #include <boost/asio.hpp>
 #include <boost/intrusive/list.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
@@ -369,7 +372,6 @@ namespace dmc = rgw::dmclock;
 class AsioFrontend {
   RGWProcessEnv env;
   RGWFrontendConfig* conf;
-  boost::asio::io_context context;
   ceph::timespan request_timeout = std::chrono::milliseconds(REQUEST_TIMEOUT);
   size_t header_limit = 16384;
 #ifdef WITH_RADOSGW_BEAST_OPENSSL
@@ -381,7 +383,6 @@ class AsioFrontend {
   int ssl_set_certificate_chain(const string& name);
   int init_ssl();
 #endif
-  SharedMutex pause_mutex;
   std::unique_ptr<rgw::dmclock::Scheduler> scheduler;
 
   struct Listener {
@@ -394,13 +395,29 @@ class AsioFrontend {
     explicit Listener(boost::asio::io_context& context)
       : acceptor(context), socket(context) {}
   };
-  std::vector<Listener> listeners;
-
-  ConnectionList connections;
 
-  // work guard to keep run() threads busy while listeners are paused
   using Executor = boost::asio::io_context::executor_type;
-  std::optional<boost::asio::executor_work_guard<Executor>> work;
+
+  // An io_context with the listeners and connections it serves. Without
+  // sharding there is a single shard, run by rgw_thread_pool_size threads.
+  // With shards=N, each shard is run by a single thread and accepts its own
+  // connections on SO_REUSEPORT listeners, so a connection is served by
+  // the thread which accepted it until it closes.
+  struct Shard {
+    boost::asio::io_context context;
+    SharedMutex pause_mutex;
+    std::vector<Listener> listeners;
+    ConnectionList connections;
+    // work guard to keep run() threads busy while listeners are paused
+    std::optional<boost::asio::executor_work_guard<Executor>> work;
+    int cpu = -1; // cpu the shard's thread is pinned to, if any
+
+    explicit Shard(int concurrency_hint)
+      : context(concurrency_hint), pause_mutex(context.get_executor()) {}
+  };
+  std::vector<std::unique_ptr<Shard>> shards;
+  bool sharded = false;
+  bool paused = false; // every shard's pause_mutex is held
 
   std::vector<std::thread> threads;
   std::atomic<bool> going_down{false};
@@ -408,18 +425,23 @@ class AsioFrontend {
   CephContext* ctx() const { return env.store->ctx(); }
   std::optional<dmc::ClientCounters> client_counters;
   std::unique_ptr<dmc::ClientConfig> client_config;
-  void accept(Listener& listener, boost::system::error_code ec);
+  void init_shards();
+  void accept(Shard& shard, Listener& listener, boost::system::error_code ec);
 
  public:
   AsioFrontend(const RGWProcessEnv& env, RGWFrontendConfig* conf,
 	       dmc::SchedulerCtx& sched_ctx)
-    : env(env), conf(conf), pause_mutex(context.get_executor())
+    : env(env), conf(conf)
   {
+    init_shards();
+
+    // the scheduler is shared by the shards: its completions run on the
+    // executor of the request they resume
     auto sched_t = dmc::get_scheduler_t(ctx());
     switch(sched_t){
     case dmc::scheduler_t::dmclock:
       scheduler.reset(new dmc::AsyncScheduler(ctx(),
-                                              context,
+                                              shards.front()->context,
                                               std::ref(sched_ctx.get_dmc_client_counters()),
                                               sched_ctx.get_dmc_client_config(),
                                               *sched_ctx.get_dmc_client_config(),
@@ -503,6 +525,34 @@ tcp::endpoint parse_endpoint(boost::asio::string_view input,
   return endpoint;
 }
 
+// the cpus this process may run on
+static std::vector<int> get_allowed_cpus()
+{
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  return cpus;
+}
+
+static void pin_thread(CephContext *ctx, int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (r != 0) {
+    ldout(ctx, 0) << "WARNING: failed to pin frontend thread to cpu " << cpu
+        << ": " << cpp_strerror(r) << dendl;
+  }
+}
+
 static int drop_privileges(CephContext *ctx)
 {
   uid_t uid = ctx->get_set_uid();
@@ -526,10 +576,51 @@ static int drop_privileges(CephContext *ctx)
   return 0;
 }
 
+void AsioFrontend::init_shards()
+{
+  unsigned count = 0;
+  const auto cpus = get_allowed_cpus();
+
+  auto val = conf->get_val("shards");
+  if (val && *val == "auto") {
+    count = std::max<size_t>(cpus.size(), 1);
+  } else if (val) {
+    auto n = ceph::parse<unsigned>(*val);
+    if (n) {
+      count = *n;
+    } else {
+      lderr(ctx()) << "WARNING: invalid value for shards: " << *val
+          << ", running a single io_context" << dendl;
+    }
+  }
+  sharded = count > 0;
+
+  if (!sharded) {
+    shards.push_back(std::make_unique<Shard>(BOOST_ASIO_CONCURRENCY_HINT_DEFAULT));
+    return;
+  }
+
+  const bool pin = conf->get_val("shard_affinity").value_or("0") == "1";
+  for (unsigned i = 0; i < count; i++) {
+    // a hint of 1 lets asio skip locking for handlers run by the shard's
+    // own thread
+    shards.push_back(std::make_unique<Shard>(1));
+    if (pin && !cpus.empty()) {
+      shards.back()->cpu = cpus[i % cpus.size()];
+    }
+  }
+  ldout(ctx(), 4) << "frontend running " << count << " shards"
+      << (pin ? " pinned to cpus" : "") << dendl;
+}
+
 int AsioFrontend::init()
 {
   boost::system::error_code ec;
   auto& config = conf->get_config_map();
+  // the endpoints are parsed into the first shard, the other shards listen
+  // on the same ones
+  auto& context = shards.front()->context;
+  auto& listeners = shards.front()->listeners;
 
 // Setting global timeout
   auto timeout = config.find("request_timeout_ms");
@@ -599,58 +690,94 @@ int AsioFrontend::init()
       l.use_nodelay = (nodelay->second == "1");
     }
   }
-  
+
+  for (size_t i = 1; i < shards.size(); i++) {
+    auto& shard = *shards[i];
+    shard.listeners.reserve(listeners.size());
+    for (const auto& l : listeners) {
+      auto& copy = shard.listeners.emplace_back(shard.context);
+      copy.endpoint = l.endpoint;
+      copy.use_ssl = l.use_ssl;
+      copy.use_nodelay = l.use_nodelay;
+    }
+  }
 
   bool socket_bound = false;
   // start listeners
-  for (auto& l : listeners) {
-    l.acceptor.open(l.endpoint.protocol(), ec);
-    if (ec) {
-      if (ec == boost::asio::error::address_family_not_supported) {
-	ldout(ctx(), 0) << "WARNING: cannot open socket for endpoint=" << l.endpoint
-			<< ", " << ec.message() << dendl;
-	continue;
+  for (auto& shard : shards) {
+    for (auto& l : shard->listeners) {
+      l.acceptor.open(l.endpoint.protocol(), ec);
+      if (ec) {
+        if (ec == boost::asio::error::address_family_not_supported) {
+          ldout(ctx(), 0) << "WARNING: cannot open socket for endpoint=" << l.endpoint
+                          << ", " << ec.message() << dendl;
+          continue;
+        }
+
+        lderr(ctx()) << "failed to open socket: " << ec.message() << dendl;
+        return -ec.value();
       }
 
-      lderr(ctx()) << "failed to open socket: " << ec.message() << dendl;
-      return -ec.value();
-    }
+      if (l.endpoint.protocol() == tcp::v6()) {
+        l.acceptor.set_option(boost::asio::ip::v6_only(true), ec);
+        if (ec) {
+          lderr(ctx()) << "failed to set v6_only socket option: "
+                       << ec.message() << dendl;
+          return -ec.value();
+        }
+      }
 
-    if (l.endpoint.protocol() == tcp::v6()) {
-      l.acceptor.set_option(boost::asio::ip::v6_only(true), ec);
+      l.acceptor.set_option(tcp::acceptor::reuse_address(true));
+      if (sharded) {
+        // every shard binds the endpoint, the kernel spreads the incoming
+        // connections over their acceptors
+        using reuse_port = boost::asio::detail::socket_option::boolean<
+            SOL_SOCKET, SO_REUSEPORT>;
+        l.acceptor.set_option(reuse_port(true), ec);
+        if (ec) {
+          lderr(ctx()) << "failed to set SO_REUSEPORT socket option: "
+              << ec.message() << dendl;
+          return -ec.value();
+        }
+#ifdef SO_INCOMING_CPU
+        if (shard->cpu >= 0) {
+          // prefer the connections whose packets arrive on the shard's cpu
+          using incoming_cpu = boost::asio::detail::socket_option::integer<
+              SOL_SOCKET, SO_INCOMING_CPU>;
+          l.acceptor.set_option(incoming_cpu(shard->cpu), ec);
+          if (ec) {
+            ldout(ctx(), 1) << "WARNING: failed to set SO_INCOMING_CPU socket option: "
+                << ec.message() << dendl;
+          }
+        }
+#endif
+      }
+      l.acceptor.bind(l.endpoint, ec);
       if (ec) {
-        lderr(ctx()) << "failed to set v6_only socket option: "
-		     << ec.message() << dendl;
-	return -ec.value();
+        lderr(ctx()) << "failed to bind address " << l.endpoint
+            << ": " << ec.message() << dendl;
+        return -ec.value();
       }
-    }
 
-    l.acceptor.set_option(tcp::acceptor::reuse_address(true));
-    l.acceptor.bind(l.endpoint, ec);
-    if (ec) {
-      lderr(ctx()) << "failed to bind address " << l.endpoint
-          << ": " << ec.message() << dendl;
-      return -ec.value();
-    }
-
-    auto it = config.find("max_connection_backlog");
-    auto max_connection_backlog = boost::asio::socket_base::max_listen_connections;
-    if (it != config.end()) {
-      string err;
-      max_connection_backlog = strict_strtol(it->second.c_str(), 10, &err);
-      if (!err.empty()) {
-        ldout(ctx(), 0) << "WARNING: invalid value for max_connection_backlog=" << it->second << dendl;
-        max_connection_backlog = boost::asio::socket_base::max_listen_connections;
+      auto it = config.find("max_connection_backlog");
+      auto max_connection_backlog = boost::asio::socket_base::max_listen_connections;
+      if (it != config.end()) {
+        string err;
+        max_connection_backlog = strict_strtol(it->second.c_str(), 10, &err);
+        if (!err.empty()) {
+          ldout(ctx(), 0) << "WARNING: invalid value for max_connection_backlog=" << it->second << dendl;
+          max_connection_backlog = boost::asio::socket_base::max_listen_connections;
+        }
       }
+      l.acceptor.listen(max_connection_backlog);
+      l.acceptor.async_accept(l.socket,
+                              [this, &shard = *shard, &l] (boost::system::error_code ec) {
+                                accept(shard, l, ec);
+                              });
+
+      ldout(ctx(), 4) << "frontend listening on " << l.endpoint << dendl;
+      socket_bound = true;
     }
-    l.acceptor.listen(max_connection_backlog);
-    l.acceptor.async_accept(l.socket,
-                            [this, &l] (boost::system::error_code ec) {
-                              accept(l, ec);
-                            });
-
-    ldout(ctx(), 4) << "frontend listening on " << l.endpoint << dendl;
-    socket_bound = true;
   }
   if (!socket_bound) {
     lderr(ctx()) << "Unable to listen at any endpoints" << dendl;
@@ -821,6 +948,8 @@ int AsioFrontend::init_ssl()
 {
   boost::system::error_code ec;
   auto& config = conf->get_config_map();
+  auto& context = shards.front()->context;
+  auto& listeners = shards.front()->listeners;
 
   // ssl configuration
   std::optional<string> cert = conf->get_val("ssl_certificate");
@@ -964,7 +1093,7 @@ int AsioFrontend::init_ssl()
 }
 #endif // WITH_RADOSGW_BEAST_OPENSSL
 
-void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
+void AsioFrontend::accept(Shard& shard, Listener& l, boost::system::error_code ec)
 {
   if (!l.acceptor.is_open()) {
     return;
@@ -977,17 +1106,19 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
   auto stream = std::move(l.socket);
   stream.set_option(tcp::no_delay(l.use_nodelay), ec);
   l.acceptor.async_accept(l.socket,
-                          [this, &l] (boost::system::error_code ec) {
-                            accept(l, ec);
+                          [this, &shard, &l] (boost::system::error_code ec) {
+                            accept(shard, l, ec);
                           });
+  auto& context = shard.context;
   
   // spawn a coroutine to handle the connection
 #ifdef WITH_RADOSGW_BEAST_OPENSSL
   if (l.use_ssl) {
     spawn::spawn(context,
-      [this, s=std::move(stream)] (yield_context yield) mutable {
+      [this, &shard, s=std::move(stream)] (yield_context yield) mutable {
+        auto& context = shard.context;
         auto conn = boost::intrusive_ptr{new Connection(std::move(s))};
-        auto c = connections.add(*conn);
+        auto c = shard.connections.add(*conn);
         // wrap the tcp stream in an ssl stream
         boost::asio::ssl::stream<tcp_socket&> stream{conn->socket, *ssl_context};
         auto timeout = timeout_timer{context.get_executor(), request_timeout, conn};
@@ -1003,7 +1134,7 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
         }
         conn->buffer.consume(bytes);
         handle_connection(context, env, stream, timeout, header_limit,
-                          conn->buffer, true, pause_mutex, scheduler.get(),
+                          conn->buffer, true, shard.pause_mutex, scheduler.get(),
                           ec, yield);
         if (!ec) {
           // ssl shutdown (ignoring errors)
@@ -1016,13 +1147,14 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
   {
 #endif // WITH_RADOSGW_BEAST_OPENSSL
     spawn::spawn(context,
-      [this, s=std::move(stream)] (yield_context yield) mutable {
+      [this, &shard, s=std::move(stream)] (yield_context yield) mutable {
+        auto& context = shard.context;
         auto conn = boost::intrusive_ptr{new Connection(std::move(s))};
-        auto c = connections.add(*conn);
+        auto c = shard.connections.add(*conn);
         auto timeout = timeout_timer{context.get_executor(), request_timeout, conn};
         boost::system::error_code ec;
         handle_connection(context, env, conn->socket, timeout, header_limit,
-                          conn->buffer, false, pause_mutex, scheduler.get(),
+                          conn->buffer, false, shard.pause_mutex, scheduler.get(),
                           ec, yield);
         conn->socket.shutdown(tcp_socket::shutdown_both, ec);
       }, make_stack_allocator());
@@ -1032,23 +1164,31 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
 int AsioFrontend::run()
 {
   auto cct = ctx();
-  const int thread_count = cct->_conf->rgw_thread_pool_size;
-  threads.reserve(thread_count);
-
-  ldout(cct, 4) << "frontend spawning " << thread_count << " threads" << dendl;
-
-  // the worker threads call io_context::run(), which will return when there's
-  // no work left. hold a work guard to keep these threads going until join()
-  work.emplace(boost::asio::make_work_guard(context));
-
-  for (int i = 0; i < thread_count; i++) {
-    threads.emplace_back([=]() noexcept {
-      // request warnings on synchronous librados calls in this thread
-      is_asio_thread = true;
-      // Have uncaught exceptions kill the process and give a
-      // stacktrace, not be swallowed.
-      context.run();
-    });
+  // a shard is run by a single thread
+  const int thread_count = sharded ? 1 : cct->_conf->rgw_thread_pool_size;
+  threads.reserve(thread_count * shards.size());
+
+  ldout(cct, 4) << "frontend spawning " << thread_count * shards.size()
+      << " threads" << dendl;
+
+  for (auto& shard : shards) {
+    // the worker threads call io_context::run(), which will return when
+    // there's no work left. hold a work guard to keep these threads going
+    // until join()
+    shard->work.emplace(boost::asio::make_work_guard(shard->context));
+
+    for (int i = 0; i < thread_count; i++) {
+      threads.emplace_back([this, &shard = *shard]() noexcept {
+        if (shard.cpu >= 0) {
+          pin_thread(ctx(), shard.cpu);
+        }
+        // request warnings on synchronous librados calls in this thread
+        is_asio_thread = true;
+        // Have uncaught exceptions kill the process and give a
+        // stacktrace, not be swallowed.
+        shard.context.run();
+      });
+    }
   }
   return 0;
 }
@@ -1060,13 +1200,15 @@ void AsioFrontend::stop()
   going_down = true;
 
   boost::system::error_code ec;
-  // close all listeners
-  for (auto& listener : listeners) {
-    listener.acceptor.close(ec);
+  for (auto& shard : shards) {
+    // close all listeners
+    for (auto& listener : shard->listeners) {
+      listener.acceptor.close(ec);
+    }
+    // close all connections
+    shard->connections.close(ec);
+    shard->pause_mutex.cancel();
   }
-  // close all connections
-  connections.close(ec);
-  pause_mutex.cancel();
 }
 
 void AsioFrontend::join()
@@ -1074,7 +1216,9 @@ void AsioFrontend::join()
   if (!going_down) {
     stop();
   }
-  work.reset();
+  for (auto& shard : shards) {
+    shard->work.reset();
+  }
 
   ldout(ctx(), 4) << "frontend joining threads..." << dendl;
   for (auto& thread : threads) {
@@ -1089,16 +1233,29 @@ void AsioFrontend::pause()
 
   // cancel pending calls to accept(), but don't close the sockets
   boost::system::error_code ec;
-  for (auto& l : listeners) {
-    l.acceptor.cancel(ec);
+  for (auto& shard : shards) {
+    for (auto& l : shard->listeners) {
+      l.acceptor.cancel(ec);
+    }
   }
 
   // pause and wait for outstanding requests to complete
-  pause_mutex.lock(ec);
+  auto shard = shards.begin();
+  for (; shard != shards.end(); ++shard) {
+    (*shard)->pause_mutex.lock(ec);
+    if (ec) {
+      break;
+    }
+  }
 
   if (ec) {
+    // unpause the shards already paused
+    for (auto s = shards.begin(); s != shard; ++s) {
+      (*s)->pause_mutex.unlock();
+    }
     ldout(ctx(), 1) << "frontend failed to pause: " << ec.message() << dendl;
   } else {
+    paused = true;
     ldout(ctx(), 4) << "frontend paused" << dendl;
   }
 }
@@ -1109,17 +1266,22 @@ void AsioFrontend::unpause(rgw::sal::Store* const store,
   env.store = store;
   env.auth_registry = std::move(auth_registry);
 
-  // unpause to unblock connections
-  pause_mutex.unlock();
+  for (auto& shard : shards) {
+    // unpause to unblock connections
+    if (paused) {
+      shard->pause_mutex.unlock();
+    }
 
-  // start accepting connections again
-  for (auto& l : listeners) {
-    l.acceptor.async_accept(l.socket,
-                            [this, &l] (boost::system::error_code ec) {
-                              accept(l, ec);
-                            });
+    // start accepting connections again
+    for (auto& l : shard->listeners) {
+      l.acceptor.async_accept(l.socket,
+                              [this, &shard = *shard, &l] (boost::system::error_code ec) {
+                                accept(shard, l, ec);
+                              });
+    }
   }
 
+  paused = false;
   ldout(ctx(), 4) << "frontend unpaused" << dendl;
 }
 
@@ -1,7 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab ft=cpp
 
-#include "rgw_d3n_datacache.h"
+#include "rgw_d3n_cache.h"
 #include "rgw_rest_client.h"
 #include "rgw_auth_s3.h"
 #include "rgw_op.h"
@@ -216,7 +216,7 @@ void D3nDataCache::put(bufferlist& bl, unsigned int len, std::string& oid)
   ldout(cct, 10) << "D3nDataCache::" << __func__ << "(): oid=" << oid << ", len=" << len << dendl;
   {
     const std::lock_guard l(d3n_cache_lock);
-    std::unordered_map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.find(oid);
+    std::map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.find(oid);
     if (iter != d3n_cache_map.end()) {
       ldout(cct, 10) << "D3nDataCache::" << __func__ << "(): data already cached, no rewrite" << dendl;
       return;
@@ -273,7 +273,7 @@ bool D3nDataCache::get(const string& oid, const off_t len)
   string location = cache_location + oid;
 
   lsubdout(g_ceph_context, rgw_datacache, 20) << "D3nDataCache: " << __func__ << "(): location=" << location << dendl;
-  std::unordered_map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.find(oid);
+  std::map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.find(oid);
   if (!(iter == d3n_cache_map.end())) {
     // check inside cache whether file exists or not!!!! then make exist true;
     struct D3nChunkDataInfo* chdo = iter->second;
@@ -297,6 +297,41 @@ bool D3nDataCache::get(const string& oid, const off_t len)
   return exist;
 }
 
+void D3nDataCache::invalidate(const string& prefix)
+{
+  std::vector<D3nChunkDataInfo*> removed;
+  {
+    const std::lock_guard l(d3n_cache_lock);
+    auto first = d3n_cache_map.lower_bound(prefix);
+    auto last = first;
+    while (last != d3n_cache_map.end() &&
+           last->first.compare(0, prefix.size(), prefix) == 0) {
+      removed.push_back(last->second);
+      ++last;
+    }
+    d3n_cache_map.erase(first, last);
+  }
+  if (removed.empty()) {
+    return;
+  }
+  ldout(cct, 20) << "D3nDataCache: " << __func__ << "(): prefix=" << prefix << ", chunks=" << removed.size() << dendl;
+
+  uint64_t freed_size = 0;
+  {
+    const std::lock_guard l(d3n_eviction_lock);
+    for (auto chunk : removed) {
+      lru_remove(chunk);
+      freed_size += chunk->size;
+    }
+    free_data_cache_size += freed_size;
+  }
+  for (auto chunk : removed) {
+    string location = cache_location + chunk->oid;
+    ::remove(location.c_str());
+    delete chunk;
+  }
+}
+
 size_t D3nDataCache::random_eviction()
 {
   lsubdout(g_ceph_context, rgw_datacache, 20) << "D3nDataCache: " << __func__ << "()" << dendl;
@@ -313,7 +348,7 @@ size_t D3nDataCache::random_eviction()
     }
     srand (time(NULL));
     random_index = ceph::util::generate_random_number<int>(0, n_entries-1);
-    std::unordered_map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.begin();
+    std::map<string, D3nChunkDataInfo*>::iterator iter = d3n_cache_map.begin();
     std::advance(iter, random_index);
     del_oid = iter->first;
     del_entry =  iter->second;
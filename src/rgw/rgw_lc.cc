@@ -624,10 +624,7 @@ static int remove_expired_obj(
 			      const_cast<std::string&>(oc.bucket->get_tenant()),
 			      lc_req_id, null_yield);
 
-  /* can eliminate cast when reservation is lifted into Notification */
-  auto notify_res = static_cast<rgw::sal::RadosNotification*>(notify.get())->get_reservation();
-
-  ret = rgw::notify::publish_reserve(dpp, event_type, notify_res, nullptr);
+  ret = notify->publish_reserve(dpp, nullptr);
   if (ret < 0) {
     ldpp_dout(dpp, 1)
       << "ERROR: notify reservation failed, deferring delete of object k="
@@ -642,10 +639,9 @@ static int remove_expired_obj(
       "ERROR: publishing notification failed, with error: " << ret << dendl;
   } else {
       // send request to notification manager
-    (void) rgw::notify::publish_commit(
-      obj.get(), obj->get_obj_size(), ceph::real_clock::now(),
-      obj->get_attrs()[RGW_ATTR_ETAG].to_str(), version_id, event_type,
-      notify_res, dpp);
+    (void) notify->publish_commit(
+      dpp, obj->get_obj_size(), ceph::real_clock::now(),
+      obj->get_attrs()[RGW_ATTR_ETAG].to_str(), version_id);
   }
 
   return ret;
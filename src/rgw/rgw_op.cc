@@ -3970,6 +3970,11 @@ void RGWPutObj::execute(optional_yield y)
 					 pdest_placement, olh_epoch, s->req_id);
   }
 
+  // The declared length of the object or part. Compression may still
+  // change the size written.
+  if (copy_source.empty() && !chunked_upload)
+    processor->set_size_hint(s->content_length);
+
   op_ret = processor->prepare(s->yield);
   if (op_ret < 0) {
     ldpp_dout(this, 20) << "processor->prepare() returned ret=" << op_ret
@@ -6765,6 +6770,19 @@ void RGWDeleteMultiObj::execute(optional_yield y)
   RGWMultiDelXMLParser parser;
   RGWObjectCtx *obj_ctx = static_cast<RGWObjectCtx *>(s->obj_ctx);
   char* buf;
+  // The objects which passed the checks, deleted together after them so
+  // that the store can batch their index updates.
+  struct pending_delete {
+    rgw_obj_key key;
+    std::unique_ptr<rgw::sal::Object> obj;
+    std::unique_ptr<rgw::sal::Object::DeleteOp> del_op;
+    std::unique_ptr<rgw::sal::Notification> res;
+    uint64_t obj_size;
+    std::string etag;
+  };
+  vector<pending_delete> pending;
+  vector<rgw::sal::Object::DeleteOp*> del_ops;
+  vector<int> rcs;
 
   buf = data.c_str();
   if (!buf) {
@@ -6947,15 +6965,25 @@ void RGWDeleteMultiObj::execute(optional_yield y)
     del_op->params.bucket_owner = s->bucket_owner;
     del_op->params.marker_version_id = version_id;
 
-    op_ret = del_op->delete_obj(this, y);
+    del_ops.push_back(del_op.get());
+    pending.push_back({*iter, std::move(obj), std::move(del_op), std::move(res),
+                       obj_size, std::move(etag)});
+  }
+
+  if (!del_ops.empty())
+    del_ops.front()->delete_objs(this, del_ops, rcs, y);
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    auto& p = pending[i];
+    op_ret = rcs[i];
     if (op_ret == -ENOENT) {
       op_ret = 0;
     }
 
-    send_partial_response(*iter, obj->get_delete_marker(), del_op->result.version_id, op_ret);
+    send_partial_response(p.key, p.obj->get_delete_marker(), p.del_op->result.version_id, op_ret);
 
     // send request to notification manager
-    int ret = res->publish_commit(this, obj_size, ceph::real_clock::now(), etag, version_id);
+    int ret = p.res->publish_commit(this, p.obj_size, ceph::real_clock::now(), p.etag, "");
     if (ret < 0) {
       ldpp_dout(this, 1) << "ERROR: publishing notification failed, with error: " << ret << dendl;
       // too late to rollback operation, hence op_ret is not set here
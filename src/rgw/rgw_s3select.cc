@@ -2,6 +2,9 @@
 // vim: ts=8 sw=2 smarttab ft=cpp
 
 #include "rgw_s3select_private.h"
+#include <boost/asio/post.hpp>
+#include "common/async/context_pool.h"
+#include "common/strtol.h"
 
 namespace rgw::s3select {
 RGWOp* create_s3select_op()
@@ -256,9 +259,200 @@ void aws_response_handler::send_stats_response()
   rgw_flush_formatter_and_reset(s, s->formatter);
 }
 
+csv_range_job::csv_range_job(const std::string& query, csv_object::csv_defintions& defs)
+{
+  syntax.parse_query(query.c_str());
+  csv.set_csv_query(&syntax, defs);
+}
+
+int csv_range_job::process(const char* data, size_t len, size_t total)
+{
+  try {
+    status = csv.run_s3select_on_stream(output, data, len, total);
+  } catch (base_s3select_exception& e) {
+    error = e.what();
+    status = -1;
+  }
+  return status;
+}
+
+void csv_range_job::start(boost::asio::io_context& pool)
+{
+  boost::asio::post(pool, [this] {
+    process(input.data(), input.size(), input.size());
+    input = std::string();
+    std::unique_lock l{lock};
+    done = true;
+    if (completion) {
+      auto c = std::move(completion);
+      l.unlock();
+      Completion::dispatch(std::move(c), boost::system::error_code{});
+    } else {
+      cond.notify_all();
+    }
+  });
+}
+
+int csv_range_job::wait(optional_yield y)
+{
+  std::unique_lock l{lock};
+  if (!done) {
+    if (y) {
+      // Suspend the coroutine until the worker dispatches the completion.
+      auto& yield = y.get_yield_context();
+      boost::system::error_code ec;
+      auto token = yield[ec];
+      boost::asio::async_completion<yield_context, Signature> init(token);
+      completion = Completion::create(y.get_io_context().get_executor(),
+                                      std::move(init.completion_handler));
+      l.unlock();
+      init.result.get();
+    } else {
+      cond.wait(l, [this] { return done; });
+    }
+  }
+  return status;
+}
+
+std::string csv_range_job::get_error_description()
+{
+  if (!error.empty()) {
+    return error;
+  }
+  return csv.get_error_description();
+}
+
+// The worker threads of the CSV ranges, shared by all the requests.
+static boost::asio::io_context& csv_worker_pool(CephContext* cct)
+{
+  static ceph::async::io_context_pool pool;
+  static std::once_flag once;
+  std::call_once(once, [cct] {
+    pool.start(cct->_conf.get_val<uint64_t>("rgw_s3select_csv_threads"));
+  });
+  return pool.get_io_context();
+}
+
+// Find out from the parsed query whether it can run on the ranges of an
+// object, and how the results of an aggregation on the ranges combine. A
+// query with LIMIT stops after its first rows, it runs on the whole object.
+// So does an aggregation unless each of its projections is a bare COUNT,
+// SUM, MIN or MAX.
+static bool csv_range_merge_ops(s3select& syntax, std::vector<csv_merge_op>& ops)
+{
+  if (syntax.getAction()->limit_op) {
+    return false;
+  }
+  if (!syntax.is_aggregate_query()) {
+    return true;
+  }
+  for (auto projection : syntax.get_projections_list()) {
+    auto func = dynamic_cast<__function*>(projection);
+    if (func == nullptr || !func->is_aggregate()) {
+      return false;
+    }
+    const std::string name = func->get_name().c_str();
+    if (boost::iequals(name, "count")) {
+      ops.push_back(csv_merge_op::COUNT);
+    } else if (boost::iequals(name, "sum")) {
+      ops.push_back(csv_merge_op::SUM);
+    } else if (boost::iequals(name, "min")) {
+      ops.push_back(csv_merge_op::MIN);
+    } else if (boost::iequals(name, "max")) {
+      ops.push_back(csv_merge_op::MAX);
+    } else {
+      return false;
+    }
+  }
+  return !ops.empty();
+}
+
+// The values of a result row of a range, written with every field quoted.
+static std::vector<std::string> csv_split_row(const std::string& row, const csv_object::csv_defintions& csv)
+{
+  std::vector<std::string> values;
+  std::istringstream is(row);
+  is >> std::noskipws;
+  for (;;) {
+    std::string v;
+    if (!(is >> std::quoted(v, csv.output_quot_char, csv.output_escape_char))) {
+      break;
+    }
+    values.push_back(std::move(v));
+    char c;
+    if (!is.get(c) || c != csv.output_column_delimiter) {
+      break;
+    }
+  }
+  return values;
+}
+
+// A result of a range as a value of the engine, of the type it prints as.
+static s3selectEngine::value csv_result_value(const std::string& s)
+{
+  std::string err;
+  long long i = strict_strtoll(s, 10, &err);
+  if (err.empty()) {
+    return s3selectEngine::value(static_cast<int64_t>(i));
+  }
+  err.clear();
+  double d = strict_strtod(s, &err);
+  if (err.empty()) {
+    return s3selectEngine::value(d);
+  }
+  return s3selectEngine::value(s.c_str());
+}
+
+// Combine the results of an aggregation on two ranges with the arithmetic,
+// comparison and formatting of the engine. The result of a range without
+// any row may be empty or null.
+static std::string csv_merge_value(csv_merge_op op, const std::string& a, const std::string& b)
+{
+  if (a.empty() || a == "null") {
+    return b;
+  }
+  if (b.empty() || b == "null") {
+    return a;
+  }
+  s3selectEngine::value va = csv_result_value(a);
+  s3selectEngine::value vb = csv_result_value(b);
+
+  switch (op) {
+  case csv_merge_op::COUNT:
+  case csv_merge_op::SUM:
+    if (va.is_number() && vb.is_number()) {
+      return (va + vb).to_string();
+    }
+    break;
+  case csv_merge_op::MIN:
+    if (vb < va) {
+      return b;
+    }
+    break;
+  case csv_merge_op::MAX:
+    if (vb > va) {
+      return b;
+    }
+    break;
+  }
+  return a;
+}
+
 RGWSelectObj_ObjStore_S3::RGWSelectObj_ObjStore_S3():
   m_buff_header(std::make_unique<char[]>(1000)),
   m_parquet_type(false),
+  m_parquet_read_op_checked(false),
+  m_parquet_cache_bytes(0),
+  m_scan_range(false),
+  m_scan_start(0),
+  m_scan_end(-1),
+  m_scan_phase(csv_scan_phase::RECORDS),
+  m_scan_pos(0),
+  m_scan_prev_delim(true),
+  m_scan_y(nullptr),
+  m_csv_records_total(0),
+  m_csv_parallel(false),
+  m_csv_status(0),
   chunk_number(0)
 {
   set_get_data(true);
@@ -323,16 +517,8 @@ int RGWSelectObj_ObjStore_S3::get_params(optional_yield y)
   return RGWGetObj_ObjStore_S3::get_params(y);
 }
 
-int RGWSelectObj_ObjStore_S3::run_s3select(const char* query, const char* input, size_t input_length)
+void RGWSelectObj_ObjStore_S3::init_csv_definitions(csv_object::csv_defintions& csv)
 {
-  int status = 0;
-  uint32_t length_before_processing, length_post_processing;
-  csv_object::csv_defintions csv;
-  const char* s3select_syntax_error = "s3select-Syntax-Error";
-  const char* s3select_resource_id = "resourcse-id";
-  const char* s3select_processTime_error = "s3select-ProcessingTime-Error";
-
-  s3select_syntax.parse_query(query);
   if (m_row_delimiter.size()) {
     csv.row_delimiter = *m_row_delimiter.c_str();
   }
@@ -372,6 +558,19 @@ int RGWSelectObj_ObjStore_S3::run_s3select(const char* query, const char* input,
   } else if(m_header_info.compare("USE")==0) {
     csv.use_header_info=true;
   }
+}
+
+int RGWSelectObj_ObjStore_S3::run_s3select(const char* query, const char* input, size_t input_length)
+{
+  int status = 0;
+  uint32_t length_before_processing, length_post_processing;
+  csv_object::csv_defintions csv;
+  const char* s3select_syntax_error = "s3select-Syntax-Error";
+  const char* s3select_resource_id = "resourcse-id";
+  const char* s3select_processTime_error = "s3select-ProcessingTime-Error";
+
+  s3select_syntax.parse_query(query);
+  init_csv_definitions(csv);
   m_s3_csv_object.set_csv_query(&s3select_syntax, csv);
   m_aws_response_handler.init_response();
   if (s3select_syntax.get_error_description().empty() == false) {
@@ -505,6 +704,32 @@ int RGWSelectObj_ObjStore_S3::handle_aws_cli_parameters(std::string& sql_query)
     //presto change
     output_row_delimiter='\n';
   }
+  //ScanRange: the records starting from Start up to End, the last End bytes without a Start
+  std::string scan_range;
+  if (extract_by_tag(m_s3select_query, "ScanRange", scan_range) == 0) {
+    std::string scan_start, scan_end, err;
+    extract_by_tag(scan_range, "Start", scan_start);
+    extract_by_tag(scan_range, "End", scan_end);
+    if (scan_start.size()) {
+      m_scan_start = strict_strtoll(scan_start, 10, &err);
+    }
+    if (err.empty() && scan_end.size()) {
+      m_scan_end = strict_strtoll(scan_end, 10, &err);
+    }
+    bool valid = err.empty();
+    if (scan_start.size()) {
+      valid = valid && m_scan_start >= 0 && (scan_end.empty() || m_scan_end >= m_scan_start);
+    } else {
+      valid = valid && scan_end.size() && m_scan_end > 0;
+      m_scan_start = -m_scan_end;
+      m_scan_end = -1;
+    }
+    if (!valid) {
+      ldpp_dout(this, 10) << "s3-select query: invalid ScanRange <" << scan_range << ">" << dendl;
+      return -EINVAL;
+    }
+    m_scan_range = true;
+  }
   if (m_compression_type.length()>0 && m_compression_type.compare("NONE") != 0) {
     ldpp_dout(this, 10) << "RGW supports currently only NONE option for compression type" << dendl;
     return -1;
@@ -535,19 +760,118 @@ size_t RGWSelectObj_ObjStore_S3::get_obj_size()
 
 int RGWSelectObj_ObjStore_S3::range_request(int64_t ofs, int64_t len, void* buff, optional_yield y)
 {
-  //purpose: implementation for arrow::ReadAt, this may take several async calls.
-  //send_response_date(call_back) accumulate buffer, upon completion control is back to ReadAt.
-  range_req_str = "bytes=" + std::to_string(ofs) + "-" + std::to_string(ofs+len-1);
+  //purpose: implementation for arrow::ReadAt, served from the cache of the ranges read.
+  //a miss reads rgw_s3select_parquet_read_size from the requested offset, which holds the next
+  //column chunks as well. in the last part of the object, it reads its tail: the footer and the
+  //metadata the reader goes back to from there.
+  const uint64_t window = s->cct->_conf.get_val<Option::size_t>("rgw_s3select_parquet_read_size");
+  char* out = static_cast<char*>(buff);
+  uint64_t pos = ofs;
+  uint64_t left = len;
+  while (left > 0) {
+    auto next = m_parquet_cache.upper_bound(pos);
+    uint64_t prev_end = 0;
+    if (next != m_parquet_cache.begin()) {
+      auto hit = std::prev(next);
+      prev_end = hit->first + hit->second.length();
+      if (pos < prev_end) {
+        uint64_t n = std::min(left, prev_end - pos);
+        hit->second.begin(pos - hit->first).copy(n, out);
+        out += n;
+        pos += n;
+        left -= n;
+        continue;
+      }
+    }
+    uint64_t start = pos;
+    uint64_t end = pos + std::max(left, window);
+    if (s->obj_size > 0) { //known from the first read
+      if (pos + window >= s->obj_size) {
+        start = std::min(pos, std::max(prev_end, s->obj_size > window ? s->obj_size - window : 0));
+      }
+      end = std::min<uint64_t>(end, s->obj_size);
+    }
+    if (next != m_parquet_cache.end()) {
+      end = std::min(end, next->first);
+    }
+    bufferlist bl;
+    int status = parquet_read(start, end - 1, bl, y);
+    if (status < 0) {
+      return status;
+    }
+    if (start + bl.length() <= pos) {
+      ldout(s->cct, 10) << "S3select: short read " << bl.length() << " at " << start << " for range-request offset " << pos << dendl;
+      return -EIO;
+    }
+    parquet_cache_insert(start, std::move(bl));
+  }
+  return len;
+}
+
+int RGWSelectObj_ObjStore_S3::parquet_read(uint64_t ofs, uint64_t end, bufferlist& bl, optional_yield y)
+{
+  ldout(s->cct, 10) << "S3select: read offset: " << ofs << " end: " << end << (m_parquet_read_op ? " (read-op)" : "") << dendl;
+  if (m_parquet_read_op) {
+    //collects the data, as it comes
+    struct read_cb : public RGWGetDataCB {
+      bufferlist& bl;
+      explicit read_cb(bufferlist& _bl) : bl(_bl) {}
+      int handle_data(bufferlist& data, off_t ofs, off_t len) override {
+        bufferlist part;
+        part.substr_of(data, ofs, len);
+        bl.claim_append(part);
+        return 0;
+      }
+    } cb(bl);
+    return m_parquet_read_op->iterate(this, ofs, end, &cb, y);
+  }
+
+  //the first read: RGWGetObj::execute looks the object up, send_response_date(call_back) accumulate buffer.
+  range_req_str = "bytes=" + std::to_string(ofs) + "-" + std::to_string(end);
   range_str = range_req_str.c_str();
   range_parsed = false;
   RGWGetObj::parse_range();
-  requested_buffer.clear();
-  m_request_range = len;
-  ldout(s->cct, 10) << "S3select: calling execute(async):" << " request-offset :" << ofs << " request-length :" << len << " buffer size : " << requested_buffer.size() << dendl;
+  m_parquet_data.clear();
   RGWGetObj::execute(y);
-  memcpy(buff, requested_buffer.data(), len);
-  ldout(s->cct, 10) << "S3select: done waiting, buffer is complete buffer-size:" << requested_buffer.size() << dendl;
-  return len;
+  if (op_ret < 0) {
+    return op_ret;
+  }
+  bl.claim_append(m_parquet_data);
+
+  if (!m_parquet_read_op_checked) {
+    m_parquet_read_op_checked = true;
+    //an object stored as it is (no compression, encryption or manifest to follow) needs none of the
+    //filters of RGWGetObj::execute: the next reads go to the store with a single prepared read op.
+    if (attrs.count(RGW_ATTR_COMPRESSION) == 0 && attrs.count(RGW_ATTR_CRYPT_MODE) == 0 &&
+        attrs.count(RGW_ATTR_USER_MANIFEST) == 0 && attrs.count(RGW_ATTR_SLO_MANIFEST) == 0) {
+      auto read_op = s->object->get_read_op(s->obj_ctx);
+      int ret = read_op->prepare(y, this);
+      if (ret < 0) {
+        ldout(s->cct, 10) << "S3select: failed to prepare the read-op, ret=" << ret << dendl;
+      } else {
+        m_parquet_read_op = std::move(read_op);
+      }
+    }
+  }
+  return 0;
+}
+
+void RGWSelectObj_ObjStore_S3::parquet_cache_insert(uint64_t ofs, bufferlist&& bl)
+{
+  //the tail of the object stays, the other ranges go in the order they came
+  const uint64_t max = s->cct->_conf.get_val<Option::size_t>("rgw_s3select_parquet_cache_size");
+  const bool tail = ofs + bl.length() >= s->obj_size;
+  m_parquet_cache_bytes += bl.length();
+  m_parquet_cache.emplace(ofs, std::move(bl));
+  if (!tail) {
+    m_parquet_cache_order.push_back(ofs);
+  }
+  while (m_parquet_cache_bytes > max && m_parquet_cache_order.size() > 1) {
+    auto it = m_parquet_cache.find(m_parquet_cache_order.front());
+    m_parquet_cache_order.pop_front();
+    m_parquet_cache_bytes -= it->second.length();
+    m_parquet_cache.erase(it);
+  }
 }
 
 void RGWSelectObj_ObjStore_S3::execute(optional_yield y)
@@ -562,7 +886,14 @@ void RGWSelectObj_ObjStore_S3::execute(optional_yield y)
 #endif
   if (m_parquet_type) {
     //parquet processing
-    range_request(0, 4, parquet_magic, y);
+    status = range_request(0, 4, parquet_magic, y);
+    if (status < 0) {
+      ldout(s->cct, 10) << "S3select: failed to read " << s->object->get_name() << ", status=" << status << dendl;
+      if (op_ret == 0) {
+        op_ret = status;
+      }
+      return;
+    }
     if(memcmp(parquet_magic, parquet_magic1, 4) && memcmp(parquet_magic, parquet_magicE, 4)) {
       ldout(s->cct, 10) << s->object->get_name() << " does not contain parquet magic" << dendl;
       op_ret = -ERR_INVALID_REQUEST;
@@ -578,7 +909,14 @@ void RGWSelectObj_ObjStore_S3::execute(optional_yield y)
     }
   } else {
     //CSV processing
-    RGWGetObj::execute(y);
+    if (m_scan_range || s->cct->_conf.get_val<uint64_t>("rgw_s3select_csv_threads") > 0) {
+      status = csv_scan(y);
+      if (status < 0) {
+        ldout(s->cct, 10) << "S3select: failed to process query <" << m_sql_query << "> on object " << s->object->get_name() << dendl;
+      }
+    } else {
+      RGWGetObj::execute(y);
+    }
   }
 }
 
@@ -596,25 +934,11 @@ int RGWSelectObj_ObjStore_S3::parquet_processing(bufferlist& bl, off_t ofs, off_
       end_header(s, this, "application/xml", CHUNKED_TRANSFER_ENCODING);
     }
     chunk_number++;
-    size_t append_in_callback = 0;
-    int part_no = 1;
     //concat the requested buffer
-    for (auto& it : bl.buffers()) {
-      if(it.length() == 0) {
-        ldout(s->cct, 10) << "S3select: get zero-buffer while appending request-buffer " << dendl;
-      }
-      append_in_callback += it.length();
-      ldout(s->cct, 10) << "S3select: part " << part_no++ << " it.length() = " << it.length() << dendl;
-      requested_buffer.append(&(it)[0]+ofs, len);
-    }
-    ldout(s->cct, 10) << "S3select:append_in_callback = " << append_in_callback << dendl;
-    if (requested_buffer.size() < m_request_range) {
-      ldout(s->cct, 10) << "S3select: need another round buffe-size: " << requested_buffer.size() << " request range length:" << m_request_range << dendl;
-      return 0;
-    } else {//buffer is complete
-      ldout(s->cct, 10) << "S3select: buffer is complete " << requested_buffer.size() << " request range length:" << m_request_range << dendl;
-      m_request_range = 0;
-    }
+    bufferlist data;
+    data.substr_of(bl, ofs, len);
+    m_parquet_data.claim_append(data);
+    ldout(s->cct, 10) << "S3select: range-request buffer-size: " << m_parquet_data.length() << dendl;
     return 0;
 }
 
@@ -653,6 +977,346 @@ int RGWSelectObj_ObjStore_S3::csv_processing(bufferlist& bl, off_t ofs, off_t le
   return status;
 }
 
+int RGWSelectObj_ObjStore_S3::csv_scan(optional_yield y)
+{
+  //purpose: run the query on the records of the ScanRange, or of the whole object, split in ranges.
+  //the ranges run in parallel on the worker pool, their results are sent in order.
+  const char* s3select_syntax_error = "s3select-Syntax-Error";
+  const char* s3select_resource_id = "resourcse-id";
+  auto& conf = s->cct->_conf;
+  const int64_t window = conf->rgw_get_obj_max_req_size;
+  int ret = 0;
+
+  if (!m_aws_response_handler.is_set()) {
+    m_aws_response_handler.set(s, this);
+  }
+  s3select_syntax.parse_query(m_sql_query.c_str());
+  if (s3select_syntax.get_error_description().empty() == false) {
+    m_aws_response_handler.init_response();
+    m_aws_response_handler.send_error_response(s3select_syntax_error,
+        s3select_syntax.get_error_description().c_str(),
+        s3select_resource_id);
+    ldpp_dout(this, 10) << "s3-select query: failed to prase query; {" << s3select_syntax.get_error_description() << "}" << dendl;
+    return -1;
+  }
+  init_csv_definitions(m_csv_defs);
+  m_csv_parallel = conf.get_val<uint64_t>("rgw_s3select_csv_threads") > 0 &&
+    csv_range_merge_ops(s3select_syntax, m_csv_merge_ops);
+  //the results of the ranges of an aggregation are read back: quote them all
+  m_csv_merge_defs = m_csv_defs;
+  m_csv_merge_defs.quote_fields_always = true;
+  m_csv_merge_defs.quote_fields_asneeded = false;
+  if (!m_csv_parallel) {
+    //a single stream through the query, on the request's own thread
+    m_csv_stream = std::make_unique<csv_range_job>(m_sql_query, m_csv_defs);
+  }
+  const bool header = m_csv_defs.use_header_info || m_csv_defs.ignore_header_info;
+  ldpp_dout(this, 10) << "s3-select query: scan " << (m_csv_parallel ? "in ranges" : "as a stream")
+                      << " start " << m_scan_start << " end " << m_scan_end << dendl;
+  m_scan_y = &y;
+
+  if (!m_scan_range) {
+    m_scan_phase = header ? csv_scan_phase::HEADER : csv_scan_phase::RECORDS;
+    RGWGetObj::execute(y);
+    ret = op_ret;
+  } else {
+    if (m_scan_start < 0) {
+      //the last bytes of the object, its size is needed first
+      m_scan_phase = csv_scan_phase::SKIP;
+      ret = csv_scan_read(0, 0, y);
+      m_scan_start = std::max<int64_t>(0, s->obj_size + m_scan_start);
+    }
+    if (ret == 0 && m_scan_start > 0 && header) {
+      //the header line is read from the beginning of the object
+      m_scan_phase = csv_scan_phase::HEADER;
+      for (int64_t ofs = 0; ret == 0 && m_scan_phase == csv_scan_phase::HEADER && uint64_t(ofs) < s->obj_size; ofs += window) {
+        ret = csv_scan_read(ofs, ofs + window - 1, y);
+      }
+      //no record starts in the header line
+      m_scan_start = std::max<int64_t>(m_scan_start, m_csv_header.size());
+    }
+    if (ret == 0 && m_csv_status == 0) {
+      //the byte before Start tells whether a record starts at Start
+      m_scan_phase = m_scan_start > 0 ? csv_scan_phase::SEEK :
+        header ? csv_scan_phase::HEADER : csv_scan_phase::RECORDS;
+      m_scan_prev_delim = true;
+      ret = csv_scan_read(std::max<int64_t>(0, m_scan_start - 1), m_scan_end, y);
+      //the last record goes on past End
+      while (ret == 0 && m_csv_status == 0 && m_scan_phase != csv_scan_phase::DONE && m_scan_pos < s->obj_size) {
+        ret = csv_scan_read(m_scan_pos, m_scan_pos + window - 1, y);
+      }
+    }
+  }
+
+  if (ret == 0 && m_csv_status == 0) {
+    if (m_scan_phase == csv_scan_phase::HEADER) {
+      //a single line without a row delimiter
+      m_csv_records_total += m_csv_header.size();
+      m_csv_records.swap(m_csv_header);
+    }
+    csv_dispatch(true);
+  }
+  //the workers are done with the ranges before they are released
+  while (!m_csv_jobs.empty()) {
+    auto job = std::move(m_csv_jobs.front());
+    m_csv_jobs.pop_front();
+    int r = job->wait(y);
+    if (ret == 0 && m_csv_status == 0) {
+      csv_job_complete(*job, r);
+    }
+  }
+  m_scan_y = nullptr;
+  if (ret < 0) {
+    //the read failed, its error is sent already
+    return ret;
+  }
+  if (m_csv_status < 0) {
+    return m_csv_status;
+  }
+
+  if (!m_csv_aggregates.empty()) {
+    std::string row;
+    for (size_t i = 0; i < m_csv_aggregates.size(); i++) {
+      if (i > 0) {
+        row += m_csv_defs.output_column_delimiter;
+      }
+      if (m_csv_defs.quote_fields_always) {
+        std::ostringstream quoted;
+        quoted << std::quoted(m_csv_aggregates[i], m_csv_defs.output_quot_char,
+                              m_csv_defs.output_escape_char);
+        row += quoted.str();
+      } else {
+        row += m_csv_aggregates[i];
+      }
+    }
+    row += m_csv_defs.output_row_delimiter;
+    csv_send_records(row);
+  } else if (chunk_number == 0) {
+    csv_send_records(std::string());
+  }
+  m_aws_response_handler.init_stats_response();
+  m_aws_response_handler.send_stats_response();
+  m_aws_response_handler.init_end_response();
+  return 0;
+}
+
+int RGWSelectObj_ObjStore_S3::csv_scan_read(int64_t ofs, int64_t end, optional_yield y)
+{
+  //read [ofs, end] of the object (up to its end for a negative end), the data goes to csv_scan_data
+  range_req_str = "bytes=" + std::to_string(ofs) + "-";
+  if (end >= 0) {
+    range_req_str += std::to_string(end);
+  }
+  range_str = range_req_str.c_str();
+  range_parsed = false;
+  RGWGetObj::parse_range();
+  m_scan_pos = ofs;
+  ldpp_dout(this, 20) << "s3-select query: scan read " << range_req_str << dendl;
+  RGWGetObj::execute(y);
+  return op_ret;
+}
+
+void RGWSelectObj_ObjStore_S3::csv_scan_data(const char* data, size_t len)
+{
+  const char row_delimiter = m_csv_defs.row_delimiter;
+  m_aws_response_handler.update_processed_size(len);
+
+  while (len > 0 && m_csv_status == 0) {
+    size_t n = len; //consumed by the current phase
+    const char* eol = nullptr;
+    switch (m_scan_phase) {
+    case csv_scan_phase::SKIP:
+    case csv_scan_phase::DONE:
+      break;
+
+    case csv_scan_phase::HEADER:
+      eol = static_cast<const char*>(memchr(data, row_delimiter, len));
+      if (eol) {
+        n = eol - data + 1;
+        //the header of a ScanRange starting past it is read on its own
+        m_scan_phase = m_scan_start > 0 ? csv_scan_phase::SKIP : csv_scan_phase::RECORDS;
+      }
+      m_csv_header.append(data, n);
+      if (eol && m_csv_stream) {
+        csv_job_complete(*m_csv_stream, m_csv_stream->process(m_csv_header.data(), m_csv_header.size(),
+                                                              std::numeric_limits<size_t>::max()));
+      }
+      break;
+
+    case csv_scan_phase::SEEK:
+      if (m_scan_pos < uint64_t(m_scan_start)) {
+        n = std::min<uint64_t>(len, m_scan_start - m_scan_pos);
+        m_scan_prev_delim = data[n - 1] == row_delimiter;
+        break;
+      }
+      if (!m_scan_prev_delim) {
+        //in the middle of a record starting before Start
+        eol = static_cast<const char*>(memchr(data, row_delimiter, len));
+        if (eol) {
+          n = eol - data + 1;
+          m_scan_prev_delim = true;
+        }
+        break;
+      }
+      n = 0;
+      m_scan_phase = (m_scan_end >= 0 && m_scan_pos > uint64_t(m_scan_end)) ?
+        csv_scan_phase::DONE : csv_scan_phase::RECORDS;
+      break;
+
+    case csv_scan_phase::RECORDS:
+      if (m_scan_end >= 0 && m_scan_pos + len > uint64_t(m_scan_end)) {
+        //the last record starting up to End, runs up to the first row delimiter from End
+        size_t skip = m_scan_pos < uint64_t(m_scan_end) ? m_scan_end - m_scan_pos : 0;
+        eol = static_cast<const char*>(memchr(data + skip, row_delimiter, len - skip));
+        if (eol) {
+          n = eol - data + 1;
+          m_scan_phase = csv_scan_phase::DONE;
+        }
+      }
+      m_csv_records.append(data, n);
+      m_csv_records_total += n;
+      csv_dispatch(false);
+      break;
+    }
+    data += n;
+    len -= n;
+    m_scan_pos += n;
+  }
+}
+
+void RGWSelectObj_ObjStore_S3::csv_dispatch(bool last)
+{
+  const char row_delimiter = m_csv_defs.row_delimiter;
+  auto& conf = s->cct->_conf;
+
+  if (!m_csv_parallel) {
+    //the records go through the query as they come, but for the last one: the query completes with it
+    size_t n = m_csv_records.size();
+    size_t total = m_csv_header.size() + m_csv_records_total;
+    if (!last) {
+      size_t eol = n > 1 ? m_csv_records.rfind(row_delimiter, n - 2) : std::string::npos;
+      if (eol == std::string::npos) {
+        return;
+      }
+      n = eol + 1;
+      total = std::numeric_limits<size_t>::max();
+    }
+    csv_job_complete(*m_csv_stream, m_csv_stream->process(m_csv_records.data(), n, total));
+    m_csv_records.erase(0, n);
+    return;
+  }
+
+  const uint64_t range_size = conf.get_val<Option::size_t>("rgw_s3select_csv_range_size");
+  const uint64_t max_in_flight = conf.get_val<uint64_t>("rgw_s3select_csv_ranges_per_request");
+  while (m_csv_status == 0) {
+    size_t n = m_csv_records.size();
+    if (last) {
+      //an aggregation has a result with no record at all
+      if (n == 0 && m_csv_records_total > 0) {
+        return;
+      }
+    } else {
+      if (n < range_size) {
+        return;
+      }
+      //a range ends with a record
+      size_t eol = m_csv_records.rfind(row_delimiter);
+      if (eol == std::string::npos) {
+        return;
+      }
+      n = eol + 1;
+    }
+    //each range has the header line, for the column names
+    auto job = std::make_unique<csv_range_job>(m_sql_query,
+        m_csv_merge_ops.empty() ? m_csv_defs : m_csv_merge_defs);
+    job->input.reserve(m_csv_header.size() + n);
+    job->input.append(m_csv_header);
+    job->input.append(m_csv_records, 0, n);
+    m_csv_records.erase(0, n);
+    ldpp_dout(this, 20) << "s3-select query: range of " << n << " bytes, "
+                        << m_csv_jobs.size() << " in flight" << dendl;
+
+    if (last && m_csv_jobs.empty()) {
+      //nothing to run in parallel with
+      auto& input = job->input;
+      csv_job_complete(*job, job->process(input.data(), input.size(), input.size()));
+      return;
+    }
+    while (m_csv_jobs.size() >= max_in_flight && m_csv_status == 0) {
+      auto oldest = std::move(m_csv_jobs.front());
+      m_csv_jobs.pop_front();
+      csv_job_complete(*oldest, oldest->wait(*m_scan_y));
+    }
+    if (m_csv_status < 0) {
+      return;
+    }
+    job->start(csv_worker_pool(s->cct));
+    m_csv_jobs.push_back(std::move(job));
+    if (last) {
+      return;
+    }
+  }
+}
+
+void RGWSelectObj_ObjStore_S3::csv_job_complete(csv_range_job& job, int status)
+{
+  const char* s3select_resource_id = "resourcse-id";
+  const char* s3select_processTime_error = "s3select-ProcessingTime-Error";
+
+  if (status < 0) {
+    //error flow(processing-time)
+    m_csv_status = status;
+    m_aws_response_handler.send_error_response(s3select_processTime_error,
+        job.get_error_description().c_str(),
+        s3select_resource_id);
+    ldpp_dout(this, 10) << "s3-select query: failed to process query; {" << job.get_error_description() << "}" << dendl;
+    return;
+  }
+  if (m_csv_parallel && !m_csv_merge_ops.empty()) {
+    //the result of an aggregation on a range
+    auto values = csv_split_row(job.output, m_csv_merge_defs);
+    values.resize(m_csv_merge_ops.size());
+    if (m_csv_aggregates.empty()) {
+      m_csv_aggregates = std::move(values);
+    } else {
+      for (size_t i = 0; i < values.size(); i++) {
+        m_csv_aggregates[i] = csv_merge_value(m_csv_merge_ops[i], m_csv_aggregates[i], values[i]);
+      }
+    }
+  } else {
+    csv_send_records(job.output);
+  }
+  job.output.clear();
+}
+
+void RGWSelectObj_ObjStore_S3::csv_send_records(const std::string& records)
+{
+  if (chunk_number == 0) {
+    //success flow
+    if (op_ret < 0) {
+      set_req_state_err(s, op_ret);
+    }
+    dump_errno(s);
+    // Explicitly use chunked transfer encoding so that we can stream the result
+    // to the user without having to wait for the full length of it.
+    end_header(s, this, "application/xml", CHUNKED_TRANSFER_ENCODING);
+  }
+  chunk_number++;
+  m_aws_response_handler.init_response();
+  if (records.size()) {
+    m_aws_response_handler.init_success_response();
+    m_aws_response_handler.get_sql_result().append(records);
+    m_aws_response_handler.update_total_bytes_returned(records.size());
+    m_aws_response_handler.send_success_response();
+  } else {
+    m_aws_response_handler.send_continuation_response();
+  }
+  if (enable_progress == true) {
+    m_aws_response_handler.init_progress_response();
+    m_aws_response_handler.send_progress_response();
+  }
+}
+
 int RGWSelectObj_ObjStore_S3::send_response_data(bufferlist& bl, off_t ofs, off_t len)
 {
   if (!m_aws_response_handler.is_set()) {
@@ -664,6 +1328,14 @@ int RGWSelectObj_ObjStore_S3::send_response_data(bufferlist& bl, off_t ofs, off_
   if (m_parquet_type) {
     return parquet_processing(bl,ofs,len);
   }
+  if (m_scan_y) {
+    bufferlist data;
+    data.substr_of(bl, ofs, len);
+    for (auto& it : data.buffers()) {
+      csv_scan_data(it.c_str(), it.length());
+    }
+    return 0;
+  }
   return csv_processing(bl,ofs,len);
 }
 
@@ -5,6 +5,10 @@
 
 #include <errno.h>
 #include <array>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <sstream>
 #include <string.h>
 #include <string_view>
 
@@ -15,6 +19,9 @@
 #include "common/ceph_json.h"
 #include "common/safe_io.h"
 #include "common/errno.h"
+#include "common/ceph_mutex.h"
+#include "common/async/completion.h"
+#include "common/async/yield_context.h"
 #include "auth/Crypto.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -150,6 +157,44 @@ public:
 
 }; //end class aws_response_handler
 
+// How the results of an aggregation on the ranges of an object combine.
+enum class csv_merge_op { COUNT, SUM, MIN, MAX };
+
+// A part of the records of a CSV object, run through its own instance of the
+// query. Parts of a large object run in parallel on the s3select worker pool.
+class csv_range_job
+{
+  using Signature = void(boost::system::error_code);
+  using Completion = ceph::async::Completion<Signature>;
+
+  ceph::mutex lock = ceph::make_mutex("csv_range_job::lock");
+  ceph::condition_variable cond;
+  bool done = false;
+  std::unique_ptr<Completion> completion;
+
+  s3selectEngine::s3select syntax;
+  s3selectEngine::csv_object csv;
+  int status = 0;
+  std::string error;
+
+public:
+  std::string input;
+  std::string output;
+
+  csv_range_job(const std::string& query, s3selectEngine::csv_object::csv_defintions& defs);
+
+  // Run `len` bytes of the stream through the query, `total` is the length
+  // of the whole stream (the query completes with its last bytes). The
+  // results are appended to `output`.
+  int process(const char* data, size_t len, size_t total);
+
+  // Process `input` as the whole stream on `pool`, wait() returns its status.
+  void start(boost::asio::io_context& pool);
+  int wait(optional_yield y);
+
+  std::string get_error_description();
+};
+
 class RGWSelectObj_ObjStore_S3 : public RGWGetObj_ObjStore_S3
 {
 
@@ -185,13 +230,45 @@ private:
   s3selectEngine::rgw_s3select_api m_rgw_api;
 #endif
   //a request for range may statisfy by several calls to send_response_date;
-  size_t m_request_range;
-  std::string requested_buffer;
+  bufferlist m_parquet_data;
   std::string range_req_str;
+  //parquet reads: a read op prepared once the object is known, a cache of the ranges read
+  std::unique_ptr<rgw::sal::Object::ReadOp> m_parquet_read_op;
+  bool m_parquet_read_op_checked;
+  std::map<uint64_t, bufferlist> m_parquet_cache;  // by object offset
+  std::deque<uint64_t> m_parquet_cache_order;       // eviction order, without the object's tail
+  uint64_t m_parquet_cache_bytes;
   std::function<int(std::string&)> fp_result_header_format;
   std::function<int(std::string&)> fp_s3select_result_format;
   int m_header_size;
 
+  //csv scan, for a ScanRange or for the processing of an object in ranges
+  enum class csv_scan_phase {
+    SKIP,     // data read for the object size only
+    HEADER,   // reading the header line
+    SEEK,     // looking for the first record starting in the scan range
+    RECORDS,
+    DONE
+  };
+  bool m_scan_range;
+  int64_t m_scan_start;     // a negative start scans the last -m_scan_start bytes
+  int64_t m_scan_end;       // inclusive, negative up to the end of the object
+  csv_scan_phase m_scan_phase;
+  uint64_t m_scan_pos;      // object offset of the next byte read
+  bool m_scan_prev_delim;   // the byte before m_scan_pos is a row delimiter
+  optional_yield* m_scan_y;
+  s3selectEngine::csv_object::csv_defintions m_csv_defs;
+  std::string m_csv_header;
+  std::string m_csv_records;  // records read, not dispatched yet
+  uint64_t m_csv_records_total;
+  bool m_csv_parallel;
+  std::vector<csv_merge_op> m_csv_merge_ops;   // per projection of an aggregation
+  s3selectEngine::csv_object::csv_defintions m_csv_merge_defs; // of its ranges
+  std::vector<std::string> m_csv_aggregates;
+  std::unique_ptr<csv_range_job> m_csv_stream;
+  std::deque<std::unique_ptr<csv_range_job>> m_csv_jobs;
+  int m_csv_status;
+
 public:
   unsigned int chunk_number;
 
@@ -208,6 +285,20 @@ private:
 
   int csv_processing(bufferlist& bl, off_t ofs, off_t len);
 
+  void init_csv_definitions(s3selectEngine::csv_object::csv_defintions& csv);
+
+  int csv_scan(optional_yield y);
+
+  int csv_scan_read(int64_t ofs, int64_t end, optional_yield y);
+
+  void csv_scan_data(const char* data, size_t len);
+
+  void csv_dispatch(bool last);
+
+  void csv_job_complete(csv_range_job& job, int status);
+
+  void csv_send_records(const std::string& records);
+
   int parquet_processing(bufferlist& bl, off_t ofs, off_t len);
 
   int run_s3select(const char* query, const char* input, size_t input_length);
@@ -222,6 +313,10 @@ private:
 
   int range_request(int64_t start, int64_t len, void*, optional_yield);
 
+  int parquet_read(uint64_t ofs, uint64_t end, bufferlist& bl, optional_yield y);
+
+  void parquet_cache_insert(uint64_t ofs, bufferlist&& bl);
+
   size_t get_obj_size();
   std::function<int(int64_t, int64_t, void*, optional_yield*)> fp_range_req;
   std::function<size_t(void)> fp_get_obj_size;
@@ -118,6 +118,10 @@ rgw::sal::Store* StoreManager::init_storage_provider(const DoutPrefixProvider* d
       return store;
     }
     ((rgw::sal::MotrStore *)store)->init_metadata_cache(dpp, cct, use_cache);
+    ((rgw::sal::MotrStore *)store)->init_stats(dpp, quota_threads);
+    ((rgw::sal::MotrStore *)store)->init_gc(dpp, use_gc_thread);
+    ((rgw::sal::MotrStore *)store)->init_lc(dpp, use_lc_thread);
+    ((rgw::sal::MotrStore *)store)->init_data_cache(dpp);
 
     return store;
   }
@@ -925,6 +925,17 @@ class Object {
 
       /** Delete the object */
       virtual int delete_obj(const DoutPrefixProvider* dpp, optional_yield y) = 0;
+      /** Delete the objects of @a ops, delete ops of this store on objects
+       * of one bucket, putting the return code of each in @a rcs. Stores
+       * which can batch the index updates override it; by default each op
+       * is run on its own. */
+      virtual void delete_objs(const DoutPrefixProvider* dpp,
+                               std::vector<DeleteOp*>& ops,
+                               std::vector<int>& rcs, optional_yield y) {
+        rcs.resize(ops.size());
+        for (size_t i = 0; i < ops.size(); i++)
+          rcs[i] = ops[i]->delete_obj(dpp, y);
+      }
     };
 
     Object()
@@ -1366,6 +1377,9 @@ public:
   Writer(const DoutPrefixProvider *_dpp, optional_yield y) : dpp(_dpp) {}
   virtual ~Writer() = default;
 
+  /** Hint the expected size of the data, when known, before prepare() */
+  virtual void set_size_hint(uint64_t size) {}
+
   /** prepare to start processing object data */
   virtual int prepare(optional_yield y) = 0;
 
@@ -18,6 +18,11 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include <deque>
 
 extern "C" {
 #pragma clang diagnostic push
@@ -32,11 +37,17 @@ extern "C" {
 
 #include "common/Clock.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
 
 #include "rgw_compression.h"
 #include "rgw_sal.h"
 #include "rgw_sal_motr.h"
 #include "rgw_bucket.h"
+#include "rgw_perf_counters.h"
+#include "rgw_lc.h"
+#include "rgw_d3n_cache.h"
+#include "rgw_d3n_cacherequest.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -59,12 +70,174 @@ static std::string motr_global_indices[] = {
   RGW_MOTR_BUCKET_INST_IDX_NAME,
   RGW_MOTR_BUCKET_HD_IDX_NAME,
   RGW_IAM_MOTR_ACCESS_KEY,
-  RGW_IAM_MOTR_EMAIL_KEY
+  RGW_IAM_MOTR_EMAIL_KEY,
+  RGW_MOTR_BUCKET_STATS_IDX_NAME,
+  RGW_MOTR_USER_STATS_IDX_NAME,
+  RGW_MOTR_CACHE_LOG_IDX_NAME,
+  RGW_MOTR_GC_QUEUE_IDX_NAME,
+  RGW_MOTR_OBJ_REFS_IDX_NAME,
+  RGW_MOTR_LC_IDX_NAME,
+  RGW_MOTR_LC_LOCK_IDX_NAME
 };
 
+enum {
+  l_motr_cache_first = 880000,
+
+  l_motr_cache_hit,
+  l_motr_cache_miss,
+  l_motr_cache_evict,
+
+  l_motr_cache_last,
+};
+
+MotrShardedCache::MotrShardedCache(CephContext *_cct, const string& name,
+                                   size_t _nr_shards, size_t max_entries)
+  : cct(_cct),
+    nr_shards(_nr_shards),
+    max_shard_entries(std::max<size_t>(max_entries / _nr_shards, 1)),
+    expiry(std::chrono::seconds(
+             cct->_conf.get_val<uint64_t>("rgw_cache_expiry_interval"))),
+    shards(new Shard[_nr_shards])
+{
+  for (size_t i = 0; i < nr_shards; i++) {
+    PerfCountersBuilder b(cct, "motr-meta-cache-" + name + "-" + std::to_string(i),
+                          l_motr_cache_first, l_motr_cache_last);
+    b.add_u64_counter(l_motr_cache_hit, "hit", "Number of cache hits");
+    b.add_u64_counter(l_motr_cache_miss, "miss", "Number of cache misses");
+    b.add_u64_counter(l_motr_cache_evict, "evict", "Number of evicted entries");
+    shards[i].counters = PerfCountersRef{b.create_perf_counters(), cct};
+    cct->get_perfcounters_collection()->add(shards[i].counters.get());
+    shards[i].clock.reserve(max_shard_entries);
+  }
+}
+
+int MotrShardedCache::get(const string& name, bufferlist& data)
+{
+  if (!enabled)
+    return -ENOENT;
+
+  Shard& shard = shard_of(name);
+  {
+    std::shared_lock l{shard.lock};
+    auto iter = shard.entries.find(name);
+    if (iter != shard.entries.end() && !expired(*iter->second)) {
+      Entry& e = *iter->second;
+      e.referenced.store(true, std::memory_order_relaxed);
+      data = e.data;
+      shard.counters->inc(l_motr_cache_hit);
+      if (perfcounter)
+        perfcounter->inc(l_rgw_cache_hit);
+      return 0;
+    }
+  }
+  shard.counters->inc(l_motr_cache_miss);
+  if (perfcounter)
+    perfcounter->inc(l_rgw_cache_miss);
+
+  return -ENOENT;
+}
+
+void MotrShardedCache::erase(Shard& shard, const string& name)
+{
+  auto iter = shard.entries.find(name);
+  if (iter == shard.entries.end())
+    return;
+  size_t slot = iter->second->slot;
+  shard.clock[slot].clear();
+  shard.free_slots.push_back(slot);
+  shard.entries.erase(iter);
+}
+
+size_t MotrShardedCache::evict(Shard& shard)
+{
+  if (!shard.free_slots.empty()) {
+    size_t slot = shard.free_slots.back();
+    shard.free_slots.pop_back();
+    return slot;
+  }
+  if (shard.clock.size() < max_shard_entries) {
+    shard.clock.emplace_back();
+    return shard.clock.size() - 1;
+  }
+
+  // Sweep the clock hand, giving referenced entries a second chance.
+  // There are no free slots, so every slot holds an entry.
+  for (;;) {
+    size_t slot = shard.hand;
+    shard.hand = (shard.hand + 1) % shard.clock.size();
+    auto iter = shard.entries.find(shard.clock[slot]);
+    ceph_assert(iter != shard.entries.end());
+    Entry& e = *iter->second;
+    if (e.referenced.exchange(false, std::memory_order_relaxed) && !expired(e))
+      continue;
+    shard.entries.erase(iter);
+    shard.clock[slot].clear();
+    shard.counters->inc(l_motr_cache_evict);
+    return slot;
+  }
+}
+
+void MotrShardedCache::put(const string& name, const bufferlist& data)
+{
+  if (!enabled)
+    return;
+
+  Shard& shard = shard_of(name);
+  std::unique_lock l{shard.lock};
+  auto iter = shard.entries.find(name);
+  if (iter == shard.entries.end()) {
+    auto e = std::make_unique<Entry>();
+    e->slot = evict(shard);
+    shard.clock[e->slot] = name;
+    iter = shard.entries.emplace(name, std::move(e)).first;
+  }
+  Entry& e = *iter->second;
+  e.data = data;
+  e.time_added = ceph::coarse_mono_clock::now();
+  e.referenced.store(true, std::memory_order_relaxed);
+}
+
+void MotrShardedCache::remove(const string& name)
+{
+  Shard& shard = shard_of(name);
+  std::unique_lock l{shard.lock};
+  erase(shard, name);
+}
+
+void MotrShardedCache::set_enabled(bool status)
+{
+  enabled = status;
+  if (status)
+    return;
+
+  for (size_t i = 0; i < nr_shards; i++) {
+    std::unique_lock l{shards[i].lock};
+    shards[i].entries.clear();
+    shards[i].clock.clear();
+    shards[i].free_slots.clear();
+    shards[i].hand = 0;
+  }
+}
+
+MotrMetaCache::MotrMetaCache(const DoutPrefixProvider *dpp, CephContext *cct,
+                             const string& _name)
+  : name(_name)
+{
+  cache.set_ctx(cct);
+
+  uint64_t nr_shards = cct->_conf.get_val<uint64_t>("motr_meta_cache_shards");
+  if (nr_shards > 0)
+    sharded = std::make_unique<MotrShardedCache>(cct, name, nr_shards,
+                                                 cct->_conf->rgw_cache_lru_size);
+}
+
 void MotrMetaCache::invalid(const DoutPrefixProvider *dpp,
                            const string& name)
 {
+  if (sharded) {
+    sharded->remove(name);
+    return;
+  }
   cache.invalidate_remove(dpp, name);
 }
 
@@ -80,7 +253,10 @@ int MotrMetaCache::put(const DoutPrefixProvider *dpp,
   info.flags = CACHE_FLAG_DATA;
   info.meta.mtime = ceph::real_clock::now();
   info.meta.size = data.length();
-  cache.put(dpp, name, info, NULL);
+  if (sharded)
+    sharded->put(name, data);
+  else
+    cache.put(dpp, name, info, NULL);
 
   // Inform other rgw instances. Do nothing if it gets some error?
   int rc = distribute_cache(dpp, name, info, UPDATE_OBJ);
@@ -90,10 +266,35 @@ int MotrMetaCache::put(const DoutPrefixProvider *dpp,
   return 0;
 }
 
+void MotrMetaCache::fill(const DoutPrefixProvider *dpp,
+                         const string& name,
+                         const bufferlist& data)
+{
+  if (sharded) {
+    sharded->put(name, data);
+    return;
+  }
+
+  ObjectCacheInfo info;
+  info.status = 0;
+  info.data = data;
+  info.flags = CACHE_FLAG_DATA;
+  info.meta.mtime = ceph::real_clock::now();
+  info.meta.size = data.length();
+  cache.put(dpp, name, info, NULL);
+}
+
 int MotrMetaCache::get(const DoutPrefixProvider *dpp,
                        const string& name,
                        bufferlist& data)
 {
+  if (sharded) {
+    int rc = sharded->get(name, data);
+    ldpp_dout(dpp, 20) << "Cache " << (rc == 0 ? "hit" : "miss")
+                       << ": name = " << name << dendl;
+    return rc;
+  }
+
   ObjectCacheInfo info;
   uint32_t flags = CACHE_FLAG_DATA;
   int rc = cache.get(dpp, name, info, flags, NULL);
@@ -120,7 +321,10 @@ int MotrMetaCache::remove(const DoutPrefixProvider *dpp,
                           const string& name)
 
 {
-  cache.invalidate_remove(dpp, name);
+  if (sharded)
+    sharded->remove(name);
+  else
+    cache.invalidate_remove(dpp, name);
 
   ObjectCacheInfo info;
   int rc = distribute_cache(dpp, name, info, INVALIDATE_OBJ);
@@ -136,7 +340,10 @@ int MotrMetaCache::distribute_cache(const DoutPrefixProvider *dpp,
                                     const string& normal_name,
                                     ObjectCacheInfo& obj_info, int op)
 {
-  return 0;
+  if (notifier == nullptr || !notifier->enabled())
+    return 0;
+
+  return notifier->notify(dpp, name, normal_name, op);
 }
 
 int MotrMetaCache::watch_cb(const DoutPrefixProvider *dpp,
@@ -145,11 +352,347 @@ int MotrMetaCache::watch_cb(const DoutPrefixProvider *dpp,
                             uint64_t notifier_id,
                             bufferlist& bl)
 {
+  MotrCacheNotify info;
+  try {
+    auto iter = bl.cbegin();
+    decode(info, iter);
+  } catch (buffer::error& err) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to decode cache notification" << dendl;
+    return -EIO;
+  }
+
+  // The entry is reloaded from Motr on the next lookup, whether it was
+  // updated or removed.
+  ldpp_dout(dpp, 20) << "Invalidate cache entry: name = " << info.name
+                     << " op = " << info.op << " from " << info.gateway << dendl;
+  invalid(dpp, info.name);
+  return 0;
+}
+
+// Parse a socket address: an absolute path for a unix socket, otherwise
+// "<ipv4>:<port>" or "[<ipv6>]:<port>".
+static int motr_parse_sockaddr(const string& str, sockaddr_storage& ss,
+                               socklen_t& len)
+{
+  memset(&ss, 0, sizeof(ss));
+  if (str.empty())
+    return -EINVAL;
+
+  if (str[0] == '/') {
+    auto sun = reinterpret_cast<sockaddr_un*>(&ss);
+    if (str.size() >= sizeof(sun->sun_path))
+      return -ENAMETOOLONG;
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, str.c_str());
+    len = sizeof(sockaddr_un);
+    return 0;
+  }
+
+  auto colon = str.rfind(':');
+  if (colon == string::npos)
+    return -EINVAL;
+  string host = str.substr(0, colon);
+  int port = atoi(str.c_str() + colon + 1);
+  if (port <= 0 || port > 65535)
+    return -EINVAL;
+
+  if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+    auto sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    if (inet_pton(AF_INET6, host.substr(1, host.size() - 2).c_str(),
+                  &sin6->sin6_addr) != 1)
+      return -EINVAL;
+    len = sizeof(sockaddr_in6);
+  } else {
+    auto sin = reinterpret_cast<sockaddr_in*>(&ss);
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &sin->sin_addr) != 1)
+      return -EINVAL;
+    len = sizeof(sockaddr_in);
+  }
+  return 0;
+}
+
+MotrCacheNotifier::MotrCacheNotifier(MotrStore *_store, CephContext *_cct)
+  : store(_store), cct(_cct),
+    gateway(_cct->_conf.get_val<std::string>("motr_my_fid"))
+{
+}
+
+void MotrCacheNotifier::register_cache(MotrMetaCache *cache)
+{
+  caches[cache->get_name()] = cache;
+  cache->set_notifier(this);
+}
+
+int MotrCacheNotifier::start(const DoutPrefixProvider *dpp)
+{
+  auto addr = cct->_conf.get_val<std::string>("motr_cache_notify_addr");
+  changelog = cct->_conf.get_val<bool>("motr_cache_changelog");
+
+  if (!addr.empty()) {
+    sockaddr_storage ss;
+    socklen_t len;
+    int rc = motr_parse_sockaddr(addr, ss, len);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: invalid motr_cache_notify_addr " << addr << dendl;
+      return rc;
+    }
+    family = ss.ss_family;
+
+    std::list<string> peer_strs;
+    get_str_list(cct->_conf.get_val<std::string>("motr_cache_notify_peers"),
+                 ",", peer_strs);
+    for (const auto& p : peer_strs) {
+      sockaddr_storage pss;
+      socklen_t plen;
+      rc = motr_parse_sockaddr(p, pss, plen);
+      if (rc < 0 || pss.ss_family != family) {
+        ldpp_dout(dpp, 0) << "ERROR: invalid motr_cache_notify_peers entry " << p << dendl;
+        return -EINVAL;
+      }
+      peers.emplace_back(pss, plen);
+    }
+
+    fd = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      rc = -errno;
+      ldpp_dout(dpp, 0) << "ERROR: failed to create socket: " << cpp_strerror(rc) << dendl;
+      return rc;
+    }
+    if (family == AF_UNIX) {
+      unix_path = addr;
+      ::unlink(unix_path.c_str());
+    } else {
+      int on = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&ss), len) < 0) {
+      rc = -errno;
+      ldpp_dout(dpp, 0) << "ERROR: failed to bind " << addr << ": " << cpp_strerror(rc) << dendl;
+      ::close(fd);
+      fd = -1;
+      return rc;
+    }
+    // Listening on a multicast group address joins the group.
+    auto sin = reinterpret_cast<sockaddr_in*>(&ss);
+    if (family == AF_INET && IN_MULTICAST(ntohl(sin->sin_addr.s_addr))) {
+      ip_mreq mreq = {};
+      mreq.imr_multiaddr = sin->sin_addr;
+      mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+      if (::setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        rc = -errno;
+        ldpp_dout(dpp, 0) << "ERROR: failed to join " << addr << ": " << cpp_strerror(rc) << dendl;
+        ::close(fd);
+        fd = -1;
+        return rc;
+      }
+    }
+  }
+
+  if (enabled()) {
+    last_trim = real_clock::now();
+    create("motr_cache_nfy");
+  }
+  return 0;
+}
+
+void MotrCacheNotifier::stop()
+{
+  stopping = true;
+  if (is_started())
+    join();
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  if (!unix_path.empty())
+    ::unlink(unix_path.c_str());
+  changelog = false;
+}
+
+// The time part of the keys of time ordered indices, such as the cache
+// changelog and the GC queue: "<ns since epoch>.<gateway>.<seq>".
+static string motr_time_key(ceph::real_time t)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%020llu", (unsigned long long)
+           std::chrono::duration_cast<std::chrono::nanoseconds>(
+             t.time_since_epoch()).count());
+  return buf;
+}
+
+int MotrCacheNotifier::notify(const DoutPrefixProvider *dpp, const string& cache,
+                              const string& name, uint32_t op)
+{
+  MotrCacheNotify info;
+  info.op = op;
+  info.gateway = gateway;
+  info.cache = cache;
+  info.name = name;
+  bufferlist bl;
+  encode(info, bl);
+
+  int ret = 0;
+  if (fd >= 0) {
+    bl.rebuild();
+    for (const auto& [addr, len] : peers) {
+      if (::sendto(fd, bl.c_str(), bl.length(), MSG_DONTWAIT,
+                   reinterpret_cast<const sockaddr*>(&addr), len) < 0) {
+        ret = -errno;
+        ldpp_dout(dpp, 1) << "WARNING: failed to send cache notification: "
+                          << cpp_strerror(ret) << dendl;
+      }
+    }
+  }
+
+  if (changelog) {
+    string key = motr_time_key(real_clock::now()) + "." + gateway + "." +
+                 std::to_string(log_seq++);
+    int rc = store->do_idx_op_by_name(RGW_MOTR_CACHE_LOG_IDX_NAME,
+                                      M0_IC_PUT, key, bl);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to append to the cache changelog: rc="
+                        << rc << dendl;
+      ret = rc;
+    }
+  }
+
+  return ret;
+}
+
+void MotrCacheNotifier::handle(const DoutPrefixProvider *dpp, bufferlist& bl)
+{
+  MotrCacheNotify info;
+  try {
+    auto iter = bl.cbegin();
+    decode(info, iter);
+  } catch (buffer::error& err) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to decode cache notification" << dendl;
+    return;
+  }
+  if (info.gateway == gateway)
+    return;
+
+  auto iter = caches.find(info.cache);
+  if (iter == caches.end()) {
+    ldpp_dout(dpp, 1) << "WARNING: cache notification for unknown cache "
+                      << info.cache << dendl;
+    return;
+  }
+  iter->second->watch_cb(dpp, 0, 0, 0, bl);
+}
+
+// Apply the changelog entries of the last few poll intervals. Looking back
+// covers clock skew between gateways; entries already applied are skipped.
+int MotrCacheNotifier::poll_changelog(const DoutPrefixProvider *dpp)
+{
+  auto interval = cct->_conf.get_val<uint64_t>("motr_cache_changelog_poll_interval");
+  auto lookback = std::chrono::seconds(2 * interval + 10);
+  const int max = 1000;
+  std::set<string> seen;
+
+  string marker = motr_time_key(real_clock::now() - lookback);
+  for (;;) {
+    vector<string> keys(max);
+    vector<bufferlist> vals(max);
+    keys[0] = marker;
+    int rc = store->next_query_by_name(RGW_MOTR_CACHE_LOG_IDX_NAME, keys, vals, "", "");
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to read the cache changelog: rc=" << rc << dendl;
+      return rc;
+    }
+    for (int i = 0; i < rc; i++) {
+      seen.insert(keys[i]);
+      if (log_seen.count(keys[i]) == 0)
+        handle(dpp, vals[i]);
+    }
+    if (rc < max)
+      break;
+    marker = keys[rc - 1] + " ";
+  }
+  log_seen.swap(seen);
+
   return 0;
 }
 
+// Remove the entries too old to be looked at by any poll.
+int MotrCacheNotifier::trim_changelog(const DoutPrefixProvider *dpp)
+{
+  auto interval = cct->_conf.get_val<uint64_t>("motr_cache_changelog_poll_interval");
+  auto age = std::chrono::seconds(std::max<uint64_t>(60, 10 * (2 * interval + 10)));
+  string end = motr_time_key(real_clock::now() - age);
+  const int max = 1000;
+
+  for (;;) {
+    vector<string> keys(max);
+    vector<bufferlist> vals(max);
+    int rc = store->next_query_by_name(RGW_MOTR_CACHE_LOG_IDX_NAME, keys, vals, "", "");
+    if (rc <= 0)
+      return rc;
+
+    vector<string> old;
+    for (int i = 0; i < rc && keys[i] < end; i++)
+      old.push_back(keys[i]);
+    if (old.empty())
+      return 0;
+
+    vector<bufferlist> bls;
+    vector<int> rcs;
+    rc = store->do_idx_batch_op_by_name(RGW_MOTR_CACHE_LOG_IDX_NAME, M0_IC_DEL,
+                                        old, bls, rcs);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to trim the cache changelog: rc=" << rc << dendl;
+      return rc;
+    }
+    if (old.size() < (size_t)max)
+      return 0;
+  }
+}
+
+void *MotrCacheNotifier::entry()
+{
+  DoutPrefix dp(cct, dout_subsys, "motr cache notifier: ");
+  auto interval = std::chrono::seconds(
+      cct->_conf.get_val<uint64_t>("motr_cache_changelog_poll_interval"));
+  auto next_poll = ceph::coarse_mono_clock::now();
+  std::vector<char> buf(65536);
+
+  while (!stopping) {
+    if (fd >= 0) {
+      pollfd pfd = {fd, POLLIN, 0};
+      // Wake up at least once a second to check for stop().
+      int rc = ::poll(&pfd, 1, 1000);
+      if (rc > 0 && (pfd.revents & POLLIN)) {
+        ssize_t n = ::recv(fd, buf.data(), buf.size(), MSG_DONTWAIT);
+        if (n > 0) {
+          bufferlist bl;
+          bl.append(buf.data(), n);
+          handle(&dp, bl);
+        }
+      }
+    } else {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    if (changelog && ceph::coarse_mono_clock::now() >= next_poll) {
+      poll_changelog(&dp);
+      next_poll = ceph::coarse_mono_clock::now() + interval;
+      if (real_clock::now() - last_trim > std::chrono::minutes(10)) {
+        trim_changelog(&dp);
+        last_trim = real_clock::now();
+      }
+    }
+  }
+  return nullptr;
+}
+
 void MotrMetaCache::set_enabled(bool status)
 {
+  if (sharded)
+    sharded->set_enabled(status);
   cache.set_enabled(status);
 }
 
@@ -173,7 +716,7 @@ int MotrUser::list_buckets(const DoutPrefixProvider *dpp, const string& marker,
   buckets.clear();
   string user_info_iname = "motr.rgw.user.info." + info.user_id.to_str();
   keys[0] = marker;
-  rc = store->next_query_by_name(user_info_iname, keys, vals);
+  rc = store->next_query_by_name(user_info_iname, keys, vals, "", "", y);
   if (rc < 0) {
     ldpp_dout(dpp, 0) << "ERROR: NEXT query failed. " << rc << dendl;
     return rc;
@@ -296,17 +839,57 @@ int MotrUser::read_attrs(const DoutPrefixProvider* dpp, optional_yield y)
   return 0;
 }
 
+// The user stats are the roll-up of the stats of the user's buckets as of
+// their last MotrBucket::sync_user_stats().
 int MotrUser::read_stats(const DoutPrefixProvider *dpp,
     optional_yield y, RGWStorageStats* stats,
     ceph::real_time *last_stats_sync,
     ceph::real_time *last_stats_update)
 {
+  bufferlist bl;
+  MotrStats ustats;
+
+  int rc = store->do_idx_op_by_name(RGW_MOTR_USER_STATS_IDX_NAME,
+                                    M0_IC_GET, info.user_id.to_str(), bl, true, y);
+  if (rc < 0 && rc != -ENOENT) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to read user stats: rc=" << rc << dendl;
+    return rc;
+  }
+  if (rc == 0) {
+    try {
+      auto iter = bl.cbegin();
+      decode(ustats, iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode user stats" << dendl;
+      return -EIO;
+    }
+  }
+
+  stats->num_objects = std::max<int64_t>(ustats.num_objects, 0);
+  stats->size = std::max<int64_t>(ustats.size, 0);
+  stats->size_rounded = std::max<int64_t>(ustats.size_rounded, 0);
+  if (last_stats_sync)
+    *last_stats_sync = ustats.last_stats_sync;
+  if (last_stats_update)
+    *last_stats_update = ustats.last_stats_update;
+
   return 0;
 }
 
-/* stats - Not for first pass */
 int MotrUser::read_stats_async(const DoutPrefixProvider *dpp, RGWGetUserStats_CB *cb)
 {
+  RGWStorageStats stats;
+
+  // The stats are a single index record, read them in place.
+  int rc = read_stats(dpp, null_yield, &stats);
+  if (rc < 0) {
+    cb->put();
+    return rc;
+  }
+  cb->set_response(stats);
+  cb->handle_response(0);
+  cb->put();
+
   return 0;
 }
 
@@ -344,7 +927,7 @@ int MotrUser::load_user_from_idx(const DoutPrefixProvider *dpp,
         return rc;
 
     // Put into cache.
-    store->get_user_cache()->put(dpp, info.user_id.to_str(), bl);
+    store->get_user_cache()->fill(dpp, info.user_id.to_str(), bl);
   }
 
   bufferlist& blr = bl;
@@ -432,7 +1015,7 @@ int MotrUser::store_user(const DoutPrefixProvider* dpp,
   muinfo.user_version = obj_ver;
   muinfo.encode(bl);
   rc = store->do_idx_op_by_name(RGW_MOTR_USERS_IDX_NAME,
-                                M0_IC_PUT, info.user_id.to_str(), bl);
+                                M0_IC_PUT, info.user_id.to_str(), bl, true, y);
   ldpp_dout(dpp, 10) << "Store user to motr index: rc = " << rc << dendl;
   if (rc == 0) {
     objv_tracker.read_version = obj_ver;
@@ -504,22 +1087,27 @@ int MotrUser::remove_user(const DoutPrefixProvider* dpp, optional_yield y)
 
   // Delete all access key of user
   if (!info.access_keys.empty()) {
-    for(auto acc_key = info.access_keys.begin(); acc_key != info.access_keys.end(); acc_key++) {
-      auto access_key = acc_key->first;
-      rc = store->delete_access_key(dpp, y, access_key);
-      // TODO 
-      // Check error code for access_key does not exist
-      // Continue to next step only if delete failed because key doesn't exists
-      if (rc < 0){
-        ldpp_dout(dpp, 0) << "Unable to delete access key" << rc << dendl;
-      }
-    }
+    vector<string> keys;
+    vector<bufferlist> vals;
+    vector<int> rcs;
+    for (const auto& acc_key : info.access_keys)
+      keys.push_back(acc_key.first);
+    rc = store->do_idx_batch_op_by_name(RGW_IAM_MOTR_ACCESS_KEY,
+                                        M0_IC_DEL, keys, vals, rcs, true, y);
+    // TODO
+    // Continue to next step only if delete failed because key doesn't exists
+    if (rc < 0)
+      ldpp_dout(dpp, 0) << "Unable to delete access keys " << rc << dendl;
+    for (size_t i = 0; i < rcs.size(); i++)
+      if (rcs[i] < 0 && rcs[i] != -ENOENT)
+        ldpp_dout(dpp, 0) << "Unable to delete access key " << keys[i]
+                          << " " << rcs[i] << dendl;
   }
 
   //Delete email id 
   if (!info.user_email.empty()) {
     rc = store->do_idx_op_by_name(RGW_IAM_MOTR_EMAIL_KEY,
-		             M0_IC_DEL, info.user_email, bl);
+		             M0_IC_DEL, info.user_email, bl, true, y);
     if (rc < 0 && rc != -ENOENT) {
        ldpp_dout(dpp, 0) << "Unable to delete email id " << rc << dendl;
     }
@@ -527,12 +1115,12 @@ int MotrUser::remove_user(const DoutPrefixProvider* dpp, optional_yield y)
   
   // Delete user info index
   string user_info_iname = "motr.rgw.user.info." + info.user_id.to_str();
-  store->delete_motr_idx_by_name(user_info_iname);
+  store->delete_motr_idx_by_name(user_info_iname, y);
   ldpp_dout(dpp, 10) << "Deleted user info index - " << user_info_iname << dendl;
 
   // Delete user from user index
   rc = store->do_idx_op_by_name(RGW_MOTR_USERS_IDX_NAME,
-                           M0_IC_DEL, info.user_id.to_str(), bl);
+                           M0_IC_DEL, info.user_id.to_str(), bl, true, y);
   if (rc < 0){
     ldpp_dout(dpp, 0) << "Unable to delete user from user index " << rc << dendl;
     return rc;
@@ -613,12 +1201,19 @@ int MotrBucket::remove_bucket(const DoutPrefixProvider *dpp, bool delete_childre
 
   // 3. Remove mp index??
   string bucket_multipart_iname = "motr.rgw.bucket." + tenant_bkt_name + ".multiparts";
-  ret = store->delete_motr_idx_by_name(bucket_multipart_iname);
+  ret = store->delete_motr_idx_by_name(bucket_multipart_iname, y);
   if (ret < 0) {
     ldpp_dout(dpp, 0) << "ERROR: remove_bucket failed to remove multipart index rc=" << ret << dendl;
     return ret;
   }
 
+  string latest_iname = "motr.rgw.bucket." + tenant_bkt_name + RGW_MOTR_LATEST_IDX_SUFFIX;
+  ret = store->delete_motr_idx_by_name(latest_iname, y);
+  if (ret < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: remove_bucket failed to remove latest version index rc=" << ret << dendl;
+    return ret;
+  }
+
   // 4. Sync user stats.
   ret = this->sync_user_stats(dpp, y);
   if (ret < 0) {
@@ -634,12 +1229,17 @@ int MotrBucket::remove_bucket(const DoutPrefixProvider *dpp, bool delete_childre
 
   // 6. Remove bucket index.
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-  ret = store->delete_motr_idx_by_name(bucket_index_iname);
+  ret = store->delete_motr_idx_by_name(bucket_index_iname, y);
   if (ret < 0) {
     ldpp_dout(dpp, 0) << "ERROR: remove_bucket unlink_user failed rc=" << ret << dendl;
     return ret;
   }
 
+  // Drop the bucket stats.
+  ret = store->get_stats_tracker()->remove_bucket(dpp, tenant_bkt_name, y);
+  if (ret < 0)
+    ldpp_dout(dpp, 1) << "WARNING: failed to remove bucket stats rc=" << ret << dendl;
+
   // 7. Remove bucket instance info.
   bufferlist bl;
   ret = store->get_bucket_inst_cache()->remove(dpp, tenant_bkt_name);
@@ -650,7 +1250,7 @@ int MotrBucket::remove_bucket(const DoutPrefixProvider *dpp, bool delete_childre
   }
 
   ret = store->do_idx_op_by_name(RGW_MOTR_BUCKET_INST_IDX_NAME,
-                                  M0_IC_DEL, tenant_bkt_name, bl);
+                                  M0_IC_DEL, tenant_bkt_name, bl, true, y);
   if (ret < 0) {
     ldpp_dout(dpp, 0) << "ERROR: remove_bucket failed to remove bucket instance rc=" 
       << ret << dendl;
@@ -720,11 +1320,11 @@ int MotrBucket::load_bucket(const DoutPrefixProvider *dpp, optional_yield y, boo
     // Cache misses.
     ldpp_dout(dpp, 20) << "load_bucket(): name=" << tenant_bkt_name << dendl;
     int rc = store->do_idx_op_by_name(RGW_MOTR_BUCKET_INST_IDX_NAME,
-                                      M0_IC_GET, tenant_bkt_name, bl);
+                                      M0_IC_GET, tenant_bkt_name, bl, true, y);
     ldpp_dout(dpp, 20) << "load_bucket(): rc=" << rc << dendl;
     if (rc < 0)
       return rc;
-    store->get_bucket_inst_cache()->put(dpp, tenant_bkt_name, bl);
+    store->get_bucket_inst_cache()->fill(dpp, tenant_bkt_name, bl);
   }
 
   struct MotrBucketInfo mbinfo;
@@ -766,7 +1366,7 @@ int MotrBucket::link_user(const DoutPrefixProvider* dpp, User* new_user, optiona
   // Insert the user into the user info index.
   string user_info_idx_name = "motr.rgw.user.info." + new_user->get_info().user_id.to_str();
   return store->do_idx_op_by_name(user_info_idx_name,
-                                  M0_IC_PUT, tenant_bkt_name, bl);
+                                  M0_IC_PUT, tenant_bkt_name, bl, true, y);
 
 }
 
@@ -777,15 +1377,28 @@ int MotrBucket::unlink_user(const DoutPrefixProvider* dpp, User* new_user, optio
   string tenant_bkt_name = get_bucket_name(info.bucket.tenant, info.bucket.name);
   string user_info_idx_name = "motr.rgw.user.info." + new_user->get_info().user_id.to_str();
   return store->do_idx_op_by_name(user_info_idx_name,
-                                  M0_IC_DEL, tenant_bkt_name, bl);
+                                  M0_IC_DEL, tenant_bkt_name, bl, true, y);
 }
 
-/* stats - Not for first pass */
 int MotrBucket::read_stats(const DoutPrefixProvider *dpp, int shard_id,
     std::string *bucket_ver, std::string *master_ver,
     std::map<RGWObjCategory, RGWStorageStats>& stats,
     std::string *max_marker, bool *syncstopped)
 {
+  MotrStats bstats;
+  string tenant_bkt_name = get_bucket_name(info.bucket.tenant, info.bucket.name);
+
+  int rc = store->get_stats_tracker()->read_bucket(dpp, tenant_bkt_name, bstats, null_yield);
+  if (rc < 0)
+    return rc;
+
+  RGWStorageStats& s = stats[RGWObjCategory::Main];
+  s.category = RGWObjCategory::Main;
+  s.num_objects = std::max<int64_t>(bstats.num_objects, 0);
+  s.size = std::max<int64_t>(bstats.size, 0);
+  s.size_rounded = std::max<int64_t>(bstats.size_rounded, 0);
+  s.size_utilized = s.size;
+
   return 0;
 }
 
@@ -821,16 +1434,111 @@ int MotrBucket::create_multipart_indices()
 
 int MotrBucket::read_stats_async(const DoutPrefixProvider *dpp, int shard_id, RGWGetBucketStats_CB *ctx)
 {
+  std::map<RGWObjCategory, RGWStorageStats> stats;
+
+  int rc = read_stats(dpp, shard_id, nullptr, nullptr, stats, nullptr);
+  if (rc < 0) {
+    ctx->put();
+    return rc;
+  }
+  ctx->set_response(&stats);
+  ctx->handle_response(0);
+  ctx->put();
+
   return 0;
 }
 
+// Store the current stats of the bucket in the owner's bucket list entry
+// and apply the change to the owner's stats roll-up.
 int MotrBucket::sync_user_stats(const DoutPrefixProvider *dpp, optional_yield y)
 {
-  return 0;
+  std::map<RGWObjCategory, RGWStorageStats> stats;
+  int rc = read_stats(dpp, RGW_NO_SHARD, nullptr, nullptr, stats, nullptr);
+  if (rc < 0)
+    return rc;
+  const RGWStorageStats& bstats = stats[RGWObjCategory::Main];
+
+  string tenant_bkt_name = get_bucket_name(info.bucket.tenant, info.bucket.name);
+  string user_info_iname = "motr.rgw.user.info." + info.owner.to_str();
+  bufferlist bl;
+  rc = store->do_idx_op_by_name(user_info_iname, M0_IC_GET, tenant_bkt_name, bl, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to read bucket entry of user "
+                      << info.owner << ": rc=" << rc << dendl;
+    return rc;
+  }
+  RGWBucketEnt bent;
+  auto iter = bl.cbegin();
+  try {
+    bent.decode(iter);
+  } catch (buffer::error& err) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to decode bucket entry of user "
+                      << info.owner << ": " << err.what() << dendl;
+    return -EIO;
+  }
+
+  MotrStats delta;
+  delta.num_objects = (int64_t)bstats.num_objects - (int64_t)bent.count;
+  delta.size = (int64_t)bstats.size - (int64_t)bent.size;
+  delta.size_rounded = (int64_t)bstats.size_rounded - (int64_t)bent.size_rounded;
+
+  bent.count = bstats.num_objects;
+  bent.size = bstats.size;
+  bent.size_rounded = bstats.size_rounded;
+  bl.clear();
+  bent.encode(bl);
+  rc = store->do_idx_op_by_name(user_info_iname, M0_IC_PUT, tenant_bkt_name, bl, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to update bucket entry of user "
+                      << info.owner << ": rc=" << rc << dendl;
+    return rc;
+  }
+  ent.count = bent.count;
+  ent.size = bent.size;
+  ent.size_rounded = bent.size_rounded;
+
+  // Update the user's roll-up. It is a read-modify-write, concurrent syncs
+  // of buckets of the same user may lose an update until the next sync.
+  MotrStats ustats;
+  bl.clear();
+  rc = store->do_idx_op_by_name(RGW_MOTR_USER_STATS_IDX_NAME, M0_IC_GET,
+                                info.owner.to_str(), bl, true, y);
+  if (rc < 0 && rc != -ENOENT)
+    return rc;
+  if (rc == 0) {
+    iter = bl.cbegin();
+    try {
+      ustats.decode(iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode user stats of "
+                        << info.owner << ": " << err.what() << dendl;
+      return -EIO;
+    }
+  }
+  ustats.add(delta);
+  ustats.last_stats_sync = ustats.last_stats_update = real_clock::now();
+  bl.clear();
+  ustats.encode(bl);
+  rc = store->do_idx_op_by_name(RGW_MOTR_USER_STATS_IDX_NAME, M0_IC_PUT,
+                                info.owner.to_str(), bl, true, y);
+  if (rc < 0)
+    ldpp_dout(dpp, 0) << "ERROR: failed to update user stats of "
+                      << info.owner << ": rc=" << rc << dendl;
+  return rc;
 }
 
 int MotrBucket::update_container_stats(const DoutPrefixProvider *dpp)
 {
+  std::map<RGWObjCategory, RGWStorageStats> stats;
+  int rc = read_stats(dpp, RGW_NO_SHARD, nullptr, nullptr, stats, nullptr);
+  if (rc < 0)
+    return rc;
+
+  const RGWStorageStats& bstats = stats[RGWObjCategory::Main];
+  ent.count = bstats.num_objects;
+  ent.size = bstats.size;
+  ent.size_rounded = bstats.size_rounded;
+
   return 0;
 }
 
@@ -862,9 +1570,14 @@ int MotrBucket::check_empty(const DoutPrefixProvider *dpp, optional_yield y)
 int MotrBucket::check_quota(const DoutPrefixProvider *dpp, RGWQuotaInfo& user_quota, RGWQuotaInfo& bucket_quota, uint64_t obj_size,
     optional_yield y, bool check_size_only)
 {
-  /* Not Handled in the first pass as stats are also needed */
-  return 0;
-}
+  RGWQuotaHandler *quota_handler = store->get_quota_handler();
+  if (quota_handler == nullptr)
+    return 0;
+
+  return quota_handler->check_quota(dpp, info.owner, info.bucket, user_quota,
+                                    bucket_quota, check_size_only ? 0 : 1,
+                                    obj_size, y);
+}
 
 int MotrBucket::merge_and_store_attrs(const DoutPrefixProvider *dpp, Attrs& new_attrs, optional_yield y)
 {
@@ -895,11 +1608,39 @@ int MotrBucket::trim_usage(const DoutPrefixProvider *dpp, uint64_t start_epoch,
 
 int MotrBucket::remove_objs_from_index(const DoutPrefixProvider *dpp, std::list<rgw_obj_index_key>& objs_to_unlink)
 {
-  /* XXX: CHECK: Unlike RadosStore, there is no seperate bucket index table.
-   * Delete all the object in the list from the object table of this
-   * bucket
-   */
-  return 0;
+  // Remove the entries of the objects from the bucket index in batches.
+  // The Motr objects are not touched.
+  string tenant_bkt_name = get_bucket_name(info.bucket.tenant, info.bucket.name);
+  string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
+  vector<string> keys;
+  vector<bufferlist> vals;
+  vector<int> rcs;
+
+  if (objs_to_unlink.empty())
+    return 0;
+
+  keys.reserve(objs_to_unlink.size());
+  for (const auto& key : objs_to_unlink) {
+    keys.push_back(rgw_obj_key(key.name, key.instance).to_str());
+    store->get_obj_meta_cache()->remove(dpp, keys.back());
+  }
+
+  int rc = store->do_idx_batch_op_by_name(bucket_index_iname, M0_IC_DEL,
+                                          keys, vals, rcs, true, null_yield);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to remove objects from bucket index: rc="
+                      << rc << dendl;
+    return rc;
+  }
+  for (size_t i = 0; i < rcs.size(); i++) {
+    if (rcs[i] < 0 && rcs[i] != -ENOENT) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to remove " << keys[i]
+                        << " from bucket index: rc=" << rcs[i] << dendl;
+      rc = rcs[i];
+    }
+  }
+
+  return rc;
 }
 
 int MotrBucket::check_index(const DoutPrefixProvider *dpp, std::map<RGWObjCategory, RGWStorageStats>& existing_stats, std::map<RGWObjCategory, RGWStorageStats>& calculated_stats)
@@ -954,62 +1695,58 @@ int MotrBucket::list(const DoutPrefixProvider *dpp, ListParams& params, int max,
   int rc;
   if (max == 0)  // Return an emtpy response.
     return 0;
-  max++;  // Fetch an extra key if available to ensure presence of next obj.
-  vector<string> keys(max);
-  vector<bufferlist> vals(max);
   string tenant_bkt_name = get_bucket_name(info.bucket.tenant, info.bucket.name);
 
   ldpp_dout(dpp, 20) << "bucket=" << tenant_bkt_name
                     << " prefix=" << params.prefix
                     << " marker=" << params.marker
-                    << " max=" << max - 1 << dendl;
-
-  // Retrieve all `max` number of pairs.
-  string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-
-  // Modify the marker based on its type
-  keys[0] = params.prefix;
-  if (!params.marker.empty()) {
-    keys[0] = params.marker.to_str();
-    // Get the position of delimiter string
-    int delim_pos = keys[0].find(params.delim, params.prefix.length());
-    // If delimiter is present at the very end, append "\xff" to skip all
-    // the dir entries, else append " " to skip the maker key.
-    if (delim_pos == (int)(keys[0].length() - params.delim.length()))
-      keys[0].append("\xff");
-    else
-      keys[0].append(" ");
-  }
+                    << " max=" << max << dendl;
 
-  rc = store->next_query_by_name(bucket_index_iname, keys, vals, params.prefix,
-                                                                 params.delim);
+  // Uploads in progress are kept out of the bucket index, in the multipart
+  // index under the names of their meta objects.
+  bool mp_ns = params.ns == RGW_OBJ_NS_MULTIPART;
+  string bucket_index_iname = mp_ns ?
+    "motr.rgw.bucket." + tenant_bkt_name + ".multiparts" :
+    "motr.rgw.bucket.index." + tenant_bkt_name;
+
+  // Fetch an extra entry if available to ensure presence of next obj.
+  MotrIdxLister lister(store, bucket_index_iname, params.prefix, params.delim);
+  if (params.marker.empty())
+    rc = lister.start(params.prefix, max + 1, y);
+  else
+    rc = lister.start_after(params.marker.to_str(), max + 1, y);
   if (rc < 0) {
     ldpp_dout(dpp, 0) << "ERROR: NEXT query failed. " << rc << dendl;
     return rc;
   }
 
-  // Check if an extra key was fetched or not
-  if (rc == max) {
-    // One extra key is successfully fetched.
-    results.is_truncated = true;
-    results.next_marker = keys[max - 2];
-    rc--;
-  } else {
-    results.is_truncated = false;
-  }
-
-  // Process the returned pairs to add into ListResults.
-  int i = 0;
-  for (; i < rc; ++i) {
-    if (vals[i].length() == 0) {
-      results.common_prefixes[keys[i]] = true;
-    } else {
-      rgw_bucket_dir_entry ent;
-      auto iter = vals[i].cbegin();
-      ent.decode(iter);
-      if (params.list_versions || ent.is_visible())
-        results.objs.emplace_back(std::move(ent));
+  // Only the entries returned are decoded.
+  MotrIdxLister::Entry ent;
+  string last_key;
+  results.is_truncated = false;
+  for (int count = 0; (rc = lister.next(ent, y)) > 0; count++) {
+    if (count == max) {
+      results.is_truncated = true;
+      results.next_marker = last_key;
+      // Callers paging without a marker of their own, as the lc does,
+      // go on from here.
+      params.marker = results.next_marker;
+      break;
+    }
+    last_key.assign(ent.key);
+    if (ent.is_dir) {
+      results.common_prefixes[last_key] = true;
+      continue;
     }
+    rgw_bucket_dir_entry dirent;
+    auto iter = ent.val.cbegin();
+    dirent.decode(iter);
+    if (mp_ns || params.list_versions || dirent.is_visible())
+      results.objs.emplace_back(std::move(dirent));
+  }
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: NEXT query failed. " << rc << dendl;
+    return rc;
   }
 
   return 0;
@@ -1085,8 +1822,22 @@ int MotrBucket::abort_multiparts(const DoutPrefixProvider *dpp, CephContext *cct
 
 void MotrStore::finalize(void)
 {
+  if (quota_handler != nullptr) {
+    RGWQuotaHandler::free_handler(quota_handler);
+    quota_handler = nullptr;
+  }
+  // The lc workers queue deletes to the GC.
+  delete lc;
+  lc = nullptr;
+  gc.stop();
+  stats_tracker.stop();
+  cache_notifier.stop();
+  idx_cache.clear();
   // close connection with motr
   m0_client_fini(this->instance, true);
+  motr_perf.reset();
+  delete data_cache;
+  data_cache = nullptr;
 }
 
 const RGWZoneGroup& MotrZone::get_zonegroup()
@@ -1154,19 +1905,10 @@ int MotrObject::get_obj_state(const DoutPrefixProvider* dpp, RGWObjectCtx* rctx,
 
   // Get object's metadata (those stored in rgw_bucket_dir_entry).
   bufferlist bl;
-  string tenant_bkt_name = get_bucket_name(this->get_bucket()->get_tenant(), this->get_bucket()->get_name());
-  if (this->store->get_obj_meta_cache()->get(dpp, this->get_key().to_str(), bl)) {
-    // Cache misses.
-    string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-    int rc = this->store->do_idx_op_by_name(bucket_index_iname,
-                                  M0_IC_GET, this->get_key().to_str(), bl);
-    if (rc < 0) {
-      ldpp_dout(dpp, 0) << "Failed to get object's entry from bucket index. " << dendl;
-      return rc;
-    }
-
-    // Put into cache.
-    this->store->get_obj_meta_cache()->put(dpp, this->get_key().to_str(), bl);
+  int rc = this->get_bucket_dir_ent_bl(dpp, bl, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "Failed to get object's entry from bucket index. " << dendl;
+    return rc;
   }
 
   rgw_bucket_dir_entry ent;
@@ -1234,17 +1976,23 @@ int MotrObject::get_obj_attrs(RGWObjectCtx* rctx, optional_yield y, const DoutPr
 
   // Get object's metadata (those stored in rgw_bucket_dir_entry).
   bufferlist bl;
-  if (this->store->get_obj_meta_cache()->get(dpp, key, bl)) {
+  if (!target_obj) {
+    int rc = this->get_bucket_dir_ent_bl(dpp, bl, y);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "Failed to get object's entry from bucket index. " << dendl;
+      return rc;
+    }
+  } else if (this->store->get_obj_meta_cache()->get(dpp, key, bl)) {
     // Cache misses.
     string bucket_index_iname = "motr.rgw.bucket.index." + bname;
-    int rc = this->store->do_idx_op_by_name(bucket_index_iname, M0_IC_GET, key, bl);
+    int rc = this->store->do_idx_op_by_name(bucket_index_iname, M0_IC_GET, key, bl, true, y);
     if (rc < 0) {
       ldpp_dout(dpp, 0) << "Failed to get object's entry from bucket index. " << dendl;
       return rc;
     }
 
     // Put into cache.
-    this->store->get_obj_meta_cache()->put(dpp, key, bl);
+    this->store->get_obj_meta_cache()->fill(dpp, key, bl);
   }
 
   rgw_bucket_dir_entry ent;
@@ -1362,48 +2110,110 @@ bool MotrObject::placement_rules_match(rgw_placement_rule& r1, rgw_placement_rul
   return true;
 }
 
+// Dump the Motr object of the object, or of each of its parts, with the
+// layout geometry its writes and reads use.
 int MotrObject::dump_obj_layout(const DoutPrefixProvider *dpp, optional_yield y, Formatter* f, RGWObjectCtx* obj_ctx)
 {
+  rgw_bucket_dir_entry ent;
+  int rc = this->get_bucket_dir_ent(dpp, ent, y);
+  if (rc < 0)
+    return rc;
+
+  f->open_object_section("layout");
+  f->dump_unsigned("size", ent.meta.size);
+  f->dump_bool("inline", meta.is_inline());
+  if (ent.meta.category == RGWObjCategory::MultiMeta) {
+    PartMap map;
+    rc = this->get_part_map(dpp, ent, map, y);
+    if (rc < 0) {
+      f->close_section();
+      return rc;
+    }
+    f->open_array_section("parts");
+    for (const auto& part : map.parts) {
+      f->open_object_section("part");
+      f->dump_unsigned("num", part.num);
+      f->dump_unsigned("off", part.off);
+      f->dump_unsigned("size", part.size);
+      get_part_obj(part)->dump_layout(f);
+      f->close_section();
+    }
+    f->close_section();
+  } else if (ent.meta.size != 0 && !meta.is_inline()) {
+    this->dump_layout(f);
+  }
+  f->close_section();
+
   return 0;
 }
 
+void MotrObject::dump_layout(Formatter *f)
+{
+  char fid_str[M0_FID_STR_LEN];
+  snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&meta.oid));
+  f->dump_string("oid", fid_str);
+  snprintf(fid_str, ARRAY_SIZE(fid_str), FID_F, FID_P(&meta.pver));
+  f->dump_string("pver", fid_str);
+  f->dump_format("layout_id", "0x%" PRIx64, meta.layout_id);
+
+  MotrPoolWidth pw;
+  if (store->get_pool_width(meta.pver, pw) < 0)
+    return;
+  if (max_bs == 0)
+    init_layout_geom();
+  f->dump_unsigned("unit_size", unit_sz);
+  f->dump_unsigned("N", pw.N);
+  f->dump_unsigned("K", pw.K);
+  f->dump_unsigned("S", pw.S);
+  f->dump_unsigned("P", pw.P);
+  f->dump_unsigned("group_size", grp_sz);
+  f->dump_unsigned("max_block_size", max_bs);
+}
+
 std::unique_ptr<Object::ReadOp> MotrObject::get_read_op(RGWObjectCtx* ctx)
 {
   return std::make_unique<MotrObject::MotrReadOp>(this, ctx);
 }
 
-MotrObject::MotrReadOp::MotrReadOp(MotrObject *_source, RGWObjectCtx *_rctx) :
-  source(_source),
-  rctx(_rctx)
-{ }
+// A part object being opened.
+struct MotrObject::MotrReadOp::PartOpen {
+  size_t idx;
+  std::unique_ptr<MotrObject> obj;
+  CephContext *cct;
+  MotrOpWaiter waiter;
+  struct m0_op *op = nullptr;
 
-int MotrObject::MotrReadOp::prepare(optional_yield y, const DoutPrefixProvider* dpp)
-{
-  int rc;
-  ldpp_dout(dpp, 20) <<__func__<< ": bucket=" << source->get_bucket()->get_name() << dendl;
+  PartOpen(size_t _idx, std::unique_ptr<MotrObject> _obj, CephContext *_cct)
+    : idx(_idx), obj(std::move(_obj)), cct(_cct) {}
+  ~PartOpen() {
+    if (op != nullptr) {
+      m0_op_cancel(&op, 1);
+      wait(null_yield);
+    }
+  }
 
-  rgw_bucket_dir_entry ent;
-  rc = source->get_bucket_dir_ent(dpp, ent);
-  if (rc < 0)
+  int wait(optional_yield y) {
+    if (op == nullptr)
+      return 0;
+    int rc = waiter.wait(cct, op, y);
+    m0_op_fini(op);
+    m0_op_free(op);
+    op = nullptr;
+    if (rc < 0)
+      obj->close_mobj();
     return rc;
+  }
+};
 
-  // Set source object's attrs. The attrs is key/value map and is used
-  // in send_response_data() to set attributes, including etag.
-  bufferlist etag_bl;
-  string& etag = ent.meta.etag;
-  ldpp_dout(dpp, 20) <<__func__<< ": object's etag: " << ent.meta.etag << dendl;
-  etag_bl.append(etag.c_str(), etag.size());
-  source->get_attrs().emplace(std::move(RGW_ATTR_ETAG), std::move(etag_bl));
-
-  source->set_key(ent.key);
-  source->set_obj_size(ent.meta.size);
-  source->category = ent.meta.category;
-  *params.lastmod = ent.meta.mtime;
-
+// Check the conditional request headers against the object's entry.
+static int check_read_conditions(const DoutPrefixProvider* dpp,
+                                 const rgw_bucket_dir_entry& ent,
+                                 const Object::ReadOp::Params& params)
+{
   if (params.mod_ptr || params.unmod_ptr) {
     // Convert all times go GMT to make them compatible
     obj_time_weight src_weight;
-    src_weight.init(*params.lastmod, params.mod_zone_id, params.mod_pg_ver);
+    src_weight.init(ent.meta.mtime, params.mod_zone_id, params.mod_pg_ver);
     src_weight.high_precision = params.high_precision_time;
 
     obj_time_weight dest_weight;
@@ -1430,6 +2240,7 @@ int MotrObject::MotrReadOp::prepare(optional_yield y, const DoutPrefixProvider*
     }
   }
   // Check if-match condition
+  const string& etag = ent.meta.etag;
   if (params.if_match) {
     string if_match_str = rgw_string_unquote(params.if_match);
     ldpp_dout(dpp, 10) << "ETag: " << etag << " & "
@@ -1448,19 +2259,56 @@ int MotrObject::MotrReadOp::prepare(optional_yield y, const DoutPrefixProvider*
     }
   }
 
-  // Skip opening an empty object.
-  if(source->get_obj_size() == 0)
+  return 0;
+}
+
+MotrObject::MotrReadOp::MotrReadOp(MotrObject *_source, RGWObjectCtx *_rctx) :
+  source(_source),
+  rctx(_rctx)
+{ }
+
+MotrObject::MotrReadOp::~MotrReadOp() = default;
+
+int MotrObject::MotrReadOp::prepare(optional_yield y, const DoutPrefixProvider* dpp)
+{
+  int rc;
+  ldpp_dout(dpp, 20) <<__func__<< ": bucket=" << source->get_bucket()->get_name() << dendl;
+
+  rgw_bucket_dir_entry ent;
+  rc = source->get_bucket_dir_ent(dpp, ent, y);
+  if (rc < 0)
+    return rc;
+
+  // Set source object's attrs. The attrs is key/value map and is used
+  // in send_response_data() to set attributes, including etag.
+  bufferlist etag_bl;
+  string& etag = ent.meta.etag;
+  ldpp_dout(dpp, 20) <<__func__<< ": object's etag: " << ent.meta.etag << dendl;
+  etag_bl.append(etag.c_str(), etag.size());
+  source->get_attrs().emplace(std::move(RGW_ATTR_ETAG), std::move(etag_bl));
+
+  source->set_key(ent.key);
+  source->set_obj_size(ent.meta.size);
+  source->category = ent.meta.category;
+  if (params.lastmod)
+    *params.lastmod = ent.meta.mtime;
+
+  rc = check_read_conditions(dpp, ent, params);
+  if (rc < 0)
+    return rc;
+
+  // Skip opening an empty object, or one with the data inline.
+  if(source->get_obj_size() == 0 || source->meta.is_inline())
     return 0;
 
-  // Open the object here.
+  // Open the object here. The parts of a multipart object are opened
+  // by iterate() when it gets to them.
   if (source->category == RGWObjCategory::MultiMeta) {
-    ldpp_dout(dpp, 20) <<__func__<< ": open obj parts..." << dendl;
-    rc = source->get_part_objs(dpp, this->part_objs)? :
-         source->open_part_objs(dpp, this->part_objs);
-    return rc;
+    ldpp_dout(dpp, 20) <<__func__<< ": load obj parts..." << dendl;
+    return source->get_part_map(dpp, ent, parts, y);
   } else {
     ldpp_dout(dpp, 20) <<__func__<< ": open object..." << dendl;
-    return source->open_mobj(dpp);
+    return source->open_mobj(dpp, y);
   }
 }
 
@@ -1476,16 +2324,29 @@ int MotrObject::MotrReadOp::read(int64_t off, int64_t end, bufferlist& bl, optio
 // (RGWGetObj_CB::handle_dta which in turn calls RGWGetObj::get_data_cb() to
 // send data back.).
 //
-// POC implements a simple sync version of iterate() function in which it reads
-// a block of data each time and call 'cb' for post-processing.
+// The data is read by read_mobj() with a window of block reads in flight.
+// With a yield context the coroutine, not the thread, waits for Motr.
 int MotrObject::MotrReadOp::iterate(const DoutPrefixProvider* dpp, int64_t off, int64_t end, RGWGetDataCB* cb, optional_yield y)
 {
   int rc;
 
+  if (source->meta.is_inline()) {
+    // Served from the bucket index entry, no Motr I/O.
+    bufferlist bl;
+    bl.substr_of(source->meta.inline_data, off, end - off + 1);
+    return cb->handle_data(bl, 0, bl.length());
+  }
+
   if (source->category == RGWObjCategory::MultiMeta)
-    rc = source->read_multipart_obj(dpp, off, end, cb, part_objs);
-  else
-    rc = source->read_mobj(dpp, off, end, cb);
+    return read_parts(dpp, off, end, cb, y);
+
+  // A failed open leaves the object closed, reopen it.
+  if (source->mobj == nullptr && source->get_obj_size() > 0) {
+    rc = source->open_mobj(dpp, y);
+    if (rc < 0)
+      return rc;
+  }
+  rc = source->read_mobj(dpp, off, end, cb, y);
 
   return rc;
 }
@@ -1517,52 +2378,245 @@ MotrObject::MotrDeleteOp::MotrDeleteOp(MotrObject *_source, RGWObjectCtx *_rctx)
 // 2. Delete an object when its versioning is turned on.
 int MotrObject::MotrDeleteOp::delete_obj(const DoutPrefixProvider* dpp, optional_yield y)
 {
-  if (source->have_instance()) {
-    rgw_obj_key& key = source->get_key();
-    if (key.have_null_instance())
-      key.instance.clear();
-  }
-
   string tenant_bkt_name = get_bucket_name(source->get_bucket()->get_tenant(), source->get_bucket()->get_name());
   ldpp_dout(dpp, 20) << "delete " << source->get_key().to_str() << " from " << tenant_bkt_name << dendl;
 
+  // Without a version id, a versioned bucket only gets a delete marker.
+  // Otherwise the delete is of the null version, looked up and unlinked by
+  // the same key; with the versioning suspended a null delete marker takes
+  // its place.
+  rgw_obj_key& key = source->get_key();
+  bool null_marker = false;
+  if (!key.have_instance() && source->get_bucket()->get_info().versioned()) {
+    int status = params.versioning_status &
+                 (BUCKET_VERSIONED | BUCKET_VERSIONS_SUSPENDED);
+    if (status == BUCKET_VERSIONED) {
+      if (params.marker_version_id.empty())
+        source->gen_rand_obj_instance_name();
+      else
+        key.set_instance(params.marker_version_id);
+      return add_delete_marker(dpp, y);
+    }
+    key.set_instance("null");
+    null_marker = status != 0;
+  }
+
+  // The null instance looks up the null version itself.
   rgw_bucket_dir_entry ent;
-  int rc = source->get_bucket_dir_ent(dpp, ent);
+  int rc = source->get_bucket_dir_ent(dpp, ent, y);
+  if (rc == -ENOENT && null_marker)
+    return add_delete_marker(dpp, y);
   if (rc < 0) {
     return rc;
   }
 
-  //TODO: When integrating with background GC for object deletion,
-  // we should consider adding object entry to GC before deleting the metadata.
+  if (key.have_null_instance())
+    key.instance.clear();
+
   // Delete from the cache first.
-  source->store->get_obj_meta_cache()->remove(dpp, source->get_key().to_str());
+  source->store->get_obj_meta_cache()->remove(dpp, key.to_str());
 
-  // Delete the object's entry from the bucket index.
-  bufferlist bl;
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-  rc = source->store->do_idx_op_by_name(bucket_index_iname,
-                                            M0_IC_DEL, source->get_key().to_str(), bl);
-  if (rc < 0) {
-    ldpp_dout(dpp, 0) << "Failed to del object's entry from bucket index. " << dendl;
-    return rc;
+  if (null_marker) {
+    rc = add_delete_marker(dpp, y);
+    if (rc < 0)
+      return rc;
+  } else {
+    // Delete the object's entry from the bucket index.
+    bufferlist bl;
+    rc = source->store->do_idx_op_by_name(bucket_index_iname,
+                                          M0_IC_DEL, key.to_str(), bl, true, y);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "Failed to del object's entry from bucket index. " << dendl;
+      return rc;
+    }
+  }
+  source->store->get_stats_tracker()->remove_object(tenant_bkt_name,
+                                                    key.to_str(),
+                                                    ent.meta.size);
+
+  if (!null_marker && source->get_bucket()->get_info().versioned()) {
+    rc = source->reset_latest_version(dpp, key, y);
+    if (rc < 0)
+      ldpp_dout(dpp, 0) << "ERROR: failed to reset the current version of "
+                        << source->get_name() << ": rc=" << rc << dendl;
   }
 
-  if (ent.meta.size == 0) {
-    ldpp_dout(dpp, 0) << __func__ << ": Object size is 0, not deleting motr object." << dendl;
+  if (ent.meta.size == 0 || source->meta.is_inline()) {
+    ldpp_dout(dpp, 20) << __func__ << ": no motr object to delete." << dendl;
     return 0;
   }
-  // Remove the motr objects.
+  // Leave the motr objects to the GC.
   if (source->category == RGWObjCategory::MultiMeta)
-    rc = source->delete_part_objs(dpp);
+    rc = source->delete_part_objs(dpp, y);
   else
-    rc = source->delete_mobj(dpp);
+    rc = source->store->get_gc()->enqueue_delete(dpp, {source->meta}, y);
   if (rc < 0) {
     ldpp_dout(dpp, 0) << "Failed to delete the object from Motr. " << dendl;
     return rc;
   }
 
-  //result.delete_marker = parent_op.result.delete_marker;
-  //result.version_id = parent_op.result.version_id;
+  return 0;
+}
+
+// The objects of an unversioned bucket are deleted together: a batch of
+// lookups and a batch of index deletes for all of them, and their Motr
+// objects left to the GC in one go. The rest are deleted one by one.
+void MotrObject::MotrDeleteOp::delete_objs(const DoutPrefixProvider* dpp,
+                                           vector<DeleteOp*>& ops,
+                                           vector<int>& rcs, optional_yield y)
+{
+  vector<MotrDeleteOp*> batch;
+  vector<size_t> pos;
+
+  rcs.assign(ops.size(), 0);
+  for (size_t i = 0; i < ops.size(); i++) {
+    auto op = static_cast<MotrDeleteOp*>(ops[i]);
+    if (op->source->get_bucket()->get_info().versioned() ||
+        op->source->get_key().have_instance()) {
+      rcs[i] = op->delete_obj(dpp, y);
+      continue;
+    }
+    batch.push_back(op);
+    pos.push_back(i);
+  }
+  if (batch.empty())
+    return;
+
+  MotrStore *store = batch.front()->source->store;
+  Bucket *bucket = batch.front()->source->get_bucket();
+  string tenant_bkt_name = get_bucket_name(bucket->get_tenant(), bucket->get_name());
+  string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
+  vector<string> keys;
+  vector<bufferlist> vals;
+  vector<int> idx_rcs;
+
+  for (auto op : batch)
+    keys.push_back(op->source->get_key().to_str());
+  int rc = store->do_idx_batch_op_by_name(bucket_index_iname, M0_IC_GET,
+                                          keys, vals, idx_rcs, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to look up the objects in bucket index: rc="
+                      << rc << dendl;
+    for (auto i : pos)
+      rcs[i] = rc;
+    return;
+  }
+
+  // Only the objects found are unlinked.
+  vector<size_t> found;
+  vector<rgw_bucket_dir_entry> ents(batch.size());
+  vector<string> del_keys;
+  for (size_t j = 0; j < batch.size(); j++) {
+    if (idx_rcs[j] < 0) {
+      rcs[pos[j]] = idx_rcs[j];
+      continue;
+    }
+    try {
+      auto iter = vals[j].cbegin();
+      ents[j].decode(iter);
+      Attrs attrs;
+      decode(attrs, iter);
+      batch[j]->source->meta.decode(iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode the entry of " << keys[j]
+                        << ": " << err.what() << dendl;
+      rcs[pos[j]] = -EIO;
+      continue;
+    }
+    if (ents[j].is_delete_marker()) {
+      rcs[pos[j]] = -ENOENT;
+      continue;
+    }
+    store->get_obj_meta_cache()->remove(dpp, keys[j]);
+    found.push_back(j);
+    del_keys.push_back(keys[j]);
+  }
+  if (found.empty())
+    return;
+
+  vals.clear();
+  rc = store->do_idx_batch_op_by_name(bucket_index_iname, M0_IC_DEL,
+                                      del_keys, vals, idx_rcs, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to del objects' entries from bucket index: rc="
+                      << rc << dendl;
+    for (auto j : found)
+      rcs[pos[j]] = rc;
+    return;
+  }
+
+  vector<MotrObject::Meta> gc_objs;
+  vector<size_t> gc_pos;
+  for (size_t k = 0; k < found.size(); k++) {
+    size_t j = found[k];
+    MotrObject *obj = batch[j]->source;
+    if (idx_rcs[k] < 0) {
+      ldpp_dout(dpp, 0) << "Failed to del object's entry from bucket index: rc="
+                        << idx_rcs[k] << dendl;
+      rcs[pos[j]] = idx_rcs[k];
+      continue;
+    }
+    store->get_stats_tracker()->remove_object(tenant_bkt_name, keys[j],
+                                              ents[j].meta.size);
+    if (ents[j].meta.size == 0 || obj->meta.is_inline())
+      continue;
+    if (ents[j].meta.category == RGWObjCategory::MultiMeta) {
+      obj->category = ents[j].meta.category;
+      rcs[pos[j]] = obj->delete_part_objs(dpp, y);
+      continue;
+    }
+    gc_objs.push_back(obj->meta);
+    gc_pos.push_back(pos[j]);
+  }
+
+  // Leave the motr objects to the GC.
+  rc = store->get_gc()->enqueue_delete(dpp, std::move(gc_objs), y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "Failed to delete the objects from Motr: rc=" << rc << dendl;
+    for (auto i : gc_pos)
+      rcs[i] = rc;
+  }
+}
+
+int MotrObject::MotrDeleteOp::add_delete_marker(const DoutPrefixProvider* dpp,
+                                                optional_yield y)
+{
+  string tenant_bkt_name = get_bucket_name(source->get_bucket()->get_tenant(), source->get_bucket()->get_name());
+  string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
+  rgw_obj_key key = source->get_key();
+  if (key.have_null_instance())
+    key.instance.clear();
+
+  // A version with no data, no attrs and no Motr object.
+  rgw_bucket_dir_entry ent;
+  key.get_index_key(&ent.key);
+  ent.meta.mtime = real_clock::is_zero(params.mtime) ? real_clock::now() : params.mtime;
+  ent.meta.owner = params.obj_owner.get_id().to_str();
+  ent.meta.owner_display_name = params.obj_owner.get_display_name();
+  ent.flags = rgw_bucket_dir_entry::FLAG_VER | rgw_bucket_dir_entry::FLAG_CURRENT |
+              rgw_bucket_dir_entry::FLAG_DELETE_MARKER;
+  bufferlist bl;
+  ent.encode(bl);
+  encode(Attrs(), bl);
+  MotrObject::Meta().encode(bl);
+
+  int rc = source->store->do_idx_op_by_name(bucket_index_iname,
+                                            M0_IC_PUT, key.to_str(), bl, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to add a delete marker for "
+                      << source->get_name() << ": rc=" << rc << dendl;
+    return rc;
+  }
+  source->store->get_obj_meta_cache()->put(dpp, key.to_str(), bl);
+
+  rc = source->set_latest_version(dpp, ent, bl, y);
+  if (rc < 0)
+    return rc;
+
+  ldpp_dout(dpp, 20) << __func__ << ": added " << key.to_str() << dendl;
+  result.delete_marker = true;
+  result.version_id = key.instance.empty() ? "null" : key.instance;
   return 0;
 }
 
@@ -1570,7 +2624,7 @@ int MotrObject::delete_object(const DoutPrefixProvider* dpp, RGWObjectCtx* obj_c
 {
   MotrObject::MotrDeleteOp del_op(this, obj_ctx);
   del_op.params.bucket_owner = bucket->get_info().owner;
-  del_op.params.versioning_status = bucket->get_info().versioning_status();
+  del_op.params.versioning_status = prevent_versioning ? 0 : bucket->get_info().versioning_status();
 
   return del_op.delete_obj(dpp, y);
 }
@@ -1583,6 +2637,62 @@ int MotrObject::delete_obj_aio(const DoutPrefixProvider* dpp, RGWObjState* astat
   return 0;
 }
 
+// Taken from rgw_rados.cc
+static void set_copy_attrs(Attrs& src_attrs, Attrs& attrs, AttrsMod attrs_mod)
+{
+  switch (attrs_mod) {
+  case ATTRSMOD_NONE:
+    attrs = src_attrs;
+    break;
+  case ATTRSMOD_REPLACE:
+    if (!attrs[RGW_ATTR_ETAG].length()) {
+      attrs[RGW_ATTR_ETAG] = src_attrs[RGW_ATTR_ETAG];
+    }
+    break;
+  case ATTRSMOD_MERGE:
+    for (auto it = src_attrs.begin(); it != src_attrs.end(); ++it) {
+      if (attrs.find(it->first) == attrs.end()) {
+        attrs[it->first] = it->second;
+      }
+    }
+    break;
+  }
+}
+
+// Hands the data read from the source of a copy to the writer of the
+// destination. The blocks are passed on without copying them, and the
+// writer launches their writes while the next blocks are being read.
+class MotrCopyCB : public RGWGetDataCB {
+  Writer *writer;
+  uint64_t ofs = 0;
+  void (*progress_cb)(off_t, void *);
+  void *progress_data;
+
+public:
+  MotrCopyCB(Writer *_writer, void (*_progress_cb)(off_t, void *), void *_progress_data)
+    : writer(_writer), progress_cb(_progress_cb), progress_data(_progress_data) {}
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    bufferlist data;
+    data.substr_of(bl, bl_ofs, bl_len);
+    int rc = writer->process(std::move(data), ofs);
+    if (rc < 0)
+      return rc;
+    ofs += bl_len;
+    if (progress_cb)
+      progress_cb(ofs, progress_data);
+    return 0;
+  }
+
+  uint64_t get_ofs() const { return ofs; }
+};
+
+// Server-side copy. Unless the copy goes to another storage class, the
+// destination shares the Motr objects of the source (see
+// MotrAtomicWriter::share_data()), and the copy costs a few index records
+// whatever the object size. Otherwise the data is read from the source and
+// written to a new object within the gateway, with the reads and the
+// writes in flight at the same time.
 int MotrObject::copy_object(RGWObjectCtx& obj_ctx,
     User* user,
     req_info* info,
@@ -1612,19 +2722,85 @@ int MotrObject::copy_object(RGWObjectCtx& obj_ctx,
     const DoutPrefixProvider* dpp,
     optional_yield y)
 {
-      return 0;
-}
+  int rc;
+  rgw_bucket_dir_entry src_ent;
+  Attrs src_attrs;
 
-int MotrObject::swift_versioning_restore(RGWObjectCtx* obj_ctx,
-    bool& restored,
-    const DoutPrefixProvider* dpp)
-{
-  return 0;
-}
+  rc = this->get_bucket_dir_ent(dpp, src_ent, y, &src_attrs);
+  if (rc < 0)
+    return rc;
+  this->set_key(src_ent.key);
+  this->category = src_ent.meta.category;
+  if (src_mtime)
+    *src_mtime = src_ent.meta.mtime;
+
+  ReadOp::Params conds;
+  conds.mod_ptr = mod_ptr;
+  conds.unmod_ptr = unmod_ptr;
+  conds.high_precision_time = high_precision_time;
+  conds.if_match = if_match;
+  conds.if_nomatch = if_nomatch;
+  rc = check_read_conditions(dpp, src_ent, conds);
+  if (rc < 0)
+    return rc;
 
-int MotrObject::swift_versioning_copy(RGWObjectCtx* obj_ctx,
-    const DoutPrefixProvider* dpp,
-    optional_yield y)
+  set_copy_attrs(src_attrs, attrs, attrs_mod);
+
+  string unique_tag = tag ? *tag : string();
+  MotrAtomicWriter writer(dpp, y, dest_object->clone(), store, user->get_id(),
+                          obj_ctx, &dest_placement, olh_epoch, unique_tag);
+  // A copy to another storage class gets its own data.
+  bool share = store->ctx()->_conf.get_val<bool>("motr_copy_share_data") &&
+               rgw_placement_rule::get_canonical_storage_class(src_ent.meta.storage_class) ==
+               dest_placement.get_storage_class();
+  if (!share)
+    writer.set_size_hint(src_ent.meta.size);
+  rc = writer.prepare(y);
+  if (rc < 0)
+    return rc;
+
+  ldpp_dout(dpp, 20) << __func__ << ": " << get_key().to_str() << " -> "
+                     << dest_object->get_key().to_str() << " size="
+                     << src_ent.meta.size << " share=" << share << dendl;
+  if (share) {
+    rc = writer.share_data(this, src_ent, y);
+  } else {
+    MotrCopyCB cb(&writer, progress_cb, progress_data);
+    MotrReadOp read_op(this, &obj_ctx);
+    ceph::real_time lastmod;
+    read_op.params.lastmod = &lastmod;
+    rc = read_op.prepare(y, dpp);
+    if (rc == 0 && src_ent.meta.size > 0)
+      rc = read_op.iterate(dpp, 0, src_ent.meta.size - 1, &cb, y);
+    if (rc == 0)
+      rc = writer.process({}, cb.get_ofs());
+  }
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to copy " << get_key().to_str()
+                      << ": rc=" << rc << dendl;
+    writer.cleanup();
+    return rc;
+  }
+
+  rc = writer.complete(src_ent.meta.accounted_size, src_ent.meta.etag,
+                       mtime, real_time(), attrs,
+                       delete_at ? *delete_at : real_time(),
+                       nullptr, nullptr, nullptr, nullptr, nullptr, y);
+  if (rc == 0 && etag)
+    *etag = src_ent.meta.etag;
+  return rc;
+}
+
+int MotrObject::swift_versioning_restore(RGWObjectCtx* obj_ctx,
+    bool& restored,
+    const DoutPrefixProvider* dpp)
+{
+  return 0;
+}
+
+int MotrObject::swift_versioning_copy(RGWObjectCtx* obj_ctx,
+    const DoutPrefixProvider* dpp,
+    optional_yield y)
 {
   return 0;
 }
@@ -1643,34 +2819,446 @@ MotrAtomicWriter::MotrAtomicWriter(const DoutPrefixProvider *dpp,
               ptail_placement_rule(_ptail_placement_rule),
               olh_epoch(_olh_epoch),
               unique_tag(_unique_tag),
+              y(y),
               obj(_store, _head_obj->get_key(), _head_obj->get_bucket()),
-              old_obj(_store, _head_obj->get_key(), _head_obj->get_bucket()) {}
+              old_obj(_store, _head_obj->get_key(), _head_obj->get_bucket()),
+              inline_max(_store->ctx()->_conf.get_val<Option::size_t>("motr_inline_data_max")),
+              wpipe(_store) {}
 
 static const unsigned MAX_BUFVEC_NR = 256;
 
+// The "motr" perf counters, shared by the ops of all the stores.
+static PerfCountersRef motr_perf;
+
+static const struct {
+  const char *name;
+  const char *desc;
+} motr_perf_ops[MOTR_PERF_OP_NR] = {
+  {"idx_get", "index GET"},
+  {"idx_put", "index PUT"},
+  {"idx_del", "index DEL"},
+  {"idx_next", "index NEXT"},
+  {"idx_create", "index create"},
+  {"idx_delete", "index delete"},
+  {"obj_create", "object create"},
+  {"obj_open", "object open"},
+  {"obj_read", "object read"},
+  {"obj_write", "object write"},
+  {"obj_delete", "object delete"},
+  {"other", "other"},
+};
+
+static void motr_perf_start(CephContext *cct)
+{
+  // The builder keeps the name and description pointers.
+  static std::deque<string> strs;
+  auto str = [] (string s) { return strs.emplace_back(std::move(s)).c_str(); };
+
+  PerfHistogramCommon::axis_config_d lat_axis{
+    "Latency (nsec)",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    100000,  // 100us
+    16,      // up to 1.6s and more
+  };
+  PerfHistogramCommon::axis_config_d bytes_axis{
+    "Request size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    4096,
+    16,      // up to 64M and more
+  };
+  PerfHistogramCommon::axis_config_d records_axis{
+    "Records",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    1,
+    12,      // up to 1024 and more
+  };
+
+  PerfCountersBuilder plb(cct, "motr", l_motr_first, l_motr_last);
+  plb.set_prio_default(PerfCountersBuilder::PRIO_USEFUL);
+
+  plb.add_u64(l_motr_in_flight, "in_flight", "Motr ops in flight");
+  plb.add_u64_counter(l_motr_read_bytes, "read_bytes", "Bytes read from Motr objects",
+                      nullptr, 0, UNIT_BYTES);
+  plb.add_u64_counter(l_motr_write_bytes, "write_bytes", "Bytes written to Motr objects",
+                      nullptr, 0, UNIT_BYTES);
+
+  for (int i = 0; i < MOTR_PERF_OP_NR; i++) {
+    const auto& op = motr_perf_ops[i];
+    int base = l_motr_op_first + i * l_motr_op_nr;
+    bool io = i == MOTR_PERF_OBJ_READ || i == MOTR_PERF_OBJ_WRITE;
+    plb.add_time_avg(base + l_motr_op_lat, str(string(op.name) + "_lat"),
+                     str(string("Latency of ") + op.desc + " ops"));
+    plb.add_u64_counter_histogram(base + l_motr_op_lat_hist,
+                                  str(string(op.name) + "_lat_histogram"),
+                                  lat_axis, io ? bytes_axis : records_axis,
+                                  str(string("Histogram of ") + op.desc + " latency (nsec) vs " +
+                                      (io ? "bytes" : "records")));
+    plb.add_u64_counter(base + l_motr_op_errors, str(string(op.name) + "_errors"),
+                        str(string("Failed ") + op.desc + " ops"));
+    plb.add_u64(base + l_motr_op_in_flight, str(string(op.name) + "_in_flight"),
+                str(string(op.desc) + " ops in flight"));
+  }
+
+  motr_perf.reset();
+  motr_perf = PerfCountersRef{plb.create_perf_counters(), cct};
+  cct->get_perfcounters_collection()->add(motr_perf.get());
+}
+
+static MotrPerfOp motr_perf_op(const struct m0_op *op)
+{
+  bool idx = op->op_entity != nullptr && op->op_entity->en_type == M0_ET_IDX;
+  switch (op->op_code) {
+  case M0_IC_GET:     return MOTR_PERF_IDX_GET;
+  case M0_IC_PUT:     return MOTR_PERF_IDX_PUT;
+  case M0_IC_DEL:     return MOTR_PERF_IDX_DEL;
+  case M0_IC_NEXT:    return MOTR_PERF_IDX_NEXT;
+  case M0_OC_READ:    return MOTR_PERF_OBJ_READ;
+  case M0_OC_WRITE:   return MOTR_PERF_OBJ_WRITE;
+  case M0_EO_CREATE:  return idx ? MOTR_PERF_IDX_CREATE : MOTR_PERF_OBJ_CREATE;
+  case M0_EO_DELETE:  return idx ? MOTR_PERF_IDX_DELETE : MOTR_PERF_OBJ_DELETE;
+  case M0_EO_OPEN:    return idx ? MOTR_PERF_OTHER : MOTR_PERF_OBJ_OPEN;
+  default:            return MOTR_PERF_OTHER;
+  }
+}
+
+const struct m0_op_ops MotrOpWaiter::ops = {
+  nullptr,                // oop_executed
+  MotrOpWaiter::op_done,  // oop_failed
+  MotrOpWaiter::op_done,  // oop_stable
+};
+
+// Called by Motr with the op's state machine group locked.
+void MotrOpWaiter::op_done(struct m0_op *op)
+{
+  auto waiter = static_cast<MotrOpWaiter*>(op->op_datum);
+  if (auto perf = waiter->perf; perf != nullptr) {
+    int base = l_motr_op_first + waiter->perf_op * l_motr_op_nr;
+    auto lat = ceph::mono_clock::now() - waiter->start;
+    int rc = m0_rc(op);
+    perf->dec(l_motr_in_flight);
+    perf->dec(base + l_motr_op_in_flight);
+    perf->tinc(base + l_motr_op_lat, lat);
+    perf->hinc(base + l_motr_op_lat_hist,
+               std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count(),
+               waiter->size);
+    // Missing and existing keys are answers, not failures.
+    if (rc < 0 && rc != -ENOENT && rc != -EEXIST)
+      perf->inc(base + l_motr_op_errors);
+    else if (waiter->perf_op == MOTR_PERF_OBJ_READ)
+      perf->inc(l_motr_read_bytes, waiter->size);
+    else if (waiter->perf_op == MOTR_PERF_OBJ_WRITE)
+      perf->inc(l_motr_write_bytes, waiter->size);
+  }
+
+  std::unique_ptr<Completion> c;
+  {
+    std::lock_guard l{waiter->lock};
+    waiter->done = true;
+    c = std::move(waiter->completion);
+  }
+  // Nothing may touch `waiter` after this: the resumed coroutine owns it.
+  if (c)
+    Completion::dispatch(std::move(c), boost::system::error_code{});
+}
+
+void MotrOpWaiter::setup(struct m0_op *op, uint64_t _size)
+{
+  perf = motr_perf.get();
+  if (perf != nullptr) {
+    perf_op = motr_perf_op(op);
+    size = _size;
+    start = ceph::mono_clock::now();
+    perf->inc(l_motr_in_flight);
+    perf->inc(l_motr_op_first + perf_op * l_motr_op_nr + l_motr_op_in_flight);
+  }
+  op->op_datum = this;
+  m0_op_setup(op, &ops, 0);
+}
+
+int MotrOpWaiter::wait(CephContext *cct, struct m0_op *op, optional_yield y)
+{
+  if (y) {
+    std::unique_lock l{lock};
+    if (!done) {
+      // Suspend the coroutine until op_done() dispatches the completion.
+      auto& yield = y.get_yield_context();
+      boost::system::error_code ec;
+      auto token = yield[ec];
+      boost::asio::async_completion<yield_context, Signature> init(token);
+      completion = Completion::create(y.get_io_context().get_executor(),
+                                      std::move(init.completion_handler));
+      l.unlock();
+      init.result.get();
+    }
+  } else if (is_asio_thread) {
+    // work on asio threads should be asynchronous, so warn when they block
+    ldout(cct, 20) << "WARNING: blocking motr call" << dendl;
+  }
+
+  // The op is in its final state by now. Waiting on it once more makes sure
+  // the callback has returned before the op is finalised.
+  return m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
+         m0_rc(op);
+}
+
+// Launch a single op, wait for it to complete and release it.
+static int motr_op_exec(CephContext *cct, struct m0_op *op, optional_yield y,
+                        uint64_t size = 0)
+{
+  MotrOpWaiter waiter;
+
+  waiter.setup(op, size);
+  m0_op_launch(&op, 1);
+  int rc = waiter.wait(cct, op, y);
+  m0_op_fini(op);
+  m0_op_free(op);
+
+  return rc;
+}
+
+bool MotrWriteBudget::try_get(uint64_t n)
+{
+  std::lock_guard l{lock};
+  if (used != 0 && used + n > max)
+    return false;
+  used += n;
+  return true;
+}
+
+void MotrWriteBudget::force_get(uint64_t n)
+{
+  std::lock_guard l{lock};
+  used += n;
+}
+
+void MotrWriteBudget::put(uint64_t n)
+{
+  std::lock_guard l{lock};
+  ceph_assert(used >= n);
+  used -= n;
+}
+
+// A write op launched by MotrWritePipeline.
+struct MotrWritePipeline::Req {
+  bufferlist data;
+  struct m0_bufvec buf = {};
+  struct m0_bufvec attr = {};
+  struct m0_indexvec ext = {};
+  struct m0_op *op = nullptr;
+  MotrOpWaiter waiter;
+  CephContext *cct;
+
+  explicit Req(CephContext *_cct) : cct(_cct) {}
+
+  int launch(struct m0_obj *mobj, uint64_t offset)
+  {
+    // Motr takes the data as a vector of buffers, merge them if there are
+    // too many.
+    if (data.get_num_buffers() > MAX_BUFVEC_NR)
+      data.rebuild();
+    unsigned nr = data.get_num_buffers();
+
+    int rc = m0_bufvec_empty_alloc(&buf, nr) ?:
+             m0_bufvec_alloc(&attr, nr, 1) ?:
+             m0_indexvec_alloc(&ext, nr);
+    if (rc != 0)
+      return rc;
+
+    unsigned i = 0;
+    for (auto& bp : data.buffers()) {
+      buf.ov_buf[i] = const_cast<char*>(bp.c_str());
+      buf.ov_vec.v_count[i] = bp.length();
+      ext.iv_index[i] = offset;
+      ext.iv_vec.v_count[i] = bp.length();
+      attr.ov_vec.v_count[i] = 0;
+      offset += bp.length();
+      ++i;
+    }
+
+    rc = m0_obj_op(mobj, M0_OC_WRITE, &ext, &buf, &attr, 0, 0, &op);
+    if (rc != 0)
+      return rc;
+    waiter.setup(op, data.length());
+    m0_op_launch(&op, 1);
+    return 0;
+  }
+
+  int wait(optional_yield y)
+  {
+    int rc = waiter.wait(cct, op, y);
+    m0_op_fini(op);
+    m0_op_free(op);
+    op = nullptr;
+    return rc;
+  }
+
+  ~Req()
+  {
+    if (op != nullptr) {
+      m0_op_cancel(&op, 1);
+      wait(null_yield);
+    }
+    m0_indexvec_free(&ext);
+    m0_bufvec_free(&attr);
+    m0_bufvec_free2(&buf);
+  }
+};
+
+MotrWritePipeline::MotrWritePipeline(MotrStore *_store) : store(_store)
+{
+}
+
+MotrWritePipeline::~MotrWritePipeline()
+{
+  cancel();
+}
+
+int MotrWritePipeline::write(const DoutPrefixProvider *dpp, MotrObject *obj,
+                             bufferlist&& data, uint64_t offset, optional_yield y)
+{
+  if (err != 0)
+    return err;
+
+  const unsigned depth = store->cctx->_conf.get_val<uint64_t>("motr_write_depth");
+  const uint64_t len = data.length();
+  MotrWriteBudget *budget = store->get_write_budget();
+
+  // Wait for a free slot in the window and for enough budget. With nothing
+  // in flight there is nothing of ours to wait for, and the budget is only
+  // returned by the other uploads: they may be coroutines on this very
+  // thread, so blocking for them could deadlock. Go over the budget by this
+  // block instead, an upload then holds at most one block beyond it.
+  for (;;) {
+    if (reqs.size() < depth && budget->try_get(len))
+      break;
+    if (reqs.empty()) {
+      budget->force_get(len);
+      break;
+    }
+    int rc = this->reap(dpp, y);
+    if (rc != 0)
+      return rc;
+  }
+
+  auto req = std::make_unique<Req>(store->cctx);
+  req->data = std::move(data);
+  int rc = req->launch(obj->mobj, offset);
+  ldpp_dout(dpp, 20) << "MotrWritePipeline::write(): off=" << offset
+                     << " len=" << len << " inflight=" << reqs.size()
+                     << " rc=" << rc << dendl;
+  if (rc != 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to launch a write op: rc=" << rc << dendl;
+    budget->put(len);
+    err = rc;
+    return rc;
+  }
+  reqs.push_back(std::move(req));
+
+  return 0;
+}
+
+int MotrWritePipeline::reap(const DoutPrefixProvider *dpp, optional_yield y)
+{
+  std::unique_ptr<Req> req = std::move(reqs.front());
+  reqs.pop_front();
+  int rc = req->wait(y);
+  store->get_write_budget()->put(req->data.length());
+  if (rc != 0) {
+    ldpp_dout(dpp, 0) << "ERROR: write op failed: rc=" << rc << dendl;
+    if (err == 0)
+      err = rc;
+  }
+  return err;
+}
+
+int MotrWritePipeline::drain(const DoutPrefixProvider *dpp, optional_yield y)
+{
+  while (!reqs.empty())
+    this->reap(dpp, y);
+  return err;
+}
+
+void MotrWritePipeline::cancel()
+{
+  for (auto& req : reqs) {
+    uint64_t len = req->data.length();
+    req.reset();
+    store->get_write_budget()->put(len);
+  }
+  reqs.clear();
+}
+
+// Data accumulated at most before launching writes, see process().
+static const unsigned MAX_ACC_SIZE = 32 * 1024 * 1024;
+
 int MotrAtomicWriter::prepare(optional_yield y)
 {
   total_data_size = 0;
+  acc_max = MAX_ACC_SIZE;
 
   if (obj.is_opened())
     return 0;
 
+  // A put without a version id in a versioned bucket replaces the null
+  // version, not the current one.
+  bool null_version = old_obj.get_bucket()->get_info().versioned() &&
+                      !old_obj.have_instance();
+  if (null_version)
+    old_obj.set_instance("null");
   rgw_bucket_dir_entry ent;
-  int rc = old_obj.get_bucket_dir_ent(dpp, ent);
+  int rc = old_obj.get_bucket_dir_ent(dpp, ent, y);
+  if (null_version)
+    old_obj.set_instance("");
   if (rc == 0) {
     ldpp_dout(dpp, 20) << __func__ << ": object exists." << dendl;
+    old_obj_exists = true;
+    old_obj_multipart = ent.meta.category == RGWObjCategory::MultiMeta;
+    old_obj_size = ent.meta.size;
   }
 
-  rc = m0_bufvec_empty_alloc(&buf, MAX_BUFVEC_NR) ?:
-           m0_bufvec_alloc(&attr, MAX_BUFVEC_NR, 1) ?:
-           m0_indexvec_alloc(&ext, MAX_BUFVEC_NR);
-  if (rc != 0)
-    this->cleanup();
+  // With the object size known, the object gets the layout for it right
+  // away, and its data goes out in blocks of the optimal size as soon as
+  // they are received.
+  if (size_hint > inline_max) {
+    rc = create_obj(size_hint);
+    if (rc < 0)
+      return rc;
+    acc_max = obj.get_optimal_bs(std::min<uint64_t>(size_hint, MAX_ACC_SIZE));
+    ldpp_dout(dpp, 20) << __func__ << ": size_hint=" << size_hint
+                       << " acc_max=" << acc_max << dendl;
+  }
+
+  return 0;
+}
 
+int MotrAtomicWriter::create_obj(uint64_t sz)
+{
+  int rc = obj.create_mobj(dpp, sz, y);
+  if (rc == 0) {
+    // Have the GC delete the object if the upload never completes.
+    string tenant_bkt_name = get_bucket_name(obj.get_bucket()->get_tenant(),
+                                             obj.get_bucket()->get_name());
+    rc = store->get_gc()->enqueue_orphan(dpp, obj.meta,
+                                         "motr.rgw.bucket.index." + tenant_bkt_name,
+                                         obj.get_key().to_str(), false, gc_tag, y);
+  } else if (rc == -EEXIST) {
+    rc = obj.open_mobj(dpp, y);
+  }
+  if (rc != 0) {
+    char fid_str[M0_FID_STR_LEN];
+    snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&obj.meta.oid));
+    ldpp_dout(dpp, 0) << "ERROR: failed to create/open motr object "
+                      << fid_str << " (" << obj.get_bucket()->get_name()
+                      << "/" << obj.get_key().to_str() << "): rc=" << rc
+                      << dendl;
+  }
   return rc;
 }
 
-int MotrObject::create_mobj(const DoutPrefixProvider *dpp, uint64_t sz)
+int MotrObject::create_mobj(const DoutPrefixProvider *dpp, uint64_t sz, optional_yield y)
 {
   if (mobj != nullptr) {
     ldpp_dout(dpp, 0) <<__func__<< "ERROR: object is already opened" << dendl;
@@ -1703,11 +3291,7 @@ int MotrObject::create_mobj(const DoutPrefixProvider *dpp, uint64_t sz)
     return rc;
   }
   ldpp_dout(dpp, 20) <<__func__<< ": call m0_op_launch()..." << dendl;
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(store->cctx, op, y);
 
   if (rc != 0) {
     this->close_mobj();
@@ -1717,16 +3301,36 @@ int MotrObject::create_mobj(const DoutPrefixProvider *dpp, uint64_t sz)
 
   meta.layout_id = mobj->ob_attr.oa_layout_id;
   meta.pver      = mobj->ob_attr.oa_pver;
+  unit_sz = grp_sz = max_bs = 0;
   ldpp_dout(dpp, 20) <<__func__<< ": lid=0x" << std::hex << meta.layout_id
                      << std::dec << " rc=" << rc << dendl;
 
-  // TODO: add key:user+bucket+key+obj.meta.oid value:timestamp to
-  // gc.queue.index. See more at github.com/Seagate/cortx-rgw/issues/7.
+  // Callers register the new object with the GC until it gets linked,
+  // see MotrGC::enqueue_orphan().
+
+  return rc;
+}
+
+int MotrObject::init_open_op(const DoutPrefixProvider *dpp, struct m0_op **op)
+{
+  M0_ASSERT(mobj == nullptr);
+  mobj = new m0_obj();
+  memset(mobj, 0, sizeof *mobj);
+  m0_obj_init(mobj, &store->container.co_realm, &meta.oid, store->conf.mc_layout_id);
 
+  mobj->ob_attr.oa_layout_id = meta.layout_id;
+  mobj->ob_attr.oa_pver      = meta.pver;
+  unit_sz = grp_sz = max_bs = 0;
+  mobj->ob_entity.en_flags  |= M0_ENF_META;
+  int rc = m0_entity_open(&mobj->ob_entity, op);
+  if (rc != 0) {
+    ldpp_dout(dpp, 0) << "ERROR: m0_entity_open() failed: rc=" << rc << dendl;
+    this->close_mobj();
+  }
   return rc;
 }
 
-int MotrObject::open_mobj(const DoutPrefixProvider *dpp)
+int MotrObject::open_mobj(const DoutPrefixProvider *dpp, optional_yield y)
 {
   char fid_str[M0_FID_STR_LEN];
   snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&meta.oid));
@@ -1735,7 +3339,7 @@ int MotrObject::open_mobj(const DoutPrefixProvider *dpp)
   int rc;
   if (meta.layout_id == 0) {
     rgw_bucket_dir_entry ent;
-    rc = this->get_bucket_dir_ent(dpp, ent);
+    rc = this->get_bucket_dir_ent(dpp, ent, y);
     if (rc < 0) {
       ldpp_dout(dpp, 0) << "ERROR: open_mobj() failed: rc=" << rc << dendl;
       return rc;
@@ -1745,26 +3349,11 @@ int MotrObject::open_mobj(const DoutPrefixProvider *dpp)
   if (meta.layout_id == 0)
     return -ENOENT;
 
-  M0_ASSERT(mobj == nullptr);
-  mobj = new m0_obj();
-  memset(mobj, 0, sizeof *mobj);
-  m0_obj_init(mobj, &store->container.co_realm, &meta.oid, store->conf.mc_layout_id);
-
   struct m0_op *op = nullptr;
-  mobj->ob_attr.oa_layout_id = meta.layout_id;
-  mobj->ob_attr.oa_pver      = meta.pver;
-  mobj->ob_entity.en_flags  |= M0_ENF_META;
-  rc = m0_entity_open(&mobj->ob_entity, &op);
-  if (rc != 0) {
-    ldpp_dout(dpp, 0) << "ERROR: m0_entity_open() failed: rc=" << rc << dendl;
-    this->close_mobj();
+  rc = init_open_op(dpp, &op);
+  if (rc != 0)
     return rc;
-  }
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(store->cctx, op, y);
 
   if (rc < 0) {
     ldpp_dout(dpp, 10) << "ERROR: failed to open motr object: rc=" << rc << dendl;
@@ -1777,7 +3366,7 @@ int MotrObject::open_mobj(const DoutPrefixProvider *dpp)
   return 0;
 }
 
-int MotrObject::delete_mobj(const DoutPrefixProvider *dpp)
+int MotrObject::delete_mobj(const DoutPrefixProvider *dpp, optional_yield y)
 {
   int rc;
   char fid_str[M0_FID_STR_LEN];
@@ -1790,7 +3379,7 @@ int MotrObject::delete_mobj(const DoutPrefixProvider *dpp)
 
   // Open the object.
   if (mobj == nullptr) {
-    rc = this->open_mobj(dpp);
+    rc = this->open_mobj(dpp, y);
     if (rc < 0)
       return rc;
   }
@@ -1803,11 +3392,7 @@ int MotrObject::delete_mobj(const DoutPrefixProvider *dpp)
     ldpp_dout(dpp, 0) << "ERROR: m0_entity_delete() failed: " << rc << dendl;
     return rc;
   }
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(store->cctx, op, y);
 
   if (rc < 0) {
     ldpp_dout(dpp, 0) << "ERROR: failed to open motr object: " << rc << dendl;
@@ -1815,10 +3400,22 @@ int MotrObject::delete_mobj(const DoutPrefixProvider *dpp)
   }
 
   this->close_mobj();
+  if (auto cache = store->get_data_cache(); cache != nullptr)
+    cache->invalidate(cache_chunk_prefix());
 
   return 0;
 }
 
+// The blocks of an object are cached as "motr.<fid>.<layout id>.<offset>".
+// A fid is not reused: the data of an overwritten object is in a new Motr
+// object, the blocks of the old one are dropped when it is deleted.
+std::string MotrObject::cache_chunk_prefix() const
+{
+  char fid_str[M0_FID_STR_LEN];
+  snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&meta.oid));
+  return string("motr.") + fid_str + ".";
+}
+
 void MotrObject::close_mobj()
 {
   if (mobj == nullptr)
@@ -1827,80 +3424,171 @@ void MotrObject::close_mobj()
   delete mobj; mobj = nullptr;
 }
 
-int MotrObject::write_mobj(const DoutPrefixProvider *dpp, bufferlist&& data, uint64_t offset)
+// Write `data` at `offset` of the object in blocks of the optimal size. The
+// writes are launched through `wpipe` and may still be in flight on return;
+// without `wpipe` they are complete when the function returns.
+int MotrObject::write_mobj(const DoutPrefixProvider *dpp, bufferlist&& data, uint64_t offset,
+                           MotrWritePipeline *wpipe, optional_yield y)
 {
-  int rc;
+  int rc = 0;
   unsigned bs, left;
-  struct m0_op *op;
-  char *start, *p;
-  struct m0_bufvec buf;
-  struct m0_bufvec attr;
-  struct m0_indexvec ext;
+  std::optional<MotrWritePipeline> local_wpipe;
 
   left = data.length();
   if (left == 0)
     return 0;
 
-  rc = m0_bufvec_empty_alloc(&buf, 1) ?:
-       m0_bufvec_alloc(&attr, 1, 1) ?:
-       m0_indexvec_alloc(&ext, 1);
-  if (rc != 0)
-    goto out;
+  if (wpipe == nullptr)
+    wpipe = &local_wpipe.emplace(store);
 
   bs = this->get_optimal_bs(left);
   ldpp_dout(dpp, 20) <<__func__<< ": left=" << left << " bs=" << bs << dendl;
 
-  start = data.c_str();
-
-  for (p = start; left > 0; left -= bs, p += bs, offset += bs) {
+  while (left > 0) {
     if (left < bs)
       bs = this->get_optimal_bs(left);
     if (left < bs) {
       data.append_zero(bs - left);
       left = bs;
-      p = data.c_str();
     }
-    buf.ov_buf[0] = p;
+    bufferlist chunk;
+    data.splice(0, bs, &chunk);
+    rc = wpipe->write(dpp, this, std::move(chunk), offset, y);
+    if (rc != 0)
+      break;
+    left -= bs;
+    offset += bs;
+  }
+
+  if (local_wpipe) {
+    int drc = local_wpipe->drain(dpp, y);
+    if (rc == 0)
+      rc = drc;
+  }
+  return rc;
+}
+
+// One block read of the read-ahead window in read_mobj().
+struct MotrReadReq {
+  bufferlist bl;
+  struct m0_bufvec buf = {};
+  struct m0_bufvec attr = {};
+  struct m0_indexvec ext = {};
+  struct m0_op *op = nullptr;
+  MotrOpWaiter waiter;
+  CephContext *cct;
+  unsigned bloff = 0;  // offset of the requested data in the block
+  unsigned len = 0;    // length of the requested data in the block
+  uint64_t off = 0;    // offset of the block in the object
+  unsigned bs = 0;     // size of the block
+  unsigned actual = 0; // length of the object data in the block
+  // Name of the block in the data cache, if it may be cached, and whether
+  // it is read from there.
+  std::string cache_key;
+  bool cached = false;
+
+  explicit MotrReadReq(CephContext *_cct) : cct(_cct) {}
+
+  // Read the block from the data cache file `path`.
+  int read_cache(const DoutPrefixProvider *dpp, const std::string& path,
+                 optional_yield y)
+  {
+    if (y) {
+      boost::system::error_code ec;
+      D3nL1CacheRequest creq;
+      bl = creq.async_read(dpp, y.get_io_context(), path, 0, actual,
+                           y.get_yield_context()[ec]);
+      return -ec.value();
+    }
+    int fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY|O_CLOEXEC));
+    if (fd < 0)
+      return -errno;
+    bufferptr bp(actual);
+    int rc = safe_pread_exact(fd, bp.c_str(), actual, 0);
+    ::close(fd);
+    if (rc < 0)
+      return rc;
+    bl.append(std::move(bp));
+    return 0;
+  }
+
+  int launch(struct m0_obj *mobj, uint64_t off, unsigned bs)
+  {
+    int rc = m0_bufvec_empty_alloc(&buf, 1) ? :
+             m0_bufvec_alloc(&attr, 1, 1) ? :
+             m0_indexvec_alloc(&ext, 1);
+    if (rc != 0)
+      return rc;
+
+    buf.ov_buf[0] = bl.append_hole(bs).c_str();
     buf.ov_vec.v_count[0] = bs;
-    ext.iv_index[0] = offset;
+    ext.iv_index[0] = off;
     ext.iv_vec.v_count[0] = bs;
     attr.ov_vec.v_count[0] = 0;
 
-    op = nullptr;
-    rc = m0_obj_op(this->mobj, M0_OC_WRITE, &ext, &buf, &attr, 0, 0, &op);
+    rc = m0_obj_op(mobj, M0_OC_READ, &ext, &buf, &attr, 0, 0, &op);
     if (rc != 0)
-      goto out;
+      return rc;
+    waiter.setup(op, bs);
     m0_op_launch(&op, 1);
-    rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-         m0_rc(op);
+    return 0;
+  }
+
+  int wait(optional_yield y)
+  {
+    int rc = waiter.wait(cct, op, y);
     m0_op_fini(op);
     m0_op_free(op);
-    if (rc != 0)
-      goto out;
+    op = nullptr;
+    return rc;
   }
 
-out:
-  m0_indexvec_free(&ext);
-  m0_bufvec_free(&attr);
-  m0_bufvec_free2(&buf);
-  return rc;
-}
+  // Abort a read which is not needed any more. Motr must be done with
+  // the buffer before it can be released.
+  void cancel()
+  {
+    if (op == nullptr)
+      return;
+    m0_op_cancel(&op, 1);
+    wait(null_yield);
+  }
+
+  ~MotrReadReq()
+  {
+    m0_indexvec_free(&ext);
+    m0_bufvec_free(&attr);
+    m0_bufvec_free2(&buf);
+  }
+};
 
-int MotrObject::read_mobj(const DoutPrefixProvider* dpp, int64_t off, int64_t end, RGWGetDataCB* cb)
+// Read the object data from `off` to `end` (inclusive) and pass it to `cb`.
+//
+// The data is read in blocks of the optimal size for the object's layout.
+// Up to motr_read_ahead_depth block reads are kept in flight: while the
+// oldest block is being processed by `cb` (and sent to the client), the
+// following ones are being read from Motr. Blocks are always handed to
+// `cb` in order. If `cb` fails (client disconnected, for example) or a read
+// fails, the reads still in flight are cancelled.
+int MotrObject::read_mobj(const DoutPrefixProvider* dpp, int64_t off, int64_t end, RGWGetDataCB* cb,
+                          optional_yield y)
 {
-  int rc;
+  int rc = 0;
   unsigned bs, actual, left, start, bloff, block_start_off;
-  struct m0_op *op;
-  struct m0_bufvec buf;
-  struct m0_bufvec attr;
-  struct m0_indexvec ext;
+  std::deque<std::unique_ptr<MotrReadReq>> reqs;
+  const unsigned depth = store->cctx->_conf.get_val<uint64_t>("motr_read_ahead_depth");
+  // The blocks up to rgw_get_obj_max_req_size go through the data cache.
+  D3nDataCache *cache = store->get_data_cache();
+  const uint64_t cache_max = store->cctx->_conf->rgw_get_obj_max_req_size;
+  string cache_prefix;
+  if (cache != nullptr)
+    cache_prefix = cache_chunk_prefix() + std::to_string(meta.layout_id) + ".";
 
   start = off;
   // make end pointer exclusive:
   // it's easier to work with it this way
   end++;
   ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): off=" << off <<
-                       " end=" << end << dendl;
+                       " end=" << end << " depth=" << depth << dendl;
   off = 0;
   // As `off` may not be parity group size aligned, even using optimal
   // buffer block size, simply reading data from offset `off` could come
@@ -1916,234 +3604,415 @@ int MotrObject::read_mobj(const DoutPrefixProvider* dpp, int64_t off, int64_t en
   bloff = 1;
   ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): bs=" << bs << dendl;
 
-  rc = m0_bufvec_empty_alloc(&buf, 1) ? :
-       m0_bufvec_alloc(&attr, 1, 1) ? :
-       m0_indexvec_alloc(&ext, 1);
-  if (rc < 0)
-    goto out;
-
   left = end - off;
-  for (; left > 0; off += actual) {
-    if (left < bs)
-      bs = this->get_optimal_bs(left);
-    actual = bs;
-    if (left < bs)
-      actual = left;
-    ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): off=" << off <<
-                                            " actual=" << actual << dendl;
-    bufferlist bl;
-    buf.ov_buf[0] = bl.append_hole(bs).c_str();
-    buf.ov_vec.v_count[0] = bs;
-    ext.iv_index[0] = off;
-    ext.iv_vec.v_count[0] = bs;
-    attr.ov_vec.v_count[0] = 0;
-
-    left -= actual;
-    // Read from Motr.
-    op = nullptr;
-    if( start >= ( block_start_off + bs )) 
-    {
-	block_start_off += bs;
-	ldpp_dout(dpp, 70) << "MotrObject::read_mobj(): block_start_off=" << block_start_off <<dendl;
-	continue;
-    }
-    if( bloff != 0 )
-	bloff = start - block_start_off;
-
-    rc = m0_obj_op(this->mobj, M0_OC_READ, &ext, &buf, &attr, 0, 0, &op);
-    ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): init read op rc=" << rc << dendl;
-    if (rc != 0) {
-      ldpp_dout(dpp, 0) << __func__ << ": read failed during m0_obj_op, rc=" << rc << dendl;
-      goto out;
+  while (left > 0 || !reqs.empty()) {
+    // Fill up the read-ahead window.
+    while (left > 0 && reqs.size() < depth) {
+      if (left < bs)
+        bs = this->get_optimal_bs(left);
+      actual = bs;
+      if (left < bs)
+        actual = left;
+      left -= actual;
+      uint64_t block_off = off;
+      off += actual;
+
+      // Skip the blocks before `start`.
+      if( start >= ( block_start_off + bs )) 
+      {
+        block_start_off += bs;
+        ldpp_dout(dpp, 70) << "MotrObject::read_mobj(): block_start_off=" << block_start_off <<dendl;
+        continue;
+      }
+      if( bloff != 0 )
+        bloff = start - block_start_off;
+
+      ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): off=" << block_off <<
+                                              " actual=" << actual << dendl;
+      auto req = std::make_unique<MotrReadReq>(store->cctx);
+      req->bloff = bloff;
+      req->len = actual - bloff;
+      req->off = block_off;
+      req->bs = bs;
+      req->actual = actual;
+      bloff = 0;
+      if (cache != nullptr && actual <= cache_max) {
+        req->cache_key = cache_prefix + std::to_string(block_off);
+        if (cache->get(req->cache_key, actual)) {
+          // Read when its turn comes, the cache is faster than Motr.
+          req->cached = true;
+          reqs.push_back(std::move(req));
+          continue;
+        }
+      }
+      rc = req->launch(this->mobj, block_off, bs);
+      ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): init read op rc=" << rc << dendl;
+      if (rc != 0) {
+        ldpp_dout(dpp, 0) << __func__ << ": read failed during m0_obj_op, rc=" << rc << dendl;
+        goto out;
+      }
+      reqs.push_back(std::move(req));
     }
-    m0_op_launch(&op, 1);
-    rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-         m0_rc(op);
-    m0_op_fini(op);
-    m0_op_free(op);
-    if (rc != 0) {
-      ldpp_dout(dpp, 0) << __func__ << ": read failed, m0_op_wait rc=" << rc << dendl;
-      goto out;
+
+    if (reqs.empty())
+      break;
+
+    // Wait for the oldest block and pass it on.
+    std::unique_ptr<MotrReadReq> req = std::move(reqs.front());
+    reqs.pop_front();
+    if (req->cached) {
+      rc = req->read_cache(dpp, cache->cache_location + req->cache_key, y);
+      if (rc != 0) {
+        // Evicted in the meantime, read it from Motr.
+        ldpp_dout(dpp, 10) << __func__ << ": failed to read " << req->cache_key
+                           << " from the cache, rc=" << rc << dendl;
+        req->bl.clear();
+        req->cached = false;
+        rc = req->launch(this->mobj, req->off, req->bs);
+        if (rc != 0) {
+          ldpp_dout(dpp, 0) << __func__ << ": read failed during m0_obj_op, rc=" << rc << dendl;
+          goto out;
+        }
+      }
+    }
+    if (!req->cached) {
+      rc = req->wait(y);
+      if (rc != 0) {
+        ldpp_dout(dpp, 0) << __func__ << ": read failed, m0_op_wait rc=" << rc << dendl;
+        goto out;
+      }
+      if (!req->cache_key.empty()) {
+        // Written to the cache asynchronously.
+        bufferlist chunk;
+        chunk.substr_of(req->bl, 0, req->actual);
+        cache->put(chunk, req->actual, req->cache_key);
+      }
     }
     // Call `cb` to process returned data.
     ldpp_dout(dpp, 20) << "MotrObject::read_mobj(): call cb to process data" << dendl;
-    cb->handle_data(bl, bloff, actual);
-    bloff = 0;
+    rc = cb->handle_data(req->bl, req->bloff, req->len);
+    if (rc < 0) {
+      ldpp_dout(dpp, 10) << __func__ << ": cb->handle_data() failed, rc=" << rc << dendl;
+      goto out;
+    }
+    rc = 0;
   }
 
 out:
-  m0_indexvec_free(&ext);
-  m0_bufvec_free(&attr);
-  m0_bufvec_free2(&buf);
-  this->close_mobj();
+  // The object is left open for the next reads, ranged reads of the same
+  // ReadOp in particular; it is closed with the MotrObject.
+  for (auto& req : reqs)
+    req->cancel();
 
   return rc;
 }
 
-int MotrObject::get_bucket_dir_ent(const DoutPrefixProvider *dpp, rgw_bucket_dir_entry& ent)
+int MotrObject::get_bucket_dir_ent_bl(const DoutPrefixProvider *dpp, bufferlist& bl,
+                                      optional_yield y)
 {
-  int rc = 0;
+  int rc;
   string tenant_bkt_name = get_bucket_name(this->get_bucket()->get_tenant(), this->get_bucket()->get_name());
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-  int max = 1000;
-  vector<string> keys(max);
-  vector<bufferlist> vals(max);
-  bufferlist bl;
-  bufferlist::const_iterator iter;
-
-  if (this->get_bucket()->get_info().versioning_status() == BUCKET_VERSIONED ||
-      this->get_bucket()->get_info().versioning_status() == BUCKET_SUSPENDED) {
+  const rgw_obj_key& key = this->get_key();
 
-    rgw_bucket_dir_entry ent_to_check;
+  // The null version is the entry keyed by the bare name. It is not cached,
+  // in a versioned bucket the name caches the current version.
+  if (key.have_null_instance())
+    return this->store->do_idx_op_by_name(bucket_index_iname,
+                                          M0_IC_GET, key.name, bl, true, y);
 
-    if (this->store->get_obj_meta_cache()->get(dpp, this->get_name(), bl) == 0) {
-      iter = bl.cbegin();
-      ent_to_check.decode(iter);
-      if (ent_to_check.is_current()) {
-        ent = ent_to_check;
-        rc = 0;
-        goto out;
-      }
-    }
+  string cache_key = key.to_str();
+  if (this->store->get_obj_meta_cache()->get(dpp, cache_key, bl) == 0)
+    return 0;
 
+  if (this->get_bucket()->get_info().versioned() && !key.have_instance()) {
     ldpp_dout(dpp, 20) <<__func__<< ": versioned bucket!" << dendl;
-    keys[0] = this->get_name();
-    rc = store->next_query_by_name(bucket_index_iname, keys, vals);
-    if (rc < 0) {
-      ldpp_dout(dpp, 0) << __func__ << "ERROR: NEXT query failed. " << rc << dendl;
-      return rc;
-    }
+    string latest_iname = "motr.rgw.bucket." + tenant_bkt_name + RGW_MOTR_LATEST_IDX_SUFFIX;
+    rc = this->store->do_idx_op_by_name(latest_iname, M0_IC_GET, key.name, bl, true, y);
+    // No current version was recorded for an object put before the
+    // versioning got enabled: its entry is the null version.
+    if (rc == -ENOENT)
+      rc = this->store->do_idx_op_by_name(bucket_index_iname,
+                                          M0_IC_GET, key.name, bl, true, y);
+  } else {
+    rc = this->store->do_idx_op_by_name(bucket_index_iname,
+                                        M0_IC_GET, cache_key, bl, true, y);
+  }
+  if (rc < 0)
+    return rc;
 
-    rc = -ENOENT;
-    for (const auto& bl: vals) {
-      if (bl.length() == 0)
-        break;
+  this->store->get_obj_meta_cache()->fill(dpp, cache_key, bl);
+  return 0;
+}
 
-      iter = bl.cbegin();
-      ent_to_check.decode(iter);
-      if (ent_to_check.is_current()) {
-        ldpp_dout(dpp, 20) <<__func__<< ": found current version!" << dendl;
-        ent = ent_to_check;
-        rc = 0;
+int MotrObject::get_bucket_dir_ent(const DoutPrefixProvider *dpp, rgw_bucket_dir_entry& ent,
+                                   optional_yield y, Attrs *pattrs)
+{
+  bufferlist bl;
+  int rc = this->get_bucket_dir_ent_bl(dpp, bl, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, rc == -ENOENT ? 20 : 0) << __func__ << ": failed to get object's entry "
+                                          << "from bucket index: rc=" << rc << dendl;
+    return rc;
+  }
 
-        this->store->get_obj_meta_cache()->put(dpp, this->get_name(), bl);
+  auto iter = bl.cbegin();
+  ent.decode(iter);
+  if (ent.is_delete_marker() && !this->have_instance())
+    return -ENOENT;
+  sal::Attrs dummy;
+  decode(pattrs ? *pattrs : dummy, iter);
+  meta.decode(iter);
+  ldpp_dout(dpp, 20) <<__func__<< ": lid=0x" << std::hex << meta.layout_id << dendl;
+  char fid_str[M0_FID_STR_LEN];
+  snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&meta.oid));
+  ldpp_dout(dpp, 70) << __func__ << ": oid=" << fid_str << dendl;
 
-        break;
-      }
-    }
-  } else {
-    if (this->store->get_obj_meta_cache()->get(dpp, this->get_key().to_str(), bl)) {
-      ldpp_dout(dpp, 20) <<__func__<< ": non-versioned bucket!" << dendl;
-      rc = this->store->do_idx_op_by_name(bucket_index_iname,
-                                          M0_IC_GET, this->get_key().to_str(), bl);
-      if (rc < 0) {
-        ldpp_dout(dpp, 0) << __func__ << "ERROR: failed to get object's entry from bucket index: rc="
-                          << rc << dendl;
-        return rc;
-      }
-      this->store->get_obj_meta_cache()->put(dpp, this->get_key().to_str(), bl);
-    }
+  return 0;
+}
 
-    bufferlist& blr = bl;
-    iter = blr.cbegin();
-    ent.decode(iter);
-  }
+static string motr_ent_idx_key(const rgw_bucket_dir_entry& ent)
+{
+  return rgw_obj_key(ent.key.name, ent.key.instance).to_str();
+}
 
-out:
-  if (rc == 0) {
-    sal::Attrs dummy;
-    decode(dummy, iter);
-    meta.decode(iter);
-    ldpp_dout(dpp, 20) <<__func__<< ": lid=0x" << std::hex << meta.layout_id << dendl;
-    char fid_str[M0_FID_STR_LEN];
-    snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&meta.oid));
-    ldpp_dout(dpp, 70) << __func__ << ": oid=" << fid_str << dendl;
-  } else
-    ldpp_dout(dpp, 0) <<__func__<< ": rc=" << rc << dendl;
+// Set or clear the CURRENT flag of the version `key` in the bucket index.
+// The rest of the value is kept as it is.
+static int motr_set_current_flag(const DoutPrefixProvider *dpp, MotrStore *store,
+                                 const string& bucket_index_iname, const string& key,
+                                 bool current, bufferlist *pbl, optional_yield y)
+{
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(bucket_index_iname, M0_IC_GET, key, bl, true, y);
+  if (rc == -ENOENT)
+    return 0; // the version is gone, don't bring it back
+  if (rc < 0)
+    return rc;
 
-  return rc;
+  rgw_bucket_dir_entry ent;
+  auto iter = bl.cbegin();
+  ent.decode(iter);
+  uint16_t flags = ent.flags | rgw_bucket_dir_entry::FLAG_VER;
+  if (current)
+    flags |= rgw_bucket_dir_entry::FLAG_CURRENT;
+  else
+    flags &= ~rgw_bucket_dir_entry::FLAG_CURRENT;
+  if (flags == ent.flags && !pbl)
+    return 0;
+  ent.flags = flags;
+
+  bufferlist upd_bl, rest;
+  ent.encode(upd_bl);
+  iter.copy(iter.get_remaining(), rest);
+  upd_bl.claim_append(rest);
+  rc = store->do_idx_op_by_name(bucket_index_iname, M0_IC_PUT, key, upd_bl, true, y);
+  if (rc < 0)
+    return rc;
+  store->get_obj_meta_cache()->put(dpp, key, upd_bl);
+  if (pbl)
+    *pbl = std::move(upd_bl);
+  return 0;
 }
 
-int MotrObject::update_version_entries(const DoutPrefixProvider *dpp)
+// The latest index gets the new current version once it is linked in the
+// bucket index, and the version it replaces loses its CURRENT flag last: a
+// reader always finds the old or the new current version. Of two
+// concurrent puts of an object, the one whose latest index update lands
+// last wins, the other drops its own CURRENT flag when it sees it lost.
+int MotrObject::set_latest_version(const DoutPrefixProvider *dpp, const rgw_bucket_dir_entry& ent,
+                                   bufferlist& bl, optional_yield y)
 {
-  int rc;
-  int max = 10;
-  vector<string> keys(max);
-  vector<bufferlist> vals(max);
   string tenant_bkt_name = get_bucket_name(this->get_bucket()->get_tenant(), this->get_bucket()->get_name());
-
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
-  keys[0] = this->get_name();
-  rc = store->next_query_by_name(bucket_index_iname, keys, vals);
-  ldpp_dout(dpp, 20) << "get all versions, name = " << this->get_name() << "rc = " << rc << dendl;
-  if (rc < 0) {
-    ldpp_dout(dpp, 0) << "ERROR: NEXT query failed. " << rc << dendl;
+  string latest_iname = "motr.rgw.bucket." + tenant_bkt_name + RGW_MOTR_LATEST_IDX_SUFFIX;
+  const string& name = ent.key.name;
+  string key = motr_ent_idx_key(ent);
+
+  // The version replaced: the recorded one, or the null version of an
+  // object put before the versioning got enabled.
+  bufferlist old_bl;
+  string old_key = name;
+  int rc = store->do_idx_op_by_name(latest_iname, M0_IC_GET, name, old_bl, true, y);
+  if (rc < 0 && rc != -ENOENT)
     return rc;
+  if (rc == 0) {
+    rgw_bucket_dir_entry old_ent;
+    auto iter = old_bl.cbegin();
+    old_ent.decode(iter);
+    old_key = motr_ent_idx_key(old_ent);
   }
 
-  // no entries returned.
-  if (rc == 0)
-    return 0;
-
-  for (const auto& bl: vals) {
-    if (bl.length() == 0)
-      break;
-
-    rgw_bucket_dir_entry ent;
-    auto iter = bl.cbegin();
-    ent.decode(iter);
+  rc = store->do_idx_op_by_name(latest_iname, M0_IC_PUT, name, bl, true, y);
+  if (rc == -ENOENT) {
+    // A bucket created before the latest index existed.
+    rc = store->create_motr_idx_by_name(latest_iname, y);
+    if (rc == 0 || rc == -EEXIST)
+      rc = store->do_idx_op_by_name(latest_iname, M0_IC_PUT, name, bl, true, y);
+  }
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to set the current version of " << name
+                      << ": rc=" << rc << dendl;
+    return rc;
+  }
+  store->get_obj_meta_cache()->put(dpp, name, bl);
 
-    if (0 != ent.key.name.compare(0, this->get_name().size(), this->get_name()))
-      continue;
+  if (old_key != key) {
+    rc = motr_set_current_flag(dpp, store, bucket_index_iname, old_key, false, nullptr, y);
+    if (rc < 0)
+      return rc;
+  }
 
-    if (!ent.is_current())
-      continue;
+  // Check that no concurrent put replaced this version in the meantime.
+  bufferlist cur_bl;
+  rc = store->do_idx_op_by_name(latest_iname, M0_IC_GET, name, cur_bl, true, y);
+  if (rc < 0)
+    return rc == -ENOENT ? 0 : rc;
+  rgw_bucket_dir_entry cur_ent;
+  auto iter = cur_bl.cbegin();
+  cur_ent.decode(iter);
+  if (motr_ent_idx_key(cur_ent) != key) {
+    ldpp_dout(dpp, 10) << __func__ << ": " << key << " was replaced by "
+                       << motr_ent_idx_key(cur_ent) << dendl;
+    return motr_set_current_flag(dpp, store, bucket_index_iname, key, false, nullptr, y);
+  }
+  return 0;
+}
 
-    // Remove from the cache.
-    store->get_obj_meta_cache()->remove(dpp, this->get_name());
+// Only unlinking the current version has the versions of the object
+// scanned, for the newest one left.
+int MotrObject::reset_latest_version(const DoutPrefixProvider *dpp, const rgw_obj_key& key,
+                                     optional_yield y)
+{
+  string tenant_bkt_name = get_bucket_name(this->get_bucket()->get_tenant(), this->get_bucket()->get_name());
+  string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
+  string latest_iname = "motr.rgw.bucket." + tenant_bkt_name + RGW_MOTR_LATEST_IDX_SUFFIX;
+  const string& name = key.name;
 
-    rgw::sal::Attrs attrs;
-    decode(attrs, iter);
-    MotrObject::Meta meta;
-    meta.decode(iter);
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(latest_iname, M0_IC_GET, name, bl, true, y);
+  if (rc == -ENOENT)
+    return 0;
+  if (rc < 0)
+    return rc;
+  rgw_bucket_dir_entry cur_ent;
+  auto iter = bl.cbegin();
+  cur_ent.decode(iter);
+  if (motr_ent_idx_key(cur_ent) != key.to_str())
+    return 0;
 
-    ent.flags = rgw_bucket_dir_entry::FLAG_VER;
-    string key;
-    if (ent.key.instance.empty())
-      key = ent.key.name;
-    else {
-      char buf[ent.key.name.size() + ent.key.instance.size() + 16];
-      snprintf(buf, sizeof(buf), "%s[%s]", ent.key.name.c_str(), ent.key.instance.c_str());
-      key = buf;
-    }
-    ldpp_dout(dpp, 20) << "update one version, key = " << key << dendl;
-    bufferlist ent_bl;
-    ent.encode(ent_bl);
-    encode(attrs, ent_bl);
-    meta.encode(ent_bl);
-
-    rc = store->do_idx_op_by_name(bucket_index_iname,
-                                  M0_IC_PUT, key, ent_bl);
+  // Keys of the versions of other objects may sort in between.
+  const int max = 1000;
+  string start = name;
+  string newest_key;
+  ceph::real_time newest_mtime;
+  bool found = false;
+  for (;;) {
+    vector<string> keys(max);
+    vector<bufferlist> vals(max);
+    keys[0] = start;
+    rc = store->next_query_by_name(bucket_index_iname, keys, vals, name, "", y);
     if (rc < 0)
+      return rc;
+    int n = rc;
+    for (int i = 0; i < n; i++) {
+      rgw_bucket_dir_entry ent;
+      auto viter = vals[i].cbegin();
+      ent.decode(viter);
+      if (ent.key.name != name)
+        continue;
+      if (!found || ent.meta.mtime >= newest_mtime) {
+        found = true;
+        newest_key = keys[i];
+        newest_mtime = ent.meta.mtime;
+      }
+    }
+    if (n < max)
       break;
+    start = keys[n - 1] + '\0';
   }
-  return rc;
+
+  if (!found) {
+    bufferlist dummy;
+    rc = store->do_idx_op_by_name(latest_iname, M0_IC_DEL, name, dummy, true, y);
+    store->get_obj_meta_cache()->remove(dpp, name);
+    return rc == -ENOENT ? 0 : rc;
+  }
+
+  ldpp_dout(dpp, 20) << __func__ << ": current version of " << name << " is " << newest_key << dendl;
+  bufferlist new_bl;
+  rc = motr_set_current_flag(dpp, store, bucket_index_iname, newest_key, true, &new_bl, y);
+  if (rc < 0 || new_bl.length() == 0)
+    return rc;
+  rc = store->do_idx_op_by_name(latest_iname, M0_IC_PUT, name, new_bl, true, y);
+  if (rc < 0)
+    return rc;
+  store->get_obj_meta_cache()->put(dpp, name, new_bl);
+  return 0;
 }
 
-// Scan object_nnn_part_index to get all parts then open their motr objects.
-// TODO: all parts are opened in the POC. But for a large object, for example
-// a 5GB object will have about 300 parts (for default 15MB part). A better
-// way of managing opened object may be needed.
-int MotrObject::get_part_objs(const DoutPrefixProvider* dpp,
-                              std::map<int, std::unique_ptr<MotrObject>>& part_objs)
+size_t MotrObject::PartMap::find(uint64_t off) const
 {
-  int rc;
+  auto iter = std::upper_bound(parts.begin(), parts.end(), off,
+                               [](uint64_t off, const Part& p) { return off < p.off; });
+  if (iter == parts.begin())
+    return parts.size();
+  --iter;
+  if (off >= iter->off + iter->size)
+    return parts.size();
+  return iter - parts.begin();
+}
+
+// Load the part map of the object from the metadata cache, or scan
+// object_nnn_part_index for it. The map is cached along with the object
+// entry it was built for, so that it is not used for a replaced object.
+int MotrObject::get_part_map(const DoutPrefixProvider* dpp,
+                             const rgw_bucket_dir_entry& ent,
+                             PartMap& map, optional_yield y)
+{
+  string tenant_bkt_name = get_bucket_name(this->get_bucket()->get_tenant(),
+                                           this->get_bucket()->get_name());
+  // "\xff" is not valid UTF-8, so the key can't clash with an object name.
+  string cache_key = "\xffparts/" + tenant_bkt_name + "/" + this->get_key().to_str();
+  bufferlist bl;
+  if (store->get_obj_meta_cache()->get(dpp, cache_key, bl) == 0) {
+    try {
+      auto iter = bl.cbegin();
+      map.decode(iter);
+      if (map.mtime == ent.meta.mtime && map.obj_size == ent.meta.size)
+        return 0;
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode cached part map" << dendl;
+    }
+  }
+
+  // The map stored by MotrMultipartUpload::complete().
+  string part_iname = "motr.rgw.object." + tenant_bkt_name + "." +
+                      this->get_name() + ".parts";
+  bl.clear();
+  int rc = store->do_idx_op_by_name(part_iname, M0_IC_GET,
+                                    RGW_MOTR_PART_MAP_KEY, bl, true, y);
+  if (rc == 0) {
+    try {
+      auto iter = bl.cbegin();
+      map.decode(iter);
+      if (map.mtime == ent.meta.mtime && map.obj_size == ent.meta.size) {
+        store->get_obj_meta_cache()->fill(dpp, cache_key, bl);
+        return 0;
+      }
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode part map of " << get_name() << dendl;
+    }
+  }
+
   int max_parts = 1000;
   int marker = 0;
   uint64_t off = 0;
   bool truncated = false;
   std::unique_ptr<rgw::sal::MultipartUpload> upload;
 
+  map.mtime = ent.meta.mtime;
+  map.obj_size = ent.meta.size;
+  map.parts.clear();
   upload = this->get_bucket()->get_multipart_upload(this->get_name(), string());
 
   do {
@@ -2154,91 +4023,121 @@ int MotrObject::get_part_objs(const DoutPrefixProvider* dpp,
     if (rc < 0)
       return rc;
 
-    std::map<uint32_t, std::unique_ptr<MultipartPart>>& parts = upload->get_parts();
-    for (auto part_iter = parts.begin(); part_iter != parts.end(); ++part_iter) {
-
-      MultipartPart *mpart = part_iter->second.get();
-      MotrMultipartPart *mmpart = static_cast<MotrMultipartPart *>(mpart);
-      uint32_t part_num = mmpart->get_num();
-      uint64_t part_size = mmpart->get_size();
-
-      string part_obj_name = this->get_bucket()->get_name() + "." +
- 	                     this->get_key().to_str() +
-	                     ".part." + std::to_string(part_num);
-      std::unique_ptr<rgw::sal::Object> obj;
-      obj = this->bucket->get_object(rgw_obj_key(part_obj_name));
-      std::unique_ptr<rgw::sal::MotrObject> mobj(static_cast<rgw::sal::MotrObject *>(obj.release()));
-
-      ldpp_dout(dpp, 20) << "get_part_objs: off = " << off << ", size = " << part_size << dendl;
-      mobj->part_off = off;
-      mobj->part_size = part_size;
-      mobj->part_num = part_num;
-      mobj->meta = mmpart->meta;
-
-      part_objs.emplace(part_num, std::move(mobj));
-
-      off += part_size;
+    std::map<uint32_t, std::unique_ptr<MultipartPart>>& mparts = upload->get_parts();
+    for (auto part_iter = mparts.begin(); part_iter != mparts.end(); ++part_iter) {
+      MotrMultipartPart *mmpart = static_cast<MotrMultipartPart *>(part_iter->second.get());
+      PartMap::Part part;
+      part.num = mmpart->get_num();
+      part.off = off;
+      part.size = mmpart->get_size();
+      part.meta = mmpart->meta;
+      ldpp_dout(dpp, 20) << "get_part_map: num = " << part.num << ", off = " << off
+                         << ", size = " << part.size << dendl;
+      off += part.size;
+      map.parts.push_back(std::move(part));
     }
+    mparts.clear();
   } while (truncated);
 
+  bl.clear();
+  map.encode(bl);
+  store->get_obj_meta_cache()->fill(dpp, cache_key, bl);
+
   return 0;
 }
 
-int MotrObject::open_part_objs(const DoutPrefixProvider* dpp,
-                               std::map<int, std::unique_ptr<MotrObject>>& part_objs)
+std::unique_ptr<MotrObject> MotrObject::get_part_obj(const PartMap::Part& part)
 {
-  //for (auto& iter: part_objs) {
-  for (auto iter = part_objs.begin(); iter != part_objs.end(); ++iter) {
-    MotrObject* obj = static_cast<MotrObject *>(iter->second.get());
-    ldpp_dout(dpp, 20) << "open_part_objs: name = " << obj->get_name() << dendl;
-    int rc = obj->open_mobj(dpp);
-    if (rc < 0)
-      return rc;
-  }
+  string part_obj_name = this->get_bucket()->get_name() + "." +
+                         this->get_key().to_str() +
+                         ".part." + std::to_string(part.num);
+  std::unique_ptr<rgw::sal::Object> obj;
+  obj = this->bucket->get_object(rgw_obj_key(part_obj_name));
+  std::unique_ptr<rgw::sal::MotrObject> mobj(static_cast<rgw::sal::MotrObject *>(obj.release()));
 
-  return 0;
+  mobj->part_off = part.off;
+  mobj->part_size = part.size;
+  mobj->part_num = part.num;
+  mobj->meta = part.meta;
+
+  return mobj;
 }
 
-int MotrObject::delete_part_objs(const DoutPrefixProvider* dpp)
+int MotrObject::delete_part_objs(const DoutPrefixProvider* dpp, optional_yield y)
 {
   std::unique_ptr<rgw::sal::MultipartUpload> upload;
   upload = this->get_bucket()->get_multipart_upload(this->get_name(), string());
   std::unique_ptr<rgw::sal::MotrMultipartUpload> mupload(static_cast<rgw::sal::MotrMultipartUpload *>(upload.release()));
-  return mupload->delete_parts(dpp);
+  return mupload->delete_parts(dpp, y);
+}
+
+// Launch the open of part `idx`.
+int MotrObject::MotrReadOp::open_part(const DoutPrefixProvider* dpp, size_t idx,
+                                      std::unique_ptr<PartOpen>& p)
+{
+  auto obj = source->get_part_obj(parts.parts[idx]);
+  ldpp_dout(dpp, 20) << "open_part: name = " << obj->get_name() << dendl;
+
+  struct m0_op *op = nullptr;
+  int rc = obj->init_open_op(dpp, &op);
+  if (rc < 0)
+    return rc;
+  p = std::make_unique<PartOpen>(idx, std::move(obj), source->store->ctx());
+  p->op = op;
+  p->waiter.setup(op);
+  m0_op_launch(&op, 1);
+
+  return 0;
 }
 
-int MotrObject::read_multipart_obj(const DoutPrefixProvider* dpp,
-                                   int64_t off, int64_t end, RGWGetDataCB* cb,
-				   std::map<int, std::unique_ptr<MotrObject>>& part_objs)
+int MotrObject::MotrReadOp::read_parts(const DoutPrefixProvider* dpp,
+                                       int64_t off, int64_t end, RGWGetDataCB* cb,
+                                       optional_yield y)
 {
   int64_t cursor = off;
+  int rc;
 
-  ldpp_dout(dpp, 20) << "read_multipart_obj: off=" << off << " end=" << end << dendl;
+  ldpp_dout(dpp, 20) << "read_parts: off=" << off << " end=" << end << dendl;
 
   // Find the parts which are in the (off, end) range and
   // read data from it. Note: `end` argument is inclusive.
-  for (auto iter = part_objs.begin(); iter != part_objs.end(); ++iter) {
-    MotrObject* obj = static_cast<MotrObject *>(iter->second.get());
-    int64_t part_off = obj->part_off;
-    int64_t part_size = obj->part_size;
-    int64_t part_end = obj->part_off + obj->part_size - 1;
-    ldpp_dout(dpp, 20) << "read_multipart_obj: part_off=" << part_off
-                                          << " part_end=" << part_end << dendl;
-    if (part_end < off)
-      continue;
+  for (size_t i = parts.find(off); i < parts.parts.size() && cursor <= end; i++) {
+    const PartMap::Part& part = parts.parts[i];
+    int64_t part_end = part.off + part.size - 1;
+
+    if (next_part && next_part->idx == i) {
+      cur_part = std::move(next_part);
+    } else if (!cur_part || cur_part->idx != i) {
+      cur_part.reset();
+      rc = open_part(dpp, i, cur_part);
+      if (rc < 0)
+        return rc;
+    }
+    rc = cur_part->wait(y);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to open part " << part.num << ": rc=" << rc << dendl;
+      cur_part.reset();
+      return rc;
+    }
+
+    // Open the next part while this one is read.
+    if (part_end < end && i + 1 < parts.parts.size() &&
+        (!next_part || next_part->idx != i + 1)) {
+      next_part.reset();
+      if (open_part(dpp, i + 1, next_part) < 0)
+        next_part.reset(); // retried when the read gets there
+    }
 
-    int64_t local_off = cursor - obj->part_off;
-    int64_t local_end = part_end < end? part_size - 1 : end - part_off;
-    ldpp_dout(dpp, 20) << "real_multipart_obj: name=" << obj->get_name()
-                                          << " local_off=" << local_off
-                                          << " local_end=" << local_end << dendl;
-    int rc = obj->read_mobj(dpp, local_off, local_end, cb);
+    int64_t local_off = cursor - part.off;
+    int64_t local_end = std::min(part_end, end) - part.off;
+    ldpp_dout(dpp, 20) << "read_parts: name=" << cur_part->obj->get_name()
+                       << " local_off=" << local_off
+                       << " local_end=" << local_end << dendl;
+    rc = cur_part->obj->read_mobj(dpp, local_off, local_end, cb, y);
     if (rc < 0)
-        return rc;
+      return rc;
 
     cursor = part_end + 1;
-    if (cursor > end)
-      break;
   }
 
   return 0;
@@ -2249,17 +4148,36 @@ static unsigned roundup(unsigned x, unsigned by)
   return ((x - 1) / by + 1) * by;
 }
 
-unsigned MotrObject::get_optimal_bs(unsigned len)
+int MotrStore::get_pool_width(const struct m0_fid& pver, MotrPoolWidth& width)
 {
-  struct m0_pool_version *pver;
+  auto key = std::make_pair(pver.f_container, pver.f_key);
+  std::lock_guard l{pver_lock};
+  auto it = pver_widths.find(key);
+  if (it != pver_widths.end()) {
+    width = it->second;
+    return 0;
+  }
+
+  struct m0_pool_version *pv = m0_pool_version_find(&instance->m0c_pools_common, &pver);
+  if (pv == nullptr)
+    return -ENOENT;
+  struct m0_pdclust_attr *pa = &pv->pv_attr;
+  width.N = pa->pa_N;
+  width.K = pa->pa_K;
+  width.S = pa->pa_S;
+  width.P = pa->pa_P;
+  pver_widths.emplace(key, width);
+  return 0;
+}
 
-  pver = m0_pool_version_find(&store->instance->m0c_pools_common,
-                              &mobj->ob_attr.oa_pver);
-  M0_ASSERT(pver != nullptr);
-  struct m0_pdclust_attr *pa = &pver->pv_attr;
+void MotrObject::init_layout_geom()
+{
+  MotrPoolWidth pw;
+  int rc = store->get_pool_width(meta.pver, pw);
+  M0_ASSERT(rc == 0);
   uint64_t lid = M0_OBJ_LAYOUT_ID(meta.layout_id);
-  unsigned unit_sz = m0_obj_layout_id_to_unit_size(lid);
-  unsigned grp_sz  = unit_sz * pa->pa_N;
+  unit_sz = m0_obj_layout_id_to_unit_size(lid);
+  grp_sz  = unit_sz * pw.N;
 
   // bs should be max 4-times pool-width deep counting by 1MB units, or
   // 8-times deep counting by 512K units, 16-times deep by 256K units,
@@ -2273,9 +4191,24 @@ unsigned MotrObject::get_optimal_bs(unsigned len)
   if (depth == 0)
     depth = 1;
   // P * N / (N + K + S) - number of data units to span the pool-width
-  unsigned max_bs = depth * unit_sz * pa->pa_P * pa->pa_N /
-                                     (pa->pa_N + pa->pa_K + pa->pa_S);
+  max_bs = depth * unit_sz * pw.P * pw.N / (pw.N + pw.K + pw.S);
   max_bs = roundup(max_bs, grp_sz); // multiple of group size
+}
+
+unsigned MotrObject::get_group_size()
+{
+  if (grp_sz == 0)
+    init_layout_geom();
+  return grp_sz;
+}
+
+// The geometry is worked out once per object, from the pool width cached
+// by the store for each pool version.
+unsigned MotrObject::get_optimal_bs(unsigned len)
+{
+  if (max_bs == 0)
+    init_layout_geom();
+
   if (len >= max_bs)
     return max_bs;
   else if (len <= grp_sz)
@@ -2286,95 +4219,54 @@ unsigned MotrObject::get_optimal_bs(unsigned len)
 
 void MotrAtomicWriter::cleanup()
 {
-  m0_indexvec_free(&ext);
-  m0_bufvec_free(&attr);
-  m0_bufvec_free2(&buf);
+  wpipe.cancel();
   acc_data.clear();
   obj.close_mobj();
   old_obj.close_mobj();
 }
 
-unsigned MotrAtomicWriter::populate_bvec(unsigned len, bufferlist::iterator &bi)
-{
-  unsigned i, l, done = 0;
-  const char *data;
-
-  for (i = 0; i < MAX_BUFVEC_NR && len > 0; ++i) {
-    l = bi.get_ptr_and_advance(len, &data);
-    buf.ov_buf[i] = (char*)data;
-    buf.ov_vec.v_count[i] = l;
-    ext.iv_index[i] = acc_off;
-    ext.iv_vec.v_count[i] = l;
-    attr.ov_vec.v_count[i] = 0;
-    acc_off += l;
-    len -= l;
-    done += l;
-  }
-  buf.ov_vec.v_nr = i;
-  ext.iv_vec.v_nr = i;
-
-  return done;
-}
-
-int MotrAtomicWriter::write()
+// Launch the writes of the accumulated data. They are completed by the
+// next write() call which needs a free slot, or by wpipe.drain(). Unless
+// this is the `last` data of the object, the data short of a full parity
+// group is kept for the next call rather than padded.
+int MotrAtomicWriter::write(bool last)
 {
   int rc;
-  unsigned bs, left;
-  struct m0_op *op;
-  bufferlist::iterator bi;
+  unsigned bs, left, tail = 0;
 
   left = acc_data.length();
 
   if (!obj.is_opened()) {
-    rc = obj.create_mobj(dpp, left);
-    if (rc == -EEXIST)
-      rc = obj.open_mobj(dpp);
-    if (rc != 0) {
-      char fid_str[M0_FID_STR_LEN];
-      snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&obj.meta.oid));
-      ldpp_dout(dpp, 0) << "ERROR: failed to create/open motr object "
-                        << fid_str << " (" << obj.get_bucket()->get_name()
-                        << "/" << obj.get_key().to_str() << "): rc=" << rc
-                        << dendl;
+    rc = create_obj(std::max<uint64_t>(size_hint, left));
+    if (rc != 0)
       goto err;
-    }
   }
 
+  if (!last)
+    tail = left % obj.get_group_size();
+  left -= tail;
   total_data_size += left;
 
   bs = obj.get_optimal_bs(left);
-  ldpp_dout(dpp, 20) <<__func__<< ": left=" << left << " bs=" << bs << dendl;
+  ldpp_dout(dpp, 20) <<__func__<< ": left=" << left << " bs=" << bs
+                     << " tail=" << tail << dendl;
 
-  bi = acc_data.begin();
   while (left > 0) {
     if (left < bs)
       bs = obj.get_optimal_bs(left);
     if (left < bs) {
       acc_data.append_zero(bs - left);
-      auto off = bi.get_off();
-      bufferlist tmp;
-      acc_data.splice(off, bs, &tmp);
-      acc_data.clear();
-      acc_data.append(tmp.c_str(), bs); // make it a single buf
-      bi = acc_data.begin();
       left = bs;
     }
 
-    left -= this->populate_bvec(bs, bi);
-
-    op = nullptr;
-    rc = m0_obj_op(obj.mobj, M0_OC_WRITE, &ext, &buf, &attr, 0, 0, &op);
-    if (rc != 0)
-      goto err;
-    m0_op_launch(&op, 1);
-    rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-         m0_rc(op);
-    m0_op_fini(op);
-    m0_op_free(op);
+    bufferlist chunk;
+    acc_data.splice(0, bs, &chunk);
+    rc = wpipe.write(dpp, &obj, std::move(chunk), acc_off, y);
     if (rc != 0)
       goto err;
+    acc_off += bs;
+    left -= bs;
   }
-  acc_data.clear();
 
   return 0;
 
@@ -2383,18 +4275,35 @@ err:
   return rc;
 }
 
-static const unsigned MAX_ACC_SIZE = 32 * 1024 * 1024;
+// Write out the data left and wait for the writes in flight. The data
+// of small objects, received in full before any write, is kept in the
+// bucket index entry instead.
+int MotrAtomicWriter::flush()
+{
+  int rc = 0;
+
+  if (acc_data.length() != 0) {
+    if (!obj.is_opened() && acc_data.length() <= inline_max) {
+      total_data_size += acc_data.length();
+      obj.meta.inline_data.claim_append(acc_data);
+    } else {
+      rc = this->write(true);
+    }
+  }
+  if (rc == 0)
+    rc = wpipe.drain(dpp, y);
+  return rc;
+}
 
 // Accumulate enough data first to make a reasonable decision about the
 // optimal unit size for a new object, or bs for existing object (32M seems
 // enough for 4M units in 8+2 parity groups, a common config on wide pools),
-// and then launch the write operations.
+// and then launch the write operations. With a size hint the object is
+// created by prepare(), and one optimal block is enough.
 int MotrAtomicWriter::process(bufferlist&& data, uint64_t offset)
 {
   if (data.length() == 0) { // last call, flush data
-    int rc = 0;
-    if (acc_data.length() != 0)
-      rc = this->write();
+    int rc = this->flush();
     this->cleanup();
     return rc;
   }
@@ -2403,10 +4312,10 @@ int MotrAtomicWriter::process(bufferlist&& data, uint64_t offset)
     acc_off = offset;
 
   acc_data.append(std::move(data));
-  if (acc_data.length() < MAX_ACC_SIZE)
+  if (acc_data.length() < acc_max)
     return 0;
 
-  return this->write();
+  return this->write(false);
 }
 
 int MotrAtomicWriter::complete(size_t accounted_size, const std::string& etag,
@@ -2418,14 +4327,10 @@ int MotrAtomicWriter::complete(size_t accounted_size, const std::string& etag,
                        rgw_zone_set *zones_trace, bool *canceled,
                        optional_yield y)
 {
-  int rc = 0;
-
-  if (acc_data.length() != 0) { // check again, just in case
-    rc = this->write();
-    this->cleanup();
-    if (rc != 0)
-      return rc;
-  }
+  int rc = this->flush(); // check again, just in case
+  this->cleanup();
+  if (rc != 0)
+    return rc;
 
   bufferlist bl;
   rgw_bucket_dir_entry ent;
@@ -2438,9 +4343,12 @@ int MotrAtomicWriter::complete(size_t accounted_size, const std::string& etag,
   // how to set the dir entry. Only set the basic ones for POC, no ACLs and
   // other attrs.
   obj.get_key().get_index_key(&ent.key);
+  ent.meta.category = category;
   ent.meta.size = total_data_size;
   ent.meta.accounted_size = total_data_size;
   ent.meta.mtime = real_clock::is_zero(set_mtime)? ceph::real_clock::now() : set_mtime;
+  if (mtime)
+    *mtime = ent.meta.mtime;
   ent.meta.etag = etag;
   ent.meta.owner = owner.to_str();
   ent.meta.owner_display_name = obj.get_bucket()->get_owner()->get_display_name();
@@ -2469,92 +4377,205 @@ int MotrAtomicWriter::complete(size_t accounted_size, const std::string& etag,
   obj.meta.encode(bl);
   ldpp_dout(dpp, 20) <<__func__<< ": lid=0x" << std::hex << obj.meta.layout_id
                                                            << dendl;
-  if (is_versioned) {
-    // get the list of all versioned objects with the same key and
-    // unset their FLAG_CURRENT later, if do_idx_op_by_name() is successful.
-    // Note: without distributed lock on the index - it is possible that 2
-    // CURRENT entries would appear in the bucket. For example, consider the
-    // following scenario when two clients are trying to add the new object
-    // version concurrently:
-    //   client 1: reads all the CURRENT entries
-    //   client 2: updates the index and sets the new CURRENT
-    //   client 1: updates the index and sets the new CURRENT
-    // At the step (1) client 1 would not see the new current record from step (2),
-    // so it won't update it. As a result, two CURRENT version entries will appear
-    // in the bucket.
-    // TODO: update the current version (unset the flag) and insert the new current
-    // version can be launched in one motr op. This requires change at do_idx_op()
-    // and do_idx_op_by_name().
-    rc = obj.update_version_entries(dpp);
-    if (rc < 0)
-      return rc;
-  }
   string tenant_bkt_name = get_bucket_name(obj.get_bucket()->get_tenant(), obj.get_bucket()->get_name());
   // Insert an entry into bucket index.
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
   rc = store->do_idx_op_by_name(bucket_index_iname,
-                                M0_IC_PUT, obj.get_key().to_str(), bl);
-  if (rc == 0)
+                                M0_IC_PUT, obj.get_key().to_str(), bl, true, y);
+  if (rc == 0) {
     store->get_obj_meta_cache()->put(dpp, obj.get_key().to_str(), bl);
+    MotrStatsTracker *stats = store->get_stats_tracker();
+    if (old_obj_exists)
+      stats->remove_object(tenant_bkt_name, obj.get_key().to_str(), old_obj_size);
+    stats->add_object(tenant_bkt_name, obj.get_key().to_str(), total_data_size);
+  }
+
+  if (rc == 0 && obj.get_bucket()->get_info().versioned())
+    rc = obj.set_latest_version(dpp, ent, bl, y);
+  if (rc < 0)
+    return rc;
 
-  if (old_obj.get_bucket()->get_info().versioning_status() != BUCKET_VERSIONED) {
-    // Delete old object data if exists.
-    old_obj.delete_mobj(dpp);
+  // The object is linked, it no longer needs the GC.
+  if (!gc_tag.empty())
+    store->get_gc()->remove(dpp, gc_tag, y);
+
+  if (old_obj_exists &&
+      old_obj.get_bucket()->get_info().versioning_status() != BUCKET_VERSIONED) {
+    // Have the GC delete the old object data.
+    if (old_obj_multipart)
+      old_obj.delete_part_objs(dpp, y);
+    else if (old_obj.meta.oid.u_hi || old_obj.meta.oid.u_lo)
+      store->get_gc()->enqueue_delete(dpp, {old_obj.meta}, y);
   }
 
-  // TODO: We need to handle the object leak caused by parallel object upload by
-  // making use of background gc, which is currently not enabled for motr.
   return rc;
 }
 
-int MotrMultipartUpload::delete_parts(const DoutPrefixProvider *dpp)
+// The object shares the data of `src`. Inline data is copied. Motr objects
+// get a ref for the entry copied from and one for the new entry before the
+// new entry refers to them, so that the GC keeps them for as long as any
+// entry does. Nothing is written to Motr objects once they are linked, so
+// the entries never see each other's changes: an overwrite creates a new
+// object and hands the old one to the GC.
+int MotrAtomicWriter::share_data(MotrObject *src, const rgw_bucket_dir_entry& src_ent,
+                                 optional_yield y)
+{
+  string src_iname = "motr.rgw.bucket.index." +
+                     get_bucket_name(src->get_bucket()->get_tenant(), src->get_bucket()->get_name());
+  string dst_iname = "motr.rgw.bucket.index." +
+                     get_bucket_name(obj.get_bucket()->get_tenant(), obj.get_bucket()->get_name());
+  // The source may be the current version, looked up without its key.
+  string src_key = motr_ent_idx_key(src_ent);
+  string dst_key = obj.get_key().to_str();
+
+  total_data_size = src_ent.meta.size;
+  category = src_ent.meta.category;
+
+  if (src_iname == dst_iname && src_key == dst_key) {
+    // A copy onto itself only changes the attributes, keep the data.
+    obj.meta = src->meta;
+    old_obj_multipart = false;
+    old_obj.meta = MotrObject::Meta();
+    return 0;
+  }
+
+  if (src_ent.meta.size == 0 || src->meta.is_inline()) {
+    obj.meta.inline_data = src->meta.inline_data;
+    return 0;
+  }
+
+  if (category == RGWObjCategory::MultiMeta)
+    return share_parts(src, y);
+
+  obj.meta = src->meta;
+  auto now = real_clock::now();
+  vector<std::pair<MotrObject::Meta, MotrObjRef>> refs;
+  refs.emplace_back(src->meta, MotrObjRef{src_iname, src_key, false, now});
+  refs.emplace_back(src->meta, MotrObjRef{dst_iname, dst_key, false, now});
+  return store->get_gc()->add_refs(dpp, refs, y);
+}
+
+// Copy the part records of a multipart object to the part index of the
+// new object, with refs for the part objects.
+int MotrAtomicWriter::share_parts(MotrObject *src, optional_yield y)
 {
+  string src_piname = "motr.rgw.object." +
+                      get_bucket_name(src->get_bucket()->get_tenant(), src->get_bucket()->get_name()) +
+                      "." + src->get_name() + ".parts";
+  string dst_piname = "motr.rgw.object." +
+                      get_bucket_name(obj.get_bucket()->get_tenant(), obj.get_bucket()->get_name()) +
+                      "." + obj.get_name() + ".parts";
   int rc;
-  int max_parts = 1000;
-  int marker = 0;
-  bool truncated = false;
 
-  // Scan all parts and delete the corresponding motr objects.
-  do {
-    rc = this->list_parts(dpp, store->ctx(), max_parts, marker, &marker, &truncated);
-    if (rc == -ENOENT) {
-      truncated = false;
-      rc = 0;
-    }
+  // The part index is named after the object, so a multipart object
+  // being replaced has its parts in it: hand them to the GC first.
+  if (old_obj_multipart &&
+      old_obj.get_bucket()->get_info().versioning_status() != BUCKET_VERSIONED) {
+    rc = old_obj.delete_part_objs(dpp, y);
     if (rc < 0)
       return rc;
+    old_obj_multipart = false;
+  }
 
-    std::map<uint32_t, std::unique_ptr<MultipartPart>>& parts = this->get_parts();
-    for (auto part_iter = parts.begin(); part_iter != parts.end(); ++part_iter) {
-
-      MultipartPart *mpart = part_iter->second.get();
-      MotrMultipartPart *mmpart = static_cast<MotrMultipartPart *>(mpart);
-      uint32_t part_num = mmpart->get_num();
-
-      // Delete the part object. Note that the part object is  not
-      // inserted into bucket index, only the corresponding motr object
-      // needs to be delete. That is why we don't call
-      // MotrObject::delete_object().
-      string part_obj_name = bucket->get_name() + "." +
- 	                     mp_obj.get_key() +
-	                     ".part." + std::to_string(part_num);
-      std::unique_ptr<rgw::sal::Object> obj;
-      obj = this->bucket->get_object(rgw_obj_key(part_obj_name));
-      std::unique_ptr<rgw::sal::MotrObject> mobj(static_cast<rgw::sal::MotrObject *>(obj.release()));
-      mobj->meta = mmpart->meta;
-      rc = mobj->delete_mobj(dpp);
-      if (rc < 0) {
-        ldpp_dout(dpp, 0) << __func__ << ": Failed to delete object from Motr. rc=" << rc << dendl;
-        return rc;
+  rc = store->create_motr_idx_by_name(dst_piname, y);
+  if (rc < 0 && rc != -EEXIST)
+    return rc;
+
+  const int max = 1000;
+  const string prefix = "part.";
+  string start = prefix;
+  auto now = real_clock::now();
+  for (;;) {
+    vector<string> keys(max);
+    vector<bufferlist> vals(max);
+    keys[0] = start;
+    rc = store->next_query_by_name(src_piname, keys, vals, prefix, "", y);
+    if (rc < 0)
+      return rc == -ENOENT ? -ERR_NO_SUCH_UPLOAD : rc;
+    int n = rc;
+    keys.resize(n);
+    vals.resize(n);
+
+    vector<std::pair<MotrObject::Meta, MotrObjRef>> refs;
+    for (int i = 0; i < n; i++) {
+      MotrObject::Meta meta;
+      try {
+        RGWUploadPartInfo info;
+        rgw::sal::Attrs attrs_dummy;
+        auto iter = vals[i].cbegin();
+        decode(info, iter);
+        decode(attrs_dummy, iter);
+        meta.decode(iter);
+      } catch (buffer::error& err) {
+        ldpp_dout(dpp, 0) << "ERROR: failed to decode part " << keys[i] << dendl;
+        return -EIO;
       }
+      refs.emplace_back(meta, MotrObjRef{src_piname, keys[i], true, now});
+      refs.emplace_back(meta, MotrObjRef{dst_piname, keys[i], true, now});
     }
-  } while (truncated);
+    rc = store->get_gc()->add_refs(dpp, refs, y);
+    if (rc < 0)
+      return rc;
 
-  // Delete object part index.
+    vector<int> rcs;
+    rc = store->do_idx_batch_op_by_name(dst_piname, M0_IC_PUT, keys, vals, rcs, true, y);
+    for (size_t i = 0; rc == 0 && i < rcs.size(); i++)
+      rc = rcs[i];
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to copy the parts to " << dst_piname
+                        << ": rc=" << rc << dendl;
+      return rc;
+    }
+    ldpp_dout(dpp, 20) << __func__ << ": copied " << n << " parts to " << dst_piname << dendl;
+
+    if (n < max)
+      break;
+    start = keys[n - 1] + '\0';
+  }
+
+  return 0;
+}
+
+int MotrMultipartUpload::delete_parts(const DoutPrefixProvider *dpp, optional_yield y)
+{
+  int rc;
+  vector<MotrObject::Meta> objs;
   std::string oid = mp_obj.get_key();
   string tenant_bkt_name = get_bucket_name(bucket->get_tenant(), bucket->get_name());
   string obj_part_iname = "motr.rgw.object." + tenant_bkt_name + "." + oid + ".parts";
-  return store->delete_motr_idx_by_name(obj_part_iname);
+
+  // Scan all parts and leave their motr objects to the GC, which deletes
+  // them with several workers. Note that the part objects are not inserted
+  // into bucket index, only the motr objects need to be deleted.
+  MotrIdxLister lister(store, obj_part_iname, "part.", "");
+  rc = lister.start("part.", 1000, y);
+  MotrIdxLister::Entry ent;
+  while (rc >= 0 && (rc = lister.next(ent, y)) > 0) {
+    MotrObject::Meta meta;
+    try {
+      RGWUploadPartInfo info;
+      rgw::sal::Attrs attrs_dummy;
+      auto iter = ent.val.cbegin();
+      decode(info, iter);
+      decode(attrs_dummy, iter);
+      meta.decode(iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode part record " << ent.key << dendl;
+      return -EIO;
+    }
+    objs.push_back(meta);
+  }
+  if (rc == -ENOENT)
+    return 0;
+  if (rc < 0)
+    return rc;
+
+  rc = store->get_gc()->enqueue_delete(dpp, std::move(objs), y);
+  if (rc < 0)
+    return rc;
+
+  // Delete object part index.
+  return store->delete_motr_idx_by_name(obj_part_iname, y);
 }
 
 int MotrMultipartUpload::abort(const DoutPrefixProvider *dpp, CephContext *cct,
@@ -2576,7 +4597,7 @@ int MotrMultipartUpload::abort(const DoutPrefixProvider *dpp, CephContext *cct,
   }
 
   // Scan all parts and delete the corresponding motr objects.
-  rc = this->delete_parts(dpp);
+  rc = this->delete_parts(dpp, null_yield);
   if (rc < 0)
     return rc;
 
@@ -2661,7 +4682,7 @@ int MotrMultipartUpload::init(const DoutPrefixProvider *dpp, optional_yield y,
     string bucket_multipart_iname =
       "motr.rgw.bucket." + tenant_bkt_name + ".multiparts";
     rc = store->do_idx_op_by_name(bucket_multipart_iname,
-                                  M0_IC_PUT, obj->get_key().to_str(), bl);
+                                  M0_IC_PUT, obj->get_key().to_str(), bl, true, y);
 
   } while (rc == -EEXIST);
 
@@ -2673,7 +4694,7 @@ int MotrMultipartUpload::init(const DoutPrefixProvider *dpp, optional_yield y,
   // TODO: add bucket as part of the name.
   string obj_part_iname = "motr.rgw.object." + tenant_bkt_name + "." + oid + ".parts";
   ldpp_dout(dpp, 20) << "MotrMultipartUpload::init(): object part index=" << obj_part_iname << dendl;
-  rc = store->create_motr_idx_by_name(obj_part_iname);
+  rc = store->create_motr_idx_by_name(obj_part_iname, y);
   if (rc == -EEXIST)
     rc = 0;
   if (rc < 0)
@@ -2751,6 +4772,12 @@ int MotrMultipartUpload::list_parts(const DoutPrefixProvider *dpp, CephContext *
 }
 
 // Heavily copy from rgw_sal_rados.cc
+//
+// The part records are streamed from the part index, the next batch being
+// fetched while the current one is checked against the parts requested
+// and folded into the ETag. The parts end up in a compact part map, stored
+// in the part index with one PUT, so that readers of the object don't have
+// to scan the part records again.
 int MotrMultipartUpload::complete(const DoutPrefixProvider *dpp,
 				   optional_yield y, CephContext* cct,
 				   map<int, string>& part_etags,
@@ -2769,132 +4796,125 @@ int MotrMultipartUpload::complete(const DoutPrefixProvider *dpp,
   MD5 hash;
   // Allow use of MD5 digest in FIPS mode for non-cryptographic purposes
   hash.SetFlags(EVP_MD_CTX_FLAG_NON_FIPS_ALLOW);
-  bool truncated;
   int rc;
 
   ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): enter" << dendl;
-  int total_parts = 0;
   int handled_parts = 0;
-  int max_parts = 1000;
-  int marker = 0;
   uint64_t min_part_size = cct->_conf->rgw_multipart_min_part_size;
   auto etags_iter = part_etags.begin();
   rgw::sal::Attrs attrs = target_obj->get_attrs();
 
-  do {
-    ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): list_parts()" << dendl;
-    rc = list_parts(dpp, cct, max_parts, marker, &marker, &truncated);
-    if (rc == -ENOENT) {
-      rc = -ERR_NO_SUCH_UPLOAD;
+  string tenant_bkt_name = get_bucket_name(bucket->get_tenant(), bucket->get_name());
+  string obj_part_iname = "motr.rgw.object." + tenant_bkt_name + "." +
+                          mp_obj.get_key() + ".parts";
+  MotrObject::PartMap part_map;
+  uint64_t map_off = 0;
+  part_map.parts.reserve(part_etags.size());
+
+  MotrIdxLister lister(store, obj_part_iname, "part.", "");
+  rc = lister.start("part.", part_etags.size(), y);
+  MotrIdxLister::Entry pent;
+  for (; rc >= 0 && (rc = lister.next(pent, y)) > 0; ++etags_iter, ++handled_parts) {
+    if (etags_iter == part_etags.end()) {
+      ldpp_dout(dpp, 0) << "NOTICE: total parts mismatch: have more than expected: "
+                        << part_etags.size() << dendl;
+      return -ERR_INVALID_PART;
     }
-    if (rc < 0)
+
+    RGWUploadPartInfo info;
+    MotrObject::Meta meta;
+    try {
+      auto iter = pent.val.cbegin();
+      decode(info, iter);
+      rgw::sal::Attrs attrs_dummy;
+      decode(attrs_dummy, iter);
+      meta.decode(iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode part record " << pent.key << dendl;
+      return -EIO;
+    }
+    RGWUploadPartInfo *part = &info;
+
+    uint64_t part_size = part->accounted_size;
+    ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): part_size=" << part_size << dendl;
+    if (handled_parts < (int)part_etags.size() - 1 &&
+        part_size < min_part_size) {
+      rc = -ERR_TOO_SMALL;
       return rc;
+    }
 
-    total_parts += parts.size();
-    if (!truncated && total_parts != (int)part_etags.size()) {
-      ldpp_dout(dpp, 0) << "NOTICE: total parts mismatch: have: " << total_parts
-		       << " expected: " << part_etags.size() << dendl;
+    char petag[CEPH_CRYPTO_MD5_DIGESTSIZE];
+    if (etags_iter->first != (int)part->num) {
+      ldpp_dout(dpp, 0) << "NOTICE: parts num mismatch: next requested: "
+                        << etags_iter->first << " next uploaded: "
+                        << part->num << dendl;
+      rc = -ERR_INVALID_PART;
+      return rc;
+    }
+    string part_etag = rgw_string_unquote(etags_iter->second);
+    if (part_etag.compare(part->etag) != 0) {
+      ldpp_dout(dpp, 0) << "NOTICE: etag mismatch: part: " << etags_iter->first
+                        << " etag: " << etags_iter->second << dendl;
       rc = -ERR_INVALID_PART;
       return rc;
     }
-    ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): parts.size()=" << parts.size() << dendl;
-
-    for (auto obj_iter = parts.begin();
-         etags_iter != part_etags.end() && obj_iter != parts.end();
-	 ++etags_iter, ++obj_iter, ++handled_parts) {
-      MultipartPart *mpart = obj_iter->second.get();
-      MotrMultipartPart *mmpart = static_cast<MotrMultipartPart *>(mpart);
-      RGWUploadPartInfo *part = &mmpart->info;
-
-      uint64_t part_size = part->accounted_size;
-      ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): part_size=" << part_size << dendl;
-      if (handled_parts < (int)part_etags.size() - 1 &&
-          part_size < min_part_size) {
-        rc = -ERR_TOO_SMALL;
-        return rc;
-      }
-
-      char petag[CEPH_CRYPTO_MD5_DIGESTSIZE];
-      if (etags_iter->first != (int)obj_iter->first) {
-        ldpp_dout(dpp, 0) << "NOTICE: parts num mismatch: next requested: "
-			 << etags_iter->first << " next uploaded: "
-			 << obj_iter->first << dendl;
-        rc = -ERR_INVALID_PART;
-        return rc;
-      }
-      string part_etag = rgw_string_unquote(etags_iter->second);
-      if (part_etag.compare(part->etag) != 0) {
-        ldpp_dout(dpp, 0) << "NOTICE: etag mismatch: part: " << etags_iter->first
-			 << " etag: " << etags_iter->second << dendl;
-        rc = -ERR_INVALID_PART;
-        return rc;
-      }
-
-      hex_to_buf(part->etag.c_str(), petag, CEPH_CRYPTO_MD5_DIGESTSIZE);
-      hash.Update((const unsigned char *)petag, sizeof(petag));
-      ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): calc etag " << dendl;
 
-      string oid = mp_obj.get_part(part->num);
-      rgw_obj src_obj;
-      src_obj.init_ns(bucket->get_key(), oid, mp_ns);
+    hex_to_buf(part->etag.c_str(), petag, CEPH_CRYPTO_MD5_DIGESTSIZE);
+    hash.Update((const unsigned char *)petag, sizeof(petag));
 
-#if 0 // does Motr backend need it?
-      /* update manifest for part */
-      if (part->manifest.empty()) {
-        ldpp_dout(dpp, 0) << "ERROR: empty manifest for object part: obj="
-			 << src_obj << dendl;
+    bool part_compressed = (part->cs_info.compression_type != "none");
+    if ((handled_parts > 0) &&
+        ((part_compressed != compressed) ||
+          (cs_info.compression_type != part->cs_info.compression_type))) {
+        ldpp_dout(dpp, 0) << "ERROR: compression type was changed during multipart upload ("
+                         << cs_info.compression_type << ">>" << part->cs_info.compression_type << ")" << dendl;
         rc = -ERR_INVALID_PART;
         return rc;
-      } else {
-        manifest.append(dpp, part->manifest, store->get_zone());
-      }
-      ldpp_dout(dpp, 0) << "MotrMultipartUpload::complete(): manifest " << dendl;
-#endif
-
-      bool part_compressed = (part->cs_info.compression_type != "none");
-      if ((handled_parts > 0) &&
-          ((part_compressed != compressed) ||
-            (cs_info.compression_type != part->cs_info.compression_type))) {
-          ldpp_dout(dpp, 0) << "ERROR: compression type was changed during multipart upload ("
-                           << cs_info.compression_type << ">>" << part->cs_info.compression_type << ")" << dendl;
-          rc = -ERR_INVALID_PART;
-          return rc;
-      }
+    }
 
-      ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): part compression" << dendl;
-      if (part_compressed) {
-        int64_t new_ofs; // offset in compression data for new part
-        if (cs_info.blocks.size() > 0)
-          new_ofs = cs_info.blocks.back().new_ofs + cs_info.blocks.back().len;
-        else
-          new_ofs = 0;
-        for (const auto& block : part->cs_info.blocks) {
-          compression_block cb;
-          cb.old_ofs = block.old_ofs + cs_info.orig_size;
-          cb.new_ofs = new_ofs;
-          cb.len = block.len;
-          cs_info.blocks.push_back(cb);
-          new_ofs = cb.new_ofs + cb.len;
-        }
-        if (!compressed)
-          cs_info.compression_type = part->cs_info.compression_type;
-        cs_info.orig_size += part->cs_info.orig_size;
-        compressed = true;
+    if (part_compressed) {
+      int64_t new_ofs; // offset in compression data for new part
+      if (cs_info.blocks.size() > 0)
+        new_ofs = cs_info.blocks.back().new_ofs + cs_info.blocks.back().len;
+      else
+        new_ofs = 0;
+      for (const auto& block : part->cs_info.blocks) {
+        compression_block cb;
+        cb.old_ofs = block.old_ofs + cs_info.orig_size;
+        cb.new_ofs = new_ofs;
+        cb.len = block.len;
+        cs_info.blocks.push_back(cb);
+        new_ofs = cb.new_ofs + cb.len;
       }
-
-      // We may not need to do the following as remove_objs are those
-      // don't show when listing a bucket. As we store in-progress uploaded
-      // object's metadata in a separate index, they are not shown when
-      // listing a bucket.
-      rgw_obj_index_key remove_key;
-      src_obj.key.get_index_key(&remove_key);
-      remove_objs.push_back(remove_key);
-
-      off += part_size;
-      accounted_size += part->accounted_size;
-      ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): off=" << off << ", accounted_size = " << accounted_size << dendl;
+      if (!compressed)
+        cs_info.compression_type = part->cs_info.compression_type;
+      cs_info.orig_size += part->cs_info.orig_size;
+      compressed = true;
     }
-  } while (truncated);
+
+    // The part objects are not in the bucket index, there is nothing for
+    // remove_objs.
+    MotrObject::PartMap::Part mpart;
+    mpart.num = part->num;
+    mpart.off = map_off;
+    mpart.size = part->size;
+    mpart.meta = meta;
+    map_off += part->size;
+    part_map.parts.push_back(std::move(mpart));
+
+    off += part_size;
+    accounted_size += part->accounted_size;
+    ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): off=" << off << ", accounted_size = " << accounted_size << dendl;
+  }
+  if (rc == -ENOENT)
+    rc = -ERR_NO_SUCH_UPLOAD;
+  if (rc < 0)
+    return rc;
+  if (etags_iter != part_etags.end()) {
+    ldpp_dout(dpp, 0) << "NOTICE: total parts mismatch: have: " << handled_parts
+                      << " expected: " << part_etags.size() << dendl;
+    return -ERR_INVALID_PART;
+  }
   hash.Final((unsigned char *)final_etag);
 
   buf_to_hex((unsigned char *)final_etag, sizeof(final_etag), final_etag_str);
@@ -2919,11 +4939,10 @@ int MotrMultipartUpload::complete(const DoutPrefixProvider *dpp,
   bufferlist bl;
   std::unique_ptr<rgw::sal::Object> meta_obj;
   meta_obj = get_meta_obj();
-  string tenant_bkt_name = get_bucket_name(meta_obj->get_bucket()->get_tenant(), meta_obj->get_bucket()->get_name());
   string bucket_multipart_iname =
       "motr.rgw.bucket." + tenant_bkt_name + ".multiparts";
   rc = this->store->do_idx_op_by_name(bucket_multipart_iname,
-                                      M0_IC_GET, meta_obj->get_key().to_str(), bl);
+                                      M0_IC_GET, meta_obj->get_key().to_str(), bl, true, y);
   ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): read entry from bucket multipart index rc=" << rc << dendl;
   if (rc < 0)
     return rc;
@@ -2942,26 +4961,65 @@ int MotrMultipartUpload::complete(const DoutPrefixProvider *dpp,
                            << " obj accounted size=" << ent.meta.accounted_size << dendl;
   ent.meta.mtime = ceph::real_clock::now();
   ent.meta.etag = etag;
+  if (target_obj->have_instance())
+    ent.flags = rgw_bucket_dir_entry::FLAG_VER | rgw_bucket_dir_entry::FLAG_CURRENT;
   ent.encode(update_bl);
   encode(attrs, update_bl);
   MotrObject::Meta meta_dummy;
   meta_dummy.encode(update_bl);
 
+  // Readers scan the part records again if the map is missing.
+  part_map.mtime = ent.meta.mtime;
+  part_map.obj_size = ent.meta.size;
+  bufferlist map_bl;
+  part_map.encode(map_bl);
+  rc = store->do_idx_op_by_name(obj_part_iname, M0_IC_PUT,
+                                RGW_MOTR_PART_MAP_KEY, map_bl, true, y);
+  if (rc < 0)
+    ldpp_dout(dpp, 1) << "WARNING: failed to store the part map of "
+                      << target_obj->get_name() << ": rc=" << rc << dendl;
+
   string bucket_index_iname = "motr.rgw.bucket.index." + tenant_bkt_name;
+  // The version's key, the bare name in an unversioned bucket.
+  string target_key = target_obj->get_key().to_str();
   ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): target_obj name=" << target_obj->get_name()
                                   << " target_obj oid=" << target_obj->get_oid() << dendl;
+  // Look up the object being replaced for the bucket stats.
+  bufferlist old_bl;
+  rgw_bucket_dir_entry old_ent;
+  rc = store->do_idx_op_by_name(bucket_index_iname, M0_IC_GET,
+                                target_key, old_bl, true, y);
+  if (rc < 0 && rc != -ENOENT)
+    return rc;
+  bool replaced = rc == 0;
+  if (replaced) {
+    auto old_iter = old_bl.cbegin();
+    old_ent.decode(old_iter);
+  }
+
   rc = store->do_idx_op_by_name(bucket_index_iname, M0_IC_PUT,
-                                target_obj->get_name(), update_bl);
+                                target_key, update_bl, true, y);
   if (rc < 0)
     return rc;
 
+  MotrStatsTracker *stats = store->get_stats_tracker();
+  if (replaced)
+    stats->remove_object(tenant_bkt_name, target_key, old_ent.meta.size);
+  stats->add_object(tenant_bkt_name, target_key, ent.meta.size);
+
   // Put into metadata cache.
-  store->get_obj_meta_cache()->put(dpp, target_obj->get_name(), update_bl);
+  store->get_obj_meta_cache()->put(dpp, target_key, update_bl);
+
+  if (target_obj->get_bucket()->get_info().versioned()) {
+    rc = static_cast<MotrObject *>(target_obj)->set_latest_version(dpp, ent, update_bl, y);
+    if (rc < 0)
+      return rc;
+  }
 
   // Now we can remove it from bucket multipart index.
   ldpp_dout(dpp, 20) << "MotrMultipartUpload::complete(): remove from bucket multipartindex " << dendl;
   return store->do_idx_op_by_name(bucket_multipart_iname,
-                                  M0_IC_DEL, meta_obj->get_key().to_str(), bl);
+                                  M0_IC_DEL, meta_obj->get_key().to_str(), bl, true, y);
 }
 
 int MotrMultipartUpload::get_info(const DoutPrefixProvider *dpp, optional_yield y, RGWObjectCtx* obj_ctx, rgw_placement_rule** rule, rgw::sal::Attrs* attrs)
@@ -2992,7 +5050,7 @@ int MotrMultipartUpload::get_info(const DoutPrefixProvider *dpp, optional_yield
   string bucket_multipart_iname =
       "motr.rgw.bucket." + tenant_bkt_name + ".multiparts";
   int rc = this->store->do_idx_op_by_name(bucket_multipart_iname,
-                                          M0_IC_GET, meta_obj->get_key().to_str(), bl);
+                                          M0_IC_GET, meta_obj->get_key().to_str(), bl, true, y);
   if (rc < 0) {
     ldpp_dout(dpp, 0) << __func__ << ": Failed to get multipart info. rc=" << rc << dendl;
     return rc == -ENOENT ? -ERR_NO_SUCH_UPLOAD : rc;
@@ -3041,6 +5099,20 @@ std::unique_ptr<Writer> MotrMultipartUpload::get_writer(
 				 obj_ctx, ptail_placement_rule, part_num, part_num_str);
 }
 
+std::string MotrMultipartWriter::part_iname() const
+{
+  string tenant_bkt_name = get_bucket_name(head_obj->get_bucket()->get_tenant(), head_obj->get_bucket()->get_name());
+  return "motr.rgw.object." + tenant_bkt_name + "." +
+         head_obj->get_key().to_str() + ".parts";
+}
+
+std::string MotrMultipartWriter::part_key() const
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "part.%08d", (int)part_num);
+  return buf;
+}
+
 int MotrMultipartWriter::prepare(optional_yield y)
 {
   string part_obj_name = head_obj->get_bucket()->get_name() + "." +
@@ -3053,20 +5125,54 @@ int MotrMultipartWriter::prepare(optional_yield y)
 
   // s3 client may retry uploading part, so the part may have already
   // been created.
-  int rc = part_obj->create_mobj(dpp, store->cctx->_conf->rgw_max_chunk_size);
+  // The layout is picked for the part size when it is known.
+  uint64_t sz = size_hint ? size_hint : store->cctx->_conf->rgw_max_chunk_size;
+  int rc = part_obj->create_mobj(dpp, sz, y);
   if (rc == -EEXIST) {
-    rc = part_obj->open_mobj(dpp);
+    rc = part_obj->open_mobj(dpp, y);
     if (rc < 0)
       return rc;
+  } else if (rc == 0) {
+    // Have the GC delete the part object if it never gets recorded.
+    rc = store->get_gc()->enqueue_orphan(dpp, part_obj->meta, part_iname(),
+                                         part_key(), true, gc_tag, y);
   }
+  if (rc == 0 && size_hint)
+    acc_max = part_obj->get_optimal_bs(std::min<uint64_t>(size_hint, MAX_ACC_SIZE));
   return rc;
 }
 
 int MotrMultipartWriter::process(bufferlist&& data, uint64_t offset)
 {
-  int rc = part_obj->write_mobj(dpp, std::move(data), offset);
+  int rc;
+
+  if (data.length() == 0) { // last call, wait for the writes in flight
+    rc = part_obj->write_mobj(dpp, std::move(acc_data), acc_off, &wpipe, y);
+    acc_data.clear();
+    if (rc < 0)
+      return rc;
+    return wpipe.drain(dpp, y);
+  }
+
+  uint64_t len = data.length();
+  if (acc_max == 0) {
+    rc = part_obj->write_mobj(dpp, std::move(data), offset, &wpipe, y);
+  } else {
+    // Write whole parity groups, keep the rest for the next call.
+    if (acc_data.length() == 0)
+      acc_off = offset;
+    acc_data.append(std::move(data));
+    rc = 0;
+    if (acc_data.length() >= acc_max) {
+      unsigned wlen = acc_data.length() - acc_data.length() % part_obj->get_group_size();
+      bufferlist bl;
+      acc_data.splice(0, wlen, &bl);
+      rc = part_obj->write_mobj(dpp, std::move(bl), acc_off, &wpipe, y);
+      acc_off += wlen;
+    }
+  }
   if (rc == 0) {
-    actual_part_size += data.length();
+    actual_part_size += len;
     ldpp_dout(dpp, 20) << " write_mobj(): actual_part_size=" << actual_part_size << dendl;
   }
   return rc;
@@ -3085,6 +5191,13 @@ int MotrMultipartWriter::complete(size_t accounted_size, const std::string& etag
   // mtime.
 
   ldpp_dout(dpp, 20) << "MotrMultipartWriter::complete(): enter" << dendl;
+  int rc = part_obj->write_mobj(dpp, std::move(acc_data), acc_off, &wpipe, y);
+  acc_data.clear();
+  if (rc == 0)
+    rc = wpipe.drain(dpp, y);
+  if (rc < 0)
+    return rc;
+
   // Add an entry into object_nnn_part_index.
   bufferlist bl;
   RGWUploadPartInfo info;
@@ -3095,7 +5208,7 @@ int MotrMultipartWriter::complete(size_t accounted_size, const std::string& etag
   info.modified = real_clock::now();
 
   bool compressed;
-  int rc = rgw_compression_info_from_attrset(attrs, compressed, info.cs_info);
+  rc = rgw_compression_info_from_attrset(attrs, compressed, info.cs_info);
   ldpp_dout(dpp, 20) << "MotrMultipartWriter::complete(): compression rc=" << rc << dendl;
   if (rc < 0) {
     ldpp_dout(dpp, 1) << "cannot get compression info" << dendl;
@@ -3105,19 +5218,39 @@ int MotrMultipartWriter::complete(size_t accounted_size, const std::string& etag
   encode(attrs, bl);
   part_obj->meta.encode(bl);
 
-  string p = "part.";
-  char buf[32];
-  snprintf(buf, sizeof(buf), "%08d", (int)part_num);
-  p.append(buf);
-  string tenant_bkt_name = get_bucket_name(head_obj->get_bucket()->get_tenant(), head_obj->get_bucket()->get_name());
-  string obj_part_iname = "motr.rgw.object." + tenant_bkt_name + "." +
-	                  head_obj->get_key().to_str() + ".parts";
+  string p = part_key();
+  string obj_part_iname = part_iname();
   ldpp_dout(dpp, 20) << "MotrMultipartWriter::complete(): object part index = " << obj_part_iname << dendl;
-  rc = store->do_idx_op_by_name(obj_part_iname, M0_IC_PUT, p, bl);
+
+  // A retried part replaces the object of the earlier upload.
+  bufferlist old_bl;
+  MotrObject::Meta old_meta;
+  bool replaced = false;
+  if (store->do_idx_op_by_name(obj_part_iname, M0_IC_GET, p, old_bl, true, y) == 0) {
+    try {
+      RGWUploadPartInfo old_info;
+      std::map<std::string, bufferlist> old_attrs;
+      auto iter = old_bl.cbegin();
+      decode(old_info, iter);
+      decode(old_attrs, iter);
+      old_meta.decode(iter);
+      replaced = old_meta.oid.u_hi != part_obj->meta.oid.u_hi ||
+                 old_meta.oid.u_lo != part_obj->meta.oid.u_lo;
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode part " << p << dendl;
+    }
+  }
+
+  rc = store->do_idx_op_by_name(obj_part_iname, M0_IC_PUT, p, bl, true, y);
   if (rc < 0) {
     return rc == -ENOENT ? -ERR_NO_SUCH_UPLOAD : rc;
   }
 
+  if (!gc_tag.empty())
+    store->get_gc()->remove(dpp, gc_tag, y);
+  if (replaced)
+    store->get_gc()->enqueue_delete(dpp, {old_meta}, y);
+
   return 0;
 }
 
@@ -3205,7 +5338,7 @@ int MotrStore::get_user_by_access_key(const DoutPrefixProvider *dpp, const std::
   MotrAccessKey access_key;
 
   rc = do_idx_op_by_name(RGW_IAM_MOTR_ACCESS_KEY,
-                           M0_IC_GET, key, bl);
+                           M0_IC_GET, key, bl, true, y);
   if (rc < 0){
     ldout(cctx, 0) << "Access key not found: rc = " << rc << dendl;
     return rc;
@@ -3238,7 +5371,7 @@ int MotrStore::get_user_by_email(const DoutPrefixProvider *dpp, const std::strin
   RGWUserInfo uinfo;
   MotrEmailInfo email_info; 
   rc = do_idx_op_by_name(RGW_IAM_MOTR_EMAIL_KEY,
-                           M0_IC_GET, email, bl);
+                           M0_IC_GET, email, bl, true, y);
   if (rc < 0){
     ldout(cctx, 0) << "Email Id not found: rc = " << rc << dendl;
     return rc;
@@ -3272,7 +5405,7 @@ int MotrStore::store_access_key(const DoutPrefixProvider *dpp, optional_yield y,
   bufferlist bl;
   access_key.encode(bl);
   rc = do_idx_op_by_name(RGW_IAM_MOTR_ACCESS_KEY,
-                                M0_IC_PUT, access_key.id, bl);
+                                M0_IC_PUT, access_key.id, bl, true, y);
   if (rc < 0){
     ldout(cctx, 0) << "Failed to store key: rc = " << rc << dendl;
     return rc;
@@ -3285,7 +5418,7 @@ int MotrStore::delete_access_key(const DoutPrefixProvider *dpp, optional_yield y
   int rc;
   bufferlist bl;
   rc = do_idx_op_by_name(RGW_IAM_MOTR_ACCESS_KEY,
-                                M0_IC_DEL, access_key, bl);
+                                M0_IC_DEL, access_key, bl, true, y);
   if (rc < 0){
     ldout(cctx, 0) << "Failed to delete key: rc = " << rc << dendl;
   }
@@ -3298,7 +5431,7 @@ int MotrStore::store_email_info(const DoutPrefixProvider *dpp, optional_yield y,
   bufferlist bl;
   email_info.encode(bl);
   rc = do_idx_op_by_name(RGW_IAM_MOTR_EMAIL_KEY,
-                                M0_IC_PUT, email_info.email_id, bl);
+                                M0_IC_PUT, email_info.email_id, bl, true, y);
   if (rc < 0) {
     ldout(cctx, 0) << "Failed to store the user by email as key: rc = " << rc << dendl;
   } 
@@ -3378,106 +5511,404 @@ int MotrStore::cluster_stat(RGWClusterStat& stats)
 
 std::unique_ptr<Lifecycle> MotrStore::get_lifecycle(void)
 {
-  return 0;
+  return std::make_unique<MotrLifecycle>(this);
 }
 
-std::unique_ptr<Completions> MotrStore::get_completions(void)
+struct motr_lc_entry
 {
-  return 0;
-}
+  std::string bucket;
+  uint64_t start_time = 0;
+  uint32_t status = 0;
 
-std::unique_ptr<Notification> MotrStore::get_notification(Object* obj, Object* src_obj, struct req_state* s,
-    rgw::notify::EventType event_type, const string* object_name)
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(bucket, bl);
+    encode(start_time, bl);
+    encode(status, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(bucket, bl);
+    decode(start_time, bl);
+    decode(status, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(motr_lc_entry)
+
+struct motr_lc_head
 {
-  return std::make_unique<MotrNotification>(obj, src_obj, event_type);
-}
+  uint64_t start_date = 0;
+  std::string marker;
 
-std::unique_ptr<Notification>  MotrStore::get_notification(const DoutPrefixProvider* dpp, Object* obj,
-        Object* src_obj, RGWObjectCtx* rctx, rgw::notify::EventType event_type, rgw::sal::Bucket* _bucket,
-        std::string& _user_id, std::string& _user_tenant, std::string& _req_id, optional_yield y)
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(start_date, bl);
+    encode(marker, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(start_date, bl);
+    decode(marker, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(motr_lc_head)
+
+struct motr_lc_lease
 {
-  return std::make_unique<MotrNotification>(obj, src_obj, event_type);
-}
+  std::string owner;
+  ceph::real_time expire;
 
-int MotrStore::log_usage(const DoutPrefixProvider *dpp, map<rgw_user_bucket, RGWUsageBatch>& usage_info)
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(owner, bl);
+    encode(expire, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(owner, bl);
+    decode(expire, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(motr_lc_lease)
+
+static int motr_lc_decode_entry(const bufferlist& bl, Lifecycle::LCEntry& entry)
 {
+  motr_lc_entry e;
+  try {
+    auto iter = bl.cbegin();
+    decode(e, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  entry.bucket = std::move(e.bucket);
+  entry.start_time = e.start_time;
+  entry.status = e.status;
   return 0;
 }
 
-int MotrStore::log_op(const DoutPrefixProvider *dpp, string& oid, bufferlist& bl)
+int MotrLifecycle::get_entry(const std::string& oid, const std::string& marker,
+                             LCEntry& entry)
 {
-  return 0;
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(RGW_MOTR_LC_IDX_NAME, M0_IC_GET,
+                                    oid + "/" + marker, bl);
+  if (rc < 0)
+    return rc;
+  return motr_lc_decode_entry(bl, entry);
 }
 
-int MotrStore::register_to_service_map(const DoutPrefixProvider *dpp, const string& daemon_type,
-    const map<string, string>& meta)
+int MotrLifecycle::get_next_entry(const std::string& oid, std::string& marker,
+                                  LCEntry& entry)
 {
+  // An empty entry tells the end of the shard.
+  vector<LCEntry> entries;
+  int rc = list_entries(oid, marker, 1, entries);
+  if (rc < 0)
+    return rc;
+  entry = entries.empty() ? LCEntry() : std::move(entries.front());
   return 0;
 }
 
-void MotrStore::get_ratelimit(RGWRateLimitInfo& bucket_ratelimit,
-                              RGWRateLimitInfo& user_ratelimit,
-                              RGWRateLimitInfo& anon_ratelimit)
+int MotrLifecycle::set_entry(const std::string& oid, const LCEntry& entry)
 {
-  return;
+  motr_lc_entry e{entry.bucket, entry.start_time, entry.status};
+  bufferlist bl;
+  encode(e, bl);
+  return store->do_idx_op_by_name(RGW_MOTR_LC_IDX_NAME, M0_IC_PUT,
+                                  oid + "/" + entry.bucket, bl);
 }
 
-void MotrStore::get_quota(RGWQuotaInfo& bucket_quota, RGWQuotaInfo& user_quota)
+int MotrLifecycle::list_entries(const std::string& oid, const std::string& marker,
+                                uint32_t max_entries, vector<LCEntry>& entries)
 {
-  // XXX: Not handled for the first pass
-  return;
-}
+  entries.clear();
+  if (max_entries == 0)
+    return 0;
 
-int MotrStore::set_buckets_enabled(const DoutPrefixProvider *dpp, vector<rgw_bucket>& buckets, bool enabled)
-{
-  return 0;
-}
+  // The entries of the shard after `marker`.
+  string prefix = oid + "/";
+  string start = prefix + marker;
+  if (!marker.empty())
+    start.push_back('\0');
 
-int MotrStore::get_sync_policy_handler(const DoutPrefixProvider *dpp,
-    std::optional<rgw_zone_id> zone,
-    std::optional<rgw_bucket> bucket,
-    RGWBucketSyncPolicyHandlerRef *phandler,
-    optional_yield y)
-{
-  return 0;
-}
+  MotrIdxLister lister(store, RGW_MOTR_LC_IDX_NAME, prefix, "");
+  int rc = lister.start(start, max_entries, null_yield);
+  if (rc < 0)
+    return rc;
 
-RGWDataSyncStatusManager* MotrStore::get_data_sync_manager(const rgw_zone_id& source_zone)
-{
-  return 0;
+  MotrIdxLister::Entry ent;
+  while (entries.size() < max_entries && (rc = lister.next(ent, null_yield)) > 0) {
+    LCEntry entry;
+    rc = motr_lc_decode_entry(ent.val, entry);
+    if (rc < 0)
+      return rc;
+    entries.push_back(std::move(entry));
+  }
+  return rc < 0 ? rc : 0;
 }
 
-int MotrStore::read_all_usage(const DoutPrefixProvider *dpp, uint64_t start_epoch, uint64_t end_epoch,
-    uint32_t max_entries, bool *is_truncated,
-    RGWUsageIter& usage_iter,
-    map<rgw_user_bucket, rgw_usage_log_entry>& usage)
+int MotrLifecycle::rm_entry(const std::string& oid, const LCEntry& entry)
 {
-  return 0;
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(RGW_MOTR_LC_IDX_NAME, M0_IC_DEL,
+                                    oid + "/" + entry.bucket, bl);
+  return rc == -ENOENT ? 0 : rc;
 }
 
-int MotrStore::trim_all_usage(const DoutPrefixProvider *dpp, uint64_t start_epoch, uint64_t end_epoch)
+int MotrLifecycle::get_head(const std::string& oid, LCHead& head)
 {
-  return 0;
-}
+  // A shard without a head has never been processed.
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(RGW_MOTR_LC_IDX_NAME, M0_IC_GET, oid, bl);
+  if (rc == -ENOENT) {
+    head = LCHead();
+    return 0;
+  }
+  if (rc < 0)
+    return rc;
 
-int MotrStore::get_config_key_val(string name, bufferlist *bl)
-{
+  motr_lc_head h;
+  try {
+    auto iter = bl.cbegin();
+    decode(h, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  head.start_date = h.start_date;
+  head.marker = std::move(h.marker);
   return 0;
 }
 
-int MotrStore::meta_list_keys_init(const DoutPrefixProvider *dpp, const string& section, const string& marker, void** phandle)
+int MotrLifecycle::put_head(const std::string& oid, const LCHead& head)
 {
-  return 0;
+  motr_lc_head h{(uint64_t)head.start_date, head.marker};
+  bufferlist bl;
+  encode(h, bl);
+  return store->do_idx_op_by_name(RGW_MOTR_LC_IDX_NAME, M0_IC_PUT, oid, bl);
 }
 
-int MotrStore::meta_list_keys_next(const DoutPrefixProvider *dpp, void* handle, int max, list<string>& keys, bool* truncated)
+LCSerializer* MotrLifecycle::get_serializer(const std::string& lock_name,
+                                            const std::string& oid,
+                                            const std::string& cookie)
 {
-  return 0;
+  return new MotrLCSerializer(store, oid, lock_name, cookie);
 }
 
-void MotrStore::meta_list_keys_complete(void* handle)
+// The owner tells apart the serializers of a gateway, which all the lc
+// workers of the gateway create with the same cookie.
+MotrLCSerializer::MotrLCSerializer(MotrStore* _store, const std::string& oid,
+                                   const std::string& lock_name,
+                                   const std::string& cookie) :
+  store(_store), key(oid + "/" + lock_name),
+  owner(_store->ctx()->_conf.get_val<std::string>("motr_my_fid") + "/" +
+        cookie + "/" + gen_rand_alphanumeric(_store->ctx(), 8))
+{ }
+
+int MotrLCSerializer::try_lock(const DoutPrefixProvider *dpp, utime_t dur, optional_yield y)
 {
-  return;
+  motr_lc_lease lease{owner, real_clock::now() + ceph::make_timespan(dur)};
+  bufferlist bl;
+  encode(lease, bl);
+  int rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_PUT,
+                                    key, bl, false, y);
+  if (rc != -EEXIST)
+    return rc;
+
+  // Like a cls lock, a lease is not taken again until it ran out, even by
+  // its owner.
+  auto read_lease = [&](motr_lc_lease& cur) {
+    bufferlist cur_bl;
+    int rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_GET,
+                                      key, cur_bl, true, y);
+    if (rc == -ENOENT) // released meanwhile, let the caller retry
+      return -EBUSY;
+    if (rc < 0)
+      return rc;
+    try {
+      auto iter = cur_bl.cbegin();
+      decode(cur, iter);
+    } catch (buffer::error& err) {
+      return -EIO;
+    }
+    return 0;
+  };
+
+  motr_lc_lease cur;
+  rc = read_lease(cur);
+  if (rc < 0)
+    return rc;
+  if (cur.expire > real_clock::now())
+    return -EBUSY;
+
+  // Of the gateways taking over the same lease, the one creating its claim
+  // gets it. A gateway that read the lease before it was taken over and
+  // released finds a different lease once it has the claim.
+  string cur_claim = key + "/claim/" + cur.owner + "/" +
+                     std::to_string(cur.expire.time_since_epoch().count());
+  bufferlist claim_bl;
+  rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_PUT,
+                                cur_claim, claim_bl, false, y);
+  if (rc == -EEXIST)
+    return -EBUSY;
+  if (rc < 0)
+    return rc;
+
+  motr_lc_lease again;
+  rc = read_lease(again);
+  if (rc == 0 && (again.owner != cur.owner || again.expire != cur.expire))
+    rc = -EBUSY;
+  if (rc < 0) {
+    store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_DEL,
+                             cur_claim, claim_bl, true, y);
+    return rc;
+  }
+
+  ldpp_dout(dpp, 10) << __func__ << ": taking over lease " << key
+                     << " of " << cur.owner << dendl;
+  rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_PUT,
+                                key, bl, true, y);
+  if (rc < 0)
+    return rc;
+  claim = std::move(cur_claim);
+  return 0;
+}
+
+// A lease that ran out is left for its takeover, which may already be
+// under way: deleting it would let a new lease be created alongside the
+// one taking it over. A gateway holding a lease past its expiry can still
+// run along with the next holder, as with any lease.
+int MotrLCSerializer::unlock()
+{
+  bufferlist bl;
+  if (!claim.empty()) {
+    store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_DEL, claim, bl);
+    claim.clear();
+  }
+
+  int rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_GET, key, bl);
+  if (rc < 0)
+    return rc == -ENOENT ? 0 : rc;
+
+  motr_lc_lease cur;
+  try {
+    auto iter = bl.cbegin();
+    decode(cur, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  // The lease was taken over, or may be being taken over.
+  if (cur.owner != owner || cur.expire <= real_clock::now())
+    return 0;
+
+  bl.clear();
+  rc = store->do_idx_op_by_name(RGW_MOTR_LC_LOCK_IDX_NAME, M0_IC_DEL, key, bl);
+  return rc == -ENOENT ? 0 : rc;
+}
+
+std::unique_ptr<Completions> MotrStore::get_completions(void)
+{
+  return 0;
+}
+
+std::unique_ptr<Notification> MotrStore::get_notification(Object* obj, Object* src_obj, struct req_state* s,
+    rgw::notify::EventType event_type, const string* object_name)
+{
+  return std::make_unique<MotrNotification>(obj, src_obj, event_type);
+}
+
+std::unique_ptr<Notification>  MotrStore::get_notification(const DoutPrefixProvider* dpp, Object* obj,
+        Object* src_obj, RGWObjectCtx* rctx, rgw::notify::EventType event_type, rgw::sal::Bucket* _bucket,
+        std::string& _user_id, std::string& _user_tenant, std::string& _req_id, optional_yield y)
+{
+  return std::make_unique<MotrNotification>(obj, src_obj, event_type);
+}
+
+int MotrStore::log_usage(const DoutPrefixProvider *dpp, map<rgw_user_bucket, RGWUsageBatch>& usage_info)
+{
+  return 0;
+}
+
+int MotrStore::log_op(const DoutPrefixProvider *dpp, string& oid, bufferlist& bl)
+{
+  return 0;
+}
+
+int MotrStore::register_to_service_map(const DoutPrefixProvider *dpp, const string& daemon_type,
+    const map<string, string>& meta)
+{
+  return 0;
+}
+
+void MotrStore::get_ratelimit(RGWRateLimitInfo& bucket_ratelimit,
+                              RGWRateLimitInfo& user_ratelimit,
+                              RGWRateLimitInfo& anon_ratelimit)
+{
+  return;
+}
+
+void MotrStore::get_quota(RGWQuotaInfo& bucket_quota, RGWQuotaInfo& user_quota)
+{
+  // XXX: Not handled for the first pass
+  return;
+}
+
+int MotrStore::set_buckets_enabled(const DoutPrefixProvider *dpp, vector<rgw_bucket>& buckets, bool enabled)
+{
+  return 0;
+}
+
+int MotrStore::get_sync_policy_handler(const DoutPrefixProvider *dpp,
+    std::optional<rgw_zone_id> zone,
+    std::optional<rgw_bucket> bucket,
+    RGWBucketSyncPolicyHandlerRef *phandler,
+    optional_yield y)
+{
+  return 0;
+}
+
+RGWDataSyncStatusManager* MotrStore::get_data_sync_manager(const rgw_zone_id& source_zone)
+{
+  return 0;
+}
+
+int MotrStore::read_all_usage(const DoutPrefixProvider *dpp, uint64_t start_epoch, uint64_t end_epoch,
+    uint32_t max_entries, bool *is_truncated,
+    RGWUsageIter& usage_iter,
+    map<rgw_user_bucket, rgw_usage_log_entry>& usage)
+{
+  return 0;
+}
+
+int MotrStore::trim_all_usage(const DoutPrefixProvider *dpp, uint64_t start_epoch, uint64_t end_epoch)
+{
+  return 0;
+}
+
+int MotrStore::get_config_key_val(string name, bufferlist *bl)
+{
+  return 0;
+}
+
+int MotrStore::meta_list_keys_init(const DoutPrefixProvider *dpp, const string& section, const string& marker, void** phandle)
+{
+  return 0;
+}
+
+int MotrStore::meta_list_keys_next(const DoutPrefixProvider *dpp, void* handle, int max, list<string>& keys, bool* truncated)
+{
+  *truncated = false;
+  return 0;
+}
+
+void MotrStore::meta_list_keys_complete(void* handle)
+{
+  return;
 }
 
 std::string MotrStore::meta_get_marker(void* handle)
@@ -3490,7 +5921,8 @@ int MotrStore::meta_remove(const DoutPrefixProvider *dpp, string& metadata_key,
   return 0;
 }
 
-int MotrStore::open_idx(struct m0_uint128 *id, bool create, struct m0_idx *idx)
+int MotrStore::open_idx(struct m0_uint128 *id, bool create, struct m0_idx *idx,
+                        optional_yield y)
 {
   m0_idx_init(idx, &container.co_realm, id);
 
@@ -3505,11 +5937,7 @@ int MotrStore::open_idx(struct m0_uint128 *id, bool create, struct m0_idx *idx)
     goto out;
   }
 
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(cctx, op, y);
 
   if (rc != 0 && rc != -EEXIST)
     ldout(cctx, 0) << "ERROR: index create failed: " << rc << dendl;
@@ -3525,7 +5953,8 @@ static void set_m0bufvec(struct m0_bufvec *bv, vector<uint8_t>& vec)
 
 // idx must be opened with open_idx() beforehand
 int MotrStore::do_idx_op(struct m0_idx *idx, enum m0_idx_opcode opcode,
-                         vector<uint8_t>& key, vector<uint8_t>& val, bool update)
+                         vector<uint8_t>& key, vector<uint8_t>& val, bool update,
+                         optional_yield y)
 {
   int rc, rc_i;
   struct m0_bufvec k, v, *vp = &v;
@@ -3561,11 +5990,7 @@ int MotrStore::do_idx_op(struct m0_idx *idx, enum m0_idx_opcode opcode,
     goto out;
   }
 
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(cctx, op, y, 1);
 
   if (rc != 0) {
     ldout(cctx, 0) << "ERROR: op failed: " << rc << dendl;
@@ -3593,190 +6018,470 @@ out:
   return rc;
 }
 
-// Retrieve a range of key/value pairs starting from keys[0].
-int MotrStore::do_idx_next_op(struct m0_idx *idx,
-                              vector<vector<uint8_t>>& keys,
-                              vector<vector<uint8_t>>& vals)
+// Run an index op on a number of records. The records are packed into Motr
+// ops of up to motr_idx_batch_size records each, so that N records take
+// N / motr_idx_batch_size round trips instead of N. The return code of
+// every record is put in `rcs`; the function itself only fails if an op
+// fails as a whole. For GET, the values of the found records are put in
+// `vals`.
+int MotrStore::do_idx_batch_op(struct m0_idx *idx, enum m0_idx_opcode opcode,
+                               vector<vector<uint8_t>>& keys,
+                               vector<vector<uint8_t>>& vals,
+                               vector<int>& rcs, bool update,
+                               optional_yield y)
 {
-  int rc;
-  uint32_t i = 0;
-  int nr_kvp = vals.size();
-  int *rcs = new int[nr_kvp];
-  struct m0_bufvec k, v;
-  struct m0_op *op = nullptr;
+  int rc = 0;
+  uint32_t flags = 0;
+  const size_t nr_kvp = keys.size();
+  const size_t batch = cctx->_conf.get_val<uint64_t>("motr_idx_batch_size");
 
-  rc = m0_bufvec_empty_alloc(&k, nr_kvp)?:
-       m0_bufvec_empty_alloc(&v, nr_kvp);
-  if (rc != 0) {
-    ldout(cctx, 0) << "ERROR: failed to allocate kv bufvecs" << dendl;
-    return rc;
-  }
+  ceph_assert(opcode == M0_IC_PUT || opcode == M0_IC_GET || opcode == M0_IC_DEL);
+  ceph_assert(opcode != M0_IC_PUT || vals.size() == nr_kvp);
 
-  set_m0bufvec(&k, keys[0]);
+  if (opcode == M0_IC_PUT && update)
+    flags |= M0_OIF_OVERWRITE;
+  if (opcode == M0_IC_GET)
+    vals.resize(nr_kvp);
+  rcs.assign(nr_kvp, 0);
 
-  rc = m0_idx_op(idx, M0_IC_NEXT, &k, &v, rcs, 0, &op);
-  if (rc != 0) {
-    ldout(cctx, 0) << "ERROR: failed to init index op: " << rc << dendl;
-    goto out;
-  }
+  for (size_t first = 0; first < nr_kvp; first += batch) {
+    size_t nr = std::min(batch, nr_kvp - first);
+    struct m0_bufvec k, v, *vp = opcode == M0_IC_DEL ? nullptr : &v;
+    struct m0_op *op = nullptr;
 
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+    if (m0_bufvec_empty_alloc(&k, nr) != 0) {
+      ldout(cctx, 0) << "ERROR: failed to allocate key bufvec" << dendl;
+      return -ENOMEM;
+    }
+    if (vp != nullptr && m0_bufvec_empty_alloc(&v, nr) != 0) {
+      ldout(cctx, 0) << "ERROR: failed to allocate value bufvec" << dendl;
+      m0_bufvec_free2(&k);
+      return -ENOMEM;
+    }
 
-  if (rc != 0) {
-    ldout(cctx, 0) << "ERROR: op failed: " << rc << dendl;
-    goto out;
-  }
+    for (size_t i = 0; i < nr; i++) {
+      k.ov_buf[i] = reinterpret_cast<char*>(keys[first + i].data());
+      k.ov_vec.v_count[i] = keys[first + i].size();
+      if (opcode == M0_IC_PUT) {
+        v.ov_buf[i] = reinterpret_cast<char*>(vals[first + i].data());
+        v.ov_vec.v_count[i] = vals[first + i].size();
+      }
+    }
 
-  for (i = 0; i < v.ov_vec.v_nr; ++i) {
-    if (rcs[i] < 0)
-      break;
+    rc = m0_idx_op(idx, opcode, &k, vp, &rcs[first], flags, &op);
+    if (rc != 0)
+      ldout(cctx, 0) << "ERROR: failed to init index op: " << rc << dendl;
+    else
+      rc = motr_op_exec(cctx, op, y, nr);
+    ldout(cctx, 20) << "do_idx_batch_op(): opcode=" << opcode << " first="
+                    << first << " nr=" << nr << " rc=" << rc << dendl;
+
+    if (rc == 0 && opcode == M0_IC_GET) {
+      for (size_t i = 0; i < nr; i++) {
+        if (rcs[first + i] != 0)
+          continue;
+        auto data = reinterpret_cast<uint8_t*>(v.ov_buf[i]);
+        vals[first + i].assign(data, data + v.ov_vec.v_count[i]);
+      }
+    }
 
-    vector<uint8_t>& key = keys[i];
-    vector<uint8_t>& val = vals[i];
-    key.resize(k.ov_vec.v_count[i]);
-    val.resize(v.ov_vec.v_count[i]);
-    memcpy(reinterpret_cast<char*>(key.data()), k.ov_buf[i], k.ov_vec.v_count[i]);
-    memcpy(reinterpret_cast<char*>(val.data()), v.ov_buf[i], v.ov_vec.v_count[i]);
-  }
+    m0_bufvec_free2(&k);
+    if (opcode == M0_IC_GET)
+      m0_bufvec_free(&v); // cleanup buffer after GET
+    else if (opcode == M0_IC_PUT)
+      m0_bufvec_free2(&v);
 
-out:
-  k.ov_vec.v_nr = i;
-  v.ov_vec.v_nr = i;
-  m0_bufvec_free(&k);
-  m0_bufvec_free(&v); // cleanup buffer after GET
+    if (rc != 0) {
+      ldout(cctx, 0) << "ERROR: batch op failed: " << rc << dendl;
+      return rc;
+    }
+  }
 
-  delete []rcs;
-  return rc ?: i;
+  return 0;
 }
 
-// Retrieve a number of key/value pairs under the prefix starting
-// from the marker at key_out[0].
-int MotrStore::next_query_by_name(string idx_name,
-                                  vector<string>& key_out,
-                                  vector<bufferlist>& val_out,
-                                  string prefix, string delim)
-{
-  unsigned nr_kvp = std::min(val_out.size(), 100UL);
-  struct m0_idx idx = {};
-  vector<vector<uint8_t>> keys(nr_kvp);
-  vector<vector<uint8_t>> vals(nr_kvp);
-  struct m0_uint128 idx_id;
-  int i = 0, j, k = 0;
-
-  index_name_to_motr_fid(idx_name, &idx_id);
-  int rc = open_motr_idx(&idx_id, &idx);
-  if (rc != 0) {
-    ldout(cctx, 0) << "ERROR: next_query_by_name(): failed to open index: rc="
-                   << rc << dendl;
-    goto out;
-  }
-
-  // Only the first element for keys needs to be set for NEXT query.
-  // The keys will be set will the returned keys from motr index.
-  ldout(cctx, 20) <<__func__<< ": next_query_by_name(): index=" << idx_name
-                  << " prefix=" << prefix << " delim=" << delim << dendl;
-  keys[0].assign(key_out[0].begin(), key_out[0].end());
-  for (i = 0; i < (int)val_out.size(); i += k, k = 0) {
-    rc = do_idx_next_op(&idx, keys, vals);
-    ldout(cctx, 20) << "do_idx_next_op() = " << rc << dendl;
-    if (rc < 0) {
-      ldout(cctx, 0) << "ERROR: NEXT query failed. " << rc << dendl;
-      goto out;
-    }
+// Retrieve a range of key/value pairs starting from keys[0].
+// Smallest NEXT op of a listing.
+static const unsigned MOTR_LIST_MIN_BATCH = 16;
 
-    string dir;
-    for (j = 0, k = 0; j < rc; ++j) {
-      string key(keys[j].begin(), keys[j].end());
-      size_t pos = std::string::npos;
-      if (!delim.empty())
-        pos = key.find(delim, prefix.length());
-      if (pos != std::string::npos) { // DIR entry
-        dir.assign(key, 0, pos + 1);
-        if (dir.compare(0, prefix.length(), prefix) != 0)
-          goto out;
-        if (i + k == 0 || dir != key_out[i + k - 1]) // a new one
-          key_out[i + k++] = dir;
-        continue;
+struct MotrIdxLister::Batch {
+  CephContext *cct;
+  MotrOpWaiter waiter;
+  struct m0_op *op = nullptr;
+  struct m0_bufvec k = {};
+  struct m0_bufvec v = {};
+  vector<int> rcs;
+  vector<uint8_t> start;
+  unsigned nr = 0;    // records asked for
+  unsigned count = 0; // records returned
+  bool waited = false;
+
+  explicit Batch(CephContext *_cct) : cct(_cct) {}
+  ~Batch() {
+    if (op != nullptr) {
+      if (!waited) {
+        m0_op_cancel(&op, 1);
+        waiter.wait(cct, op, null_yield);
       }
-      dir = "";
-      if (key.compare(0, prefix.length(), prefix) != 0)
-        goto out;
-      key_out[i + k] = key;
-      bufferlist& vbl = val_out[i + k];
-      vbl.append(reinterpret_cast<char*>(vals[j].data()), vals[j].size());
-      ++k;
+      m0_op_fini(op);
+      m0_op_free(op);
     }
+    // Only the returned records hold buffers allocated by Motr.
+    if (k.ov_buf != nullptr) {
+      k.ov_vec.v_nr = count;
+      m0_bufvec_free(&k);
+    }
+    if (v.ov_buf != nullptr) {
+      v.ov_vec.v_nr = count;
+      m0_bufvec_free(&v);
+    }
+  }
 
-    if (rc < (int)nr_kvp) // there are no more keys to fetch
-      break;
-
-    string next_key;
-    if (dir != "")
-      next_key = dir + "\xff"; // skip all dir content in 1 step
-    else
-      next_key = key_out[i + k - 1] + " ";
-    ldout(cctx, 0) << "do_idx_next_op(): next_key=" << next_key << dendl;
-    keys[0].assign(next_key.begin(), next_key.end());
-
-    int keys_left = val_out.size() - (i + k);  // i + k gives next index.
-    // Resizing keys & vals vector when `keys_left < batch size`.
-    if (keys_left < (int)nr_kvp) {
-      keys.resize(keys_left);
-      vals.resize(keys_left);
+  int wait(optional_yield y) {
+    int rc = waiter.wait(cct, op, y);
+    waited = true;
+    if (rc != 0)
+      return rc;
+    for (count = 0; count < v.ov_vec.v_nr; count++) {
+      if (rcs[count] < 0)
+        break;
     }
+    return 0;
   }
 
-out:
-  m0_idx_fini(&idx);
-  return rc < 0 ? rc : i + k;
-}
+  std::string_view key(unsigned i) const {
+    return std::string_view(static_cast<const char*>(k.ov_buf[i]),
+                            k.ov_vec.v_count[i]);
+  }
+  std::string_view val(unsigned i) const {
+    return std::string_view(static_cast<const char*>(v.ov_buf[i]),
+                            v.ov_vec.v_count[i]);
+  }
+};
 
-int MotrStore::delete_motr_idx_by_name(string iname)
+MotrIdxLister::MotrIdxLister(MotrStore *_store, const string& idx_name,
+                             const string& _prefix, const string& _delim)
+  : store(_store),
+    idx(_store->get_idx_cache()->get(idx_name)),
+    prefix(_prefix),
+    delim(_delim),
+    max_batch(_store->ctx()->_conf.get_val<uint64_t>("motr_list_batch_max"))
 {
-  struct m0_idx idx;
-  struct m0_uint128 idx_id;
-  struct m0_op *op = nullptr;
-
-  ldout(cctx, 20) << "delete_motr_idx_by_name=" << iname << dendl;
-
-  index_name_to_motr_fid(iname, &idx_id);
-  m0_idx_init(&idx, &container.co_realm, &idx_id);
-  m0_entity_open(&idx.in_entity, &op);
-  int rc = m0_entity_delete(&idx.in_entity, &op);
-  if (rc < 0)
-    goto out;
+}
 
-  m0_op_launch(&op, 1);
+MotrIdxLister::~MotrIdxLister() = default;
 
-  ldout(cctx, 70) << "waiting for op completion" << dendl;
+// Size a NEXT op for the entries still expected beyond the `ahead` records
+// already fetched, at the rate the delimiter rolled keys up so far. Zero
+// if those records are expected to be enough.
+unsigned MotrIdxLister::next_batch_size(unsigned ahead) const
+{
+  double keys_per_entry = nr_entries ? (double)nr_keys / nr_entries : 1.0;
+  uint64_t left = want > nr_entries ? want - nr_entries : 0;
+  uint64_t nr = left * keys_per_entry;
+  if (nr <= ahead)
+    return 0;
+  return std::clamp<uint64_t>(nr - ahead, MOTR_LIST_MIN_BATCH,
+                              std::max(max_batch, MOTR_LIST_MIN_BATCH));
+}
 
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+int MotrIdxLister::launch(std::unique_ptr<Batch>& b, const string& start, unsigned nr)
+{
+  b = std::make_unique<Batch>(store->ctx());
+  b->nr = nr;
+  b->rcs.resize(nr);
+  b->start.assign(start.begin(), start.end());
 
-  if (rc == -ENOENT) // race deletion??
-    rc = 0;
-  else if (rc < 0)
-    ldout(cctx, 0) << "ERROR: index create failed: " << rc << dendl;
+  int rc = m0_bufvec_empty_alloc(&b->k, nr)?:
+           m0_bufvec_empty_alloc(&b->v, nr);
+  if (rc != 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to allocate kv bufvecs" << dendl;
+    b.reset();
+    return rc;
+  }
+  set_m0bufvec(&b->k, b->start);
 
-  ldout(cctx, 20) << "delete_motr_idx_by_name rc=" << rc << dendl;
+  rc = m0_idx_op(idx.get(), M0_IC_NEXT, &b->k, &b->v, b->rcs.data(), 0, &b->op);
+  if (rc != 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to init index op: " << rc << dendl;
+    b->op = nullptr;
+    b.reset();
+    return rc;
+  }
+  b->waiter.setup(b->op, nr);
+  m0_op_launch(&b->op, 1);
 
-out:
-  m0_idx_fini(&idx);
-  return rc;
+  return 0;
 }
 
-int MotrStore::open_motr_idx(struct m0_uint128 *id, struct m0_idx *idx)
+// The key to continue a listing from after `last`: the next possible key,
+// or the first one after the whole directory `last` is in.
+string MotrIdxLister::resume_key(std::string_view last) const
 {
-  m0_idx_init(idx, &container.co_realm, id);
+  string start;
+  size_t dpos = string::npos;
+  if (!delim.empty() && last.compare(0, prefix.size(), prefix) == 0)
+    dpos = last.find(delim, prefix.size());
+  if (dpos != string::npos) {
+    start.assign(last.substr(0, dpos + delim.size()));
+    start.push_back('\xff');
+  } else {
+    start.assign(last);
+    start.push_back('\0');
+  }
+  return start;
+}
+
+int MotrIdxLister::advance(optional_yield y)
+{
+  cur = std::move(ahead);
+  pos = 0;
+  int rc = cur->wait(y);
+  if (rc != 0) {
+    ldout(store->ctx(), 0) << "ERROR: NEXT query failed. " << rc << dendl;
+    return rc;
+  }
+  ldout(store->ctx(), 20) << __func__ << ": got " << cur->count << " of "
+                          << cur->nr << " records" << dendl;
+
+  // A short batch reaches the end of the index.
+  last_batch = cur->count < cur->nr || cur->count == 0;
+  if (last_batch)
+    return 0;
+
+  // Stop prefetching once past the prefix.
+  std::string_view last = cur->key(cur->count - 1);
+  if (last.compare(0, prefix.size(), prefix) > 0)
+    return 0;
+  unsigned nr = next_batch_size(cur->count);
+  if (nr == 0)
+    return 0;
+  return launch(ahead, resume_key(last), nr);
+}
+
+int MotrIdxLister::start(const string& start_key, unsigned _want, optional_yield y)
+{
+  want = _want;
+  ldout(store->ctx(), 20) << __func__ << ": prefix=" << prefix << " delim=" << delim
+                          << " start=" << start_key << " want=" << want << dendl;
+  int rc = launch(ahead, start_key,
+                  std::max(next_batch_size(0), MOTR_LIST_MIN_BATCH));
+  if (rc < 0)
+    return rc;
+  return advance(y);
+}
+
+int MotrIdxLister::next(Entry& ent, optional_yield y)
+{
+  while (!done) {
+    if (pos == cur->count) {
+      if (last_batch) {
+        done = true;
+        break;
+      }
+      if (ahead == nullptr) {
+        // Fewer entries came out of the records than expected.
+        int rc = launch(ahead, resume_key(cur->key(cur->count - 1)),
+                        std::max(next_batch_size(0), MOTR_LIST_MIN_BATCH));
+        if (rc < 0)
+          return rc;
+      }
+      int rc = advance(y);
+      if (rc < 0)
+        return rc;
+      continue;
+    }
+
+    std::string_view key = cur->key(pos++);
+    nr_keys++;
+    if (key.compare(0, prefix.size(), prefix) != 0) {
+      done = true;
+      break;
+    }
+
+    size_t dpos = string::npos;
+    if (!delim.empty())
+      dpos = key.find(delim, prefix.size());
+    if (dpos != string::npos) {
+      std::string_view dir = key.substr(0, dpos + delim.size());
+      if (dir == last_dir)
+        continue;
+      last_dir.assign(dir);
+      // Skip the rest of the directory in this batch.
+      while (pos < cur->count && cur->key(pos).compare(0, dir.size(), dir) == 0) {
+        pos++;
+        nr_keys++;
+      }
+      ent.key = last_dir;
+      ent.is_dir = true;
+      ent.val.clear();
+    } else {
+      std::string_view val = cur->val(pos - 1);
+      ent.key = key;
+      ent.is_dir = false;
+      ent.val.clear();
+      ent.val.push_back(buffer::create_static(val.size(),
+                                              const_cast<char*>(val.data())));
+    }
+    nr_entries++;
+    return 1;
+  }
+
   return 0;
 }
 
+// Retrieve a number of key/value pairs under the prefix starting
+// from the marker at key_out[0].
+int MotrStore::next_query_by_name(string idx_name,
+                                  vector<string>& key_out,
+                                  vector<bufferlist>& val_out,
+                                  string prefix, string delim,
+                                  optional_yield y)
+{
+  MotrIdxLister lister(this, idx_name, prefix, delim);
+  MotrIdxLister::Entry ent;
+  int n = 0;
+
+  ldout(cctx, 20) <<__func__<< ": next_query_by_name(): index=" << idx_name
+                  << " prefix=" << prefix << " delim=" << delim << dendl;
+  int rc = lister.start(key_out[0], val_out.size(), y);
+  while (rc == 0 && n < (int)val_out.size()) {
+    rc = lister.next(ent, y);
+    if (rc <= 0)
+      break;
+    key_out[n].assign(ent.key);
+    if (!ent.is_dir)
+      val_out[n].append(ent.val.c_str(), ent.val.length());
+    n++;
+    rc = 0;
+  }
+  if (rc < 0) {
+    ldout(cctx, 0) << "ERROR: NEXT query failed. " << rc << dendl;
+    return rc;
+  }
+
+  return n;
+}
+
+int MotrStore::delete_motr_idx_by_name(string iname, optional_yield y)
+{
+  struct m0_idx idx;
+  struct m0_uint128 idx_id;
+  struct m0_op *op = nullptr;
+
+  ldout(cctx, 20) << "delete_motr_idx_by_name=" << iname << dendl;
+
+  idx_cache.invalidate(iname);
+  index_name_to_motr_fid(iname, &idx_id);
+  m0_idx_init(&idx, &container.co_realm, &idx_id);
+  m0_entity_open(&idx.in_entity, &op);
+  int rc = m0_entity_delete(&idx.in_entity, &op);
+  if (rc < 0)
+    goto out;
+
+  ldout(cctx, 70) << "waiting for op completion" << dendl;
+
+  rc = motr_op_exec(cctx, op, y);
+
+  if (rc == -ENOENT) // race deletion??
+    rc = 0;
+  else if (rc < 0)
+    ldout(cctx, 0) << "ERROR: index create failed: " << rc << dendl;
+
+  ldout(cctx, 20) << "delete_motr_idx_by_name rc=" << rc << dendl;
+
+out:
+  m0_idx_fini(&idx);
+  return rc;
+}
+
+MotrIdxCache::IdxRef MotrIdxCache::get(const std::string& iname)
+{
+  Shard& shard = shard_of(iname);
+  if (max_shard_entries != 0) {
+    std::shared_lock l{shard.lock};
+    auto iter = shard.entries.find(iname);
+    if (iter != shard.entries.end()) {
+      iter->second->referenced.store(true, std::memory_order_relaxed);
+      return iter->second->idx;
+    }
+  }
+
+  struct m0_uint128 idx_id;
+  store->index_name_to_motr_fid(iname, &idx_id);
+  IdxRef idx(new m0_idx(), [](struct m0_idx *idx) {
+    m0_idx_fini(idx);
+    delete idx;
+  });
+  m0_idx_init(idx.get(), &store->container.co_realm, &idx_id);
+  if (max_shard_entries == 0)
+    return idx;
+
+  std::unique_lock l{shard.lock};
+  auto iter = shard.entries.find(iname);
+  if (iter != shard.entries.end()) // raced with another miss
+    return iter->second->idx;
+
+  auto e = std::make_unique<Entry>();
+  e->idx = idx;
+  e->slot = evict(shard);
+  shard.clock[e->slot] = iname;
+  shard.entries.emplace(iname, std::move(e));
+
+  return idx;
+}
+
+size_t MotrIdxCache::evict(Shard& shard)
+{
+  if (!shard.free_slots.empty()) {
+    size_t slot = shard.free_slots.back();
+    shard.free_slots.pop_back();
+    return slot;
+  }
+  if (shard.clock.size() < max_shard_entries) {
+    shard.clock.emplace_back();
+    return shard.clock.size() - 1;
+  }
+
+  // Every slot holds an entry, give the referenced ones a second chance.
+  for (;;) {
+    size_t slot = shard.hand;
+    shard.hand = (shard.hand + 1) % shard.clock.size();
+    auto iter = shard.entries.find(shard.clock[slot]);
+    ceph_assert(iter != shard.entries.end());
+    if (iter->second->referenced.exchange(false, std::memory_order_relaxed))
+      continue;
+    shard.entries.erase(iter);
+    shard.clock[slot].clear();
+    return slot;
+  }
+}
+
+void MotrIdxCache::invalidate(const std::string& iname)
+{
+  Shard& shard = shard_of(iname);
+  std::unique_lock l{shard.lock};
+
+  auto iter = shard.entries.find(iname);
+  if (iter == shard.entries.end())
+    return;
+  size_t slot = iter->second->slot;
+  shard.clock[slot].clear();
+  shard.free_slots.push_back(slot);
+  shard.entries.erase(iter);
+}
+
+void MotrIdxCache::clear()
+{
+  for (auto& shard : shards) {
+    std::unique_lock l{shard.lock};
+    shard.entries.clear();
+    shard.clock.clear();
+    shard.free_slots.clear();
+    shard.hand = 0;
+  }
+}
+
 // The following marcos are from dix/fid_convert.h which are not exposed.
 enum {
       M0_DIX_FID_DEVICE_ID_OFFSET   = 32,
@@ -3807,19 +6512,12 @@ void MotrStore::index_name_to_motr_fid(string iname, struct m0_uint128 *id)
 }
 
 int MotrStore::do_idx_op_by_name(string idx_name, enum m0_idx_opcode opcode,
-                                 string key_str, bufferlist &bl, bool update)
+                                 string key_str, bufferlist &bl, bool update,
+                                 optional_yield y)
 {
-  struct m0_idx idx;
   vector<uint8_t> key(key_str.begin(), key_str.end());
   vector<uint8_t> val;
-  struct m0_uint128 idx_id;
-
-  index_name_to_motr_fid(idx_name, &idx_id);
-  int rc = open_motr_idx(&idx_id, &idx);
-  if (rc != 0) {
-    ldout(cctx, 0) << "ERROR: failed to open index: " << rc << dendl;
-    goto out;
-  }
+  MotrIdxCache::IdxRef idx = idx_cache.get(idx_name);
 
   if (opcode == M0_IC_PUT)
     val.assign(bl.c_str(), bl.c_str() + bl.length());
@@ -3827,17 +6525,46 @@ int MotrStore::do_idx_op_by_name(string idx_name, enum m0_idx_opcode opcode,
   ldout(cctx, 20) <<__func__<< ": do_idx_op_by_name(): op="
                  << (opcode == M0_IC_PUT ? "PUT" : "GET")
                  << " idx=" << idx_name << " key=" << key_str << dendl;
-  rc = do_idx_op(&idx, opcode, key, val, update);
+  int rc = do_idx_op(idx.get(), opcode, key, val, update, y);
   if (rc == 0 && opcode == M0_IC_GET)
     // Append the returned value (blob) to the bufferlist.
     bl.append(reinterpret_cast<char*>(val.data()), val.size());
 
-out:
-  m0_idx_fini(&idx);
   return rc;
 }
 
-int MotrStore::create_motr_idx_by_name(string iname)
+int MotrStore::do_idx_batch_op_by_name(string idx_name, enum m0_idx_opcode opcode,
+                                       const vector<string>& key_strs,
+                                       vector<bufferlist>& bls, vector<int>& rcs,
+                                       bool update, optional_yield y)
+{
+  vector<vector<uint8_t>> keys;
+  vector<vector<uint8_t>> vals;
+  MotrIdxCache::IdxRef idx = idx_cache.get(idx_name);
+
+  keys.reserve(key_strs.size());
+  for (const auto& key_str : key_strs)
+    keys.emplace_back(key_str.begin(), key_str.end());
+  if (opcode == M0_IC_PUT) {
+    vals.reserve(bls.size());
+    for (auto& bl : bls)
+      vals.emplace_back(bl.c_str(), bl.c_str() + bl.length());
+  }
+
+  ldout(cctx, 20) <<__func__<< ": idx=" << idx_name << " opcode=" << opcode
+                  << " nr=" << keys.size() << dendl;
+  int rc = do_idx_batch_op(idx.get(), opcode, keys, vals, rcs, update, y);
+  if (rc == 0 && opcode == M0_IC_GET) {
+    bls.resize(vals.size());
+    for (size_t i = 0; i < vals.size(); i++)
+      if (rcs[i] == 0)
+        bls[i].append(reinterpret_cast<char*>(vals[i].data()), vals[i].size());
+  }
+
+  return rc;
+}
+
+int MotrStore::create_motr_idx_by_name(string iname, optional_yield y)
 {
   struct m0_idx idx = {};
   struct m0_uint128 id;
@@ -3853,11 +6580,7 @@ int MotrStore::create_motr_idx_by_name(string iname)
     goto out;
   }
 
-  m0_op_launch(&op, 1);
-  rc = m0_op_wait(op, M0_BITS(M0_OS_FAILED, M0_OS_STABLE), M0_TIME_NEVER) ?:
-       m0_rc(op);
-  m0_op_fini(op);
-  m0_op_free(op);
+  rc = motr_op_exec(cctx, op, y);
 
   if (rc != 0 && rc != -EEXIST)
     ldout(cctx, 0) << "ERROR: index create failed: " << rc << dendl;
@@ -3899,18 +6622,750 @@ std::string MotrStore::get_cluster_id(const DoutPrefixProvider* dpp,  optional_y
 int MotrStore::init_metadata_cache(const DoutPrefixProvider *dpp,
                                    CephContext *cct, bool use_cache)
 {
-  this->obj_meta_cache = new MotrMetaCache(dpp, cct);
+  this->obj_meta_cache = new MotrMetaCache(dpp, cct, "obj_meta");
   this->get_obj_meta_cache()->set_enabled(use_cache);
 
-  this->user_cache = new MotrMetaCache(dpp, cct);
+  this->user_cache = new MotrMetaCache(dpp, cct, "user");
   this->get_user_cache()->set_enabled(use_cache);
 
-  this->bucket_inst_cache = new MotrMetaCache(dpp, cct);
+  this->bucket_inst_cache = new MotrMetaCache(dpp, cct, "bucket_inst");
   this->get_bucket_inst_cache()->set_enabled(use_cache);
 
+  if (!use_cache)
+    return 0;
+
+  cache_notifier.register_cache(obj_meta_cache);
+  cache_notifier.register_cache(user_cache);
+  cache_notifier.register_cache(bucket_inst_cache);
+  int rc = cache_notifier.start(dpp);
+  if (rc < 0)
+    ldpp_dout(dpp, 0) << "ERROR: failed to start the cache notifier, relying on "
+                      << "rgw_cache_expiry_interval: rc=" << rc << dendl;
+
+  return 0;
+}
+
+int MotrStore::init_stats(const DoutPrefixProvider *dpp, bool quota_threads)
+{
+  stats_tracker.start();
+  quota_handler = RGWQuotaHandler::generate_handler(dpp, this, quota_threads);
+  return 0;
+}
+
+MotrStatsTracker::MotrStatsTracker(MotrStore *_store, CephContext *cct)
+  : store(_store),
+    gateway(cct->_conf.get_val<std::string>("motr_my_fid")),
+    nr_shards(cct->_conf.get_val<uint64_t>("motr_stats_shards")),
+    shards(new Shard[nr_shards])
+{
+}
+
+std::string MotrStatsTracker::record_key(const std::string& bucket, unsigned shard)
+{
+  return bucket + "/" + gateway + "/" + std::to_string(shard);
+}
+
+void MotrStatsTracker::update(const std::string& bucket, const std::string& obj_name,
+                              int sign, uint64_t size)
+{
+  Shard& shard = shards[std::hash<std::string>{}(obj_name) % nr_shards];
+  std::lock_guard l{shard.lock};
+  MotrStats& delta = shard.deltas[bucket];
+  delta.num_objects += sign;
+  delta.size += sign * (int64_t)size;
+  delta.size_rounded += sign * (int64_t)rgw_rounded_objsize(size);
+}
+
+void MotrStatsTracker::add_object(const std::string& bucket, const std::string& obj_name,
+                                  uint64_t size)
+{
+  update(bucket, obj_name, 1, size);
+}
+
+void MotrStatsTracker::remove_object(const std::string& bucket, const std::string& obj_name,
+                                     uint64_t size)
+{
+  update(bucket, obj_name, -1, size);
+}
+
+void MotrStatsTracker::requeue(unsigned shard, const std::string& bucket,
+                               const MotrStats& delta)
+{
+  std::lock_guard l{shards[shard].lock};
+  shards[shard].deltas[bucket].add(delta);
+}
+
+void MotrStatsTracker::flush()
+{
+  CephContext *cct = store->ctx();
+  std::lock_guard fl{flush_lock};
+
+  for (unsigned i = 0; i < nr_shards; i++) {
+    std::map<std::string, MotrStats> deltas;
+    {
+      std::lock_guard l{shards[i].lock};
+      deltas.swap(shards[i].deltas);
+    }
+    if (deltas.empty())
+      continue;
+
+    // Load the current records, in one batch. They are read on every flush
+    // rather than kept: another gateway removing the bucket drops them.
+    vector<string> keys;
+    vector<bufferlist> vals;
+    vector<int> rcs;
+    vector<string> bkts;
+    for (const auto& [bucket, delta] : deltas) {
+      bkts.push_back(bucket);
+      keys.push_back(record_key(bucket, i));
+    }
+    int rc = store->do_idx_batch_op_by_name(RGW_MOTR_BUCKET_STATS_IDX_NAME,
+                                            M0_IC_GET, keys, vals, rcs);
+    if (rc < 0) {
+      ldout(cct, 0) << "ERROR: failed to read bucket stats: rc=" << rc << dendl;
+      for (const auto& [bucket, delta] : deltas)
+        requeue(i, bucket, delta);
+      continue;
+    }
+
+    // Add the deltas and write the records out, in one batch.
+    vector<string> put_bkts;
+    vector<string> put_keys;
+    vector<bufferlist> put_vals;
+    for (size_t j = 0; j < keys.size(); j++) {
+      MotrStats rec;
+      if (rcs[j] == 0) {
+        try {
+          auto iter = vals[j].cbegin();
+          decode(rec, iter);
+        } catch (buffer::error& err) {
+          ldout(cct, 0) << "ERROR: failed to decode bucket stats " << keys[j] << dendl;
+          requeue(i, bkts[j], deltas[bkts[j]]);
+          continue;
+        }
+      } else if (rcs[j] != -ENOENT) { // failed to load, retry next time
+        requeue(i, bkts[j], deltas[bkts[j]]);
+        continue;
+      }
+      rec.add(deltas[bkts[j]]);
+      rec.last_stats_update = real_clock::now();
+      bufferlist bl;
+      encode(rec, bl);
+      put_bkts.push_back(std::move(bkts[j]));
+      put_keys.push_back(std::move(keys[j]));
+      put_vals.push_back(std::move(bl));
+    }
+    if (put_keys.empty())
+      continue;
+    rc = store->do_idx_batch_op_by_name(RGW_MOTR_BUCKET_STATS_IDX_NAME,
+                                        M0_IC_PUT, put_keys, put_vals, rcs);
+    for (size_t j = 0; j < put_keys.size(); j++) {
+      if (rc == 0 && rcs[j] == 0)
+        continue;
+      ldout(cct, 0) << "ERROR: failed to write bucket stats " << put_keys[j]
+                    << ": rc=" << (rc ?: rcs[j]) << dendl;
+      requeue(i, put_bkts[j], deltas[put_bkts[j]]);
+    }
+  }
+}
+
+// List all the stats records of a bucket, of all the gateways.
+int MotrStatsTracker::list_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                                  vector<string>& keys, vector<bufferlist>& vals,
+                                  optional_yield y)
+{
+  const string prefix = bucket + "/";
+  const int max = 1000;
+  string marker = prefix;
+
+  for (;;) {
+    vector<string> page_keys(max);
+    vector<bufferlist> page_vals(max);
+    page_keys[0] = marker;
+    int rc = store->next_query_by_name(RGW_MOTR_BUCKET_STATS_IDX_NAME,
+                                       page_keys, page_vals, prefix, "", y);
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to list bucket stats: rc=" << rc << dendl;
+      return rc;
+    }
+    for (int i = 0; i < rc; i++) {
+      keys.push_back(std::move(page_keys[i]));
+      vals.push_back(std::move(page_vals[i]));
+    }
+    if (rc < max)
+      break;
+    marker = keys.back() + " ";
+  }
+
+  return 0;
+}
+
+int MotrStatsTracker::read_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                                  MotrStats& stats, optional_yield y)
+{
+  vector<string> keys;
+  vector<bufferlist> vals;
+
+  stats = MotrStats();
+  int rc = list_bucket(dpp, bucket, keys, vals, y);
+  if (rc < 0)
+    return rc;
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    MotrStats rec;
+    try {
+      auto iter = vals[i].cbegin();
+      decode(rec, iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode bucket stats " << keys[i] << dendl;
+      return -EIO;
+    }
+    stats.add(rec);
+    stats.last_stats_update = std::max(stats.last_stats_update, rec.last_stats_update);
+  }
+
+  // Add what this gateway has not written out yet.
+  for (unsigned i = 0; i < nr_shards; i++) {
+    std::lock_guard l{shards[i].lock};
+    auto iter = shards[i].deltas.find(bucket);
+    if (iter != shards[i].deltas.end())
+      stats.add(iter->second);
+  }
+
+  return 0;
+}
+
+int MotrStatsTracker::remove_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                                    optional_yield y)
+{
+  for (unsigned i = 0; i < nr_shards; i++) {
+    std::lock_guard l{shards[i].lock};
+    shards[i].deltas.erase(bucket);
+  }
+  // Wait out a flush under way, it would write the records back.
+  { std::lock_guard fl{flush_lock}; }
+
+  vector<string> keys;
+  vector<bufferlist> vals;
+  vector<int> rcs;
+  int rc = list_bucket(dpp, bucket, keys, vals, y);
+  if (rc < 0 || keys.empty())
+    return rc;
+
+  vals.clear();
+  return store->do_idx_batch_op_by_name(RGW_MOTR_BUCKET_STATS_IDX_NAME,
+                                        M0_IC_DEL, keys, vals, rcs, true, y);
+}
+
+void *MotrStatsTracker::entry()
+{
+  std::unique_lock l{lock};
+  while (!stopping) {
+    auto interval = std::chrono::seconds(
+        store->ctx()->_conf.get_val<uint64_t>("motr_stats_flush_interval"));
+    cond.wait_for(l, interval, [this] { return stopping; });
+    l.unlock();
+    flush();
+    l.lock();
+  }
+  return nullptr;
+}
+
+void MotrStatsTracker::start()
+{
+  create("motr_stats");
+}
+
+void MotrStatsTracker::stop()
+{
+  {
+    std::lock_guard l{lock};
+    stopping = true;
+    cond.notify_all();
+  }
+  if (is_started())
+    join();
+  flush();
+}
+
+int MotrStore::init_gc(const DoutPrefixProvider *dpp, bool use_gc_thread)
+{
+  if (use_gc_thread)
+    gc.start();
+  return 0;
+}
+
+// The lc workers only run with use_lc_thread; radosgw-admin uses the
+// RGWLC itself to list and process the lc shards.
+int MotrStore::init_lc(const DoutPrefixProvider *dpp, bool use_lc_thread)
+{
+  lc = new RGWLC();
+  lc->initialize(cctx, this);
+  if (use_lc_thread)
+    lc->start_processor();
+  return 0;
+}
+
+int MotrStore::init_data_cache(const DoutPrefixProvider *dpp)
+{
+  if (!cctx->_conf->rgw_d3n_l1_local_datacache_enabled)
+    return 0;
+  data_cache = new D3nDataCache();
+  data_cache->init(cctx);
+  ldpp_dout(dpp, 1) << "INFO: motr object data cached in "
+                    << data_cache->cache_location << dendl;
+  return 0;
+}
+
+enum {
+  l_motr_gc_first = 880100,
+
+  l_motr_gc_enqueue,
+  l_motr_gc_entries,
+  l_motr_gc_objs,
+  l_motr_gc_linked,
+  l_motr_gc_shared,
+  l_motr_gc_errors,
+  l_motr_gc_pending,
+
+  l_motr_gc_last,
+};
+
+MotrGC::MotrGC(MotrStore *_store, CephContext *_cct)
+  : store(_store), cct(_cct),
+    gateway(_cct->_conf.get_val<std::string>("motr_my_fid"))
+{
+  PerfCountersBuilder b(cct, "motr-gc", l_motr_gc_first, l_motr_gc_last);
+  b.add_u64_counter(l_motr_gc_enqueue, "enqueue", "Number of entries queued");
+  b.add_u64_counter(l_motr_gc_entries, "entries", "Number of entries processed");
+  b.add_u64_counter(l_motr_gc_objs, "objs", "Number of Motr objects deleted");
+  b.add_u64_counter(l_motr_gc_linked, "linked", "Number of uploaded objects found linked");
+  b.add_u64_counter(l_motr_gc_shared, "shared", "Number of Motr objects kept for other references");
+  b.add_u64_counter(l_motr_gc_errors, "errors", "Number of failed entries");
+  b.add_u64(l_motr_gc_pending, "pending", "Number of due entries being processed");
+  counters = PerfCountersRef{b.create_perf_counters(), cct};
+  cct->get_perfcounters_collection()->add(counters.get());
+}
+
+int MotrGC::enqueue(const DoutPrefixProvider *dpp, const MotrGCEntry& e,
+                    ceph::timespan wait, string *tag, optional_yield y)
+{
+  string key = motr_time_key(real_clock::now() + wait) + "." + gateway + "." +
+               std::to_string(seq++);
+  bufferlist bl;
+  encode(e, bl);
+  int rc = store->do_idx_op_by_name(RGW_MOTR_GC_QUEUE_IDX_NAME, M0_IC_PUT,
+                                    key, bl, true, y);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to queue GC entry: rc=" << rc << dendl;
+    return rc;
+  }
+  ldpp_dout(dpp, 20) << "queued GC entry " << key << " type=" << (int)e.type
+                     << " objs=" << e.objs.size() << dendl;
+  counters->inc(l_motr_gc_enqueue);
+  if (tag)
+    *tag = std::move(key);
+  return 0;
+}
+
+// Many objects, the parts of a multipart object, are split into entries
+// of up to MOTR_GC_ENTRY_MAX_OBJS, queued in one batch, for the workers to
+// delete them in parallel.
+static const size_t MOTR_GC_ENTRY_MAX_OBJS = 100;
+
+int MotrGC::enqueue_delete(const DoutPrefixProvider *dpp,
+                           vector<MotrObject::Meta> objs, optional_yield y)
+{
+  if (objs.empty())
+    return 0;
+  auto wait = std::chrono::seconds(cct->_conf.get_val<uint64_t>("motr_gc_obj_min_wait"));
+  if (objs.size() <= MOTR_GC_ENTRY_MAX_OBJS) {
+    MotrGCEntry e;
+    e.type = MotrGCEntry::DELETE;
+    e.objs = std::move(objs);
+    return enqueue(dpp, e, wait, nullptr, y);
+  }
+
+  string when = motr_time_key(real_clock::now() + wait);
+  vector<string> keys;
+  vector<bufferlist> vals;
+  for (auto it = objs.begin(); it != objs.end(); ) {
+    auto end = it + std::min<size_t>(MOTR_GC_ENTRY_MAX_OBJS, objs.end() - it);
+    MotrGCEntry e;
+    e.type = MotrGCEntry::DELETE;
+    e.objs.assign(std::make_move_iterator(it), std::make_move_iterator(end));
+    it = end;
+    keys.push_back(when + "." + gateway + "." + std::to_string(seq++));
+    vals.emplace_back();
+    encode(e, vals.back());
+  }
+
+  vector<int> rcs;
+  int rc = store->do_idx_batch_op_by_name(RGW_MOTR_GC_QUEUE_IDX_NAME, M0_IC_PUT,
+                                          keys, vals, rcs, true, y);
+  for (size_t i = 0; rc == 0 && i < rcs.size(); i++)
+    rc = rcs[i];
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to queue GC entries: rc=" << rc << dendl;
+    return rc;
+  }
+  ldpp_dout(dpp, 20) << "queued " << keys.size() << " GC entries for "
+                     << objs.size() << " objects" << dendl;
+  counters->inc(l_motr_gc_enqueue, keys.size());
+  return 0;
+}
+
+int MotrGC::enqueue_orphan(const DoutPrefixProvider *dpp, const MotrObject::Meta& obj,
+                           const string& ref_idx, const string& ref_key,
+                           bool ref_is_part, string& tag, optional_yield y)
+{
+  MotrGCEntry e;
+  e.type = MotrGCEntry::ORPHAN;
+  e.objs.push_back(obj);
+  e.ref_idx = ref_idx;
+  e.ref_key = ref_key;
+  e.ref_is_part = ref_is_part;
+  auto wait = std::chrono::seconds(cct->_conf.get_val<uint64_t>("motr_gc_orphan_min_wait"));
+  return enqueue(dpp, e, wait, &tag, y);
+}
+
+int MotrGC::remove(const DoutPrefixProvider *dpp, const string& tag, optional_yield y)
+{
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(RGW_MOTR_GC_QUEUE_IDX_NAME, M0_IC_DEL,
+                                    tag, bl, true, y);
+  if (rc < 0 && rc != -ENOENT) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to remove GC entry " << tag << ": rc=" << rc << dendl;
+    return rc;
+  }
   return 0;
 }
 
+// Check whether the record `ref_key` of index `ref_idx` refers to the
+// object `m`.
+int MotrGC::is_referenced(const DoutPrefixProvider *dpp, const string& ref_idx,
+                          const string& ref_key, bool ref_is_part,
+                          const MotrObject::Meta& m)
+{
+  bufferlist bl;
+  int rc = store->do_idx_op_by_name(ref_idx, M0_IC_GET, ref_key, bl);
+  if (rc == -ENOENT)
+    return 0;
+  if (rc < 0)
+    return rc;
+
+  MotrObject::Meta ref;
+  try {
+    auto iter = bl.cbegin();
+    if (ref_is_part) {
+      RGWUploadPartInfo info;
+      decode(info, iter);
+    } else {
+      rgw_bucket_dir_entry ent;
+      decode(ent, iter);
+    }
+    rgw::sal::Attrs attrs;
+    decode(attrs, iter);
+    ref.decode(iter);
+  } catch (buffer::error& err) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to decode " << ref_idx << "/" << ref_key << dendl;
+    return -EIO;
+  }
+  return ref.oid.u_hi == m.oid.u_hi && ref.oid.u_lo == m.oid.u_lo;
+}
+
+// Check whether the uploaded object `m` ended up referenced by the record
+// of an ORPHAN entry.
+int MotrGC::is_linked(const DoutPrefixProvider *dpp, const MotrGCEntry& e,
+                      const MotrObject::Meta& m)
+{
+  return is_referenced(dpp, e.ref_idx, e.ref_key, e.ref_is_part, m);
+}
+
+static string motr_ref_prefix(const MotrObject::Meta& m)
+{
+  char fid_str[M0_FID_STR_LEN];
+  snprintf(fid_str, ARRAY_SIZE(fid_str), U128X_F, U128_P(&m.oid));
+  return string(fid_str) + "/";
+}
+
+int MotrGC::add_refs(const DoutPrefixProvider *dpp,
+                     const vector<std::pair<MotrObject::Meta, MotrObjRef>>& refs,
+                     optional_yield y)
+{
+  if (refs.empty())
+    return 0;
+
+  vector<string> keys;
+  vector<bufferlist> vals(refs.size());
+  for (size_t i = 0; i < refs.size(); i++) {
+    const auto& [m, ref] = refs[i];
+    keys.push_back(motr_ref_prefix(m) + ref.ref_idx + "/" + ref.ref_key);
+    encode(ref, vals[i]);
+  }
+  vector<int> rcs;
+  int rc = store->do_idx_batch_op_by_name(RGW_MOTR_OBJ_REFS_IDX_NAME, M0_IC_PUT,
+                                          keys, vals, rcs, true, y);
+  for (size_t i = 0; rc == 0 && i < rcs.size(); i++)
+    rc = rcs[i];
+  if (rc < 0)
+    ldpp_dout(dpp, 0) << "ERROR: failed to add object refs: rc=" << rc << dendl;
+  return rc;
+}
+
+// Check the refs of `m` added by server-side copies. Returns 1 if a record
+// still refers to `m`, and 0 once no record does and `m` can be deleted;
+// the refs of the records found gone are dropped. A recent ref whose record
+// doesn't refer to `m` may belong to a copy still linking it: -EAGAIN has
+// the entry retried later.
+int MotrGC::check_refs(const DoutPrefixProvider *dpp, const MotrObject::Meta& m)
+{
+  const int max = 100;
+  const string prefix = motr_ref_prefix(m);
+  const auto grace = std::chrono::seconds(cct->_conf.get_val<uint64_t>("motr_gc_obj_min_wait"));
+  string start = prefix;
+  bool pending = false;
+
+  for (;;) {
+    vector<string> keys(max);
+    vector<bufferlist> vals(max);
+    keys[0] = start;
+    int n = store->next_query_by_name(RGW_MOTR_OBJ_REFS_IDX_NAME, keys, vals, prefix);
+    if (n < 0)
+      return n;
+
+    vector<string> stale;
+    for (int i = 0; i < n; i++) {
+      MotrObjRef ref;
+      try {
+        auto iter = vals[i].cbegin();
+        decode(ref, iter);
+      } catch (buffer::error& err) {
+        ldpp_dout(dpp, 0) << "ERROR: failed to decode object ref " << keys[i] << dendl;
+        stale.push_back(keys[i]);
+        continue;
+      }
+      int rc = is_referenced(dpp, ref.ref_idx, ref.ref_key, ref.ref_is_part, m);
+      if (rc < 0)
+        return rc;
+      if (rc > 0)
+        return 1;
+      if (real_clock::now() - ref.ctime < grace)
+        pending = true;
+      else
+        stale.push_back(keys[i]);
+    }
+
+    if (!stale.empty()) {
+      vector<bufferlist> bls;
+      vector<int> rcs;
+      int rc = store->do_idx_batch_op_by_name(RGW_MOTR_OBJ_REFS_IDX_NAME, M0_IC_DEL,
+                                              stale, bls, rcs);
+      if (rc < 0)
+        return rc;
+    }
+    if (n < max)
+      break;
+    start = keys[n - 1] + '\0';
+  }
+
+  return pending ? -EAGAIN : 0;
+}
+
+void MotrGC::throttle()
+{
+  uint64_t rate = cct->_conf.get_val<uint64_t>("motr_gc_max_deletes_per_sec");
+  if (rate == 0)
+    return;
+
+  ceph::mono_time t;
+  {
+    std::lock_guard l{rate_lock};
+    auto now = ceph::mono_clock::now();
+    next_delete = std::max(next_delete, now) +
+                  std::chrono::nanoseconds(1000000000ull / rate);
+    t = next_delete;
+  }
+  std::this_thread::sleep_until(t);
+}
+
+int MotrGC::delete_obj(const DoutPrefixProvider *dpp, const MotrObject::Meta& m)
+{
+  // Keep an object shared by a copy for the entries still using it.
+  int rc = check_refs(dpp, m);
+  if (rc > 0) {
+    counters->inc(l_motr_gc_shared);
+    return 0;
+  }
+  if (rc < 0)
+    return rc;
+
+  throttle();
+  MotrObject obj(store, rgw_obj_key());
+  obj.meta = m;
+  rc = obj.delete_mobj(dpp);
+  if (rc == -ENOENT)
+    return 0;
+  if (rc == 0)
+    counters->inc(l_motr_gc_objs);
+  return rc;
+}
+
+int MotrGC::process(const DoutPrefixProvider *dpp, const string& key,
+                    const MotrGCEntry& e)
+{
+  for (const auto& m : e.objs) {
+    if (e.type == MotrGCEntry::ORPHAN) {
+      int rc = is_linked(dpp, e, m);
+      if (rc < 0)
+        return rc;
+      if (rc > 0) {
+        counters->inc(l_motr_gc_linked);
+        continue;
+      }
+    }
+    int rc = delete_obj(dpp, m);
+    if (rc == -EAGAIN) {
+      ldpp_dout(dpp, 10) << "GC object of " << key << " may still be shared, retrying later" << dendl;
+      return rc;
+    }
+    if (rc < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: GC failed to delete object of " << key
+                        << ": rc=" << rc << dendl;
+      return rc;
+    }
+  }
+  return remove(dpp, key);
+}
+
+// Queue the entries due by now for the workers.
+int MotrGC::list_due(const DoutPrefixProvider *dpp)
+{
+  const int max = 1000;
+  vector<string> keys(max);
+  vector<bufferlist> vals(max);
+  string end = motr_time_key(real_clock::now());
+
+  // Go on after the previous batch while it was all due, so that entries
+  // failing at the head of the queue don't hold back the later ones.
+  keys[0] = marker;
+  int rc = store->next_query_by_name(RGW_MOTR_GC_QUEUE_IDX_NAME, keys, vals);
+  if (rc < 0) {
+    ldpp_dout(dpp, 0) << "ERROR: failed to list the GC queue: rc=" << rc << dendl;
+    marker.clear();
+    return rc;
+  }
+  if (rc == max && keys[rc - 1] < end) {
+    marker = keys[rc - 1];
+    marker.push_back('\0');
+  } else {
+    marker.clear();
+  }
+
+  std::lock_guard l{lock};
+  for (int i = 0; i < rc && keys[i] < end; i++) {
+    MotrGCEntry e;
+    try {
+      auto iter = vals[i].cbegin();
+      decode(e, iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0) << "ERROR: failed to decode GC entry " << keys[i] << dendl;
+      counters->inc(l_motr_gc_errors);
+      continue;
+    }
+    queue.emplace_back(std::move(keys[i]), std::move(e));
+  }
+  counters->set(l_motr_gc_pending, queue.size());
+  cond.notify_all();
+  return queue.size();
+}
+
+void *MotrGC::Worker::entry()
+{
+  return gc->worker_entry();
+}
+
+void *MotrGC::worker_entry()
+{
+  DoutPrefix dp(cct, dout_subsys, "motr gc: ");
+  std::unique_lock l{lock};
+  while (!stopping) {
+    if (queue.empty()) {
+      cond.wait(l);
+      continue;
+    }
+    auto [key, e] = std::move(queue.front());
+    queue.pop_front();
+    busy++;
+    l.unlock();
+
+    int rc = process(&dp, key, e);
+    counters->inc(rc < 0 ? l_motr_gc_errors : l_motr_gc_entries);
+
+    l.lock();
+    if (rc < 0)
+      failed++;
+    busy--;
+    counters->set(l_motr_gc_pending, queue.size() + busy);
+    cond.notify_all();
+  }
+  return nullptr;
+}
+
+// List the due entries once the workers are done with the previous ones,
+// so that an entry is never handed out twice by one gateway.
+void *MotrGC::entry()
+{
+  DoutPrefix dp(cct, dout_subsys, "motr gc: ");
+  std::unique_lock l{lock};
+  while (!stopping) {
+    cond.wait(l, [this] { return stopping || (queue.empty() && busy == 0); });
+    if (stopping)
+      break;
+    // Retry failed entries only after a pause, once the listing is back
+    // at the head of the queue.
+    bool retry = failed > 0 && marker.empty();
+    if (marker.empty())
+      failed = 0;
+    int rc = 0;
+    if (!retry) {
+      l.unlock();
+      rc = list_due(&dp);
+      l.lock();
+    }
+    if (rc <= 0 && !stopping) {
+      auto period = std::chrono::seconds(
+          cct->_conf.get_val<uint64_t>("motr_gc_processor_period"));
+      cond.wait_for(l, period, [this] { return stopping; });
+    }
+  }
+  return nullptr;
+}
+
+void MotrGC::start()
+{
+  unsigned n = cct->_conf.get_val<uint64_t>("motr_gc_max_concurrent");
+  for (unsigned i = 0; i < n; i++) {
+    workers.push_back(std::make_unique<Worker>(this));
+    workers.back()->create("motr_gc_wrk");
+  }
+  create("motr_gc");
+}
+
+void MotrGC::stop()
+{
+  {
+    std::lock_guard l{lock};
+    stopping = true;
+    cond.notify_all();
+  }
+  if (is_started())
+    join();
+  for (auto& w : workers)
+    w->join();
+  workers.clear();
+}
+
 } // namespace rgw::sal
 
 extern "C" {
@@ -3970,6 +7425,8 @@ void *newMotrStore(CephContext *cct)
       m0_trace_set_mmapped_buffer(false);
     }
 
+    motr_perf_start(cct);
+
     store->instance = nullptr;
     rc = m0_client_init(&store->instance, &store->conf, true);
     if (rc != 0) {
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <sys/socket.h>
+
 extern "C" {
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wextern-c-compat"
@@ -25,6 +27,9 @@ extern "C" {
 #pragma clang diagnostic pop
 }
 
+#include "common/Thread.h"
+#include "common/perf_counters_collection.h"
+#include "common/async/completion.h"
 #include "rgw_sal.h"
 #include "rgw_rados.h"
 #include "rgw_notify.h"
@@ -32,6 +37,9 @@ extern "C" {
 #include "rgw_role.h"
 #include "rgw_multi.h"
 #include "rgw_putobj_processor.h"
+#include "rgw_quota.h"
+
+struct D3nDataCache;
 
 namespace rgw::sal {
 
@@ -43,9 +51,150 @@ class MotrStore;
 #define RGW_MOTR_BUCKET_HD_IDX_NAME   "motr.rgw.bucket.headers"
 #define RGW_IAM_MOTR_ACCESS_KEY       "motr.rgw.accesskeys"
 #define RGW_IAM_MOTR_EMAIL_KEY        "motr.rgw.emails"
+#define RGW_MOTR_BUCKET_STATS_IDX_NAME "motr.rgw.bucket.stats"
+#define RGW_MOTR_USER_STATS_IDX_NAME  "motr.rgw.user.stats"
+#define RGW_MOTR_CACHE_LOG_IDX_NAME   "motr.rgw.cache.changelog"
+#define RGW_MOTR_GC_QUEUE_IDX_NAME    "motr.rgw.gc.queue"
+#define RGW_MOTR_OBJ_REFS_IDX_NAME    "motr.rgw.obj.refs"
+#define RGW_MOTR_LC_IDX_NAME          "motr.rgw.lc"
+#define RGW_MOTR_LC_LOCK_IDX_NAME     "motr.rgw.lc.locks"
+
+// Per-bucket index of the current versions of the objects of a versioned
+// bucket, "motr.rgw.bucket.<bucket>.latest". The key is the object name,
+// the value a copy of the bucket index value of the current version, so
+// that reading an object without a version id is one lookup whatever the
+// number of its versions.
+#define RGW_MOTR_LATEST_IDX_SUFFIX    ".latest"
+
+// Key of the part map of a completed multipart object in its part index,
+// next to the "part.%08d" part records.
+#define RGW_MOTR_PART_MAP_KEY         "map"
 
 //#define RGW_MOTR_BUCKET_ACL_IDX_NAME  "motr.rgw.bucket.acls"
 
+// A metadata cache split into independently locked shards, picked by key
+// hash. Each shard evicts with the CLOCK algorithm: a hit only sets the
+// entry's reference bit under the shared lock, so concurrent lookups never
+// serialize on a writer lock the way ObjectCache::get() does to update its
+// LRU list. Entries expire after rgw_cache_expiry_interval, as in
+// ObjectCache.
+class MotrShardedCache
+{
+  struct Entry {
+    bufferlist data;
+    ceph::coarse_mono_time time_added;
+    std::atomic<bool> referenced = false;
+    size_t slot; // position in Shard::clock
+  };
+
+  struct Shard {
+    ceph::shared_mutex lock = ceph::make_shared_mutex("MotrShardedCache::Shard::lock");
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+    std::vector<std::string> clock; // entry names, "" for a free slot
+    std::vector<size_t> free_slots;
+    size_t hand = 0;
+    PerfCountersRef counters;
+  };
+
+  CephContext *cct;
+  const size_t nr_shards;
+  const size_t max_shard_entries;
+  const ceph::timespan expiry;
+  std::unique_ptr<Shard[]> shards;
+  std::atomic<bool> enabled = true;
+
+  Shard& shard_of(const std::string& name) {
+    return shards[std::hash<std::string>{}(name) % nr_shards];
+  }
+  bool expired(const Entry& e) const {
+    return expiry.count() &&
+           ceph::coarse_mono_clock::now() - e.time_added > expiry;
+  }
+  // Free a slot for a new entry. Called with the shard lock held.
+  size_t evict(Shard& shard);
+  void erase(Shard& shard, const std::string& name);
+
+public:
+  MotrShardedCache(CephContext *_cct, const std::string& name,
+                   size_t _nr_shards, size_t max_entries);
+
+  int get(const std::string& name, bufferlist& data);
+  void put(const std::string& name, const bufferlist& data);
+  void remove(const std::string& name);
+  void set_enabled(bool status);
+};
+
+class MotrMetaCache;
+
+// A metadata cache invalidation, sent between gateways.
+struct MotrCacheNotify {
+  uint32_t op = 0;       // UPDATE_OBJ or INVALIDATE_OBJ
+  std::string gateway;   // motr_my_fid of the sender
+  std::string cache;     // name of the MotrMetaCache
+  std::string name;      // cache entry name
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(op, bl);
+    encode(gateway, bl);
+    encode(cache, bl);
+    encode(name, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(op, bl);
+    decode(gateway, bl);
+    decode(cache, bl);
+    decode(name, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(MotrCacheNotify)
+
+// Carries metadata cache invalidations between the gateways of one Motr
+// cluster, so that their caches can keep entries past the few seconds a
+// short rgw_cache_expiry_interval allows. Changes are sent as datagrams to
+// the motr_cache_notify_peers (UDP, possibly multicast, or unix sockets),
+// and with motr_cache_changelog also appended to a changelog index that
+// every gateway polls. Peers drop the named entry, whatever the change.
+class MotrCacheNotifier : public Thread
+{
+  MotrStore *store;
+  CephContext *cct;
+  std::string gateway;
+  std::map<std::string, MotrMetaCache*> caches;
+
+  int fd = -1;
+  int family = AF_UNSPEC;
+  std::string unix_path; // bound unix socket, removed on stop()
+  std::vector<std::pair<sockaddr_storage, socklen_t>> peers;
+
+  bool changelog = false;
+  std::atomic<uint64_t> log_seq = 0;
+  std::set<std::string> log_seen; // entries applied by the last poll
+  ceph::real_time last_trim;
+
+  std::atomic<bool> stopping = false;
+
+  void handle(const DoutPrefixProvider *dpp, bufferlist& bl);
+  int poll_changelog(const DoutPrefixProvider *dpp);
+  int trim_changelog(const DoutPrefixProvider *dpp);
+  void *entry() override;
+
+public:
+  MotrCacheNotifier(MotrStore *_store, CephContext *_cct);
+
+  // Route the notifications for `cache` to it. Called before start().
+  void register_cache(MotrMetaCache *cache);
+  int start(const DoutPrefixProvider *dpp);
+  void stop();
+
+  bool enabled() const { return fd >= 0 || changelog; }
+  int notify(const DoutPrefixProvider *dpp, const std::string& cache,
+             const std::string& name, uint32_t op);
+};
+
 // A simplified metadata cache implementation.
 // Note: MotrObjMetaCache doesn't handle the IO operations to Motr. A proxy
 // class can be added to handle cache and 'real' ops.
@@ -69,21 +218,30 @@ protected:
   // of RGW instances under heavy use. If you would like to turn off cache expiry,
   // set this value to zero.
   //
-  // Currently POC hasn't implemented the watch-notify menchanism yet. So the
-  // current implementation is similar to cortx-s3server which is based on expiry
-  // time. TODO: see comments on distribute_cache).
+  // Changes are relayed to the other gateways by MotrCacheNotifier, when it
+  // is configured. Otherwise the caches only rely on the expiry time, as
+  // cortx-s3server does.
   //
-  // Beaware: Motr object data is not cached in current POC as RGW!
-  // RGW caches the first chunk (4MB by default).
+  // Object data is not cached here: the blocks read from Motr go to the
+  // D3N local data cache, when it is enabled (see MotrObject::read_mobj()).
   ObjectCache cache;
 
+  // Used instead of `cache` when motr_meta_cache_shards is not zero.
+  std::unique_ptr<MotrShardedCache> sharded;
+
+  std::string name;
+  MotrCacheNotifier *notifier = nullptr;
+
 public:
   // Lookup a cache entry.
   int get(const DoutPrefixProvider *dpp, const std::string& name, bufferlist& data);
 
-  // Insert a cache entry.
+  // Insert a cache entry for a changed record and tell the other gateways.
   int put(const DoutPrefixProvider *dpp, const std::string& name, const bufferlist& data);
 
+  // Insert a cache entry for a record just read from Motr.
+  void fill(const DoutPrefixProvider *dpp, const std::string& name, const bufferlist& data);
+
   // Called when an object is deleted. Notification should be sent to other
   // RGW instances.
   int remove(const DoutPrefixProvider *dpp, const std::string& name);
@@ -91,11 +249,9 @@ public:
   // Make the local cache entry invalid.
   void invalid(const DoutPrefixProvider *dpp, const std::string& name);
 
-  // TODO: Distribute_cache() and watch_cb() now are only place holder functions.
-  // Checkout services/svc_sys_obj_cache.h/cc for reference.
-  // These 2 functions are designed to notify or to act on cache notification.
-  // It is feasible to implement the functionality using Motr's FDMI after discussing
-  // with Hua.
+  // Send a change of `normal_name` to the other gateways, and act on one
+  // received from them. See services/svc_sys_obj_cache.cc for the RADOS
+  // counterparts.
   int distribute_cache(const DoutPrefixProvider *dpp,
                        const std::string& normal_name,
                        ObjectCacheInfo& obj_info, int op);
@@ -106,10 +262,121 @@ public:
                bufferlist& bl);
 
   void set_enabled(bool status);
+  void set_notifier(MotrCacheNotifier *_notifier) { notifier = _notifier; }
+  const std::string& get_name() const { return name; }
+
+  // `name` tells the caches apart in the perf counters and notifications.
+  MotrMetaCache(const DoutPrefixProvider *dpp, CephContext *cct,
+                const std::string& name);
+};
+
+// Initialised m0_idx handles of the recently used indices, keyed by index
+// name. It saves the name to fid hashing and m0_idx_init() on every index
+// op. A handle stays valid for as long as a reference to it is held, even
+// after it has been evicted or invalidated. As in MotrShardedCache, the
+// cache is split into shards evicting with CLOCK, so that hits only take a
+// shared lock.
+class MotrIdxCache
+{
+public:
+  using IdxRef = std::shared_ptr<struct m0_idx>;
+
+private:
+  static constexpr size_t NR_SHARDS = 16;
 
-  MotrMetaCache(const DoutPrefixProvider *dpp, CephContext *cct) {
-    cache.set_ctx(cct);
+  struct Entry {
+    IdxRef idx;
+    std::atomic<bool> referenced = false;
+    size_t slot; // position in Shard::clock
+  };
+
+  struct Shard {
+    ceph::shared_mutex lock = ceph::make_shared_mutex("MotrIdxCache::Shard::lock");
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+    std::vector<std::string> clock; // entry names, "" for a free slot
+    std::vector<size_t> free_slots;
+    size_t hand = 0;
+  };
+
+  MotrStore *store;
+  const size_t max_shard_entries; // 0 when the cache is disabled
+  Shard shards[NR_SHARDS];
+
+  Shard& shard_of(const std::string& iname) {
+    return shards[std::hash<std::string>{}(iname) % NR_SHARDS];
+  }
+  // Free a slot for a new entry. Called with the shard lock held.
+  size_t evict(Shard& shard);
+
+public:
+  MotrIdxCache(MotrStore *_store, size_t max_entries)
+    : store(_store),
+      max_shard_entries(max_entries ? std::max<size_t>(max_entries / NR_SHARDS, 1) : 0) {}
+
+  // Get the handle of the index, initialise it on a miss.
+  IdxRef get(const std::string& iname);
+  // Forget the handle of a deleted index.
+  void invalidate(const std::string& iname);
+  void clear();
+};
+
+// Streams the records of an index in key order, under a prefix and with
+// the keys rolled up at a delimiter as in S3 listings. NEXT ops are sized
+// from the number of entries the caller expects and from how many keys
+// the delimiter rolled up so far, and the next one is launched as soon as
+// the current batch arrives, so that it is in flight while the batch is
+// consumed. The keys and values are handed out as views of the Motr
+// buffers; rolled up keys are skipped without being copied.
+class MotrIdxLister
+{
+public:
+  struct Entry {
+    std::string_view key; // common prefix for a rolled up directory
+    bool is_dir = false;
+    bufferlist val;       // empty for a directory
+  };
+
+private:
+  struct Batch;
+
+  MotrStore *store;
+  MotrIdxCache::IdxRef idx;
+  const std::string prefix;
+  const std::string delim;
+  const unsigned max_batch;
+
+  std::unique_ptr<Batch> cur;  // being consumed
+  std::unique_ptr<Batch> ahead; // in flight
+  unsigned pos = 0;            // next record of cur
+  bool last_batch = false;     // nothing beyond cur
+  bool done = false;
+
+  unsigned want = 0;        // entries the caller expects
+  uint64_t nr_keys = 0;     // records consumed
+  uint64_t nr_entries = 0;  // entries returned
+  std::string last_dir;
+
+  unsigned next_batch_size(unsigned ahead) const;
+  std::string resume_key(std::string_view last) const;
+  int launch(std::unique_ptr<Batch>& b, const std::string& start, unsigned nr);
+  // Wait for the in flight batch, make it current and prefetch the next.
+  int advance(optional_yield y);
+
+public:
+  MotrIdxLister(MotrStore *_store, const std::string& idx_name,
+                const std::string& _prefix, const std::string& _delim);
+  ~MotrIdxLister();
+
+  // List from `start_key` on, expecting to take about `_want` entries.
+  int start(const std::string& start_key, unsigned _want, optional_yield y);
+  // List from right after `marker` on, past all of its directory if it is
+  // a rolled up one.
+  int start_after(const std::string& marker, unsigned _want, optional_yield y) {
+    return start(std::max(resume_key(marker), prefix), _want, y);
   }
+  // Get the next entry, valid until the next call. Returns 1, or 0 at the
+  // end of the listing.
+  int next(Entry& ent, optional_yield y);
 };
 
 struct MotrUserInfo {
@@ -188,6 +455,214 @@ struct MotrAccessKey {
 };
 WRITE_CLASS_ENCODER(MotrAccessKey);
 
+// Usage stats as stored in the stats indices: a share of the stats of a
+// bucket or the stats of a user. The counters of a share may go below
+// zero, when objects written through one gateway are deleted through
+// another one.
+struct MotrStats {
+  int64_t num_objects = 0;
+  int64_t size = 0;
+  int64_t size_rounded = 0;
+  ceph::real_time last_stats_sync;
+  ceph::real_time last_stats_update;
+
+  void add(const MotrStats& o) {
+    num_objects += o.num_objects;
+    size += o.size;
+    size_rounded += o.size_rounded;
+  }
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(num_objects, bl);
+    encode(size, bl);
+    encode(size_rounded, bl);
+    encode(last_stats_sync, bl);
+    encode(last_stats_update, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(num_objects, bl);
+    decode(size, bl);
+    decode(size_rounded, bl);
+    decode(last_stats_sync, bl);
+    decode(last_stats_update, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(MotrStats);
+
+// Maintains the usage stats of the buckets.
+//
+// Every gateway keeps its share of the stats of a bucket in
+// motr_stats_shards records of the bucket stats index, keyed
+// "<bucket>/<gateway>/<shard>", and no other gateway writes them. The
+// stats of a bucket are the sum of all its records. The object PUT and
+// DELETE paths only add to in-memory deltas; a thread adds them to the
+// records every motr_stats_flush_interval seconds.
+class MotrStatsTracker : public Thread {
+  struct Shard {
+    ceph::mutex lock = ceph::make_mutex("MotrStatsTracker::Shard::lock");
+    std::map<std::string, MotrStats> deltas; // by bucket
+  };
+
+  MotrStore *store;
+  std::string gateway;
+  const unsigned nr_shards;
+  std::unique_ptr<Shard[]> shards;
+
+  // Serializes the flushes with the removal of the records.
+  ceph::mutex flush_lock = ceph::make_mutex("MotrStatsTracker::flush_lock");
+
+  ceph::mutex lock = ceph::make_mutex("MotrStatsTracker::lock");
+  ceph::condition_variable cond;
+  bool stopping = false;
+
+  std::string record_key(const std::string& bucket, unsigned shard);
+  void update(const std::string& bucket, const std::string& obj_name,
+              int sign, uint64_t size);
+  void requeue(unsigned shard, const std::string& bucket, const MotrStats& delta);
+  int list_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                  std::vector<std::string>& keys, std::vector<bufferlist>& vals,
+                  optional_yield y);
+  void *entry() override;
+
+public:
+  MotrStatsTracker(MotrStore *_store, CephContext *cct);
+
+  // Account an object added to or removed from a bucket.
+  void add_object(const std::string& bucket, const std::string& obj_name,
+                  uint64_t size);
+  void remove_object(const std::string& bucket, const std::string& obj_name,
+                     uint64_t size);
+  // Write the accumulated deltas to the stats index.
+  void flush();
+  // Sum up the stats of a bucket.
+  int read_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                  MotrStats& stats, optional_yield y);
+  // Drop the stats of a removed bucket.
+  int remove_bucket(const DoutPrefixProvider *dpp, const std::string& bucket,
+                    optional_yield y);
+
+  void start();
+  void stop();
+};
+
+// Kinds of Motr ops with their own counters in the "motr" perf counters.
+enum MotrPerfOp {
+  MOTR_PERF_IDX_GET,
+  MOTR_PERF_IDX_PUT,
+  MOTR_PERF_IDX_DEL,
+  MOTR_PERF_IDX_NEXT,
+  MOTR_PERF_IDX_CREATE,
+  MOTR_PERF_IDX_DELETE,
+  MOTR_PERF_OBJ_CREATE,
+  MOTR_PERF_OBJ_OPEN,
+  MOTR_PERF_OBJ_READ,
+  MOTR_PERF_OBJ_WRITE,
+  MOTR_PERF_OBJ_DELETE,
+  MOTR_PERF_OTHER,
+  MOTR_PERF_OP_NR,
+};
+
+// Counters of each op kind, at l_motr_op_first + op * l_motr_op_nr.
+enum {
+  l_motr_op_lat,        // time from launch to completion
+  l_motr_op_lat_hist,   // latency vs bytes (object i/o) or records (index)
+  l_motr_op_errors,
+  l_motr_op_in_flight,
+  l_motr_op_nr,
+};
+
+enum {
+  l_motr_first = 15500,
+
+  l_motr_in_flight,
+  l_motr_read_bytes,
+  l_motr_write_bytes,
+
+  l_motr_op_first,
+  l_motr_last = l_motr_op_first + MOTR_PERF_OP_NR * l_motr_op_nr,
+};
+
+// Completion of a Motr op. setup() must be called before the op is launched.
+// With a yield context, wait() suspends the coroutine instead of blocking
+// the thread: the op callbacks resume it on its executor when the op
+// becomes stable or fails.
+class MotrOpWaiter {
+  using Signature = void(boost::system::error_code);
+  using Completion = ceph::async::Completion<Signature>;
+
+  ceph::mutex lock = ceph::make_mutex("MotrOpWaiter::lock");
+  bool done = false;
+  std::unique_ptr<Completion> completion;
+
+  // Accounting of the op in the perf counters, if they are enabled.
+  PerfCounters *perf = nullptr;
+  MotrPerfOp perf_op = MOTR_PERF_OTHER;
+  uint64_t size = 0;
+  ceph::mono_time start;
+
+  static const struct m0_op_ops ops;
+  static void op_done(struct m0_op *op);
+
+public:
+  // `size` is the number of bytes of an object i/o, of records of an
+  // index op.
+  void setup(struct m0_op *op, uint64_t size = 0);
+  // Wait for the op to become stable or to fail, return its rc.
+  int wait(CephContext *cct, struct m0_op *op, optional_yield y);
+};
+
+// Memory budget for the object data being written to Motr, shared by
+// all the uploads of a store.
+class MotrWriteBudget {
+  ceph::mutex lock = ceph::make_mutex("MotrWriteBudget::lock");
+  const uint64_t max;
+  uint64_t used = 0;
+
+public:
+  explicit MotrWriteBudget(uint64_t _max) : max(_max) {}
+
+  // Take `n` bytes of the budget if they are available.
+  bool try_get(uint64_t n);
+  // Take `n` bytes of the budget even if it goes over it.
+  void force_get(uint64_t n);
+  void put(uint64_t n);
+};
+
+class MotrObject;
+
+// Writes object data to Motr keeping up to motr_write_depth write ops in
+// flight, so the client can keep sending data while the previous blocks are
+// being written. A block is kept in memory (and accounted in the store's
+// write budget) until its op is complete.
+class MotrWritePipeline {
+  struct Req;
+
+  MotrStore *store;
+  std::deque<std::unique_ptr<Req>> reqs;
+  int err = 0;
+
+  // Wait for the oldest write to complete.
+  int reap(const DoutPrefixProvider *dpp, optional_yield y);
+
+public:
+  explicit MotrWritePipeline(MotrStore *_store);
+  ~MotrWritePipeline();
+
+  // Launch a write of `data` at `offset` of `obj`. The data length must
+  // be a multiple of the object's group size (see get_optimal_bs()).
+  int write(const DoutPrefixProvider *dpp, MotrObject *obj,
+            bufferlist&& data, uint64_t offset, optional_yield y);
+  // Wait for all the launched writes to complete.
+  int drain(const DoutPrefixProvider *dpp, optional_yield y);
+  // Cancel the writes still in flight.
+  void cancel();
+};
+
 class MotrNotification : public Notification {
   public:
     MotrNotification(Object* _obj, Object* _src_obj, rgw::notify::EventType _type) :
@@ -481,6 +956,15 @@ class MotrOIDCProvider : public RGWOIDCProvider {
   }
 };
 
+// The parity declustering attributes of a pool version: N data units, K
+// parity units and S spare units per group, P targets in the pool.
+struct MotrPoolWidth {
+  unsigned N = 0;
+  unsigned K = 0;
+  unsigned S = 0;
+  unsigned P = 0;
+};
+
 class MotrObject : public Object {
   private:
     MotrStore *store;
@@ -498,6 +982,15 @@ class MotrObject : public Object {
     uint64_t part_size;
     uint64_t part_num;
 
+    // The layout geometry of the Motr object, set up once by
+    // get_optimal_bs().
+    unsigned unit_sz = 0;
+    unsigned grp_sz = 0;
+    unsigned max_bs = 0;
+
+    void init_layout_geom();
+    void dump_layout(Formatter *f);
+
   public:
 
     // motr object metadata stored in index
@@ -505,26 +998,97 @@ class MotrObject : public Object {
       struct m0_uint128 oid = {};
       struct m0_fid pver = {};
       uint64_t layout_id = 0;
+      // The data of a small object, kept in the bucket index instead
+      // of a Motr object.
+      bufferlist inline_data;
+
+      bool is_inline() const { return inline_data.length() != 0; }
 
       void encode(bufferlist& bl) const
       {
-        ENCODE_START(5, 5, bl);
+        ENCODE_START(6, 5, bl);
         encode(oid.u_hi, bl);
         encode(oid.u_lo, bl);
         encode(pver.f_container, bl);
         encode(pver.f_key, bl);
         encode(layout_id, bl);
+        encode(inline_data, bl);
         ENCODE_FINISH(bl);
       }
 
       void decode(bufferlist::const_iterator& bl)
       {
-        DECODE_START(5, bl);
+        DECODE_START(6, bl);
         decode(oid.u_hi, bl);
         decode(oid.u_lo, bl);
         decode(pver.f_container, bl);
         decode(pver.f_key, bl);
         decode(layout_id, bl);
+        if (struct_v >= 6)
+          decode(inline_data, bl);
+        DECODE_FINISH(bl);
+      }
+    };
+
+    // The parts of a multipart uploaded object, sorted by their offset
+    // in the object.
+    struct PartMap {
+      struct Part {
+        uint32_t num = 0;
+        uint64_t off = 0;
+        uint64_t size = 0;
+        Meta meta;
+
+        void encode(bufferlist& bl) const
+        {
+          ENCODE_START(1, 1, bl);
+          encode(num, bl);
+          encode(off, bl);
+          encode(size, bl);
+          meta.encode(bl);
+          ENCODE_FINISH(bl);
+        }
+
+        void decode(bufferlist::const_iterator& bl)
+        {
+          DECODE_START(1, bl);
+          decode(num, bl);
+          decode(off, bl);
+          decode(size, bl);
+          meta.decode(bl);
+          DECODE_FINISH(bl);
+        }
+      };
+
+      // The object the map was built for, to tell a stale cached map.
+      ceph::real_time mtime;
+      uint64_t obj_size = 0;
+      std::vector<Part> parts;
+
+      // Index of the part holding byte `off`, parts.size() if none.
+      size_t find(uint64_t off) const;
+
+      void encode(bufferlist& bl) const
+      {
+        ENCODE_START(1, 1, bl);
+        encode(mtime, bl);
+        encode(obj_size, bl);
+        encode((uint32_t)parts.size(), bl);
+        for (const auto& p : parts)
+          p.encode(bl);
+        ENCODE_FINISH(bl);
+      }
+
+      void decode(bufferlist::const_iterator& bl)
+      {
+        DECODE_START(1, bl);
+        decode(mtime, bl);
+        decode(obj_size, bl);
+        uint32_t n;
+        decode(n, bl);
+        parts.resize(n);
+        for (auto& p : parts)
+          p.decode(bl);
         DECODE_FINISH(bl);
       }
     };
@@ -537,12 +1101,22 @@ class MotrObject : public Object {
         MotrObject* source;
         RGWObjectCtx* rctx;
 
-	// The set of part objects if the source is
-	// a multipart uploaded object.
-        std::map<int, std::unique_ptr<MotrObject>> part_objs;
+	// The parts if the source is a multipart uploaded object. A part is
+	// opened when a read reaches it, and the next one in the background
+	// while it is read.
+        struct PartOpen;
+        PartMap parts;
+        std::unique_ptr<PartOpen> cur_part;
+        std::unique_ptr<PartOpen> next_part;
+
+        int open_part(const DoutPrefixProvider *dpp, size_t idx,
+                      std::unique_ptr<PartOpen>& p);
+        int read_parts(const DoutPrefixProvider* dpp, int64_t off, int64_t end,
+                       RGWGetDataCB* cb, optional_yield y);
 
       public:
         MotrReadOp(MotrObject *_source, RGWObjectCtx *_rctx);
+        ~MotrReadOp();
 
         virtual int prepare(optional_yield y, const DoutPrefixProvider* dpp) override;
         virtual int read(int64_t off, int64_t end, bufferlist& bl, optional_yield y, const DoutPrefixProvider* dpp) override;
@@ -555,10 +1129,17 @@ class MotrObject : public Object {
         MotrObject* source;
         RGWObjectCtx* rctx;
 
+        // Make a delete marker, keyed by the source's instance, the
+        // current version of the object.
+        int add_delete_marker(const DoutPrefixProvider* dpp, optional_yield y);
+
       public:
         MotrDeleteOp(MotrObject* _source, RGWObjectCtx* _rctx);
 
         virtual int delete_obj(const DoutPrefixProvider* dpp, optional_yield y) override;
+        virtual void delete_objs(const DoutPrefixProvider* dpp,
+                                 std::vector<DeleteOp*>& ops,
+                                 std::vector<int>& rcs, optional_yield y) override;
     };
 
     MotrObject() = default;
@@ -648,25 +1229,41 @@ class MotrObject : public Object {
 
   public:
     bool is_opened() { return mobj != NULL; }
-    int create_mobj(const DoutPrefixProvider *dpp, uint64_t sz);
-    int open_mobj(const DoutPrefixProvider *dpp);
-    int delete_mobj(const DoutPrefixProvider *dpp);
+    int create_mobj(const DoutPrefixProvider *dpp, uint64_t sz, optional_yield y = null_yield);
+    int open_mobj(const DoutPrefixProvider *dpp, optional_yield y = null_yield);
+    // Set up the open op of the object with a known meta, the caller
+    // launches it.
+    int init_open_op(const DoutPrefixProvider *dpp, struct m0_op **op);
+    int delete_mobj(const DoutPrefixProvider *dpp, optional_yield y = null_yield);
     void close_mobj();
-    int write_mobj(const DoutPrefixProvider *dpp, bufferlist&& data, uint64_t offset);
-    int read_mobj(const DoutPrefixProvider* dpp, int64_t off, int64_t end, RGWGetDataCB* cb);
+    int write_mobj(const DoutPrefixProvider *dpp, bufferlist&& data, uint64_t offset,
+                   MotrWritePipeline *wpipe = nullptr, optional_yield y = null_yield);
+    int read_mobj(const DoutPrefixProvider* dpp, int64_t off, int64_t end, RGWGetDataCB* cb,
+                  optional_yield y = null_yield);
     unsigned get_optimal_bs(unsigned len);
-
-    int get_part_objs(const DoutPrefixProvider *dpp,
-                      std::map<int, std::unique_ptr<MotrObject>>& part_objs);
-    int open_part_objs(const DoutPrefixProvider* dpp,
-                       std::map<int, std::unique_ptr<MotrObject>>& part_objs);
-    int read_multipart_obj(const DoutPrefixProvider* dpp,
-                           int64_t off, int64_t end, RGWGetDataCB* cb,
-                           std::map<int, std::unique_ptr<MotrObject>>& part_objs);
-    int delete_part_objs(const DoutPrefixProvider* dpp);
+    unsigned get_group_size();
+    // Prefix of the names of the object's blocks in the data cache.
+    std::string cache_chunk_prefix() const;
+
+    int get_part_map(const DoutPrefixProvider *dpp, const rgw_bucket_dir_entry& ent,
+                     PartMap& map, optional_yield y = null_yield);
+    std::unique_ptr<MotrObject> get_part_obj(const PartMap::Part& part);
+    int delete_part_objs(const DoutPrefixProvider* dpp, optional_yield y);
     void set_category(RGWObjCategory _category) {category = _category;}
-    int get_bucket_dir_ent(const DoutPrefixProvider *dpp, rgw_bucket_dir_entry& ent);
-    int update_version_entries(const DoutPrefixProvider *dpp);
+    // The raw bucket index value of the object: the version asked for, or
+    // the current one in a versioned bucket.
+    int get_bucket_dir_ent_bl(const DoutPrefixProvider *dpp, bufferlist& bl,
+                              optional_yield y = null_yield);
+    int get_bucket_dir_ent(const DoutPrefixProvider *dpp, rgw_bucket_dir_entry& ent,
+                           optional_yield y = null_yield, Attrs *pattrs = nullptr);
+    // Make the version `ent`, linked with the bucket index value `bl`, the
+    // current version of the object, see RGW_MOTR_LATEST_IDX_SUFFIX.
+    int set_latest_version(const DoutPrefixProvider *dpp, const rgw_bucket_dir_entry& ent,
+                           bufferlist& bl, optional_yield y = null_yield);
+    // Make the newest version left current after the version `key` was
+    // unlinked.
+    int reset_latest_version(const DoutPrefixProvider *dpp, const rgw_obj_key& key,
+                             optional_yield y = null_yield);
 };
 
 // A placeholder locking class for multipart upload.
@@ -680,6 +1277,46 @@ class MPMotrSerializer : public MPSerializer {
     virtual int unlock() override { return 0;}
 };
 
+// A lease on a lifecycle shard, shared by all the gateways: a record of
+// the lc lock index with the owner and the time the lease runs out. A
+// lease that ran out can be taken over by another gateway. Motr has no
+// conditional update, so a takeover first creates a claim record named
+// after the lease it replaces, which only one gateway can create.
+class MotrLCSerializer : public LCSerializer {
+  MotrStore* store;
+  const std::string key;
+  const std::string owner;
+  std::string claim; // of the lease taken over, removed by unlock()
+
+public:
+  MotrLCSerializer(MotrStore* store, const std::string& oid, const std::string& lock_name, const std::string& cookie);
+
+  virtual int try_lock(const DoutPrefixProvider *dpp, utime_t dur, optional_yield y) override;
+  virtual int unlock() override;
+};
+
+// Lifecycle shards kept in the lc index: the head of shard <oid> under
+// "<oid>", its bucket entries under "<oid>/<bucket>". A shard is listed
+// with one prefix query and a run resumes after the bucket of the head
+// marker, so the RGWLC workers process the shards in parallel the way
+// they do on the other stores.
+class MotrLifecycle : public Lifecycle {
+  MotrStore* store;
+
+public:
+  MotrLifecycle(MotrStore* _st) : store(_st) {}
+
+  virtual int get_entry(const std::string& oid, const std::string& marker, LCEntry& entry) override;
+  virtual int get_next_entry(const std::string& oid, std::string& marker, LCEntry& entry) override;
+  virtual int set_entry(const std::string& oid, const LCEntry& entry) override;
+  virtual int list_entries(const std::string& oid, const std::string& marker,
+			   uint32_t max_entries, std::vector<LCEntry>& entries) override;
+  virtual int rm_entry(const std::string& oid, const LCEntry& entry) override;
+  virtual int get_head(const std::string& oid, LCHead& head) override;
+  virtual int put_head(const std::string& oid, const LCHead& head) override;
+  virtual LCSerializer* get_serializer(const std::string& lock_name, const std::string& oid, const std::string& cookie) override;
+};
+
 class MotrAtomicWriter : public Writer {
   protected:
   rgw::sal::MotrStore* store;
@@ -687,15 +1324,24 @@ class MotrAtomicWriter : public Writer {
   const rgw_placement_rule *ptail_placement_rule;
   uint64_t olh_epoch;
   const std::string& unique_tag;
+  optional_yield y;
   MotrObject obj;
   MotrObject old_obj;
   uint64_t total_data_size; // for total data being uploaded
   bufferlist acc_data;  // accumulated data
   uint64_t   acc_off; // accumulated data offset
-
-  struct m0_bufvec buf;
-  struct m0_bufvec attr;
-  struct m0_indexvec ext;
+  bool old_obj_exists = false; // the upload replaces an existing object
+  bool old_obj_multipart = false;
+  uint64_t old_obj_size = 0;
+  std::string gc_tag; // GC entry of the new object until it is linked
+  uint64_t inline_max; // max size of the data kept in the bucket index
+  RGWObjCategory category = RGWObjCategory::Main;
+  uint64_t size_hint = 0; // expected object size, 0 if unknown
+  unsigned acc_max; // data accumulated before launching writes
+  MotrWritePipeline wpipe;
+
+  int create_obj(uint64_t sz);
+  int share_parts(MotrObject *src, optional_yield y);
 
   public:
   MotrAtomicWriter(const DoutPrefixProvider *dpp,
@@ -714,7 +1360,15 @@ class MotrAtomicWriter : public Writer {
   // Process a bufferlist
   virtual int process(bufferlist&& data, uint64_t offset) override;
 
-  int write();
+  int write(bool last);
+  int flush();
+
+  virtual void set_size_hint(uint64_t size) override { size_hint = size; }
+
+  // Make the new object refer to the data of `src` instead of writing
+  // any, for a server-side copy. Called after prepare().
+  int share_data(MotrObject *src, const rgw_bucket_dir_entry& src_ent,
+                 optional_yield y);
 
   // complete the operation and make its result visible to clients
   virtual int complete(size_t accounted_size, const std::string& etag,
@@ -726,13 +1380,13 @@ class MotrAtomicWriter : public Writer {
                        rgw_zone_set *zones_trace, bool *canceled,
                        optional_yield y) override;
 
-  unsigned populate_bvec(unsigned len, bufferlist::iterator &bi);
   void cleanup();
 };
 
 class MotrMultipartWriter : public Writer {
 protected:
   rgw::sal::MotrStore* store;
+  optional_yield y;
 
   // Head object.
   std::unique_ptr<rgw::sal::Object> head_obj;
@@ -742,6 +1396,17 @@ protected:
   const std::string part_num_str;
   std::unique_ptr<MotrObject> part_obj;
   uint64_t actual_part_size = 0;
+  uint64_t size_hint = 0; // expected part size, 0 if unknown
+  // With a size hint the data is written in blocks of the optimal size
+  // for the part, accumulated here.
+  bufferlist acc_data;
+  uint64_t acc_off = 0;
+  unsigned acc_max = 0;
+  MotrWritePipeline wpipe;
+  std::string gc_tag;
+
+  std::string part_iname() const;
+  std::string part_key() const;
 
 public:
   MotrMultipartWriter(const DoutPrefixProvider *dpp,
@@ -751,12 +1416,14 @@ public:
 		       const rgw_user& owner, RGWObjectCtx& obj_ctx,
 		       const rgw_placement_rule *ptail_placement_rule,
 		       uint64_t _part_num, const std::string& part_num_str) :
-				  Writer(dpp, y), store(_store), head_obj(std::move(_head_obj)),
-				  part_num(_part_num), part_num_str(part_num_str)
+				  Writer(dpp, y), store(_store), y(y), head_obj(std::move(_head_obj)),
+				  part_num(_part_num), part_num_str(part_num_str), wpipe(_store)
   {
   }
   ~MotrMultipartWriter() = default;
 
+  virtual void set_size_hint(uint64_t size) override { size_hint = size; }
+
   // prepare to start processing object data
   virtual int prepare(optional_yield y) override;
 
@@ -866,7 +1533,159 @@ public:
 			  const rgw_placement_rule *ptail_placement_rule,
 			  uint64_t part_num,
 			  const std::string& part_num_str) override;
-  int delete_parts(const DoutPrefixProvider *dpp);
+  int delete_parts(const DoutPrefixProvider *dpp, optional_yield y);
+};
+
+// An entry of the GC queue: Motr objects to delete once the entry is due.
+struct MotrGCEntry {
+  enum Type : uint8_t {
+    // Objects no longer referenced.
+    DELETE = 0,
+    // An object being uploaded, to delete unless the upload linked it to
+    // the record `ref_key` of index `ref_idx` by the time the entry is due.
+    ORPHAN = 1,
+  };
+  uint8_t type = DELETE;
+  std::vector<MotrObject::Meta> objs;
+  std::string ref_idx;
+  std::string ref_key;
+  bool ref_is_part = false; // `ref_key` is a part record, not a bucket entry
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(type, bl);
+    encode((uint32_t)objs.size(), bl);
+    for (const auto& m : objs)
+      m.encode(bl);
+    encode(ref_idx, bl);
+    encode(ref_key, bl);
+    encode(ref_is_part, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(type, bl);
+    uint32_t n;
+    decode(n, bl);
+    objs.resize(n);
+    for (auto& m : objs)
+      m.decode(bl);
+    decode(ref_idx, bl);
+    decode(ref_key, bl);
+    decode(ref_is_part, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(MotrGCEntry)
+
+// A reference to a Motr object shared by a server-side copy: the record
+// `ref_key` of index `ref_idx` that uses the object. Every user of a shared
+// object gets one, the entry copied from included.
+struct MotrObjRef {
+  std::string ref_idx;
+  std::string ref_key;
+  bool ref_is_part = false; // `ref_key` is a part record, not a bucket entry
+  ceph::real_time ctime;
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(ref_idx, bl);
+    encode(ref_key, bl);
+    encode(ref_is_part, bl);
+    encode(ctime, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(ref_idx, bl);
+    decode(ref_key, bl);
+    decode(ref_is_part, bl);
+    decode(ctime, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(MotrObjRef)
+
+// Deletes Motr objects in the background, so that removing or replacing
+// an object on the request path costs a GC queue index put rather than
+// the deletes of all its Motr objects. The queue is an index keyed by the
+// time entries fall due; a lister thread feeds the due entries to a pool
+// of motr_gc_max_concurrent workers, at up to motr_gc_max_deletes_per_sec
+// object deletes. Every gateway works on the queue; an entry processed
+// twice only costs a few ENOENTs.
+//
+// Objects shared by server-side copies are listed in the object refs
+// index with the records using them. The GC deletes such an object only
+// once none of these records refers to it any more.
+class MotrGC : public Thread
+{
+  class Worker : public Thread {
+    MotrGC *gc;
+  public:
+    explicit Worker(MotrGC *_gc) : gc(_gc) {}
+    void *entry() override;
+  };
+
+  MotrStore *store;
+  CephContext *cct;
+  std::string gateway;
+  std::atomic<uint64_t> seq = 0;
+  PerfCountersRef counters;
+
+  ceph::mutex lock = ceph::make_mutex("MotrGC::lock");
+  ceph::condition_variable cond;
+  std::deque<std::pair<std::string, MotrGCEntry>> queue;
+  unsigned busy = 0;   // entries taken by workers
+  unsigned failed = 0; // entries failed since the last listing
+  std::string marker;  // the next listing goes on from there
+  bool stopping = false;
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  // Delete rate limit.
+  ceph::mutex rate_lock = ceph::make_mutex("MotrGC::rate_lock");
+  ceph::mono_time next_delete;
+
+  void throttle();
+  int is_referenced(const DoutPrefixProvider *dpp, const std::string& ref_idx,
+                    const std::string& ref_key, bool ref_is_part,
+                    const MotrObject::Meta& m);
+  int is_linked(const DoutPrefixProvider *dpp, const MotrGCEntry& e,
+                const MotrObject::Meta& m);
+  int check_refs(const DoutPrefixProvider *dpp, const MotrObject::Meta& m);
+  int delete_obj(const DoutPrefixProvider *dpp, const MotrObject::Meta& m);
+  int process(const DoutPrefixProvider *dpp, const std::string& key,
+              const MotrGCEntry& e);
+  int list_due(const DoutPrefixProvider *dpp);
+  void *entry() override;
+  void *worker_entry();
+
+public:
+  MotrGC(MotrStore *_store, CephContext *_cct);
+
+  // Queue `e`, due after `wait`. Returns the key of the entry in `tag`.
+  int enqueue(const DoutPrefixProvider *dpp, const MotrGCEntry& e,
+              ceph::timespan wait, std::string *tag = nullptr,
+              optional_yield y = null_yield);
+  // Queue the deletion of Motr objects after motr_gc_obj_min_wait.
+  int enqueue_delete(const DoutPrefixProvider *dpp,
+                     std::vector<MotrObject::Meta> objs,
+                     optional_yield y = null_yield);
+  // Queue the deletion of a new object in case its upload never links
+  // it to its record, after motr_gc_orphan_min_wait.
+  int enqueue_orphan(const DoutPrefixProvider *dpp, const MotrObject::Meta& obj,
+                     const std::string& ref_idx, const std::string& ref_key,
+                     bool ref_is_part, std::string& tag,
+                     optional_yield y = null_yield);
+  int remove(const DoutPrefixProvider *dpp, const std::string& tag,
+             optional_yield y = null_yield);
+  // Record the users of objects shared by a server-side copy, given as
+  // (object, user) pairs.
+  int add_refs(const DoutPrefixProvider *dpp,
+               const std::vector<std::pair<MotrObject::Meta, MotrObjRef>>& refs,
+               optional_yield y = null_yield);
+
+  void start();
+  void stop();
 };
 
 class MotrStore : public Store {
@@ -879,6 +1698,20 @@ class MotrStore : public Store {
     MotrMetaCache* user_cache;
     MotrMetaCache* bucket_inst_cache;
 
+    MotrWriteBudget write_budget;
+    MotrIdxCache idx_cache;
+    MotrStatsTracker stats_tracker;
+    RGWQuotaHandler *quota_handler = nullptr;
+    MotrCacheNotifier cache_notifier;
+    MotrGC gc;
+    RGWLC* lc = nullptr;
+    // Local ssd cache of the object data, if rgw_d3n_l1_local_datacache_enabled.
+    D3nDataCache* data_cache = nullptr;
+
+    // The pool-width geometry of the pool versions, looked up once.
+    ceph::mutex pver_lock = ceph::make_mutex("MotrStore::pver_lock");
+    std::map<std::pair<uint64_t, uint64_t>, MotrPoolWidth> pver_widths;
+
   public:
     CephContext *cctx;
     struct m0_client   *instance;
@@ -887,7 +1720,13 @@ class MotrStore : public Store {
     struct m0_config    conf = {};
     struct m0_idx_dix_config dix_conf = {};
 
-    MotrStore(CephContext *c): zone(this), cctx(c) {}
+    MotrStore(CephContext *c): zone(this),
+      write_budget(c->_conf.get_val<Option::size_t>("motr_write_budget")),
+      idx_cache(this, c->_conf.get_val<uint64_t>("motr_idx_cache_size")),
+      stats_tracker(this, c),
+      cache_notifier(this, c),
+      gc(this, c),
+      cctx(c) {}
     ~MotrStore() {
       delete obj_meta_cache;
       delete user_cache;
@@ -922,7 +1761,7 @@ class MotrStore : public Store {
     virtual std::unique_ptr<Notification> get_notification(const DoutPrefixProvider* dpp, rgw::sal::Object* obj,
         rgw::sal::Object* src_obj, RGWObjectCtx* rctx, rgw::notify::EventType event_type, rgw::sal::Bucket* _bucket,
         std::string& _user_id, std::string& _user_tenant, std::string& _req_id, optional_yield y) override;
-    virtual RGWLC* get_rgwlc(void) override { return NULL; }
+    virtual RGWLC* get_rgwlc(void) override { return lc; }
     virtual RGWCoroutinesManagerRegistry* get_cr_registry() override { return NULL; }
 
     virtual int log_usage(const DoutPrefixProvider *dpp, std::map<rgw_user_bucket, RGWUsageBatch>& usage_info) override;
@@ -1004,33 +1843,54 @@ class MotrStore : public Store {
       luarocks_path = path;
     }
 
-    int open_idx(struct m0_uint128 *id, bool create, struct m0_idx *out);
+    int open_idx(struct m0_uint128 *id, bool create, struct m0_idx *out,
+                 optional_yield y = null_yield);
     void close_idx(struct m0_idx *idx) { m0_idx_fini(idx); }
     int do_idx_op(struct m0_idx *, enum m0_idx_opcode opcode,
-      std::vector<uint8_t>& key, std::vector<uint8_t>& val, bool update = false);
+      std::vector<uint8_t>& key, std::vector<uint8_t>& val, bool update = false,
+      optional_yield y = null_yield);
+
+    int do_idx_batch_op(struct m0_idx *idx, enum m0_idx_opcode opcode,
+                        std::vector<std::vector<uint8_t>>& keys,
+                        std::vector<std::vector<uint8_t>>& vals,
+                        std::vector<int>& rcs, bool update = false,
+                        optional_yield y = null_yield);
 
-    int do_idx_next_op(struct m0_idx *idx,
-                       std::vector<std::vector<uint8_t>>& key_vec,
-                       std::vector<std::vector<uint8_t>>& val_vec);
     int next_query_by_name(std::string idx_name, std::vector<std::string>& key_str_vec,
                                             std::vector<bufferlist>& val_bl_vec,
-                                            std::string prefix="", std::string delim="");
+                                            std::string prefix="", std::string delim="",
+                                            optional_yield y = null_yield);
 
     void index_name_to_motr_fid(std::string iname, struct m0_uint128 *fid);
-    int open_motr_idx(struct m0_uint128 *id, struct m0_idx *idx);
-    int create_motr_idx_by_name(std::string iname);
-    int delete_motr_idx_by_name(std::string iname);
+    int create_motr_idx_by_name(std::string iname, optional_yield y = null_yield);
+    int delete_motr_idx_by_name(std::string iname, optional_yield y = null_yield);
     int do_idx_op_by_name(std::string idx_name, enum m0_idx_opcode opcode,
-                          std::string key_str, bufferlist &bl, bool update=true);
+                          std::string key_str, bufferlist &bl, bool update=true,
+                          optional_yield y = null_yield);
+    int do_idx_batch_op_by_name(std::string idx_name, enum m0_idx_opcode opcode,
+                                const std::vector<std::string>& key_strs,
+                                std::vector<bufferlist>& bls, std::vector<int>& rcs,
+                                bool update=true, optional_yield y = null_yield);
     int check_n_create_global_indices();
     int store_access_key(const DoutPrefixProvider *dpp, optional_yield y, MotrAccessKey access_key);
     int delete_access_key(const DoutPrefixProvider *dpp, optional_yield y, std::string access_key);
     int store_email_info(const DoutPrefixProvider *dpp, optional_yield y, MotrEmailInfo& email_info);
 
     int init_metadata_cache(const DoutPrefixProvider *dpp, CephContext *cct, bool use_cache);
+    int init_stats(const DoutPrefixProvider *dpp, bool quota_threads);
+    int init_gc(const DoutPrefixProvider *dpp, bool use_gc_thread);
+    int init_lc(const DoutPrefixProvider *dpp, bool use_lc_thread);
+    int init_data_cache(const DoutPrefixProvider *dpp);
     MotrMetaCache* get_obj_meta_cache() {return obj_meta_cache;}
     MotrMetaCache* get_user_cache() {return user_cache;}
     MotrMetaCache* get_bucket_inst_cache() {return bucket_inst_cache;}
+    MotrWriteBudget* get_write_budget() {return &write_budget;}
+    MotrIdxCache* get_idx_cache() {return &idx_cache;}
+    MotrStatsTracker* get_stats_tracker() {return &stats_tracker;}
+    MotrGC* get_gc() {return &gc;}
+    D3nDataCache* get_data_cache() {return data_cache;}
+    int get_pool_width(const struct m0_fid& pver, MotrPoolWidth& width);
+    RGWQuotaHandler* get_quota_handler() {return quota_handler;}
 };
 
 struct obj_time_weight {
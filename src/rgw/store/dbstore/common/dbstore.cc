@@ -39,12 +39,29 @@ int DB::Initialize(string logfile, int loglevel)
     return ret;
   }
 
+  if (!cct->_conf.get_val<std::string>("dbstore_data_dir").empty()) {
+    extents = std::make_unique<DBExtentStore>(cct,
+        cct->_conf.get_val<std::string>("dbstore_data_dir") + "/" + db_name,
+        cct->_conf.get_val<Option::size_t>("dbstore_extent_file_size"));
+
+    ret = extents->open(dpp);
+
+    if (ret) {
+      ldpp_dout(dpp, 0) <<"Failed to open data tier " << dendl;
+      extents.reset();
+      closeDB(dpp);
+      db = NULL;
+      return ret;
+    }
+  }
+
   ret = InitializeDBOps(dpp);
 
   if (ret) {
     ldpp_dout(dpp, 0) <<"InitializeDBOps failed " << dendl;
     closeDB(dpp);
     db = NULL;
+    extents.reset();
     return ret;
   }
 
@@ -64,6 +81,8 @@ int DB::Destroy(const DoutPrefixProvider *dpp)
 
   FreeDBOps(dpp);
 
+  extents.reset();
+
   ldpp_dout(dpp, 20)<<"DB successfully destroyed - name:" \
     <<db_name << dendl;
 
@@ -197,6 +216,31 @@ int DB::objectmapDelete(const DoutPrefixProvider *dpp, string bucket)
   return 0;
 }
 
+bool DB::isReadOp(const string& Op)
+{
+  return (!Op.compare("GetUser") ||
+      !Op.compare("GetBucket") ||
+      !Op.compare("ListUserBuckets") ||
+      !Op.compare("GetLCEntry") ||
+      !Op.compare("ListLCEntries") ||
+      !Op.compare("GetLCHead") ||
+      !Op.compare("GetObject") ||
+      !Op.compare("ListBucketObjects") ||
+      !Op.compare("GetObjectData"));
+}
+
+int DB::ExecuteReadOp(const DoutPrefixProvider *dpp, string Op,
+    DBOp *db_op, DBOpParams *params)
+{
+  return db_op->Execute(dpp, params);
+}
+
+int DB::ExecuteWriteOp(const DoutPrefixProvider *dpp, string Op,
+    DBOp *db_op, DBOpParams *params)
+{
+  return db_op->Execute(dpp, params);
+}
+
 int DB::InitializeParams(const DoutPrefixProvider *dpp, string Op, DBOpParams *params)
 {
   int ret = -1;
@@ -227,7 +271,11 @@ int DB::ProcessOp(const DoutPrefixProvider *dpp, string Op, struct DBOpParams *p
     ldpp_dout(dpp, 0)<<"No db_op found for Op("<<Op<<")" << dendl;
     return ret;
   }
-  ret = db_op->Execute(dpp, params);
+
+  if (isReadOp(Op))
+    ret = ExecuteReadOp(dpp, Op, db_op, params);
+  else
+    ret = ExecuteWriteOp(dpp, Op, db_op, params);
 
   if (ret) {
     ldpp_dout(dpp, 0)<<"In Process op Execute failed for fop(" \
@@ -1072,10 +1120,13 @@ int DB::raw_obj::read(const DoutPrefixProvider *dpp, int64_t ofs,
 {
   int ret = 0;
   DBOpParams params = {};
+  DBExtentStore *extents = db->get_extents();
+  bool retried = false;
 
   db->InitializeParams(dpp, "GetObjectData", &params);
   InitializeParamsfromRawObj(dpp, &params);
 
+again:
   ret = db->ProcessOp(dpp, "GetObjectData", &params);
 
   if (ret) {
@@ -1083,6 +1134,28 @@ int DB::raw_obj::read(const DoutPrefixProvider *dpp, int64_t ofs,
     return ret;
   }
 
+  if (params.op.obj_data.extent) {
+    if (!extents) {
+      ldpp_dout(dpp, 0)<<"Data of obj("<<obj_name<<") is in the data tier, "
+        <<"but dbstore_data_dir is not set" << dendl;
+      return -EIO;
+    }
+
+    ret = extents->read(dpp, *params.op.obj_data.extent, ofs, len, bl);
+
+    if (ret == -ENOENT && !retried) {
+      /* The compaction moved the data meanwhile, look it up again */
+      retried = true;
+      params.op.obj_data.extent.reset();
+      goto again;
+    }
+    if (ret < 0) {
+      return ret;
+    }
+
+    return bl.length();
+  }
+
   bufferlist& read_bl = params.op.obj_data.data;
 
   unsigned copy_len;
@@ -1092,7 +1165,7 @@ int DB::raw_obj::read(const DoutPrefixProvider *dpp, int64_t ofs,
 }
 
 int DB::raw_obj::write(const DoutPrefixProvider *dpp, int64_t ofs, int64_t write_ofs,
-                       uint64_t len, bufferlist& bl)
+                       uint64_t len, bufferlist& bl, bool replace)
 {
   int ret = 0;
   DBOpParams params = {};
@@ -1103,11 +1176,41 @@ int DB::raw_obj::write(const DoutPrefixProvider *dpp, int64_t ofs, int64_t write
   /* XXX: Check for chunk_size ?? */
   params.op.obj_data.offset = ofs;
   unsigned write_len = std::min((uint64_t)bl.length() - write_ofs, len);
-  bl.begin(write_ofs).copy(write_len, params.op.obj_data.data);
-  params.op.obj_data.size = params.op.obj_data.data.length();
+  DBExtentStore *extents = db->get_extents();
+
+  if (extents) {
+    /* Only the extent goes in the db, see Write::_do_write_meta() for the
+     * sync of the data of a new object */
+    bufferlist data;
+    DBExtent extent;
+
+    bl.begin(write_ofs).copy(write_len, data);
+    ret = extents->append(dpp, data, &extent);
+    if (ret < 0) {
+      return ret;
+    }
+    params.op.obj_data.extent = extent;
+    params.op.obj_data.size = write_len;
+
+    /* The meta of the live object would point at unsynced data */
+    if (replace) {
+      ret = extents->sync(dpp);
+      if (ret < 0) {
+        extents->unpin(extent);
+        return ret;
+      }
+    }
+  } else {
+    bl.begin(write_ofs).copy(write_len, params.op.obj_data.data);
+    params.op.obj_data.size = params.op.obj_data.data.length();
+  }
 
   ret = db->ProcessOp(dpp, "PutObjectData", &params);
 
+  if (extents) {
+    extents->unpin(*params.op.obj_data.extent);
+  }
+
   if (ret) {
     ldpp_dout(dpp, 0)<<"In PutObjectData failed err:(" <<ret<<")" << dendl;
     return ret;
@@ -1587,7 +1690,7 @@ int DB::Object::Write::write_data(const DoutPrefixProvider* dpp,
     ldpp_dout(dpp, 20) << "dbstore->write obj-ofs=" << ofs << " write_len=" << len << dendl;
 
     // write into non head object
-    int r = write_obj.write(dpp, ofs, write_ofs, len, data); 
+    int r = write_obj.write(dpp, ofs, write_ofs, len, data, obj_state.exists);
     if (r < 0) {
       return r;
     }
@@ -1710,6 +1813,14 @@ int DB::Object::Write::_do_write_meta(const DoutPrefixProvider *dpp,
     *meta.mtime = meta.set_mtime;
   }
 
+  /* The object is there once its meta is written: so is its data */
+  if (store->get_extents()) {
+    ret = store->get_extents()->sync(dpp);
+    if (ret < 0) {
+      goto out;
+    }
+  }
+
   /* XXX: handle multipart */
   params.op.query_str = "meta";
   ret = store->ProcessOp(dpp, "UpdateObject", &params);
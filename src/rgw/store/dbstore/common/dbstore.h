@@ -15,7 +15,10 @@
 #define FMT_HEADER_ONLY 1
 #include "fmt/format.h"
 #include <map>
+#include <memory>
+#include <optional>
 #include "dbstore_log.h"
+#include "dbstore_extents.h"
 #include "rgw/rgw_sal.h"
 #include "rgw/rgw_common.h"
 #include "rgw/rgw_bucket.h"
@@ -102,6 +105,8 @@ struct DBOpObjectDataInfo {
   uint64_t offset;
   uint64_t size;
   bufferlist data{};
+  /* Set in place of the data when it is in the data tier */
+  std::optional<DBExtent> extent;
 };
 
 struct DBOpLCHeadInfo {
@@ -297,6 +302,7 @@ struct DBOpObjectDataPrepareInfo {
   string data = ":data";
   string size = ":size";
   string multipart_part_str = ":multipart_part_str";
+  string extent = ":extent";
 };
 
 struct DBOpLCEntryPrepareInfo {
@@ -574,6 +580,9 @@ class DBOp {
        many stripes), a multipart object might have many parts. Each part
        has a fixed stripe size (ObjChunkSize), although the last stripe of a
        part might be smaller than that.
+       *
+       *  - Extent: where the data of the stripe is in the data tier, if
+       it is not in 'Data' (see DBExtentStore).
        */
       "CREATE TABLE IF NOT EXISTS '{}' ( \
       ObjName TEXT NOT NULL , \
@@ -585,6 +594,7 @@ class DBOp {
       Offset   INTEGER, \
       Size 	 INTEGER, \
       Data     BLOB,             \
+      Extent   BLOB,             \
       PRIMARY KEY (ObjName, BucketName, ObjInstance, MultipartPartStr, PartNum), \
       FOREIGN KEY (BucketName, ObjName, ObjInstance) \
       REFERENCES '{}' (BucketName, ObjName, ObjInstance) ON DELETE CASCADE ON UPDATE CASCADE \n);";
@@ -1150,8 +1160,8 @@ class PutObjectDataOp: virtual public DBOp {
   private:
     const string Query =
       "INSERT OR REPLACE INTO '{}' \
-      (ObjName, ObjInstance, ObjNS, BucketName, MultipartPartStr, PartNum, Offset, Size, Data) \
-      VALUES ({}, {}, {}, {}, {}, {}, {}, {}, {})";
+      (ObjName, ObjInstance, ObjNS, BucketName, MultipartPartStr, PartNum, Offset, Size, Data, Extent) \
+      VALUES ({}, {}, {}, {}, {}, {}, {}, {}, {}, {})";
 
   public:
     virtual ~PutObjectDataOp() {}
@@ -1166,7 +1176,8 @@ class PutObjectDataOp: virtual public DBOp {
           params.op.obj_data.part_num,
           params.op.obj_data.offset.c_str(),
           params.op.obj_data.size,
-          params.op.obj_data.data.c_str());
+          params.op.obj_data.data.c_str(),
+          params.op.obj_data.extent.c_str());
     }
 };
 
@@ -1195,7 +1206,7 @@ class GetObjectDataOp: virtual public DBOp {
   private:
     const string Query =
       "SELECT  \
-      ObjName, ObjInstance, ObjNS, BucketName, MultipartPartStr, PartNum, Offset, Size, Data \
+      ObjName, ObjInstance, ObjNS, BucketName, MultipartPartStr, PartNum, Offset, Size, Data, Extent \
       from '{}' where BucketName = {} and ObjName = {} and ObjInstance = {} ORDER BY MultipartPartStr, PartNum";
 
   public:
@@ -1386,6 +1397,8 @@ class DB {
     // Below mutex is to protect objectmap and other shared
     // objects if any.
     std::mutex mtx;
+    // data tier, if dbstore_data_dir is set
+    std::unique_ptr<DBExtentStore> extents;
 
   public:	
     DB(string db_name, CephContext *_cct) : db_name(db_name),
@@ -1436,6 +1449,7 @@ class DB {
 
     CephContext *ctx() { return cct; }
     const DoutPrefixProvider *get_def_dpp() { return &dp; }
+    DBExtentStore *get_extents() { return extents.get(); }
 
     int Initialize(string logfile, int loglevel);
     int Destroy(const DoutPrefixProvider *dpp);
@@ -1450,6 +1464,15 @@ class DB {
     int objectmapInsert(const DoutPrefixProvider *dpp, string bucket, class ObjectOp* ptr);
     int objectmapDelete(const DoutPrefixProvider *dpp, string bucket);
 
+    /* Ops which only read the db, and may run concurrently with others */
+    static bool isReadOp(const string& Op);
+    /* By default the op runs right away on the one db handle. A backend
+     * may run the reads and the writes on connections of their own. */
+    virtual int ExecuteReadOp(const DoutPrefixProvider *dpp, string Op,
+        DBOp *db_op, DBOpParams *params);
+    virtual int ExecuteWriteOp(const DoutPrefixProvider *dpp, string Op,
+        DBOp *db_op, DBOpParams *params);
+
     virtual uint64_t get_blob_limit() { return 0; };
     virtual void *openDB(const DoutPrefixProvider *dpp) { return NULL; }
     virtual int closeDB(const DoutPrefixProvider *dpp) { return 0; }
@@ -1583,7 +1606,10 @@ class DB {
       int InitializeParamsfromRawObj (const DoutPrefixProvider *dpp, DBOpParams* params);
 
       int read(const DoutPrefixProvider *dpp, int64_t ofs, uint64_t end, bufferlist& bl);
-      int write(const DoutPrefixProvider *dpp, int64_t ofs, int64_t write_ofs, uint64_t len, bufferlist& bl);
+      /* replace: the row may replace one of a live object, whose meta
+       * then points at the new data as soon as the row commits */
+      int write(const DoutPrefixProvider *dpp, int64_t ofs, int64_t write_ofs, uint64_t len, bufferlist& bl,
+                bool replace = false);
     };
 
     class Bucket {
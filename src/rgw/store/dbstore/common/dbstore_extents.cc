@@ -0,0 +1,324 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
+#include <vector>
+#include "dbstore_extents.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+
+namespace fs = std::filesystem;
+
+using namespace std;
+
+namespace rgw { namespace store {
+
+/* Pieces in which compaction copies an extent */
+static constexpr uint64_t EXTENT_COPY_SIZE = 4 << 20;
+
+DBExtentStore::File::~File()
+{
+  if (fd >= 0)
+    ::close(fd);
+}
+
+string DBExtentStore::file_path(uint64_t id) const
+{
+  char name[32];
+
+  snprintf(name, sizeof(name), "%016" PRIx64 ".extents", id);
+
+  return dir + "/" + name;
+}
+
+int DBExtentStore::open(const DoutPrefixProvider *dpp)
+{
+  std::error_code ec;
+
+  fs::create_directories(dir, ec);
+  if (ec) {
+    ldpp_dout(dpp, 0) << "Cant create data dir " << dir << "; "
+      << ec.message() << dendl;
+    return -ec.value();
+  }
+
+  const std::lock_guard<std::mutex> lk(mtx);
+
+  for (auto& entry : fs::directory_iterator(dir, ec)) {
+    const string name = entry.path().filename().string();
+    char *end = NULL;
+    uint64_t id = strtoull(name.c_str(), &end, 16);
+    struct stat st;
+
+    if (end == name.c_str() || strcmp(end, ".extents") != 0)
+      continue;
+
+    int fd = ::open(entry.path().c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0 || ::fstat(fd, &st) < 0) {
+      int r = -errno;
+      ldpp_dout(dpp, 0) << "Cant open extent file " << entry.path() << "; "
+        << cpp_strerror(r) << dendl;
+      if (fd >= 0)
+        ::close(fd);
+      return r;
+    }
+
+    /* A new file is started for the appends, these are sealed */
+    files[id] = make_shared<File>(id, fd, st.st_size);
+    next_id = std::max(next_id, id + 1);
+  }
+
+  if (ec) {
+    ldpp_dout(dpp, 0) << "Cant list data dir " << dir << "; "
+      << ec.message() << dendl;
+    return -ec.value();
+  }
+
+  ldpp_dout(dpp, 10) << "Opened data dir " << dir << " with "
+    << files.size() << " extent files" << dendl;
+
+  return 0;
+}
+
+int DBExtentStore::allocate(const DoutPrefixProvider *dpp, uint64_t len,
+    shared_ptr<File>& file, uint64_t *offset)
+{
+  const std::lock_guard<std::mutex> lk(mtx);
+
+  if (active && active->size > 0 && active->size + len > file_size) {
+    ldpp_dout(dpp, 20) << "Sealed extent file " << file_path(active->id)
+      << " of size " << active->size << dendl;
+    active.reset();
+  }
+
+  if (!active) {
+    uint64_t id = next_id++;
+    string path = file_path(id);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      int r = -errno;
+      ldpp_dout(dpp, 0) << "Cant create extent file " << path << "; "
+        << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    active = make_shared<File>(id, fd, 0);
+    files[id] = active;
+    dir_dirty = true;
+  }
+
+  file = active;
+  *offset = active->size;
+  active->size += len;
+  active->pins++;
+
+  return 0;
+}
+
+shared_ptr<DBExtentStore::File> DBExtentStore::get_file(uint64_t id)
+{
+  const std::lock_guard<std::mutex> lk(mtx);
+
+  auto iter = files.find(id);
+  if (iter == files.end())
+    return nullptr;
+
+  return iter->second;
+}
+
+int DBExtentStore::append(const DoutPrefixProvider *dpp, bufferlist& bl,
+    DBExtent *extent)
+{
+  shared_ptr<File> file;
+  uint64_t offset = 0;
+
+  int r = allocate(dpp, bl.length(), file, &offset);
+  if (r < 0)
+    return r;
+
+  extent->file = file->id;
+  extent->offset = offset;
+  extent->size = bl.length();
+
+  r = bl.write_fd(file->fd, offset);
+  if (r < 0) {
+    ldpp_dout(dpp, 0) << "Cant write extent file " << file_path(file->id)
+      << "; " << cpp_strerror(r) << dendl;
+    unpin(*extent);
+    return r;
+  }
+
+  const std::lock_guard<std::mutex> lk(mtx);
+  file->dirty = true;
+
+  return 0;
+}
+
+void DBExtentStore::unpin(const DBExtent& extent)
+{
+  const std::lock_guard<std::mutex> lk(mtx);
+
+  auto iter = files.find(extent.file);
+  if (iter != files.end() && iter->second->pins > 0)
+    iter->second->pins--;
+}
+
+int DBExtentStore::read(const DoutPrefixProvider *dpp, const DBExtent& extent,
+    uint64_t ofs, uint64_t len, bufferlist& bl)
+{
+  if (ofs >= extent.size)
+    return 0;
+
+  len = std::min(len, extent.size - ofs);
+
+  shared_ptr<File> file = get_file(extent.file);
+  if (!file)
+    return -ENOENT;
+
+  bufferptr bp(ceph::buffer::create_page_aligned(len));
+
+  ssize_t r = safe_pread_exact(file->fd, bp.c_str(), len, extent.offset + ofs);
+  if (r < 0) {
+    ldpp_dout(dpp, 0) << "Cant read extent file " << file_path(file->id)
+      << "; " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  bl.append(std::move(bp));
+
+  return len;
+}
+
+int DBExtentStore::copy(const DoutPrefixProvider *dpp, const DBExtent& from,
+    DBExtent *to)
+{
+  shared_ptr<File> file;
+  uint64_t offset = 0;
+
+  int r = allocate(dpp, from.size, file, &offset);
+  if (r < 0)
+    return r;
+
+  to->file = file->id;
+  to->offset = offset;
+  to->size = from.size;
+
+  for (uint64_t ofs = 0; ofs < from.size; ofs += EXTENT_COPY_SIZE) {
+    bufferlist bl;
+
+    r = read(dpp, from, ofs, EXTENT_COPY_SIZE, bl);
+    if (r >= 0)
+      r = bl.write_fd(file->fd, offset + ofs);
+
+    if (r < 0) {
+      ldpp_dout(dpp, 0) << "Cant copy extent of file " << file_path(from.file)
+        << " to " << file_path(file->id) << "; " << cpp_strerror(r) << dendl;
+      unpin(*to);
+      return r;
+    }
+  }
+
+  const std::lock_guard<std::mutex> lk(mtx);
+  file->dirty = true;
+
+  return 0;
+}
+
+int DBExtentStore::sync(const DoutPrefixProvider *dpp)
+{
+  const std::lock_guard<std::mutex> sl(sync_mtx);
+  vector<shared_ptr<File>> dirty;
+  bool sync_dir = false;
+
+  /* The flags are cleared before the syncs, so that the writes made
+   * meanwhile mark the files again, and set back for what is left
+   * unsynced if a sync fails */
+  {
+    const std::lock_guard<std::mutex> lk(mtx);
+
+    for (auto& [id, file] : files) {
+      if (file->dirty) {
+        file->dirty = false;
+        dirty.push_back(file);
+      }
+    }
+    sync_dir = dir_dirty;
+    dir_dirty = false;
+  }
+
+  auto remark = [&] (size_t first) {
+    const std::lock_guard<std::mutex> lk(mtx);
+
+    for (size_t i = first; i < dirty.size(); i++)
+      dirty[i]->dirty = true;
+    dir_dirty = dir_dirty || sync_dir;
+  };
+
+  for (size_t i = 0; i < dirty.size(); i++) {
+    if (::fdatasync(dirty[i]->fd) < 0) {
+      int r = -errno;
+      ldpp_dout(dpp, 0) << "Cant sync extent file " << file_path(dirty[i]->id)
+        << "; " << cpp_strerror(r) << dendl;
+      remark(i);
+      return r;
+    }
+  }
+
+  if (sync_dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int r = (fd < 0 || ::fsync(fd) < 0) ? -errno : 0;
+
+    if (fd >= 0)
+      ::close(fd);
+    if (r < 0) {
+      ldpp_dout(dpp, 0) << "Cant sync data dir " << dir << "; "
+        << cpp_strerror(r) << dendl;
+      remark(dirty.size());
+      return r;
+    }
+  }
+
+  return 0;
+}
+
+map<uint64_t, uint64_t> DBExtentStore::sealed_files()
+{
+  const std::lock_guard<std::mutex> lk(mtx);
+  map<uint64_t, uint64_t> sealed;
+
+  for (auto& [id, file] : files) {
+    if (file != active && file->pins == 0)
+      sealed[id] = file->size;
+  }
+
+  return sealed;
+}
+
+int DBExtentStore::remove(const DoutPrefixProvider *dpp, uint64_t id)
+{
+  {
+    const std::lock_guard<std::mutex> lk(mtx);
+    files.erase(id);
+  }
+
+  /* Reads already on the file keep its fd open till they are done */
+  string path = file_path(id);
+  if (::unlink(path.c_str()) < 0) {
+    int r = -errno;
+    ldpp_dout(dpp, 0) << "Cant remove extent file " << path << "; "
+      << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  ldpp_dout(dpp, 20) << "Removed extent file " << path << dendl;
+
+  return 0;
+}
+
+} } // namespace rgw::store
@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef DB_STORE_EXTENTS_H
+#define DB_STORE_EXTENTS_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "include/ceph_assert.h"
+#include "include/buffer.h"
+#include "include/encoding.h"
+#include "dbstore_log.h"
+
+namespace rgw { namespace store {
+
+/* Where a piece of object data lives in the data tier: a range of one of
+ * the extent files. The objectdata table keeps it in place of the data. */
+struct DBExtent {
+  uint64_t file = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(file, bl);
+    encode(offset, bl);
+    encode(size, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(file, bl);
+    decode(offset, bl);
+    decode(size, bl);
+    DECODE_FINISH(bl);
+  }
+};
+WRITE_CLASS_ENCODER(DBExtent)
+
+/* The data tier (dbstore_data_dir): object data is appended to extent
+ * files in a directory of the local filesystem, and SQLite only holds
+ * the extent map. One file at a time is appended to, up to
+ * dbstore_extent_file_size, then it is sealed and never written again.
+ * The space of the deleted data is reclaimed by rewriting the live
+ * extents of the sealed files out of them (see the compaction of the
+ * backend), after which the files are removed. */
+class DBExtentStore {
+  private:
+    struct File {
+      uint64_t id;
+      int fd = -1;
+      uint64_t size = 0;
+      bool dirty = false; // written since last synced
+      unsigned pins = 0;  // appends not yet in the extent map
+
+      File(uint64_t id, int fd, uint64_t size) : id(id), fd(fd), size(size) {}
+      ~File();
+    };
+
+    CephContext *cct;
+    const std::string dir;
+    const uint64_t file_size;
+
+    std::mutex mtx; // protects below
+    std::map<uint64_t, std::shared_ptr<File>> files;
+    std::shared_ptr<File> active;
+    uint64_t next_id = 1;
+    bool dir_dirty = false; // files created since last synced
+
+    // serializes sync(), so that it only returns once the data written
+    // before the call is synced, whoever synced it
+    std::mutex sync_mtx;
+
+    std::string file_path(uint64_t id) const;
+    int allocate(const DoutPrefixProvider *dpp, uint64_t len,
+        std::shared_ptr<File>& file, uint64_t *offset);
+    std::shared_ptr<File> get_file(uint64_t id);
+
+  public:
+    DBExtentStore(CephContext *cct, std::string dir, uint64_t file_size)
+      : cct(cct), dir(std::move(dir)), file_size(file_size) {}
+    ~DBExtentStore() {}
+
+    /* Open the files already in the directory, creating it if need be */
+    int open(const DoutPrefixProvider *dpp);
+
+    /* Append the data to the active file. Its file is pinned, so that the
+     * compaction leaves it alone until unpin(), once the extent is in
+     * the extent map. */
+    int append(const DoutPrefixProvider *dpp, bufferlist& bl, DBExtent *extent);
+    void unpin(const DBExtent& extent);
+    /* Read len bytes at ofs of the extent. -ENOENT if its file was
+     * removed, its data may have been moved meanwhile. */
+    int read(const DoutPrefixProvider *dpp, const DBExtent& extent,
+        uint64_t ofs, uint64_t len, bufferlist& bl);
+    /* Append a copy of the extent to the active file, pinned as well */
+    int copy(const DoutPrefixProvider *dpp, const DBExtent& from, DBExtent *to);
+    /* Make the data appended so far durable */
+    int sync(const DoutPrefixProvider *dpp);
+
+    /* Id and size of the files no longer appended to, nor pinned */
+    std::map<uint64_t, uint64_t> sealed_files();
+    int remove(const DoutPrefixProvider *dpp, uint64_t id);
+};
+
+} } // namespace rgw::store
+
+#endif
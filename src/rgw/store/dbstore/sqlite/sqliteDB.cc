@@ -1,7 +1,10 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <strings.h>
+#include <set>
 #include "sqliteDB.h"
+#include "common/Thread.h"
 
 #define SQL_PREPARE(dpp, params, sdb, stmt, ret, Op) 	\
   do {							\
@@ -277,7 +280,8 @@ enum GetObjectData {
   PartNum,
   Offset,
   ObjDataSize,
-  ObjData
+  ObjData,
+  ObjDataExtent
 };
 
 enum GetLCEntry {
@@ -491,6 +495,13 @@ static int get_objectdata(const DoutPrefixProvider *dpp, DBOpInfo &op, sqlite3_s
   op.obj_data.multipart_part_str = (const char*)sqlite3_column_text(stmt, MultipartPartStr);
   SQL_DECODE_BLOB_PARAM(dpp, stmt, ObjData, op.obj_data.data, sdb);
 
+  if (sqlite3_column_type(stmt, ObjDataExtent) != SQLITE_NULL) {
+    op.obj_data.extent.emplace();
+    SQL_DECODE_BLOB_PARAM(dpp, stmt, ObjDataExtent, *op.obj_data.extent, sdb);
+  } else {
+    op.obj_data.extent.reset();
+  }
+
   return 0;
 }
 
@@ -522,6 +533,8 @@ static int list_lc_head(const DoutPrefixProvider *dpp, DBOpInfo &op, sqlite3_stm
 
 int SQLiteDB::InitializeDBOps(const DoutPrefixProvider *dpp)
 {
+  int ret = 0;
+
   (void)createTables(dpp);
   dbops.InsertUser = new SQLInsertUser(&this->db, this->getDBname(), cct);
   dbops.RemoveUser = new SQLRemoveUser(&this->db, this->getDBname(), cct);
@@ -539,6 +552,16 @@ int SQLiteDB::InitializeDBOps(const DoutPrefixProvider *dpp)
   dbops.RemoveLCHead = new SQLRemoveLCHead(&this->db, this->getDBname(), cct);
   dbops.GetLCHead = new SQLGetLCHead(&this->db, this->getDBname(), cct);
 
+  if (wal) {
+    ret = openReaders(dpp,
+        cct->_conf.get_val<uint64_t>("dbstore_read_connections"));
+    if (ret)
+      return ret;
+  }
+
+  if (get_extents())
+    startCompactor(dpp);
+
   return 0;
 }
 
@@ -563,6 +586,26 @@ int SQLiteDB::FreeDBOps(const DoutPrefixProvider *dpp)
   return 0;
 }
 
+/* How long a connection retries when the db is locked, in WAL mode: only
+ * while the log is recovered or reset by a checkpoint */
+#define SQLITE_BUSY_TIMEOUT_MS 5000
+
+static bool set_journal_mode_wal(sqlite3 *db)
+{
+  sqlite3_stmt *stmt = NULL;
+  bool ret = false;
+
+  /* The pragma returns the journal mode now in effect */
+  if (sqlite3_prepare_v2(db, "PRAGMA journal_mode=WAL", -1, &stmt, NULL) == SQLITE_OK &&
+      sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *mode = (const char *)sqlite3_column_text(stmt, 0);
+    ret = mode && !strcasecmp(mode, "wal");
+  }
+  sqlite3_finalize(stmt);
+
+  return ret;
+}
+
 void *SQLiteDB::openDB(const DoutPrefixProvider *dpp)
 {
   string dbname;
@@ -589,12 +632,36 @@ void *SQLiteDB::openDB(const DoutPrefixProvider *dpp)
 
   exec(dpp, "PRAGMA foreign_keys=ON", NULL);
 
+  if (db && cct->_conf.get_val<bool>("dbstore_wal")) {
+    if (!set_journal_mode_wal((sqlite3 *)db)) {
+      ldpp_dout(dpp, 0) <<"Cant switch "<<dbname<<" to WAL mode, "\
+        <<"keeping the default journal; Errmsg - "\
+        <<sqlite3_errmsg((sqlite3*)db) <<  dendl;
+      goto out;
+    }
+    /* Each commit syncs the log unless told otherwise: with NORMAL the
+     * log is only synced at the checkpoints, the database stays consistent
+     * if the host crashes but may lose the last commits */
+    if (cct->_conf.get_val<bool>("dbstore_wal_sync_normal"))
+      exec(dpp, "PRAGMA synchronous=NORMAL", NULL);
+    else
+      exec(dpp, "PRAGMA synchronous=FULL", NULL);
+    sqlite3_busy_timeout((sqlite3 *)db, SQLITE_BUSY_TIMEOUT_MS);
+
+    wal = std::make_unique<SQLiteWAL>();
+    wal->write_batch = cct->_conf.get_val<uint64_t>("dbstore_write_batch");
+    ldpp_dout(dpp, 0) <<"Opened database("<<dbname<<") in WAL mode" <<  dendl;
+  }
+
 out:
   return db;
 }
 
 int SQLiteDB::closeDB(const DoutPrefixProvider *dpp)
 {
+  stopCompactor();
+  closeReaders(dpp);
+
   if (db)
     sqlite3_close((sqlite3 *)db);
 
@@ -603,6 +670,508 @@ int SQLiteDB::closeDB(const DoutPrefixProvider *dpp)
   return 0;
 }
 
+int SQLiteDB::openReaders(const DoutPrefixProvider *dpp, uint64_t count)
+{
+  string dbname = getDBfile();
+  int rc = 0;
+
+  /* Without readers the reads would run on the writer, within the
+   * transaction of the writes not committed yet */
+  if (count == 0) {
+    ldpp_dout(dpp, 0) <<"WAL mode needs at least one read connection" <<  dendl;
+    return -EINVAL;
+  }
+
+  for (uint64_t i = 0; i < count; i++) {
+    SQLiteReader *reader = new SQLiteReader;
+
+    /* The reader is used by one thread at a time, no need for the
+     * serialization of the writer */
+    rc = sqlite3_open_v2(dbname.c_str(), &reader->db,
+        SQLITE_OPEN_READONLY |
+        SQLITE_OPEN_NOMUTEX,
+        NULL);
+
+    if (rc) {
+      ldpp_dout(dpp, 0) <<"Cant open reader of "<<dbname<<"; Errmsg - "\
+        <<sqlite3_errmsg(reader->db) <<  dendl;
+      sqlite3_close(reader->db);
+      delete reader;
+      return -1;
+    }
+    sqlite3_busy_timeout(reader->db, SQLITE_BUSY_TIMEOUT_MS);
+
+    /* Only the read ops, see DB::isReadOp() */
+    void **rdb = (void **)&reader->db;
+    reader->dbops.GetUser = new SQLGetUser(rdb, this->getDBname(), cct);
+    reader->dbops.GetBucket = new SQLGetBucket(rdb, this->getDBname(), cct);
+    reader->dbops.ListUserBuckets = new SQLListUserBuckets(rdb, this->getDBname(), cct);
+    reader->dbops.GetLCEntry = new SQLGetLCEntry(rdb, this->getDBname(), cct);
+    reader->dbops.ListLCEntries = new SQLListLCEntries(rdb, this->getDBname(), cct);
+    reader->dbops.GetLCHead = new SQLGetLCHead(rdb, this->getDBname(), cct);
+
+    wal->readers.push_back(reader);
+    wal->free_readers.push_back(reader);
+  }
+
+  ldpp_dout(dpp, 20) <<"Opened "<<count<<" readers of "<<dbname <<  dendl;
+
+  return 0;
+}
+
+void SQLiteDB::closeReaders(const DoutPrefixProvider *dpp)
+{
+  if (!wal)
+    return;
+
+  for (auto reader : wal->readers) {
+    delete reader->dbops.GetUser;
+    delete reader->dbops.GetBucket;
+    delete reader->dbops.ListUserBuckets;
+    delete reader->dbops.GetLCEntry;
+    delete reader->dbops.ListLCEntries;
+    delete reader->dbops.GetLCHead;
+
+    for (auto& [bucket, Ob] : reader->objectmap) {
+      Ob->FreeObjectOps(dpp);
+      delete Ob;
+    }
+
+    sqlite3_close(reader->db);
+    delete reader;
+  }
+
+  wal.reset();
+}
+
+SQLiteReader *SQLiteDB::getReader()
+{
+  std::unique_lock l{wal->readers_mtx};
+
+  wal->readers_cond.wait(l, [this] { return !wal->free_readers.empty(); });
+
+  SQLiteReader *reader = wal->free_readers.back();
+  wal->free_readers.pop_back();
+
+  return reader;
+}
+
+void SQLiteDB::putReader(SQLiteReader *reader)
+{
+  {
+    const std::lock_guard<std::mutex> lk(wal->readers_mtx);
+    wal->free_readers.push_back(reader);
+  }
+  wal->readers_cond.notify_one();
+}
+
+DBOp *SQLiteDB::getReaderOp(const DoutPrefixProvider *dpp, SQLiteReader *reader,
+    string Op, DBOpParams *params)
+{
+  if (!Op.compare("GetUser"))
+    return reader->dbops.GetUser;
+  if (!Op.compare("GetBucket"))
+    return reader->dbops.GetBucket;
+  if (!Op.compare("ListUserBuckets"))
+    return reader->dbops.ListUserBuckets;
+  if (!Op.compare("GetLCEntry"))
+    return reader->dbops.GetLCEntry;
+  if (!Op.compare("ListLCEntries"))
+    return reader->dbops.ListLCEntries;
+  if (!Op.compare("GetLCHead"))
+    return reader->dbops.GetLCHead;
+
+  /* Object Operations */
+  string bucket = params->op.bucket.info.bucket.name;
+  map<string, SQLObjectOp*>::iterator iter;
+  SQLObjectOp *Ob;
+
+  iter = reader->objectmap.find(bucket);
+
+  if (iter == reader->objectmap.end()) {
+    /* The reader can't create the tables of the bucket as the Prepare()
+     * of the object ops does, the writer does it instead */
+    DBOpParams tparams = {};
+
+    tparams.cct = cct;
+    tparams.bucket_table = getBucketTable();
+    tparams.object_table = getObjectTable(bucket);
+    tparams.objectdata_table = getObjectDataTable(bucket);
+    queueWrite(dpp, [&] {
+      (void)createObjectTable(dpp, &tparams);
+      (void)createObjectDataTable(dpp, &tparams);
+      return 0;
+    });
+
+    Ob = new SQLObjectOp(&reader->db, ctx());
+    Ob->InitializeObjectOps(getDBname(), dpp);
+    reader->objectmap.insert(pair<string, SQLObjectOp*>(bucket, Ob));
+  } else {
+    Ob = iter->second;
+  }
+
+  if (!Op.compare("GetObject"))
+    return Ob->GetObject;
+  if (!Op.compare("ListBucketObjects"))
+    return Ob->ListBucketObjects;
+  if (!Op.compare("GetObjectData"))
+    return Ob->GetObjectData;
+
+  return NULL;
+}
+
+int SQLiteDB::ExecuteReadOp(const DoutPrefixProvider *dpp, string Op,
+    DBOp *db_op, DBOpParams *params)
+{
+  int ret = -1;
+  SQLiteReader *reader;
+  DBOp *reader_op;
+
+  /* In WAL mode there is always a reader, see openReaders() */
+  if (!wal)
+    return db_op->Execute(dpp, params);
+
+  if (!Op.compare("GetBucket")) {
+    /* The object ops of the bucket write through the writer connection,
+     * so insert them here rather than in the reader's SQLGetBucket */
+    objectmapInsert(dpp, params->op.bucket.info.bucket.name,
+        new SQLObjectOp((sqlite3 **)&db, ctx()));
+  }
+
+  reader = getReader();
+
+  reader_op = getReaderOp(dpp, reader, Op, params);
+  if (reader_op) {
+    ret = reader_op->Execute(dpp, params);
+  } else {
+    ldpp_dout(dpp, 0)<<"No reader op found for Op("<<Op<<")" << dendl;
+  }
+
+  putReader(reader);
+
+  return ret;
+}
+
+int SQLiteDB::ExecuteWriteOp(const DoutPrefixProvider *dpp, string Op,
+    DBOp *db_op, DBOpParams *params)
+{
+  if (!wal)
+    return db_op->Execute(dpp, params);
+
+  return queueWrite(dpp, [&] { return db_op->Execute(dpp, params); });
+}
+
+int SQLiteDB::queueWrite(const DoutPrefixProvider *dpp, std::function<int()> fn)
+{
+  SQLiteWriteReq req;
+  vector<SQLiteWriteReq*> batch;
+
+  req.fn = std::move(fn);
+
+  std::unique_lock l{wal->write_mtx};
+  wal->write_queue.push_back(&req);
+
+  while (!req.done) {
+    if (wal->writing) {
+      wal->write_cond.wait(l);
+      continue;
+    }
+
+    /* No commit in progress: commit the queue, this write included if
+     * it fits in the batch, or else on the next round */
+    wal->writing = true;
+    batch.clear();
+    while (!wal->write_queue.empty() && batch.size() < wal->write_batch) {
+      batch.push_back(wal->write_queue.front());
+      wal->write_queue.pop_front();
+    }
+
+    l.unlock();
+    commitWrites(dpp, batch);
+    l.lock();
+
+    for (auto r : batch) {
+      r->done = true;
+    }
+    wal->writing = false;
+    wal->write_cond.notify_all();
+  }
+
+  return req.ret;
+}
+
+void SQLiteDB::commitWrites(const DoutPrefixProvider *dpp,
+    vector<SQLiteWriteReq*>& batch)
+{
+  size_t i = 0;
+
+  if (batch.size() > 1 && exec(dpp, "BEGIN IMMEDIATE", NULL) == 0) {
+    for (; i < batch.size(); i++) {
+      batch[i]->ret = batch[i]->fn();
+
+      if (sqlite3_get_autocommit((sqlite3 *)db)) {
+        /* The error rolled back the whole transaction, and the writes
+         * before this one with it. The remaining ones run on their own. */
+        ldpp_dout(dpp, 0)<<"Write transaction rolled back; Errmsg - " \
+          <<sqlite3_errmsg((sqlite3 *)db) << dendl;
+        for (size_t j = 0; j <= i; j++) {
+          batch[j]->ret = -1;
+        }
+        i++;
+        break;
+      }
+    }
+
+    if (!sqlite3_get_autocommit((sqlite3 *)db) &&
+        exec(dpp, "COMMIT", NULL) != 0) {
+      exec(dpp, "ROLLBACK", NULL);
+      for (size_t j = 0; j < i; j++) {
+        batch[j]->ret = -1;
+      }
+    }
+
+    ldpp_dout(dpp, 20)<<"Committed "<<i<<" writes in one transaction" << dendl;
+  }
+
+  for (; i < batch.size(); i++) {
+    batch[i]->ret = batch[i]->fn();
+  }
+}
+
+void SQLiteDB::startCompactor(const DoutPrefixProvider *dpp)
+{
+  compactor = std::make_unique<SQLiteCompactor>();
+
+  compactor->thread = make_named_thread("dbstore_compact", [this] {
+    const DoutPrefixProvider *dpp = get_def_dpp();
+    std::unique_lock l{compactor->mtx};
+
+    while (!compactor->stop) {
+      auto interval = cct->_conf.get_val<std::chrono::seconds>("dbstore_compact_interval");
+
+      if (compactor->cond.wait_for(l, interval, [this] { return compactor->stop; }))
+        break;
+
+      l.unlock();
+      compactExtents(dpp);
+      l.lock();
+    }
+  });
+}
+
+void SQLiteDB::stopCompactor()
+{
+  if (!compactor)
+    return;
+
+  {
+    const std::lock_guard<std::mutex> lk(compactor->mtx);
+    compactor->stop = true;
+  }
+  compactor->cond.notify_all();
+  compactor->thread.join();
+
+  compactor.reset();
+}
+
+int SQLiteDB::listObjectDataTables(const DoutPrefixProvider *dpp, sqlite3 *sdb,
+    vector<string>& tables)
+{
+  sqlite3_stmt *stmt = NULL;
+  const char *schema = "SELECT name FROM sqlite_master WHERE type = 'table' \
+                        AND name LIKE '%.objectdata.table'";
+  int rc;
+
+  rc = sqlite3_prepare_v2(sdb, schema, -1, &stmt, NULL);
+  if (rc == SQLITE_OK) {
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      tables.push_back((const char *)sqlite3_column_text(stmt, 0));
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  if (rc != SQLITE_DONE) {
+    ldpp_dout(dpp, 0)<<"Listing the objectdata tables failed; Errmsg - " \
+      <<sqlite3_errmsg(sdb) << dendl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int SQLiteDB::scanExtents(const DoutPrefixProvider *dpp, sqlite3 *sdb, const string& table,
+    std::function<void(int64_t rowid, const DBExtent& extent)> cb)
+{
+  sqlite3_stmt *stmt = NULL;
+  string schema = fmt::format("SELECT rowid, Extent FROM '{}' WHERE Extent IS NOT NULL",
+      table);
+  int rc;
+
+  /* Not used since the data tier, there's no Extent column yet */
+  if (sqlite3_prepare_v2(sdb, schema.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+    ldpp_dout(dpp, 20)<<"No extents in table("<<table<<")" << dendl;
+    sqlite3_finalize(stmt);
+    return 0;
+  }
+
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    DBExtent extent;
+    bufferlist b;
+
+    b.append((const char *)sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1));
+    try {
+      decode(extent, b);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 0)<<"Bad extent in table("<<table<<") rowid(" \
+        <<sqlite3_column_int64(stmt, 0)<<")" << dendl;
+      continue;
+    }
+
+    cb(sqlite3_column_int64(stmt, 0), extent);
+  }
+  sqlite3_finalize(stmt);
+
+  if (rc != SQLITE_DONE) {
+    ldpp_dout(dpp, 0)<<"Scanning the extents of table("<<table<<") failed; Errmsg - " \
+      <<sqlite3_errmsg(sdb) << dendl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int SQLiteDB::compactExtents(const DoutPrefixProvider *dpp)
+{
+  struct Move {
+    string table;
+    int64_t rowid;
+    DBExtent from;
+    DBExtent to;
+  };
+
+  DBExtentStore *extents = get_extents();
+  const double ratio = cct->_conf.get_val<double>("dbstore_compact_ratio");
+  map<uint64_t, uint64_t> sealed;
+  map<uint64_t, uint64_t> live;
+  std::set<uint64_t> victims;
+  vector<string> tables;
+  vector<Move> moves;
+  SQLiteReader *reader = NULL;
+  sqlite3 *sdb = (sqlite3 *)db;
+  size_t copied = 0;
+  int ret = 0;
+
+  if (!extents)
+    return 0;
+
+  /* No more data goes to these files, but what is already in the extent
+   * map, see DBExtentStore::unpin() */
+  sealed = extents->sealed_files();
+  if (sealed.empty())
+    return 0;
+
+  /* Scan the extent maps on a reader if there are, not to hold the writer */
+  if (wal && !wal->readers.empty()) {
+    reader = getReader();
+    sdb = reader->db;
+  }
+
+  ret = listObjectDataTables(dpp, sdb, tables);
+
+  for (size_t t = 0; !ret && t < tables.size(); t++) {
+    ret = scanExtents(dpp, sdb, tables[t], [&] (int64_t rowid, const DBExtent& extent) {
+      live[extent.file] += extent.size;
+    });
+  }
+
+  if (!ret) {
+    for (auto& [id, size] : sealed) {
+      if (live[id] == 0 || live[id] < size * ratio)
+        victims.insert(id);
+    }
+  }
+
+  for (size_t t = 0; !ret && !victims.empty() && t < tables.size(); t++) {
+    ret = scanExtents(dpp, sdb, tables[t], [&] (int64_t rowid, const DBExtent& extent) {
+      if (victims.count(extent.file))
+        moves.push_back(Move{tables[t], rowid, extent, {}});
+    });
+  }
+
+  if (reader)
+    putReader(reader);
+
+  if (ret || victims.empty())
+    return ret;
+
+  /* Copy the live extents to the active file, and make them durable before
+   * the extent map points at them */
+  for (; copied < moves.size(); copied++) {
+    ret = extents->copy(dpp, moves[copied].from, &moves[copied].to);
+    if (ret < 0)
+      goto out;
+  }
+
+  ret = extents->sync(dpp);
+  if (ret < 0)
+    goto out;
+
+  {
+    /* Unless the data of the row changed meanwhile: the copy is garbage
+     * then, for the next compaction */
+    auto update = [&] {
+      for (auto& move : moves) {
+        sqlite3_stmt *stmt = NULL;
+        string schema = fmt::format("UPDATE '{}' SET Extent = ?1 \
+            WHERE rowid = ?2 AND Extent = ?3", move.table);
+        bufferlist from_bl, to_bl;
+        int rc;
+
+        encode(move.from, from_bl);
+        encode(move.to, to_bl);
+
+        rc = sqlite3_prepare_v2((sqlite3 *)db, schema.c_str(), -1, &stmt, NULL);
+        if (rc == SQLITE_OK) {
+          sqlite3_bind_blob(stmt, 1, to_bl.c_str(), to_bl.length(), SQLITE_TRANSIENT);
+          sqlite3_bind_int64(stmt, 2, move.rowid);
+          sqlite3_bind_blob(stmt, 3, from_bl.c_str(), from_bl.length(), SQLITE_TRANSIENT);
+          rc = sqlite3_step(stmt);
+        }
+        sqlite3_finalize(stmt);
+
+        if (rc != SQLITE_DONE) {
+          ldpp_dout(dpp, 0)<<"Moving extent of table("<<move.table<<") rowid(" \
+            <<move.rowid<<") failed; Errmsg - "<<sqlite3_errmsg((sqlite3 *)db) << dendl;
+          return -1;
+        }
+      }
+      return 0;
+    };
+
+    ret = wal ? queueWrite(dpp, update) : update();
+  }
+
+out:
+  for (size_t i = 0; i < copied; i++) {
+    extents->unpin(moves[i].to);
+  }
+
+  if (ret) {
+    ldpp_dout(dpp, 0)<<"Compaction of the data tier failed, ret="<<ret << dendl;
+    return ret;
+  }
+
+  /* Reads which looked the extents up before the move retry */
+  for (auto id : victims) {
+    extents->remove(dpp, id);
+  }
+
+  ldpp_dout(dpp, 10)<<"Compacted "<<victims.size()<<" extent files, moved " \
+    <<moves.size()<<" extents" << dendl;
+
+  return 0;
+}
+
 int SQLiteDB::Reset(const DoutPrefixProvider *dpp, sqlite3_stmt *stmt)
 {
   int ret = -1;
@@ -737,6 +1306,10 @@ int SQLiteDB::createObjectTable(const DoutPrefixProvider *dpp, DBOpParams *param
   int ret = -1;
   string schema;
 
+  /* A reader of the WAL mode, the writer created it */
+  if (db && sqlite3_db_readonly((sqlite3 *)db, "main") == 1)
+    return 0;
+
   schema = CreateTableSchema("Object", params);
 
   ret = exec(dpp, schema.c_str(), NULL);
@@ -748,6 +1321,18 @@ int SQLiteDB::createObjectTable(const DoutPrefixProvider *dpp, DBOpParams *param
   return ret;
 }
 
+bool SQLiteDB::hasColumn(const string& table, const string& column)
+{
+  sqlite3_stmt *stmt = NULL;
+  string schema = fmt::format("SELECT {} FROM '{}' LIMIT 0", column, table);
+
+  /* Fails to prepare if there is no such column */
+  int rc = sqlite3_prepare_v2((sqlite3 *)db, schema.c_str(), -1, &stmt, NULL);
+  sqlite3_finalize(stmt);
+
+  return rc == SQLITE_OK;
+}
+
 int SQLiteDB::createQuotaTable(const DoutPrefixProvider *dpp, DBOpParams *params)
 {
   int ret = -1;
@@ -769,12 +1354,25 @@ int SQLiteDB::createObjectDataTable(const DoutPrefixProvider *dpp, DBOpParams *p
   int ret = -1;
   string schema;
 
+  /* A reader of the WAL mode, the writer created it */
+  if (db && sqlite3_db_readonly((sqlite3 *)db, "main") == 1)
+    return 0;
+
   schema = CreateTableSchema("ObjectData", params);
 
   ret = exec(dpp, schema.c_str(), NULL);
   if (ret)
     ldpp_dout(dpp, 0)<<"CreateObjectDataTable failed " << dendl;
 
+  if (!ret && !hasColumn(params->objectdata_table, "Extent")) {
+    /* Created before the data tier */
+    schema = fmt::format("ALTER TABLE '{}' ADD COLUMN Extent BLOB",
+        params->objectdata_table);
+    ret = exec(dpp, schema.c_str(), NULL);
+    if (ret)
+      ldpp_dout(dpp, 0)<<"Adding Extent to ObjectDataTable failed " << dendl;
+  }
+
   ldpp_dout(dpp, 20)<<"CreateObjectDataTable suceeded " << dendl;
 
   return ret;
@@ -997,6 +1595,7 @@ int SQLObjectOp::FreeObjectOps(const DoutPrefixProvider *dpp)
   delete DeleteObject;
   delete GetObject;
   delete UpdateObject;
+  delete ListBucketObjects;
   delete PutObjectData;
   delete UpdateObjectData;
   delete GetObjectData;
@@ -1621,10 +2220,12 @@ int SQLGetBucket::Execute(const DoutPrefixProvider *dpp, struct DBOpParams *para
 
   params->op.name = "GetBucket";
 
-  ObPtr = new SQLObjectOp(sdb, ctx());
-
-  /* For the case when the  server restarts, need to reinsert objectmap*/
-  objectmapInsert(dpp, params->op.bucket.info.bucket.name, ObPtr);
+  /* For the case when the  server restarts, need to reinsert objectmap.
+   * Not from a reader of the WAL mode, see SQLiteDB::ExecuteReadOp() */
+  if (sqlite3_db_readonly(*sdb, "main") != 1) {
+    ObPtr = new SQLObjectOp(sdb, ctx());
+    objectmapInsert(dpp, params->op.bucket.info.bucket.name, ObPtr);
+  }
   SQL_EXECUTE(dpp, params, stmt, list_bucket);
 out:
   return ret;
@@ -2341,6 +2942,13 @@ int SQLPutObjectData::Bind(const DoutPrefixProvider *dpp, struct DBOpParams *par
 
   SQL_BIND_TEXT(dpp, stmt, index, params->op.obj_data.multipart_part_str.c_str(), sdb);
 
+  /* Left NULL if the data is inline */
+  if (params->op.obj_data.extent) {
+    SQL_BIND_INDEX(dpp, stmt, index, p_params.op.obj_data.extent.c_str(), sdb);
+
+    SQL_ENCODE_BLOB_PARAM(dpp, stmt, index, *params->op.obj_data.extent, sdb);
+  }
+
 out:
   return rc;
 }
@@ -7,15 +7,87 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <sqlite3.h>
 #include "rgw/store/dbstore/common/dbstore.h"
 
 using namespace std;
 using namespace rgw::store;
 
+class SQLObjectOp;
+
+/* A read-only connection of the WAL mode, with prepared statements of its
+ * own: the read ops of the db, and those of the buckets read so far.
+ * One thread at a time uses it. */
+struct SQLiteReader {
+  sqlite3 *db = NULL;
+  DBOps dbops = {};
+  map<string, SQLObjectOp*> objectmap;
+};
+
+/* A write queued for the writer connection */
+struct SQLiteWriteReq {
+  std::function<int()> fn;
+  int ret = -1;
+  bool done = false;
+};
+
+/* State of the WAL mode (dbstore_wal). The reads run on a pool of
+ * read-only connections, which the writer doesn't block. The writes are
+ * queued: the first writer to find no commit in progress takes all the
+ * queue and runs it in one transaction, so that the writes arriving
+ * during a commit share the next one. */
+struct SQLiteWAL {
+  std::mutex readers_mtx;
+  std::condition_variable readers_cond;
+  vector<SQLiteReader*> readers;
+  vector<SQLiteReader*> free_readers;
+
+  std::mutex write_mtx;
+  std::condition_variable write_cond;
+  std::deque<SQLiteWriteReq*> write_queue;
+  bool writing = false;
+  uint64_t write_batch = 1;
+};
+
+/* Runs the compaction of the data tier every dbstore_compact_interval */
+struct SQLiteCompactor {
+  std::thread thread;
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool stop = false;
+};
+
 class SQLiteDB : public DB, virtual public DBOp {
   private:
     sqlite3_mutex *mutex = NULL;
+    /* Only set on the db handle openDB() was called on, in WAL mode */
+    std::unique_ptr<SQLiteWAL> wal;
+
+    int openReaders(const DoutPrefixProvider *dpp, uint64_t count);
+    void closeReaders(const DoutPrefixProvider *dpp);
+    SQLiteReader *getReader();
+    void putReader(SQLiteReader *reader);
+    DBOp *getReaderOp(const DoutPrefixProvider *dpp, SQLiteReader *reader,
+        string Op, DBOpParams *params);
+    int queueWrite(const DoutPrefixProvider *dpp, std::function<int()> fn);
+    void commitWrites(const DoutPrefixProvider *dpp, vector<SQLiteWriteReq*>& batch);
+
+    /* Only set on the db handle openDB() was called on, with a data tier */
+    std::unique_ptr<SQLiteCompactor> compactor;
+
+    void startCompactor(const DoutPrefixProvider *dpp);
+    void stopCompactor();
+    int listObjectDataTables(const DoutPrefixProvider *dpp, sqlite3 *sdb,
+        vector<string>& tables);
+    int scanExtents(const DoutPrefixProvider *dpp, sqlite3 *sdb, const string& table,
+        std::function<void(int64_t rowid, const DBExtent& extent)> cb);
 
   protected:
     CephContext *cct;
@@ -38,6 +110,10 @@ class SQLiteDB : public DB, virtual public DBOp {
     int closeDB(const DoutPrefixProvider *dpp) override;
     int InitializeDBOps(const DoutPrefixProvider *dpp) override;
     int FreeDBOps(const DoutPrefixProvider *dpp) override;
+    int ExecuteReadOp(const DoutPrefixProvider *dpp, string Op,
+        DBOp *db_op, DBOpParams *params) override;
+    int ExecuteWriteOp(const DoutPrefixProvider *dpp, string Op,
+        DBOp *db_op, DBOpParams *params) override;
 
     int InitPrepareParams(const DoutPrefixProvider *dpp, DBOpPrepareParams &params) override { return 0; }
 
@@ -46,6 +122,7 @@ class SQLiteDB : public DB, virtual public DBOp {
     int Step(const DoutPrefixProvider *dpp, DBOpInfo &op, sqlite3_stmt *stmt,
         int (*cbk)(const DoutPrefixProvider *dpp, DBOpInfo &op, sqlite3_stmt *stmt));
     int Reset(const DoutPrefixProvider *dpp, sqlite3_stmt *stmt);
+    bool hasColumn(const string& table, const string& column);
     /* default value matches with sqliteDB style */
 
     int createTables(const DoutPrefixProvider *dpp);
@@ -68,6 +145,10 @@ class SQLiteDB : public DB, virtual public DBOp {
     int ListAllBuckets(const DoutPrefixProvider *dpp, DBOpParams *params) override;
     int ListAllUsers(const DoutPrefixProvider *dpp, DBOpParams *params) override;
     int ListAllObjects(const DoutPrefixProvider *dpp, DBOpParams *params) override;
+
+    /* Move the live extents out of the sealed files of the data tier where
+     * less than dbstore_compact_ratio of the data is live, and remove them */
+    int compactExtents(const DoutPrefixProvider *dpp);
 };
 
 class SQLObjectOp : public ObjectOp {
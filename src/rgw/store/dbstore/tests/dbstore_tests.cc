@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <filesystem>
+#include <thread>
 #include <dbstore.h>
 #include <sqliteDB.h>
 #include "rgw_common.h"
@@ -1155,6 +1157,97 @@ TEST_F(DBStoreTest, InsertTestIDUser) {
   ASSERT_EQ(ret, 0);
 }
 
+TEST_F(DBStoreTest, WALConcurrentOps) {
+  CephContext *cct = gtest::env->cct;
+  const int nthreads = 16;
+  vector<int> put_ret(nthreads, -1), get_ret(nthreads, -1);
+  vector<string> get_email(nthreads);
+  vector<std::thread> threads;
+  int ret = -1;
+
+  cct->_conf.set_val("dbstore_wal", "true");
+  cct->_conf.set_val("dbstore_read_connections", "4");
+  SQLiteDB *wdb = new SQLiteDB("wal_ns", cct);
+  ret = wdb->Initialize("", -1);
+  cct->_conf.set_val("dbstore_wal", "false");
+  ASSERT_EQ(ret, 0);
+
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back([&, i] {
+      struct DBOpParams params = GlobalParams;
+      string id = "wal_user" + std::to_string(i);
+
+      wdb->InitializeParams(dpp, "", &params);
+      params.op.user.uinfo.user_id.id = id;
+      params.op.user.uinfo.user_email = id + "@dbstore.com";
+      put_ret[i] = wdb->ProcessOp(dpp, "InsertUser", &params);
+
+      params = GlobalParams;
+      wdb->InitializeParams(dpp, "", &params);
+      params.op.user.uinfo.user_id.id = id;
+      get_ret[i] = wdb->ProcessOp(dpp, "GetUser", &params);
+      get_email[i] = params.op.user.uinfo.user_email;
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    ASSERT_EQ(put_ret[i], 0);
+    ASSERT_EQ(get_ret[i], 0);
+    ASSERT_EQ(get_email[i], "wal_user" + std::to_string(i) + "@dbstore.com");
+  }
+
+  wdb->Destroy(wdb->get_def_dpp());
+  delete wdb;
+}
+
+TEST_F(DBStoreTest, ExtentStore) {
+  string dir = "dbstore_extents_test";
+  DBExtentStore store(gtest::env->cct, dir, 4096);
+  DBExtent e1, e2, e3;
+  bufferlist bl1, bl2, out;
+  int ret = -1;
+
+  std::filesystem::remove_all(dir);
+  ret = store.open(dpp);
+  ASSERT_EQ(ret, 0);
+
+  bl1.append(string(3000, 'a'));
+  bl2.append(string(3000, 'b'));
+  ret = store.append(dpp, bl1, &e1);
+  ASSERT_EQ(ret, 0);
+  ret = store.append(dpp, bl2, &e2);
+  ASSERT_EQ(ret, 0);
+  ASSERT_NE(e1.file, e2.file);
+  ASSERT_EQ(store.sync(dpp), 0);
+
+  ret = store.read(dpp, e2, 1000, 4096, out);
+  ASSERT_EQ(ret, 2000);
+  ASSERT_EQ(out.to_str(), string(2000, 'b'));
+
+  /* pinned until in the extent map */
+  ASSERT_EQ(store.sealed_files().count(e1.file), 0);
+  store.unpin(e1);
+  store.unpin(e2);
+  ASSERT_EQ(store.sealed_files().count(e1.file), 1);
+  ASSERT_EQ(store.sealed_files().count(e2.file), 0);
+
+  ret = store.copy(dpp, e1, &e3);
+  ASSERT_EQ(ret, 0);
+  store.unpin(e3);
+  ASSERT_EQ(store.remove(dpp, e1.file), 0);
+
+  out.clear();
+  ASSERT_EQ(store.read(dpp, e1, 0, e1.size, out), -ENOENT);
+  ret = store.read(dpp, e3, 0, e3.size, out);
+  ASSERT_EQ(ret, 3000);
+  ASSERT_EQ(out.to_str(), string(3000, 'a'));
+
+  std::filesystem::remove_all(dir);
+}
+
 int main(int argc, char **argv)
 {
   int ret = -1;
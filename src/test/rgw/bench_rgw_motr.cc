@@ -0,0 +1,391 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Benchmark of the Motr SAL on the in-process libmotr stand-in.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "common/ceph_argparse.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "global/global_init.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_sal.h"
+#include "rgw/rgw_sal_motr.h"
+#include "motr_shim.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using Clock = ceph::mono_clock;
+
+struct parameters {
+  unsigned threads = 16;
+  uint64_t ops = 1000;
+  uint64_t obj_size = 1 << 20;
+  uint64_t chunk_size = 4 << 20; // as rgw_max_chunk_size
+  unsigned parts = 4;
+  uint64_t part_size = 5 << 20;
+  unsigned list_max = 1000;
+};
+
+struct result {
+  std::vector<uint64_t> lat_us;
+  uint64_t bytes = 0;
+  uint64_t errors = 0;
+};
+
+static void report(const std::string& name, std::vector<result>& results,
+                   Clock::duration elapsed)
+{
+  result all;
+  for (auto& r : results) {
+    all.lat_us.insert(all.lat_us.end(), r.lat_us.begin(), r.lat_us.end());
+    all.bytes += r.bytes;
+    all.errors += r.errors;
+  }
+  std::sort(all.lat_us.begin(), all.lat_us.end());
+  auto pct = [&](double p) -> uint64_t {
+    if (all.lat_us.empty())
+      return 0;
+    size_t i = std::min(all.lat_us.size() - 1, size_t(p * all.lat_us.size()));
+    return all.lat_us[i];
+  };
+  double secs = std::chrono::duration<double>(elapsed).count();
+  char line[256];
+  snprintf(line, sizeof(line),
+           "%-5s %8zu ops %8.2fs %10.1f ops/s %9.1f MiB/s  "
+           "lat(us) p50 %llu p90 %llu p99 %llu max %llu  errors %llu",
+           name.c_str(), all.lat_us.size(), secs, all.lat_us.size() / secs,
+           all.bytes / secs / (1 << 20),
+           (unsigned long long)pct(0.5), (unsigned long long)pct(0.9),
+           (unsigned long long)pct(0.99),
+           (unsigned long long)(all.lat_us.empty() ? 0 : all.lat_us.back()),
+           (unsigned long long)all.errors);
+  std::cout << line << std::endl;
+}
+
+// Run `ops` calls of `op(i, bytes)` on `threads` threads and report them.
+template <typename Op>
+static void run_phase(const std::string& name, unsigned threads, uint64_t ops, Op&& op)
+{
+  std::atomic<uint64_t> next = 0;
+  std::vector<result> results(threads);
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      result& r = results[t];
+      for (uint64_t i; (i = next++) < ops; ) {
+        uint64_t bytes = 0;
+        auto op_start = Clock::now();
+        int rc = op(i, bytes);
+        auto lat = Clock::now() - op_start;
+        if (rc < 0) {
+          r.errors++;
+          continue;
+        }
+        r.lat_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(lat).count());
+        r.bytes += bytes;
+      }
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  report(name, results, Clock::now() - start);
+}
+
+static std::string obj_name(uint64_t i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "obj.%08llu", (unsigned long long)i);
+  return buf;
+}
+
+static int write_data(rgw::sal::Writer* writer, const bufferlist& data,
+                      uint64_t chunk_size)
+{
+  writer->set_size_hint(data.length());
+  int rc = writer->prepare(null_yield);
+  for (uint64_t off = 0; rc == 0 && off < data.length(); off += chunk_size) {
+    bufferlist bl;
+    bl.substr_of(data, off, std::min<uint64_t>(chunk_size, data.length() - off));
+    rc = writer->process(std::move(bl), off);
+  }
+  if (rc == 0)
+    rc = writer->process({}, data.length());
+  return rc;
+}
+
+static int put_obj(const DoutPrefixProvider* dpp, rgw::sal::Store* store,
+                   rgw::sal::Bucket* bucket, const std::string& name,
+                   const bufferlist& data, const parameters& params)
+{
+  RGWObjectCtx obj_ctx(store);
+  auto writer = store->get_atomic_writer(dpp, null_yield,
+                                         bucket->get_object(rgw_obj_key(name)),
+                                         bucket->get_info().owner, obj_ctx,
+                                         &bucket->get_placement_rule(), 0, name);
+  int rc = write_data(writer.get(), data, params.chunk_size);
+  if (rc < 0)
+    return rc;
+  std::map<std::string, bufferlist> attrs;
+  return writer->complete(data.length(), name, nullptr, ceph::real_time(),
+                          attrs, ceph::real_time(), nullptr, nullptr, nullptr,
+                          nullptr, nullptr, null_yield);
+}
+
+class NullCB : public RGWGetDataCB {
+public:
+  uint64_t bytes = 0;
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    bytes += bl_len;
+    return 0;
+  }
+};
+
+static int get_obj(const DoutPrefixProvider* dpp, rgw::sal::Store* store,
+                   rgw::sal::Bucket* bucket, const std::string& name,
+                   uint64_t size, uint64_t& bytes)
+{
+  RGWObjectCtx obj_ctx(store);
+  auto obj = bucket->get_object(rgw_obj_key(name));
+  auto read_op = obj->get_read_op(&obj_ctx);
+  int rc = read_op->prepare(null_yield, dpp);
+  if (rc < 0)
+    return rc;
+  NullCB cb;
+  rc = read_op->iterate(dpp, 0, size - 1, &cb, null_yield);
+  bytes = cb.bytes;
+  return rc;
+}
+
+static int list_bucket(const DoutPrefixProvider* dpp, rgw::sal::Bucket* bucket,
+                       unsigned max, uint64_t& nr)
+{
+  rgw::sal::Bucket::ListParams params;
+  rgw::sal::Bucket::ListResults results;
+  nr = 0;
+  do {
+    results.objs.clear();
+    int rc = bucket->list(dpp, params, max, results, null_yield);
+    if (rc < 0)
+      return rc;
+    nr += results.objs.size();
+    params.marker = results.next_marker;
+  } while (results.is_truncated);
+  return 0;
+}
+
+static int put_multipart(const DoutPrefixProvider* dpp, rgw::sal::Store* store,
+                         rgw::sal::Bucket* bucket, const std::string& name,
+                         const bufferlist& part_data, const parameters& params)
+{
+  RGWObjectCtx obj_ctx(store);
+  ACLOwner owner;
+  owner.set_id(bucket->get_info().owner);
+  rgw::sal::Attrs attrs;
+  auto upload = bucket->get_multipart_upload(name, std::string());
+  int rc = upload->init(dpp, null_yield, &obj_ctx, owner,
+                        bucket->get_placement_rule(), attrs);
+  if (rc < 0)
+    return rc;
+
+  std::map<int, std::string> part_etags;
+  for (unsigned num = 1; num <= params.parts; num++) {
+    auto writer = upload->get_writer(dpp, null_yield,
+                                     bucket->get_object(rgw_obj_key(name)),
+                                     bucket->get_info().owner, obj_ctx,
+                                     &bucket->get_placement_rule(),
+                                     num, std::to_string(num));
+    rc = write_data(writer.get(), part_data, params.chunk_size);
+    if (rc < 0)
+      return rc;
+    char etag[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
+    snprintf(etag, sizeof(etag), "%032x", num);
+    std::map<std::string, bufferlist> part_attrs;
+    rc = writer->complete(part_data.length(), etag, nullptr, ceph::real_time(),
+                          part_attrs, ceph::real_time(), nullptr, nullptr,
+                          nullptr, nullptr, nullptr, null_yield);
+    if (rc < 0)
+      return rc;
+    part_etags[num] = etag;
+  }
+
+  std::list<rgw_obj_index_key> remove_objs;
+  uint64_t accounted_size = 0;
+  bool compressed = false;
+  RGWCompressionInfo cs_info;
+  off_t ofs = 0;
+  std::string tag = name;
+  auto target = bucket->get_object(rgw_obj_key(name));
+  return upload->complete(dpp, null_yield, store->ctx(), part_etags,
+                          remove_objs, accounted_size, compressed, cs_info,
+                          ofs, tag, owner, 0, target.get(), &obj_ctx);
+}
+
+static int create_bucket(const DoutPrefixProvider* dpp, rgw::sal::Store* store,
+                         const std::string& name,
+                         std::unique_ptr<rgw::sal::Bucket>* bucket)
+{
+  CephContext* cct = store->ctx();
+  auto user = store->get_user(rgw_user("motr-bench"));
+  user->get_info().display_name = "motr-bench";
+  int rc = user->store_user(dpp, null_yield, false);
+  if (rc < 0)
+    return rc;
+
+  rgw_bucket b("", name, name);
+  b.marker = name;
+  rgw_placement_rule placement;
+  std::string swift_ver_location;
+  RGWAccessControlPolicy policy(cct);
+  rgw::sal::Attrs attrs;
+  RGWBucketInfo info;
+  obj_version ep_objv;
+  bool existed = false;
+  RGWEnv env;
+  env.init(cct);
+  req_info rinfo(cct, &env);
+  rc = user->create_bucket(dpp, b, "default", placement, swift_ver_location,
+                           nullptr, policy, attrs, info, ep_objv, false, false,
+                           &existed, rinfo, bucket, null_yield);
+  if (rc == -EEXIST)
+    rc = store->get_bucket(dpp, user.get(), b, bucket, null_yield);
+  return rc;
+}
+
+int main(int argc, char **argv)
+{
+  parameters params;
+  std::vector<std::string> workloads;
+  MotrShimConfig shim_conf;
+  try {
+    using namespace boost::program_options;
+    options_description desc{"Options"};
+    desc.add_options()
+      ("help,h", "Help screen")
+      ("workload", value<std::vector<std::string>>()->multitoken()
+         ->default_value({"put", "get", "list", "mpu"}, "put get list mpu"),
+       "phases to run, in order")
+      ("threads", value<unsigned>()->default_value(16), "concurrent requests")
+      ("ops", value<uint64_t>()->default_value(1000), "requests per phase")
+      ("obj-size", value<uint64_t>()->default_value(1 << 20), "object size for put and get")
+      ("parts", value<unsigned>()->default_value(4), "parts of a multipart upload")
+      ("part-size", value<uint64_t>()->default_value(5 << 20), "part size of a multipart upload")
+      ("list-max", value<unsigned>()->default_value(1000), "entries per bucket listing request")
+      ("completion-threads", value<unsigned>()->default_value(8), "motr ops completing at once")
+      ("entity-latency-us", value<uint64_t>()->default_value(0), "motr create/open/delete latency")
+      ("obj-latency-us", value<uint64_t>()->default_value(0), "motr object read/write latency")
+      ("idx-latency-us", value<uint64_t>()->default_value(0), "motr index op latency")
+      ("obj-bandwidth", value<uint64_t>()->default_value(0), "motr object bytes/s per op, 0 for no limit")
+      ("data-dir", value<std::string>()->default_value(""), "object files, a temporary directory if empty");
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+    workloads = vm["workload"].as<std::vector<std::string>>();
+    params.threads = std::max(vm["threads"].as<unsigned>(), 1u);
+    params.ops = vm["ops"].as<uint64_t>();
+    params.obj_size = std::max<uint64_t>(vm["obj-size"].as<uint64_t>(), 1);
+    params.parts = std::max(vm["parts"].as<unsigned>(), 1u);
+    params.part_size = std::max<uint64_t>(vm["part-size"].as<uint64_t>(), 1);
+    params.list_max = std::max(vm["list-max"].as<unsigned>(), 1u);
+    shim_conf.completion_threads = vm["completion-threads"].as<unsigned>();
+    shim_conf.entity_latency = std::chrono::microseconds(vm["entity-latency-us"].as<uint64_t>());
+    shim_conf.obj_latency = std::chrono::microseconds(vm["obj-latency-us"].as<uint64_t>());
+    shim_conf.idx_latency = std::chrono::microseconds(vm["idx-latency-us"].as<uint64_t>());
+    shim_conf.obj_bandwidth = vm["obj-bandwidth"].as<uint64_t>();
+    shim_conf.data_dir = vm["data-dir"].as<std::string>();
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto args = argv_to_vec(argc, argv);
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  // The parts are as large as asked for.
+  g_conf().set_val_or_die("rgw_multipart_min_part_size", "0");
+
+  motr_shim_configure(shim_conf);
+  DoutPrefix dp(g_ceph_context, dout_subsys, "motr bench: ");
+  rgw::sal::Store* store =
+    StoreManager::get_storage(&dp, g_ceph_context, "motr", true, false, false,
+                              false, false);
+  if (store == nullptr) {
+    std::cerr << "failed to initialize the motr store" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<rgw::sal::Bucket> bucket;
+  int rc = create_bucket(&dp, store, "motr-bench", &bucket);
+  if (rc < 0) {
+    std::cerr << "failed to create the bucket: " << cpp_strerror(-rc) << std::endl;
+    StoreManager::close_storage(store);
+    return EXIT_FAILURE;
+  }
+
+  bufferlist obj_data;
+  obj_data.append_zero(params.obj_size);
+  bufferlist part_data;
+  part_data.append_zero(params.part_size);
+  uint64_t nr_objs = 0; // objects put
+
+  for (const auto& w : workloads) {
+    if (w == "put") {
+      run_phase(w, params.threads, params.ops, [&](uint64_t i, uint64_t& bytes) {
+        bytes = params.obj_size;
+        return put_obj(&dp, store, bucket.get(), obj_name(nr_objs + i), obj_data, params);
+      });
+      nr_objs += params.ops;
+    } else if (w == "get") {
+      if (nr_objs == 0) {
+        std::cerr << "get: no objects, run put first" << std::endl;
+        continue;
+      }
+      run_phase(w, params.threads, params.ops, [&](uint64_t i, uint64_t& bytes) {
+        return get_obj(&dp, store, bucket.get(), obj_name(i % nr_objs),
+                       params.obj_size, bytes);
+      });
+    } else if (w == "list") {
+      run_phase(w, params.threads, params.ops, [&](uint64_t i, uint64_t& bytes) {
+        uint64_t nr;
+        return list_bucket(&dp, bucket.get(), params.list_max, nr);
+      });
+    } else if (w == "mpu") {
+      run_phase(w, params.threads, params.ops, [&](uint64_t i, uint64_t& bytes) {
+        bytes = params.parts * params.part_size;
+        return put_multipart(&dp, store, bucket.get(), "mpu." + obj_name(i),
+                             part_data, params);
+      });
+    } else {
+      std::cerr << "unknown workload " << w << std::endl;
+    }
+  }
+
+  bucket.reset();
+  StoreManager::close_storage(store);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,722 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+/*
+ * Ceph - scalable distributed file system
+ *
+ * In-process stand-in for libmotr, for testing the Motr SAL without a
+ * cluster.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wextern-c-compat"
+#include "motr/config.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/layout.h"
+#include "lib/memory.h"
+#include "lib/time.h"
+#include "pool/pool.h"
+#include "conf/obj.h"
+#include "conf/confc.h"
+#include "reqh/reqh.h"
+#include "helpers/helpers.h"
+#pragma clang diagnostic pop
+}
+
+#include "motr_shim.h"
+
+// The calls below replace the libmotr ones of the same names: the
+// program's own definitions take precedence over those of the shared
+// library. Only the client surface is replaced; the bufvec, fid and
+// layout id helpers are libmotr's.
+//
+// An op is a ShimOp, allocated by the call creating it. The SAL only sees
+// its m0_op, where it keeps op_datum. A launched op is queued until its
+// latency has elapsed, then a completion thread runs it and calls its
+// callbacks, with the op locked so that m0_op_wait() returns only after
+// them, as with Motr.
+
+namespace {
+
+namespace efs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+enum class OpKind {
+  ENTITY_CREATE,
+  ENTITY_OPEN,
+  ENTITY_DELETE,
+  OBJ_IO,
+  IDX,
+};
+
+struct OpState {
+  OpKind kind;
+  struct m0_entity *entity = nullptr;
+
+  // Object i/o.
+  enum m0_obj_opcode obj_opcode = M0_OC_READ;
+  struct m0_indexvec *ext = nullptr;
+  struct m0_bufvec *data = nullptr;
+
+  // Index op.
+  enum m0_idx_opcode idx_opcode = M0_IC_GET;
+  struct m0_bufvec *keys = nullptr;
+  struct m0_bufvec *vals = nullptr;
+  int32_t *rcs = nullptr;
+  uint32_t flags = 0;
+
+  const struct m0_op_ops *cbs = nullptr;
+  std::mutex lock;
+  std::condition_variable cond;
+  uint32_t state = M0_OS_INITIALISED;
+  // Read by m0_rc() without the lock: as in Motr, it may be called from
+  // the op callbacks, which run with the lock held.
+  std::atomic<int> rc = 0;
+  std::atomic<bool> cancelled = false;
+
+  explicit OpState(OpKind k) : kind(k) {}
+};
+
+// m0_op first, so that the SAL's m0_op pointers convert back.
+struct ShimOp {
+  struct m0_op op;
+  OpState *st;
+};
+
+ShimOp *to_shim(struct m0_op *op)
+{
+  return reinterpret_cast<ShimOp*>(op);
+}
+
+struct Index {
+  std::shared_mutex lock;
+  std::map<std::string, std::string> kv;
+};
+
+using Fid = std::pair<uint64_t, uint64_t>;
+
+Fid to_fid(const struct m0_uint128& id)
+{
+  return {id.u_hi, id.u_lo};
+}
+
+struct Pending {
+  Clock::time_point due;
+  ShimOp *op;
+  bool operator<(const Pending& rhs) const {
+    return due > rhs.due; // earliest first
+  }
+};
+
+class Shim {
+  std::mutex idx_lock;
+  std::map<Fid, std::shared_ptr<Index>> indices;
+
+  std::mutex q_lock;
+  std::condition_variable q_cond;
+  std::priority_queue<Pending> queue;
+  std::vector<std::thread> threads;
+  bool stopping = false;
+
+  void run();
+  int exec(OpState *st);
+  int exec_entity(OpState *st);
+  int exec_obj(OpState *st);
+  int exec_idx(OpState *st);
+  std::chrono::nanoseconds latency(const OpState *st) const;
+
+public:
+  MotrShimConfig conf;
+  std::string dir;
+  bool own_dir = false;
+  std::atomic<uint64_t> next_id = 1;
+
+  struct m0_pool_version pver = {};
+  struct m0_conf_obj root = {};
+  struct m0_confc confc = {};
+
+  std::string obj_path(const struct m0_uint128& id) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%016" PRIx64 ":%016" PRIx64, id.u_hi, id.u_lo);
+    return dir + "/" + name;
+  }
+  std::shared_ptr<Index> get_index(const struct m0_uint128& id) {
+    std::lock_guard l{idx_lock};
+    auto i = indices.find(to_fid(id));
+    return i == indices.end() ? nullptr : i->second;
+  }
+
+  int start();
+  void stop();
+  void launch(ShimOp *op);
+  void complete(ShimOp *op, int rc);
+};
+
+Shim& shim()
+{
+  static Shim s;
+  return s;
+}
+
+int Shim::start()
+{
+  dir = conf.data_dir;
+  own_dir = dir.empty();
+  if (own_dir) {
+    char tmpl[] = "/tmp/motr-shim.XXXXXX";
+    if (mkdtemp(tmpl) == nullptr)
+      return -errno;
+    dir = tmpl;
+  } else {
+    std::error_code ec;
+    efs::create_directories(dir, ec);
+    if (ec)
+      return -ec.value();
+  }
+
+  m0_fid_set(&pver.pv_id, 0x7600000000000001, 1);
+  pver.pv_attr.pa_N = conf.pool_N;
+  pver.pv_attr.pa_K = conf.pool_K;
+  pver.pv_attr.pa_S = conf.pool_S;
+  pver.pv_attr.pa_P = conf.pool_P;
+  m0_fid_set(&root.co_id, 0x7400000000000001, 0);
+  confc.cc_root = &root;
+
+  stopping = false;
+  for (unsigned i = 0; i < std::max(conf.completion_threads, 1u); i++)
+    threads.emplace_back([this] { run(); });
+  return 0;
+}
+
+void Shim::stop()
+{
+  {
+    std::lock_guard l{q_lock};
+    stopping = true;
+    q_cond.notify_all();
+  }
+  for (auto& t : threads)
+    t.join();
+  threads.clear();
+
+  std::lock_guard l{idx_lock};
+  indices.clear();
+  if (own_dir) {
+    std::error_code ec;
+    efs::remove_all(dir, ec);
+  }
+}
+
+std::chrono::nanoseconds Shim::latency(const OpState *st) const
+{
+  MotrShimOp kind = MotrShimOp::ENTITY;
+  uint64_t bytes = 0;
+  if (st->kind == OpKind::OBJ_IO) {
+    kind = st->obj_opcode == M0_OC_WRITE ? MotrShimOp::OBJ_WRITE :
+                                           MotrShimOp::OBJ_READ;
+    for (uint32_t i = 0; i < st->ext->iv_vec.v_nr; i++)
+      bytes += st->ext->iv_vec.v_count[i];
+  } else if (st->kind == OpKind::IDX) {
+    kind = MotrShimOp::IDX;
+  }
+  if (conf.latency)
+    return conf.latency(kind, bytes);
+
+  switch (kind) {
+  case MotrShimOp::ENTITY:
+    return conf.entity_latency;
+  case MotrShimOp::IDX:
+    return conf.idx_latency;
+  default:
+    break;
+  }
+  std::chrono::nanoseconds lat = conf.obj_latency;
+  if (conf.obj_bandwidth != 0)
+    lat += std::chrono::nanoseconds(bytes * 1000000000ull / conf.obj_bandwidth);
+  return lat;
+}
+
+void Shim::launch(ShimOp *op)
+{
+  {
+    std::lock_guard l{op->st->lock};
+    op->st->state = M0_OS_LAUNCHED;
+  }
+  auto due = Clock::now() + latency(op->st);
+  std::lock_guard l{q_lock};
+  queue.push({due, op});
+  q_cond.notify_one();
+}
+
+void Shim::run()
+{
+  std::unique_lock l{q_lock};
+  while (true) {
+    if (queue.empty()) {
+      // Launched ops complete before the threads stop.
+      if (stopping)
+        break;
+      q_cond.wait(l);
+      continue;
+    }
+    auto due = queue.top().due;
+    if (due > Clock::now()) {
+      q_cond.wait_until(l, due);
+      continue;
+    }
+    ShimOp *op = queue.top().op;
+    queue.pop();
+    l.unlock();
+    int rc = op->st->cancelled ? -ECANCELED : exec(op->st);
+    complete(op, rc);
+    l.lock();
+  }
+}
+
+void Shim::complete(ShimOp *op, int rc)
+{
+  OpState *st = op->st;
+  std::lock_guard l{st->lock};
+  st->rc = rc;
+  if (rc == 0) {
+    st->state = M0_OS_EXECUTED;
+    if (st->cbs && st->cbs->oop_executed)
+      st->cbs->oop_executed(&op->op);
+    st->state = M0_OS_STABLE;
+    if (st->cbs && st->cbs->oop_stable)
+      st->cbs->oop_stable(&op->op);
+  } else {
+    st->state = M0_OS_FAILED;
+    if (st->cbs && st->cbs->oop_failed)
+      st->cbs->oop_failed(&op->op);
+  }
+  st->cond.notify_all();
+}
+
+int Shim::exec(OpState *st)
+{
+  switch (st->kind) {
+  case OpKind::OBJ_IO:
+    return exec_obj(st);
+  case OpKind::IDX:
+    return exec_idx(st);
+  default:
+    return exec_entity(st);
+  }
+}
+
+int Shim::exec_entity(OpState *st)
+{
+  const struct m0_uint128& id = st->entity->en_id;
+
+  if (st->entity->en_type == M0_ET_IDX) {
+    std::lock_guard l{idx_lock};
+    switch (st->kind) {
+    case OpKind::ENTITY_CREATE:
+      return indices.emplace(to_fid(id), std::make_shared<Index>()).second ?
+             0 : -EEXIST;
+    case OpKind::ENTITY_DELETE:
+      return indices.erase(to_fid(id)) ? 0 : -ENOENT;
+    default: // DIX does not check that an index exists on open
+      return 0;
+    }
+  }
+
+  std::string path = obj_path(id);
+  switch (st->kind) {
+  case OpKind::ENTITY_CREATE: {
+    int fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+    if (fd < 0)
+      return -errno;
+    ::close(fd);
+    // Motr picks the pool version of a new object.
+    reinterpret_cast<struct m0_obj*>(st->entity)->ob_attr.oa_pver = pver.pv_id;
+    return 0;
+  }
+  case OpKind::ENTITY_DELETE:
+    return ::unlink(path.c_str()) < 0 ? -errno : 0;
+  default:
+    return ::access(path.c_str(), F_OK) < 0 ? -errno : 0;
+  }
+}
+
+int Shim::exec_obj(OpState *st)
+{
+  std::string path = obj_path(st->entity->en_id);
+  bool write = st->obj_opcode == M0_OC_WRITE;
+  int fd = ::open(path.c_str(), write ? O_WRONLY : O_RDONLY);
+  if (fd < 0)
+    return -errno;
+
+  int rc = 0;
+  for (uint32_t i = 0; i < st->ext->iv_vec.v_nr && rc == 0; i++) {
+    char *buf = static_cast<char*>(st->data->ov_buf[i]);
+    size_t len = st->ext->iv_vec.v_count[i];
+    off_t off = st->ext->iv_index[i];
+    if (write) {
+      ssize_t r = ::pwrite(fd, buf, len, off);
+      if (r < 0 || (size_t)r != len)
+        rc = r < 0 ? -errno : -EIO;
+      continue;
+    }
+    // Unwritten data reads as zeroes.
+    ssize_t r = ::pread(fd, buf, len, off);
+    if (r < 0)
+      rc = -errno;
+    else if ((size_t)r < len)
+      memset(buf + r, 0, len - r);
+  }
+  ::close(fd);
+  return rc;
+}
+
+void *copy_out(const std::string& s)
+{
+  void *p = m0_alloc(std::max<size_t>(s.size(), 1));
+  if (p != nullptr)
+    memcpy(p, s.data(), s.size());
+  return p;
+}
+
+int Shim::exec_idx(OpState *st)
+{
+  auto idx = get_index(st->entity->en_id);
+  if (idx == nullptr)
+    return -ENOENT;
+
+  struct m0_bufvec *keys = st->keys;
+  struct m0_bufvec *vals = st->vals;
+  uint32_t nr = keys->ov_vec.v_nr;
+  auto key = [&](uint32_t i) {
+    return std::string(static_cast<const char*>(keys->ov_buf[i]),
+                       keys->ov_vec.v_count[i]);
+  };
+
+  switch (st->idx_opcode) {
+  case M0_IC_PUT: {
+    std::unique_lock l{idx->lock};
+    for (uint32_t i = 0; i < nr; i++) {
+      std::string v(static_cast<const char*>(vals->ov_buf[i]),
+                    vals->ov_vec.v_count[i]);
+      auto [it, added] = idx->kv.try_emplace(key(i), std::move(v));
+      if (!added) {
+        if (!(st->flags & M0_OIF_OVERWRITE)) {
+          st->rcs[i] = -EEXIST;
+          continue;
+        }
+        it->second.assign(static_cast<const char*>(vals->ov_buf[i]),
+                          vals->ov_vec.v_count[i]);
+      }
+      st->rcs[i] = 0;
+    }
+    break;
+  }
+  case M0_IC_DEL: {
+    std::unique_lock l{idx->lock};
+    for (uint32_t i = 0; i < nr; i++)
+      st->rcs[i] = idx->kv.erase(key(i)) ? 0 : -ENOENT;
+    break;
+  }
+  case M0_IC_GET: {
+    std::shared_lock l{idx->lock};
+    for (uint32_t i = 0; i < nr; i++) {
+      auto it = idx->kv.find(key(i));
+      if (it == idx->kv.end()) {
+        st->rcs[i] = -ENOENT;
+        continue;
+      }
+      vals->ov_buf[i] = copy_out(it->second);
+      vals->ov_vec.v_count[i] = it->second.size();
+      st->rcs[i] = vals->ov_buf[i] ? 0 : -ENOMEM;
+    }
+    break;
+  }
+  case M0_IC_NEXT: {
+    // The records from the first key on, which the buffers returned
+    // replace; the records past the end of the index get -ENOENT.
+    std::shared_lock l{idx->lock};
+    auto it = idx->kv.lower_bound(key(0));
+    for (uint32_t i = 0; i < nr; i++) {
+      if (it == idx->kv.end()) {
+        st->rcs[i] = -ENOENT;
+        continue;
+      }
+      keys->ov_buf[i] = copy_out(it->first);
+      keys->ov_vec.v_count[i] = it->first.size();
+      vals->ov_buf[i] = copy_out(it->second);
+      vals->ov_vec.v_count[i] = it->second.size();
+      st->rcs[i] = 0;
+      ++it;
+    }
+    break;
+  }
+  default:
+    return -ENOTSUP;
+  }
+  return 0;
+}
+
+ShimOp *new_op(OpKind kind, struct m0_entity *entity)
+{
+  auto op = new ShimOp();
+  memset(&op->op, 0, sizeof(op->op));
+  op->op.op_entity = entity;
+  op->st = new OpState(kind);
+  op->st->entity = entity;
+  return op;
+}
+
+enum m0_entity_opcode entity_opcode(OpKind kind)
+{
+  switch (kind) {
+  case OpKind::ENTITY_CREATE: return M0_EO_CREATE;
+  case OpKind::ENTITY_OPEN:   return M0_EO_OPEN;
+  case OpKind::ENTITY_DELETE: return M0_EO_DELETE;
+  default:                    return M0_EO_INVALID;
+  }
+}
+
+// Reuse the op passed in, as Motr does for the entity ops.
+int entity_op(OpKind kind, struct m0_entity *entity, struct m0_op **op)
+{
+  if (*op == nullptr) {
+    *op = &new_op(kind, entity)->op;
+    (*op)->op_code = entity_opcode(kind);
+    return 0;
+  }
+  OpState *st = to_shim(*op)->st;
+  std::lock_guard l{st->lock};
+  (*op)->op_code = entity_opcode(kind);
+  st->kind = kind;
+  st->entity = entity;
+  st->state = M0_OS_INITIALISED;
+  st->rc = 0;
+  return 0;
+}
+
+} // anonymous namespace
+
+void motr_shim_configure(const MotrShimConfig& conf)
+{
+  shim().conf = conf;
+}
+
+extern "C" {
+
+int m0_client_init(struct m0_client **m0c, struct m0_config *conf, bool init_m0)
+{
+  auto instance = static_cast<struct m0_client*>(m0_alloc(sizeof(struct m0_client)));
+  if (instance == nullptr)
+    return -ENOMEM;
+  int rc = shim().start();
+  if (rc != 0) {
+    m0_free(instance);
+    return rc;
+  }
+  *m0c = instance;
+  return 0;
+}
+
+void m0_client_fini(struct m0_client *m0c, bool fini_m0)
+{
+  shim().stop();
+  m0_free(m0c);
+}
+
+void m0_container_init(struct m0_container *con, struct m0_realm *parent,
+                       const struct m0_uint128 *id, struct m0_client *instance)
+{
+  memset(con, 0, sizeof(*con));
+  con->co_realm.re_entity.en_type = M0_ET_REALM;
+  con->co_realm.re_entity.en_id = *id;
+  con->co_realm.re_instance = instance;
+  con->co_realm.re_entity.en_sm.sm_rc = 0;
+}
+
+int m0_ufid_init(struct m0_client *m0c, struct m0_ufid_generator *gr)
+{
+  return 0;
+}
+
+int m0_ufid_next(struct m0_ufid_generator *gr, uint32_t nr_ids, struct m0_uint128 *id)
+{
+  // Object ids clear of the reserved range, never 0 in either half.
+  uint64_t lo = shim().next_id.fetch_add(nr_ids);
+  for (uint32_t i = 0; i < nr_ids; i++) {
+    id[i].u_hi = 0x5348494d; // "SHIM"
+    id[i].u_lo = lo + i;
+  }
+  return 0;
+}
+
+struct m0_confc *m0_reqh2confc(struct m0_reqh *reqh)
+{
+  return &shim().confc;
+}
+
+struct m0_pool_version *m0_pool_version_find(struct m0_pools_common *pc,
+                                             const struct m0_fid *id)
+{
+  return &shim().pver;
+}
+
+// The largest unit size up to an even spread of the object over the data
+// units of the pool, from 4K up to 1M.
+uint64_t m0_layout_find_by_objsz(struct m0_client *cinst, struct m0_fid *pver, size_t sz)
+{
+  uint64_t per_unit = sz / std::max(shim().conf.pool_N, 1u);
+  uint64_t lid = 1;
+  while (lid < 9 && m0_obj_layout_id_to_unit_size(lid + 1) <= per_unit)
+    lid++;
+  return lid;
+}
+
+void m0_obj_init(struct m0_obj *obj, struct m0_realm *parent,
+                 const struct m0_uint128 *id, uint64_t layout_id)
+{
+  obj->ob_entity.en_type = M0_ET_OBJ;
+  obj->ob_entity.en_id = *id;
+  obj->ob_entity.en_realm = parent;
+  obj->ob_attr.oa_layout_id = layout_id;
+  obj->ob_attr.oa_bshift = M0_DEFAULT_BUF_SHIFT;
+}
+
+void m0_obj_fini(struct m0_obj *obj)
+{
+}
+
+void m0_idx_init(struct m0_idx *idx, struct m0_realm *parent,
+                 const struct m0_uint128 *id)
+{
+  memset(idx, 0, sizeof(*idx));
+  idx->in_entity.en_type = M0_ET_IDX;
+  idx->in_entity.en_id = *id;
+  idx->in_entity.en_realm = parent;
+}
+
+void m0_idx_fini(struct m0_idx *idx)
+{
+}
+
+int m0_entity_create(struct m0_fid *pool, struct m0_entity *entity, struct m0_op **op)
+{
+  return entity_op(OpKind::ENTITY_CREATE, entity, op);
+}
+
+int m0_entity_open(struct m0_entity *entity, struct m0_op **op)
+{
+  return entity_op(OpKind::ENTITY_OPEN, entity, op);
+}
+
+int m0_entity_delete(struct m0_entity *entity, struct m0_op **op)
+{
+  return entity_op(OpKind::ENTITY_DELETE, entity, op);
+}
+
+int m0_obj_op(struct m0_obj *obj, enum m0_obj_opcode opcode,
+              struct m0_indexvec *ext, struct m0_bufvec *data,
+              struct m0_bufvec *attr, uint64_t mask, uint32_t flags,
+              struct m0_op **op)
+{
+  if (opcode != M0_OC_READ && opcode != M0_OC_WRITE)
+    return -ENOTSUP;
+  ShimOp *sop = new_op(OpKind::OBJ_IO, &obj->ob_entity);
+  sop->op.op_code = opcode;
+  sop->st->obj_opcode = opcode;
+  sop->st->ext = ext;
+  sop->st->data = data;
+  *op = &sop->op;
+  return 0;
+}
+
+int m0_idx_op(struct m0_idx *idx, enum m0_idx_opcode opcode,
+              struct m0_bufvec *keys, struct m0_bufvec *vals,
+              int32_t *rcs, uint32_t flags, struct m0_op **op)
+{
+  ShimOp *sop = new_op(OpKind::IDX, &idx->in_entity);
+  sop->op.op_code = opcode;
+  sop->st->idx_opcode = opcode;
+  sop->st->keys = keys;
+  sop->st->vals = vals;
+  sop->st->rcs = rcs;
+  sop->st->flags = flags;
+  *op = &sop->op;
+  return 0;
+}
+
+void m0_op_setup(struct m0_op *op, const struct m0_op_ops *cbs, m0_time_t linger)
+{
+  to_shim(op)->st->cbs = cbs;
+}
+
+void m0_op_launch(struct m0_op **op, uint32_t nr)
+{
+  for (uint32_t i = 0; i < nr; i++)
+    shim().launch(to_shim(op[i]));
+}
+
+int32_t m0_op_wait(struct m0_op *op, uint64_t bits, m0_time_t to)
+{
+  OpState *st = to_shim(op)->st;
+  std::unique_lock l{st->lock};
+  auto reached = [&] { return (M0_BITS(st->state) & bits) != 0; };
+  if (to == M0_TIME_NEVER) {
+    st->cond.wait(l, reached);
+    return 0;
+  }
+  m0_time_t now = m0_time_now();
+  auto left = std::chrono::nanoseconds(to > now ? to - now : 0);
+  return st->cond.wait_for(l, left, reached) ? 0 : -ETIMEDOUT;
+}
+
+// A cancelled op fails with -ECANCELED when it comes due, unless it has
+// run already.
+void m0_op_cancel(struct m0_op **op, uint32_t nr)
+{
+  for (uint32_t i = 0; i < nr; i++)
+    to_shim(op[i])->st->cancelled = true;
+}
+
+int32_t m0_rc(const struct m0_op *op)
+{
+  return to_shim(const_cast<struct m0_op*>(op))->st->rc;
+}
+
+void m0_op_fini(struct m0_op *op)
+{
+}
+
+void m0_op_free(struct m0_op *op)
+{
+  ShimOp *sop = to_shim(op);
+  delete sop->st;
+  delete sop;
+}
+
+} // extern "C"
@@ -0,0 +1,64 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+/*
+ * Ceph - scalable distributed file system
+ *
+ * In-process stand-in for libmotr, for testing the Motr SAL without a
+ * cluster.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Linked into a program ahead of libmotr, motr_shim.cc takes over the
+// client calls made by MotrStore: m0_client_init(), the entity, object
+// and index ops and the m0_op_* calls. The indices are ordered maps in
+// memory and the objects sparse files, so the Motr SAL runs unchanged on
+// a dev box. The ops complete asynchronously on a pool of completion
+// threads, after a latency taken from the configuration.
+
+enum class MotrShimOp {
+  ENTITY,    // create, open or delete of an object or index
+  OBJ_READ,
+  OBJ_WRITE,
+  IDX,       // one index op, whatever the number of records
+};
+
+struct MotrShimConfig {
+  // Directory of the object files. A temporary directory, removed by
+  // m0_client_fini(), if empty.
+  std::string data_dir;
+  // Ops complete in parallel on that many threads.
+  unsigned completion_threads = 8;
+
+  // Latency of an op: the base latency of its kind, plus the time to move
+  // the data at `obj_bandwidth` bytes/s (no limit if 0) for object i/o.
+  std::chrono::microseconds entity_latency{0};
+  std::chrono::microseconds obj_latency{0};
+  std::chrono::microseconds idx_latency{0};
+  uint64_t obj_bandwidth = 0;
+  // Overrides the latency above when set, given the op kind and the
+  // bytes read or written.
+  std::function<std::chrono::nanoseconds(MotrShimOp, uint64_t)> latency;
+
+  // Pool width of the only pool version: data units, parity units, spare
+  // units and devices.
+  uint32_t pool_N = 4;
+  uint32_t pool_K = 2;
+  uint32_t pool_S = 0;
+  uint32_t pool_P = 8;
+};
+
+// Set the configuration used by the next m0_client_init().
+void motr_shim_configure(const MotrShimConfig& conf);